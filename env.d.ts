@@ -1 +1,4 @@
 /// <reference types="vite/client" />
+
+// hash of the wasm module and mesher sources from vite.config.ts
+declare const __SOLVER_REVISION__: string;
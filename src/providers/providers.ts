@@ -20,6 +20,17 @@ export const providers = {
     if (value.value === undefined) throw Error("gpu_adapter has not been initialised yet");
     return value as Ref<GPUAdapter>;
   },
+  // for views that can fall back to the cpu when WebGPU is unavailable
+  get optional_gpu_device(): Ref<GPUDevice | undefined> {
+    const value = inject<Ref<GPUDevice | undefined>>("gpu_device");
+    if (value === undefined) throw Error("Expected gpu_device to be injected from provider");
+    return value;
+  },
+  get optional_gpu_adapter(): Ref<GPUAdapter | undefined> {
+    const value = inject<Ref<GPUAdapter | undefined>>("gpu_adapter");
+    if (value === undefined) throw Error("Expected gpu_adapter to be injected from provider");
+    return value;
+  },
   get user_data(): Ref<UserData> {
     const value = inject<Ref<UserData | undefined>>("user_data");
     if (value === undefined) throw Error("Expected user_data to be injected from provider");
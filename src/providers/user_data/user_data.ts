@@ -5,6 +5,7 @@ import {
   type MemoryBandwidthBenchmarkConfig,
 } from "../../views/gpu_benchmark/config.ts";
 import { type ParameterSearchConfig } from "../../views/stackup_2d/search.ts";
+import { type SolverMode, solver_modes } from "../../views/stackup_2d/electrostatic_2d.ts";
 
 function try_into_distance_unit(storage: Storage, key: string, default_value: DistanceUnit): DistanceUnit {
   const value = storage.getItem(key);
@@ -36,6 +37,36 @@ class DistanceEntry {
   }
 }
 
+function try_into_solver_mode(storage: Storage, key: string, default_value: SolverMode): SolverMode {
+  const value = storage.getItem(key);
+  if (value === null) return default_value;
+  for (const mode of solver_modes) {
+    if (value === mode) return value;
+  }
+  return default_value;
+}
+
+class SolverModeEntry {
+  storage: Storage;
+  key: string;
+  _value: SolverMode;
+
+  constructor(storage: Storage, key: string, default_value: SolverMode) {
+    this.storage = storage;
+    this.key = key;
+    this._value = try_into_solver_mode(storage, key, default_value);
+  }
+
+  get value(): SolverMode {
+    return this._value;
+  }
+
+  set value(value: SolverMode) {
+    this._value = value;
+    this.storage.setItem(this.key, value);
+  }
+}
+
 function try_into_number(storage: Storage, key: string, default_value: number, type?: "float" | "integer"): number {
   type = type ?? "float";
   const value = storage.getItem(key);
@@ -117,6 +148,9 @@ export const keys = {
     min_y_subdivisions: "mesh_2d.min_y_subdivisions",
     min_epsilon_resolution: "mesh_2d.min_epsilon_resolution",
     signal_amplitude: "mesh_2d.signal_amplitude",
+    max_refinement_steps: "mesh_2d.max_refinement_steps",
+    refinement_tolerance: "mesh_2d.refinement_tolerance",
+    solver_mode: "mesh_2d.solver_mode",
   },
   compute_benchmark_config: {
     total_compute_units: "compute_benchmark.total_compute_units",
@@ -132,6 +166,7 @@ export const keys = {
     max_steps: "parameter_search.max_steps",
     impedance_tolerance: "parameter_search.impedance_tolerance",
     search_precision: "parameter_search.search_precision",
+    parallel_candidates: "parameter_search.parallel_candidates",
   },
 };
 
@@ -174,6 +209,9 @@ export class Stackup2DMeshConfig implements StackupGridConfig {
   _min_y_subdivisions: NumberEntry;
   _min_epsilon_resolution: NumberEntry;
   _signal_amplitude: NumberEntry;
+  _max_refinement_steps: NumberEntry;
+  _refinement_tolerance: NumberEntry;
+  _solver_mode: SolverModeEntry;
 
   constructor(storage: Storage) {
     this.storage = storage;
@@ -186,6 +224,9 @@ export class Stackup2DMeshConfig implements StackupGridConfig {
     this._min_y_subdivisions = new NumberEntry(storage, K.min_y_subdivisions, 5, "integer");
     this._min_epsilon_resolution = new NumberEntry(storage, K.min_epsilon_resolution, 0.01, "float");
     this._signal_amplitude = new NumberEntry(storage, K.signal_amplitude, 1, "float");
+    this._max_refinement_steps = new NumberEntry(storage, K.max_refinement_steps, 0, "integer");
+    this._refinement_tolerance = new NumberEntry(storage, K.refinement_tolerance, 0.001, "float");
+    this._solver_mode = new SolverModeEntry(storage, K.solver_mode, "auto");
   }
 
   get minimum_grid_resolution() { return this._minimum_grid_resolution.value; }
@@ -204,6 +245,12 @@ export class Stackup2DMeshConfig implements StackupGridConfig {
   set min_epsilon_resolution(value: number) { this._min_epsilon_resolution.value = value; }
   get signal_amplitude() { return this._signal_amplitude.value; }
   set signal_amplitude(value: number) { this._signal_amplitude.value = value; }
+  get max_refinement_steps() { return this._max_refinement_steps.value; }
+  set max_refinement_steps(value: number) { this._max_refinement_steps.value = value; }
+  get refinement_tolerance() { return this._refinement_tolerance.value; }
+  set refinement_tolerance(value: number) { this._refinement_tolerance.value = value; }
+  get solver_mode() { return this._solver_mode.value; }
+  set solver_mode(value: SolverMode) { this._solver_mode.value = value; }
 }
 
 export class UserComputeBenchmarkConfig implements ComputeBenchmarkConfig {
@@ -251,6 +298,7 @@ export class UserParameterSearchConfig implements ParameterSearchConfig {
   _max_steps: NumberEntry;
   _impedance_tolerance: NumberEntry;
   _search_precision: NumberEntry;
+  _parallel_candidates: NumberEntry;
 
   constructor(storage: Storage) {
     this.storage = storage;
@@ -258,6 +306,7 @@ export class UserParameterSearchConfig implements ParameterSearchConfig {
     this._max_steps = new NumberEntry(storage, K.max_steps, 16, "integer");
     this._impedance_tolerance = new NumberEntry(storage, K.impedance_tolerance, 0.1, "float");
     this._search_precision = new NumberEntry(storage, K.search_precision, 0.001, "float");
+    this._parallel_candidates = new NumberEntry(storage, K.parallel_candidates, 4, "integer");
   }
 
   get max_steps(): number { return this._max_steps.value; }
@@ -266,4 +315,6 @@ export class UserParameterSearchConfig implements ParameterSearchConfig {
   set impedance_tolerance(value: number) { this._impedance_tolerance.value = value; }
   get search_precision(): number { return this._search_precision.value; }
   set search_precision(value: number) { this._search_precision.value = value; }
+  get parallel_candidates(): number { return this._parallel_candidates.value; }
+  set parallel_candidates(value: number) { this._parallel_candidates.value = value; }
 }
@@ -234,4 +234,56 @@ export class ClosedGeometricMeshSegment implements IMeshSegment {
   }
 }
 
-export type MeshSegment = LinearMeshSegment | OpenGeometricMeshSegment | ClosedGeometricMeshSegment;
+// Mesh segment with explicit deltas after adaptive refinement has split some of its elements
+export class RefinedMeshSegment implements IMeshSegment {
+  readonly type = "refined";
+  deltas: number[];
+
+  constructor(deltas: number[]) {
+    this.deltas = deltas;
+  }
+
+  generate_deltas(): number[] {
+    return [...this.deltas];
+  }
+
+  get_size(): number {
+    return this.deltas.reduce((a,b) => a+b, 0);
+  }
+
+  get_total_elements(): number {
+    return this.deltas.length;
+  }
+
+  // split elements in half where is_split[offset+i] is set for the i-th element of the segment
+  static from_split(segment: IMeshSegment, is_split: ArrayLike<boolean>, offset: number): RefinedMeshSegment {
+    const deltas: number[] = [];
+    for (const [i, delta] of segment.generate_deltas().entries()) {
+      if (is_split[offset+i]) {
+        deltas.push(delta/2, delta/2);
+      } else {
+        deltas.push(delta);
+      }
+    }
+    return new RefinedMeshSegment(deltas);
+  }
+}
+
+export type MeshSegment = LinearMeshSegment | OpenGeometricMeshSegment | ClosedGeometricMeshSegment | RefinedMeshSegment;
+
+// Dörfler marking which selects the elements with the largest errors until they make up a fraction of the total error
+// (https://doi.org/10.1137/0733054)
+export function mark_largest_errors(errors: ArrayLike<number>, fraction: number): boolean[] {
+  const is_marked: boolean[] = new Array(errors.length).fill(false);
+  const total_error = Array.from(errors).reduce((a,b) => a+b, 0);
+  if (!(total_error > 0)) return is_marked;
+  const order = Array.from({ length: errors.length }, (_, i) => i);
+  order.sort((a,b) => errors[b]-errors[a]);
+  let marked_error = 0;
+  for (const i of order) {
+    if (marked_error >= fraction*total_error) break;
+    is_marked[i] = true;
+    marked_error += errors[i];
+  }
+  return is_marked;
+}
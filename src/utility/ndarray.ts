@@ -29,6 +29,20 @@ const get_array_constructor_from_dtype = (dtype: NdarrayType) => {
   }
 }
 
+export const get_numpy_descr_from_dtype = (dtype: NdarrayType): string => {
+  switch (dtype) {
+  case "u8": return "<B";
+  case "u8_clamped": return "<B";
+  case "s8": return "<b";
+  case "u16": return "<u2";
+  case "s16": return "<i2";
+  case "u32": return "<u4";
+  case "s32": return "<i4";
+  case "f32": return "<f4";
+  case "f64": return "<f8";
+  }
+}
+
 const get_dtype_from_array = (buffer: NdarrayData): NdarrayType => {
   if (buffer instanceof Int8Array) return "s8";
   if (buffer instanceof Uint8Array) return "u8";
@@ -498,18 +512,7 @@ export class Ndarray extends NdarrayView {
     const header = new Uint8Array([magic_number, ...magic_label, major_version, minor_version]);
 
     // descriptor
-    let type_id = null;
-    switch (this.dtype) {
-      case "u8": type_id = "<B"; break;
-      case "u8_clamped": type_id = "<B"; break;
-      case "s8": type_id = "<b"; break;
-      case "u16": type_id = "<u2"; break;
-      case "s16": type_id = "<i2"; break;
-      case "u32": type_id = "<u4"; break;
-      case "s32": type_id = "<i4"; break;
-      case "f32": type_id = "<f4"; break;
-      case "f64": type_id = "<f8"; break;
-    }
+    const type_id = get_numpy_descr_from_dtype(this.dtype);
     const descriptor_string = `{`+
       `'descr':'${type_id}',` +
       `'fortran_order':False,` +
@@ -1,5 +1,5 @@
 import {
-  LinearMeshSegment, OpenGeometricMeshSegment, ClosedGeometricMeshSegment,
+  LinearMeshSegment, OpenGeometricMeshSegment, ClosedGeometricMeshSegment, RefinedMeshSegment,
   type MeshSegment,
 } from "./mesher.ts";
 import { LinesBuilder } from "./lines_builder.ts";
@@ -142,6 +142,17 @@ export class RegionToGridMap {
     this.region_to_grid_index = region_to_grid_index;
   }
 
+  // Map with the marked grid segments split in half while keeping the same region lines
+  refine(is_split: ArrayLike<boolean>): RegionToGridMap {
+    if (is_split.length != this.total_grid_segments) {
+      throw Error(`Expected ${this.total_grid_segments} grid segments to refine but got ${is_split.length}`);
+    }
+    const region_segments = this.region_segments.map((segment, i) => {
+      return RefinedMeshSegment.from_split(segment, is_split, this.region_to_grid_index[i]);
+    });
+    return new RegionToGridMap(this.region_lines_builder, region_segments);
+  }
+
   id_to_grid_index(id: number): number {
     const region_index = this.id_to_region_index(id);
     const grid_index = this.region_to_grid_index[region_index];
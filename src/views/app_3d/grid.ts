@@ -1,5 +1,6 @@
 import { Ndarray } from "../../utility/ndarray.ts";
 import { KernelCurrentSource, KernelUpdateElectricField, KernelUpdateMagneticField } from "../../wgpu_kernels/fdtd_3d/index.ts";
+import { type WasmModule, Float32ModuleBuffer, FDTD_3D_Engine } from "../../wasm/index.ts";
 
 export class SimulationGrid {
   size: [number, number, number];
@@ -116,6 +117,13 @@ export class GpuGrid {
     this.bake_b0 = this.setup.grid.bake_b0;
   }
 
+  destroy() {
+    this.e_field.destroy();
+    this.h_field.destroy();
+    this.bake_a0.destroy();
+    this.bake_a1.destroy();
+  }
+
   get size(): [number, number, number] {
     return this.setup.grid.size;
   }
@@ -152,3 +160,73 @@ export class GpuEngine {
     this.device.queue.submit([command_encoder.finish()]);
   }
 }
+
+// Same simulation state as GpuGrid but in the wasm heap for the cpu engine
+export class CpuGrid {
+  module: WasmModule;
+  setup: SimulationSetup;
+
+  e_field: Float32ModuleBuffer;
+  h_field: Float32ModuleBuffer;
+  bake_a0: Float32ModuleBuffer;
+  bake_a1: Float32ModuleBuffer;
+  bake_b0: number;
+
+  constructor(module: WasmModule, setup: SimulationSetup) {
+    this.module = module;
+    this.setup = setup;
+
+    const create_from_ndarray = (arr: Ndarray): Float32ModuleBuffer => {
+      return Float32ModuleBuffer.create(module, arr.data as Float32Array);
+    };
+
+    this.e_field = create_from_ndarray(setup.grid.init_e_field);
+    this.h_field = create_from_ndarray(setup.grid.init_h_field);
+    this.bake_a0 = create_from_ndarray(setup.grid.bake_a0);
+    this.bake_a1 = create_from_ndarray(setup.grid.bake_a1);
+    this.bake_b0 = setup.grid.bake_b0;
+  }
+
+  reset() {
+    this.e_field.array_view.set(this.setup.grid.init_e_field.data as Float32Array);
+    this.h_field.array_view.set(this.setup.grid.init_h_field.data as Float32Array);
+    this.bake_a0.array_view.set(this.setup.grid.bake_a0.data as Float32Array);
+    this.bake_a1.array_view.set(this.setup.grid.bake_a1.data as Float32Array);
+    this.bake_b0 = this.setup.grid.bake_b0;
+  }
+
+  delete() {
+    this.e_field.delete();
+    this.h_field.delete();
+    this.bake_a0.delete();
+    this.bake_a1.delete();
+  }
+
+  get size(): [number, number, number] {
+    return this.setup.grid.size;
+  }
+}
+
+// Runs several timesteps per call so the engine can sweep them through the grid together
+export class CpuEngine {
+  module: WasmModule;
+  engine: FDTD_3D_Engine;
+
+  constructor(module: WasmModule, setup: SimulationSetup) {
+    this.module = module;
+    this.engine = new FDTD_3D_Engine(module, setup.grid.size);
+    for (const source of setup.sources) {
+      const signal = Float32ModuleBuffer.create(module, source.signal);
+      this.engine.add_source(source.offset, source.size, signal);
+      signal.delete();
+    }
+  }
+
+  step_fdtd(grid: CpuGrid, timestep: number, total_steps: number = 1) {
+    this.engine.step(grid.e_field, grid.h_field, grid.bake_a0, grid.bake_a1, grid.bake_b0, timestep, total_steps);
+  }
+
+  delete() {
+    this.engine.delete();
+  }
+}
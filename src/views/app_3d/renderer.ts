@@ -1,6 +1,6 @@
 import { ComputeCopyToTexture } from "../../wgpu_kernels/view_3d/index.ts";
 import { ShaderComponentViewer } from "../../wgpu_kernels/view_2d/index.ts";
-import { GpuGrid } from "./grid.ts";
+import { GpuGrid, CpuGrid } from "./grid.ts";
 
 export type GridDisplayMode = "x" | "y" | "z" | "mag";
 export type FieldDisplayMode = "e_field" | "h_field";
@@ -125,3 +125,89 @@ export class Renderer {
     }
   }
 }
+
+// Draws the same slice view as Renderer on a 2d canvas so the cpu engine can be shown without WebGPU
+export class CpuRenderer {
+  slice?: Float32Array;
+  slice_size?: [number, number];
+  slice_image?: ImageData;
+  slice_canvas?: OffscreenCanvas;
+
+  upload_slice(grid: CpuGrid, copy_z: number, field_mode: FieldDisplayMode) {
+    const [Nz, Ny, Nx] = grid.size;
+    if (copy_z < 0 || copy_z >= Nz) {
+      throw Error(`Attempting to copy z slice (${copy_z}) outside of 3D grid with shape (${grid.size.join(',')})`);
+    }
+    if (this.slice_size === undefined || this.slice_size[0] != Ny || this.slice_size[1] != Nx) {
+      this.slice_size = [Ny, Nx];
+      this.slice = new Float32Array(Ny*Nx*3);
+      this.slice_image = new ImageData(Nx, Ny);
+      this.slice_canvas = new OffscreenCanvas(Nx, Ny);
+    }
+
+    const get_field_buffer = (mode: FieldDisplayMode) => {
+      switch (mode) {
+      case "e_field": return grid.e_field;
+      case "h_field": return grid.h_field;
+      }
+    };
+    // NOTE: copy out of the wasm heap since the view is invalidated if the heap grows
+    const total_slice = Ny*Nx*3;
+    const field = get_field_buffer(field_mode).array_view;
+    this.slice?.set(field.subarray(copy_z*total_slice, (copy_z+1)*total_slice));
+  }
+
+  update_display(
+    canvas_context: CanvasRenderingContext2D, canvas_size: { width: number, height: number },
+    scale: number, axis_mode: GridDisplayMode,
+  ) {
+    if (this.slice === undefined || this.slice_size === undefined || this.slice_image === undefined || this.slice_canvas === undefined) {
+      throw Error(`Attempted to update display without perform an initial upload`);
+    }
+    const [Ny, Nx] = this.slice_size;
+    const slice = this.slice;
+    const pixels = this.slice_image.data;
+    const clamp = (v: number) => Math.min(Math.max(v, 0), 1);
+    const get_component = (mode: GridDisplayMode): number => {
+      switch (mode) {
+      case "x": return 0;
+      case "y": return 1;
+      case "z": return 2;
+      case "mag": return -1;
+      }
+    };
+    const component = get_component(axis_mode);
+    for (let y = 0; y < Ny; y++) {
+      // NOTE: match the gpu viewer which places the first row at the bottom of the canvas
+      const dst_row = (Ny-1-y)*Nx;
+      for (let x = 0; x < Nx; x++) {
+        const src_i = (y*Nx + x)*3;
+        const dst_i = (dst_row + x)*4;
+        // same colour map as the shader blended over a black background
+        let r = 0, g = 0, b = 0;
+        if (component < 0) {
+          const vx = slice[src_i+0], vy = slice[src_i+1], vz = slice[src_i+2];
+          const mag = Math.sqrt(vx*vx + vy*vy + vz*vz)*scale;
+          const alpha = clamp(mag);
+          r = g = b = clamp(mag)*alpha;
+        } else {
+          const mag = slice[src_i+component]*scale;
+          const alpha = clamp(Math.abs(mag));
+          r = clamp(-mag)*alpha;
+          g = clamp(mag)*alpha;
+        }
+        pixels[dst_i+0] = r*255;
+        pixels[dst_i+1] = g*255;
+        pixels[dst_i+2] = b*255;
+        pixels[dst_i+3] = 255;
+      }
+    }
+
+    const slice_context = this.slice_canvas.getContext("2d");
+    if (slice_context === null) {
+      throw Error("Failed to get 2d context from offscreen canvas");
+    }
+    slice_context.putImageData(this.slice_image, 0, 0);
+    canvas_context.drawImage(this.slice_canvas, 0, 0, canvas_size.width, canvas_size.height);
+  }
+}
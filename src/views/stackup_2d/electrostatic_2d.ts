@@ -2,10 +2,18 @@ import {
   WasmModule,
   ManagedObject,
   LU_Solver,
-  Float32ModuleBuffer, Int32ModuleBuffer,
+  Cholesky_Solver,
+  Mirror_Solver,
+  Iterative_Solver,
+  Multigrid_Solver,
+  type LinearSolver,
+  type DirectSolver,
+  type LU_Solver_Stats,
+  type Cholesky_Solver_Stats,
 } from "../../wasm/index.ts";
-import { Float32ModuleNdarray, Uint32ModuleNdarray } from "../../utility/module_ndarray.ts";
+import { Float32ModuleNdarray, Float64ModuleNdarray, Uint32ModuleNdarray } from "../../utility/module_ndarray.ts";
 import { Profiler } from "../../utility/profiler.ts";
+import { with_standard_suffix } from "../../utility/standard_suffix.ts";
 
 export interface ImpedanceResult {
   voltage: number;
@@ -19,21 +27,177 @@ export interface ImpedanceResult {
   propagation_delay: number;
 }
 
+// direct: LU factorisation which is fast but has fill-in that grows quickly with grid size
+// cholesky: LDL^T factorisation of only the unknown voltages with nested dissection ordering
+// mirror: cholesky factorisations of the left half if the grid is mirror symmetric, otherwise cholesky
+// iterative: BiCGSTAB with ILU(0) preconditioning which only needs O(nnz) memory
+//            only used if solver_mode is set to "iterative" explicitly in the mesh settings
+// multigrid: conjugate gradient with a geometric multigrid V-cycle as the preconditioner which only needs O(N) memory
+// auto: pick mirror solver and switch to multigrid once the grid exceeds MULTIGRID_SOLVER_MIN_VOLTAGES
+// NOTE: iterative and multigrid fall back to the mirror solver if they fail to converge
+export type SolverMode = "auto" | "direct" | "cholesky" | "mirror" | "iterative" | "multigrid";
+
+export const solver_modes: SolverMode[] = [
+  "auto", "mirror", "cholesky", "direct", "multigrid", "iterative",
+];
+
+// Propagation mode of coupled conductors with a unit length voltage vector
+export interface ConductorMode {
+  vector: Float64Array; // [N]
+  Z0: number;
+  propagation_speed: number;
+  effective_er: number;
+}
+
+// Maxwell matrices between conductors with the v_table index 0 conductor as ground
+export interface ConductorMatrices {
+  conductor_indices: number[]; // v_table index of each row/column
+  Ch: Float64Array; // [N,N] without dielectric
+  Cih: Float64Array; // [N,N] with dielectric
+  Lh: Float64Array; // [N,N]
+  modes: ConductorMode[]; // fastest to slowest
+}
+
+// Voltage fields with one conductor at unit voltage and every other conductor grounded
+// By linearity any v_table is the superposition v_table[0] + sum_i (v_table[i]-v_table[0])*v_fields[i]
+interface BasisSolution {
+  conductor_indices: number[];
+  v_fields: Float32ModuleNdarray; // [N,Ny+1,Nx+1]
+}
+
+// Cross energies between basis solutions with the inhomogenous part split per dielectric index
+// Cell permittivity is linear in ek_table so any table of the same length is sum_m ek_table[m]*partial_inhomogenous[m]
+interface BasisEnergy {
+  table_length: number;
+  homogenous: Float32Array; // [N,N]
+  partial_inhomogenous: Float32Array; // [K,N,N]
+}
+
+const epsilon_0 = 8.85e-12;
+const c_0 = 3e8;
+
+type MetaData = Partial<Record<string, string>>;
+
+// SuperLU counters shown on the factorisation span so stackups with large fill-in stand out
+function get_lu_factor_metadata(stats: LU_Solver_Stats): MetaData {
+  const fill_in = (stats.L_non_zeros+stats.U_non_zeros-stats.total_rows)/stats.A_non_zeros;
+  return {
+    "nnz(A)": `${stats.A_non_zeros}`,
+    "nnz(L)": `${stats.L_non_zeros}`,
+    "nnz(U)": `${stats.U_non_zeros}`,
+    "Fill-in": `${fill_in.toFixed(2)}x`,
+    "Supernodes": `${stats.total_supernodes}`,
+    "Factor Flops": with_standard_suffix(stats.factor_flops, "FLOP"),
+    "Ordering Time": with_standard_suffix(stats.ordering_ms*1e-3, "s"),
+    "Factor Time": with_standard_suffix(stats.factor_ms*1e-3, "s"),
+    "LU Memory": with_standard_suffix(stats.lu_bytes, "B"),
+    "Total Memory": with_standard_suffix(stats.total_bytes, "B"),
+    "Tiny Pivots": `${stats.tiny_pivots}`,
+    "Memory Expansions": `${stats.memory_expansions}`,
+  };
+}
+
+function get_lu_solve_metadata(stats: LU_Solver_Stats): MetaData {
+  return {
+    "Solve Flops": with_standard_suffix(stats.solve_flops, "FLOP"),
+    "Solve Time": with_standard_suffix(stats.solve_ms*1e-3, "s"),
+  };
+}
+
+function get_cholesky_factor_metadata(stats: Cholesky_Solver_Stats): MetaData {
+  return {
+    "Unknowns": `${stats.reduced_rows} of ${stats.total_rows}`,
+    "nnz(A)": `${stats.A_non_zeros}`,
+    "nnz(L)": `${stats.L_non_zeros}`,
+    "Fill-in": `${(stats.L_non_zeros/stats.A_non_zeros).toFixed(2)}x`,
+    "Factor Flops": with_standard_suffix(stats.factor_flops, "FLOP"),
+    "Ordering Time": with_standard_suffix(stats.ordering_ms*1e-3, "s"),
+    "Factor Time": with_standard_suffix(stats.factor_ms*1e-3, "s"),
+    "Factor Memory": with_standard_suffix(stats.factor_bytes, "B"),
+  };
+}
+
+function get_mirror_metadata(solver: Mirror_Solver): MetaData {
+  return {
+    "Mirror Axis": (solver.axis === Mirror_Solver.AXIS_ON_NODE) ? "On Node" : "In Cell",
+    "Odd Half": solver.has_odd_solver ? "Factorised" : "Not Needed",
+  };
+}
+
+// Cell of the src mesh containing each node of the dst mesh and the fractional position of the node inside that cell
+// Both meshes have to span the same length, e.g. a mesh and its refinement
+function get_node_interpolation(src_d: Float32Array, dst_d: Float32Array): { index: Int32Array, weight: Float32Array } {
+  const index = new Int32Array(dst_d.length+1);
+  const weight = new Float32Array(dst_d.length+1);
+  let src_i = 0;
+  let src_start = 0;
+  let dst_pos = 0;
+  for (let i = 0; i <= dst_d.length; i++) {
+    while (src_i < src_d.length-1 && src_start+src_d[src_i] <= dst_pos) {
+      src_start += src_d[src_i];
+      src_i++;
+    }
+    index[i] = src_i;
+    weight[i] = Math.min(Math.max((dst_pos-src_start)/src_d[src_i], 0.0), 1.0);
+    if (i < dst_d.length) dst_pos += dst_d[i];
+  }
+  return { index, weight };
+}
+
+function get_solve_metadata(solver: LinearSolver): MetaData {
+  if (solver instanceof LU_Solver) return get_lu_solve_metadata(solver.stats);
+  if (solver instanceof Cholesky_Solver) {
+    return { "Solve Time": with_standard_suffix(solver.stats.solve_ms*1e-3, "s") };
+  }
+  if (solver instanceof Mirror_Solver) {
+    // odd half is factorised by the first solve which needs it
+    return {
+      ...get_mirror_metadata(solver),
+      "Solve Time": with_standard_suffix(solver.stats.solve_ms*1e-3, "s"),
+    };
+  }
+  if (solver instanceof Iterative_Solver) {
+    return {
+      "Last Iterations": `${solver.last_iterations}`,
+      "Last Relative Residual": solver.last_relative_residual.toExponential(2),
+    };
+  }
+  if (solver instanceof Multigrid_Solver) {
+    return {
+      "Levels": `${solver.total_levels}`,
+      "Last V-cycles": `${solver.last_cycles}`,
+      "Last Relative Residual": solver.last_relative_residual.toExponential(2),
+    };
+  }
+  return {};
+}
+
 export class Grid extends ManagedObject {
+  // native benchmark crosses over between 160k and 640k voltages once the setup and two solves are counted
+  // since the factorisation of the mirror solver grows faster than O(N) and multigrid has no fill-in
+  static readonly MULTIGRID_SOLVER_MIN_VOLTAGES = 400_000;
+
   readonly size: [number, number];
   readonly dx: Float32ModuleNdarray;
   readonly dy: Float32ModuleNdarray;
   readonly v_index_beta: Uint32ModuleNdarray;
   _v_table: Float32ModuleNdarray;
   readonly v_field: Float32ModuleNdarray;
-  readonly ex_field: Float32ModuleNdarray;
-  readonly ey_field: Float32ModuleNdarray;
+  // electric field is only allocated and calculated when it is read for visualisation or export
+  _ex_field?: Float32ModuleNdarray;
+  _ey_field?: Float32ModuleNdarray;
+  _is_e_field_stale: boolean;
   _ek_table: Float32ModuleNdarray;
   readonly ek_index_beta: Uint32ModuleNdarray;
 
   v_input: number;
 
-  _lu_solver?: LU_Solver;
+  solver_mode: SolverMode;
+  _solver?: LinearSolver;
+  _basis?: BasisSolution;
+  _basis_energy?: BasisEnergy;
+  // voltage fields [k,Ny+1,Nx+1] which warm start the next baked iterative solver
+  _initial_guess?: Float32ModuleNdarray;
 
   static pack_index_beta(index: number, beta: number): number {
     beta = Math.max(Math.min(0xFFFF, beta), 0x0000);
@@ -53,10 +217,10 @@ export class Grid extends ManagedObject {
     this.dy = Float32ModuleNdarray.from_shape(this.module, [Ny]);
     this.v_index_beta = Uint32ModuleNdarray.from_shape(this.module, [Ny+1,Nx+1]);
     this.v_field = Float32ModuleNdarray.from_shape(this.module, [Ny+1,Nx+1]);
-    this.ex_field = Float32ModuleNdarray.from_shape(this.module, [Ny+1,Nx]);
-    this.ey_field = Float32ModuleNdarray.from_shape(this.module, [Ny,Nx+1]);
+    this._is_e_field_stale = true;
     this.ek_index_beta = Uint32ModuleNdarray.from_shape(this.module, [Ny,Nx]);
     this.v_input = 1;
+    this.solver_mode = "auto";
 
     this._v_table = Float32ModuleNdarray.from_shape(this.module, [3]);
     this._ek_table = Float32ModuleNdarray.from_shape(this.module, [Ny,Nx]);
@@ -64,8 +228,6 @@ export class Grid extends ManagedObject {
     this._child_objects.add(this.dy);
     this._child_objects.add(this.v_index_beta);
     this._child_objects.add(this.v_field);
-    this._child_objects.add(this.ex_field);
-    this._child_objects.add(this.ey_field);
     this._child_objects.add(this.ek_index_beta);
     this._child_objects.add(this._v_table);
     this._child_objects.add(this._ek_table);
@@ -93,192 +255,359 @@ export class Grid extends ManagedObject {
     return this._ek_table;
   }
 
-  set lu_solver(lu_solver: LU_Solver) {
-    if (this._lu_solver !== undefined) {
-      this._child_objects.delete(this._lu_solver);
+  set solver(solver: LinearSolver) {
+    if (this._solver !== undefined) {
+      this._child_objects.delete(this._solver);
     }
-    this._child_objects.add(lu_solver);
-    this._lu_solver?.delete();
-    this._lu_solver = lu_solver;
+    this._child_objects.add(solver);
+    this._solver?.delete();
+    this._solver = solver;
+  }
+
+  get solver(): LinearSolver | undefined {
+    return this._solver;
   }
 
-  get lu_solver(): LU_Solver | undefined {
-    return this._lu_solver;
+  get ex_field(): Float32ModuleNdarray {
+    return this.update_e_field().ex_field;
+  }
+
+  get ey_field(): Float32ModuleNdarray {
+    return this.update_e_field().ey_field;
+  }
+
+  // Calculate electric field from voltage field if it has changed since it was last read
+  update_e_field(profiler?: Profiler): { ex_field: Float32ModuleNdarray, ey_field: Float32ModuleNdarray } {
+    if (this._ex_field === undefined || this._ey_field === undefined) {
+      const [Ny,Nx] = this.size;
+      this._ex_field = Float32ModuleNdarray.from_shape(this.module, [Ny+1,Nx]);
+      this._ey_field = Float32ModuleNdarray.from_shape(this.module, [Ny,Nx+1]);
+      this._child_objects.add(this._ex_field);
+      this._child_objects.add(this._ey_field);
+      this._is_e_field_stale = true;
+    }
+    if (this._is_e_field_stale) {
+      profiler?.begin("calc_e_field", "Calculate electric field from voltage field");
+      this.module.calculate_e_field(this._ex_field, this._ey_field, this.v_field, this.dx, this.dy);
+      profiler?.end();
+      this._is_e_field_stale = false;
+    }
+    return { ex_field: this._ex_field, ey_field: this._ey_field };
   }
 
   reset() {
     this.v_field.array_view.fill(0.0);
-    this.ex_field.array_view.fill(0.0);
-    this.ey_field.array_view.fill(0.0);
+    this._is_e_field_stale = true;
   }
 
-  bake(profiler?: Profiler) {
-    // generate A matrix for Ax=b
-    const A_data: number[] = [];
-    const A_col_indices: number[] = [];
-    const A_row_index_ptr: number[] = [];
+  // Detach the factorised solver so it can be refactorised by another grid with the same mesh shape
+  take_direct_solver(): DirectSolver | undefined {
+    const solver = this._solver;
+    if (!(solver instanceof LU_Solver || solver instanceof Cholesky_Solver || solver instanceof Mirror_Solver)) return undefined;
+    this._child_objects.delete(solver);
+    this._solver = undefined;
+    return solver;
+  }
 
-    const push_csr_entry = (value: number, column: number) => {
-      A_data.push(value);
-      A_col_indices.push(column);
+  get_preferred_solver(): Exclude<SolverMode, "auto"> {
+    switch (this.solver_mode) {
+      case "auto": {
+        const [Ny,Nx] = this.size;
+        return ((Ny+1)*(Nx+1) >= Grid.MULTIGRID_SOLVER_MIN_VOLTAGES) ? "multigrid" : "mirror";
+      }
+      default: return this.solver_mode;
     }
+  }
 
-    const push_csr_row = () => {
-      A_row_index_ptr.push(A_data.length);
+  bake(profiler?: Profiler, reuse_direct_solver?: DirectSolver) {
+    const solver_type = this.get_preferred_solver();
+    if (solver_type === "iterative" || solver_type === "multigrid") {
+      // basis of the last bake is already close if only part of the grid has changed
+      if (this._basis !== undefined) this.set_initial_guess(this._basis.v_fields);
+    }
+    // mesh or conductors may have changed
+    this.clear_basis();
+    if (solver_type === "iterative") {
+      reuse_direct_solver?.delete();
+      profiler?.begin("create_iterative_solver", "Create CSR matrix A to represent grid and calculate ILU(0) preconditioner");
+      const solver = Iterative_Solver.create_from_grid(this.module, this.dx, this.dy, this.v_index_beta);
+      this.solver = solver;
+      profiler?.end();
+      this.warm_start_solver(solver);
+      return;
+    }
+    if (solver_type === "multigrid") {
+      reuse_direct_solver?.delete();
+      profiler?.begin("create_multigrid_solver", "Create coarsened grid levels for multigrid solver");
+      const solver = Multigrid_Solver.create_from_grid(this.module, this.dx, this.dy, this.v_index_beta);
+      this.solver = solver;
+      profiler?.end();
+      this.warm_start_solver(solver);
+      return;
+    }
+    this.clear_initial_guess();
+    if (solver_type === "cholesky") {
+      this.bake_cholesky_solver(profiler, reuse_direct_solver);
+      return;
+    }
+    if (solver_type === "mirror") {
+      this.bake_mirror_solver(profiler, reuse_direct_solver);
+      return;
     }
 
-    const [Ny,Nx] = this.size;
-    {
-      profiler?.begin("create_csr", "Create CSR matrix A to represent grid");
-      const v_index_beta = this.v_index_beta.array_view;
-      const dx = this.dx.array_view;
-      const dy = this.dy.array_view;
-
-      for (let y = 0; y < Ny+1; y++) {
-        for (let x = 0; x < Nx+1; x++) {
-          push_csr_row();
-          const iv = x + y*(Nx+1);
-          const index_beta = v_index_beta[iv];
-          const { beta } = Grid.unpack_index_beta(index_beta);
-          const has_div_E_constraint = (x > 0 && x < Nx) || (y > 0 && y < Ny);
-          if ((beta > 0.5) || !has_div_E_constraint) {
-            push_csr_entry(1, iv);
-            continue;
-          }
-
-          // Creating the following constraint for cell at [y,x]
-          // div(E)[y,x] = (Ex[y,x]-Ex[y,x-1])/(dx[x]+dx[x-1]) +
-          //               (Ey[y,x]-Ey[y-1,x])/(dy[y]+dy[y-1])
-          // div(E)[y,x] = 0
-          //
-          // Ex[y,x] = -(V[y,x+1]-V[y,x])/dx[x]
-          // Ey[y,x] = -(V[y+1,x]-V[y,x])/dy[y]
-          //
-          // substituting into div(E)[y,x] = 0
-          // div(E)[y,x] = - (V[y,x+1]/dx[x+0])/(dx[x]+dx[x-1]) # Ex[y,x]
-          //               + (V[y,x+0]/dx[x+0])/(dx[x]+dx[x-1]) # Ex[y,x]
-          //               + (V[y,x+0]/dx[x-1])/(dx[x]+dx[x-1]) # Ex[y,x-1]
-          //               - (V[y,x-1]/dx[x-1])/(dx[x]+dx[x-1]) # Ex[y,x-1]
-          //               - (V[y+1,x]/dy[y+0])/(dy[y]+dy[y-1]) # Ey[y,x]
-          //               + (V[y+0,x]/dy[y+0])/(dy[y]+dy[y-1]) # Ey[y,x]
-          //               + (V[y+0,x]/dy[y-1])/(dy[y]+dy[y-1]) # Ey[y-1,x]
-          //               - (V[y-1,x]/dy[y-1])/(dy[y]+dy[y-1]) # Ey[y-1,x]
-          // div(E)[y,x] = 0
-          //
-          // This gives us a row for our constraint matrix L and target value b
-          // these are the possible columns that are set in a row inside L
-          // di = -(Nx+1), -1, 0, +1, +(Nx+1)
-          const column_value = [0,0,0,0,0];
-          const column_index = [iv-(Nx+1), iv-1, iv, iv+1, iv+(Nx+1)];
-
-          // div(Ex) = 0
-          if (x > 0 && x < Nx) {
-            const dx_0 = dx[x-1];
-            const dx_1 = dx[x];
-            const norm = dx_0+dx_1;
-            column_value[1] -= (1/dx_0)/norm;
-            column_value[2] += (1/dx_0 + 1/dx_1)/norm;
-            column_value[3] -= (1/dx_1)/norm;
-          }
-
-          // div(Ey) = 0
-          if (y > 0 && y < Ny) {
-            const dy_0 = dy[y-1];
-            const dy_1 = dy[y];
-            const norm = dy_0+dy_1;
-            column_value[0] -= (1/dy_0)/norm;
-            column_value[2] += (1/dy_0 + 1/dy_1)/norm;
-            column_value[4] -= (1/dy_1)/norm;
-          }
-
-          for (let i = 0; i < 5; i++) {
-            const value = column_value[i];
-            const index = column_index[i];
-            if (value != 0) {
-              push_csr_entry(value, index);
-            }
-          }
-        }
-      }
-      push_csr_row();
+    // reuse symbolic factorisation if the grid has the same sparsity pattern as the donor solver
+    if (reuse_direct_solver instanceof LU_Solver) {
+      const metadata: MetaData = {};
+      profiler?.begin("refactor_lu_solver", "Calculate LU factorisations reusing existing sparsity pattern", metadata);
+      // NOTE: partial pivoting runs again since the row permutation of one mesh is not safe to reuse
+      //       rows are only normalised and on graded meshes the couplings next to the identity rows of
+      //       forced voltages are far larger than their diagonal of 1, so A is not diagonally dominant
+      const is_same_row_permutation = false;
+      const refactor_info = reuse_direct_solver.refactor_from_grid(this.dx, this.dy, this.v_index_beta, is_same_row_permutation);
       profiler?.end();
+      if (refactor_info === 0) {
+        if (profiler !== undefined) Object.assign(metadata, get_lu_factor_metadata(reuse_direct_solver.stats));
+        this.solver = reuse_direct_solver;
+        return;
+      }
     }
+    reuse_direct_solver?.delete();
 
-    profiler?.begin("alloc_csr", "Allocate temporary CSR A matrix buffers inside WASM heap");
-    const pinned_A_data = Float32ModuleBuffer.create(this.module, A_data.length);
-    const pinned_A_col_indices = Int32ModuleBuffer.create(this.module, A_col_indices.length);
-    const pinned_A_row_index_ptr = Int32ModuleBuffer.create(this.module, A_row_index_ptr.length);
-    pinned_A_data.array_view.set(A_data);
-    pinned_A_col_indices.array_view.set(A_col_indices);
-    pinned_A_row_index_ptr.array_view.set(A_row_index_ptr);
+    // generate A matrix for Ax=b inside the module and factorise it without any intermediate buffers
+    const metadata: MetaData = {};
+    profiler?.begin("create_lu_solver", "Create CSR matrix A to represent grid and calculate new LU factorisations", metadata);
+    const solver = LU_Solver.create_from_grid(this.module, this.dx, this.dy, this.v_index_beta);
+    this.solver = solver;
     profiler?.end();
+    if (profiler !== undefined) Object.assign(metadata, get_lu_factor_metadata(solver.stats));
+  }
 
-    const total_voltages = (Ny+1)*(Nx+1);
-    profiler?.begin("create_lu_solver", "Calculate new LU factorisations");
-    this.lu_solver = new LU_Solver(this.module, pinned_A_data, pinned_A_col_indices, pinned_A_row_index_ptr, total_voltages, total_voltages);
-    profiler?.end();
+  // Seed each right hand side from the initial guess, otherwise start the next run() from the current voltage field
+  warm_start_solver(solver: Iterative_Solver | Multigrid_Solver) {
+    const initial_guess = this._initial_guess;
+    if (initial_guess === undefined) {
+      solver.set_initial_guess(this.v_field, 1);
+      return;
+    }
+    solver.set_initial_guess(initial_guess, initial_guess.shape[0]);
+    this.clear_initial_guess();
+  }
 
-    profiler?.begin("free_csr", "Freeing temporary CSR A matrix");
-    pinned_A_data.delete();
-    pinned_A_col_indices.delete();
-    pinned_A_row_index_ptr.delete();
-    profiler?.end();
+  set_initial_guess(v_fields: Float32ModuleNdarray) {
+    this.clear_initial_guess();
+    const initial_guess = Float32ModuleNdarray.from_shape(this.module, v_fields.shape);
+    initial_guess.array_view.set(v_fields.array_view);
+    this._child_objects.add(initial_guess);
+    this._initial_guess = initial_guess;
   }
 
-  run(profiler?: Profiler) {
-    if (this.lu_solver === undefined) {
-      throw Error(`LU Solver has not been factorised yet. Call bake() first`);
+  clear_initial_guess() {
+    if (this._initial_guess !== undefined) {
+      this._child_objects.delete(this._initial_guess);
+      this._initial_guess.delete();
     }
+    this._initial_guess = undefined;
+  }
+
+  // Bilinearly interpolate the basis of a grid over the same region onto this mesh as the initial guess
+  // NOTE: only the iterative solvers use an initial guess so this is skipped for the direct solvers
+  load_initial_guess(grid: Grid) {
+    const basis = grid._basis;
+    const solver_type = this.get_preferred_solver();
+    if (basis === undefined || (solver_type !== "iterative" && solver_type !== "multigrid")) return;
+    const [src_Ny, src_Nx] = grid.size;
     const [Ny,Nx] = this.size;
-    {
-      profiler?.begin("create_b", "Generate b column vector from forcing voltage potentials");
-      const v_index_beta = this.v_index_beta.array_view;
-      const v_table = this.v_table.array_view;
-      // generate b matrix for Ax=b
-      const B = this.v_field.array_view;
-      for (let y = 0; y < Ny+1; y++) {
-        for (let x = 0; x < Nx+1; x++) {
-          const iv = x + y*(Nx+1);
-          const index_beta = v_index_beta[iv];
-          const { index, beta } = Grid.unpack_index_beta(index_beta);
-          const voltage = v_table[index];
-          B[iv] = (beta > 0.5) ? voltage : 0.0;
+    const total_rhs = basis.conductor_indices.length;
+    const x_interp = get_node_interpolation(grid.dx.array_view, this.dx.array_view);
+    const y_interp = get_node_interpolation(grid.dy.array_view, this.dy.array_view);
+    const src_stride = (src_Ny+1)*(src_Nx+1);
+    const dst_stride = (Ny+1)*(Nx+1);
+    const src = basis.v_fields.array_view;
+    this.clear_initial_guess();
+    const initial_guess = Float32ModuleNdarray.from_shape(this.module, [total_rhs,Ny+1,Nx+1]);
+    const dst = initial_guess.array_view;
+    for (let k = 0; k < total_rhs; k++) {
+      for (let y = 0; y <= Ny; y++) {
+        const sy = y_interp.index[y];
+        const ty = y_interp.weight[y];
+        const src_row = k*src_stride + sy*(src_Nx+1);
+        const dst_row = k*dst_stride + y*(Nx+1);
+        for (let x = 0; x <= Nx; x++) {
+          const sx = x_interp.index[x];
+          const tx = x_interp.weight[x];
+          const i00 = src_row + sx;
+          const i10 = i00 + (src_Nx+1);
+          const v0 = (1-tx)*src[i00] + tx*src[i00+1];
+          const v1 = (1-tx)*src[i10] + tx*src[i10+1];
+          dst[dst_row+x] = (1-ty)*v0 + ty*v1;
         }
       }
+    }
+    this._child_objects.add(initial_guess);
+    this._initial_guess = initial_guess;
+  }
+
+  // Symmetric stackups like centred traces and differential pairs only factorise the left half of the grid
+  bake_mirror_solver(profiler?: Profiler, reuse_direct_solver?: DirectSolver) {
+    const mirror_axis = Mirror_Solver.find_axis(this.module, this.dx, this.v_index_beta);
+    if (mirror_axis === Mirror_Solver.AXIS_NONE) {
+      this.bake_cholesky_solver(profiler, reuse_direct_solver);
+      return;
+    }
+
+    if (reuse_direct_solver instanceof Mirror_Solver) {
+      const metadata: MetaData = {};
+      profiler?.begin("refactor_mirror_solver", "Calculate LDL^T factorisations of half grid reusing existing ordering", metadata);
+      const refactor_info = reuse_direct_solver.refactor_from_grid(this.dx, this.dy, this.v_index_beta);
       profiler?.end();
+      if (refactor_info === 0) {
+        if (profiler !== undefined) {
+          Object.assign(metadata, get_mirror_metadata(reuse_direct_solver), get_cholesky_factor_metadata(reuse_direct_solver.stats));
+        }
+        this.solver = reuse_direct_solver;
+        return;
+      }
     }
+    reuse_direct_solver?.delete();
 
-    profiler?.begin("solve_v_field", "Solve for voltage field in system Ax=b where A has LU factors");
-    const solve_info = this.lu_solver.solve(this.v_field);
+    const metadata: MetaData = {};
+    profiler?.begin("create_mirror_solver", "Calculate LDL^T factorisation of half grid with even mirror boundary", metadata);
+    const solver = Mirror_Solver.create_from_grid(this.module, this.dx, this.dy, this.v_index_beta);
+    this.solver = solver;
     profiler?.end();
+    if (profiler !== undefined) Object.assign(metadata, get_mirror_metadata(solver), get_cholesky_factor_metadata(solver.stats));
+  }
 
-    profiler?.begin("calc_e_field", "Calculate electric field from voltage field");
-    this.module.calculate_e_field(this.ex_field, this.ey_field, this.v_field, this.dx, this.dy);
+  bake_cholesky_solver(profiler?: Profiler, reuse_direct_solver?: DirectSolver) {
+    // reuse ordering if the grid has the same size and forced voltage cells as the donor solver
+    if (reuse_direct_solver instanceof Cholesky_Solver) {
+      const metadata: MetaData = {};
+      profiler?.begin("refactor_cholesky_solver", "Calculate LDL^T factorisation reusing existing ordering", metadata);
+      const refactor_info = reuse_direct_solver.refactor_from_grid(this.dx, this.dy, this.v_index_beta);
+      profiler?.end();
+      if (refactor_info === 0) {
+        if (profiler !== undefined) Object.assign(metadata, get_cholesky_factor_metadata(reuse_direct_solver.stats));
+        this.solver = reuse_direct_solver;
+        return;
+      }
+    }
+    reuse_direct_solver?.delete();
+
+    const metadata: MetaData = {};
+    profiler?.begin("create_cholesky_solver", "Order unknown voltages by nested dissection and calculate LDL^T factorisation", metadata);
+    const solver = Cholesky_Solver.create_from_grid(this.module, this.dx, this.dy, this.v_index_beta);
+    this.solver = solver;
     profiler?.end();
+    if (profiler !== undefined) Object.assign(metadata, get_cholesky_factor_metadata(solver.stats));
+  }
+
+  run(profiler?: Profiler) {
+    this.solve_fields(this.v_field, this.v_table, 1, profiler);
+    this._is_e_field_stale = true;
+  }
 
+  // Solve for multiple voltage tables with shape [k,N] in one pass over the LU factors
+  // Returns voltage fields with shape [k,Ny+1,Nx+1] which the caller is expected to .delete()
+  run_many(v_tables: Float32ModuleNdarray, profiler?: Profiler): Float32ModuleNdarray {
+    const [Ny,Nx] = this.size;
+    const total_rhs = v_tables.shape[0];
+    const v_fields = Float32ModuleNdarray.from_shape(this.module, [total_rhs,Ny+1,Nx+1]);
+    // a grid without conductors has nothing to solve
+    if (total_rhs === 0) return v_fields;
+    try {
+      this.solve_fields(v_fields, v_tables, total_rhs, profiler);
+    } catch (error) {
+      v_fields.delete();
+      throw error;
+    }
+    return v_fields;
+  }
+
+  // Iterative solvers that fail to converge are replaced by a direct factorisation and the fields solved again
+  solve_fields(v_fields: Float32ModuleNdarray, v_tables: Float32ModuleNdarray, total_rhs: number, profiler?: Profiler) {
+    let solve_info = this.solve_fields_once(v_fields, v_tables, total_rhs, profiler);
+    const solver = this.solver;
+    if (solve_info !== 0 && (solver instanceof Iterative_Solver || solver instanceof Multigrid_Solver)) {
+      console.warn(`Iterative solver failed with code ${solve_info}, falling back to a direct solver`);
+      this.clear_initial_guess();
+      this.bake_mirror_solver(profiler);
+      solve_info = this.solve_fields_once(v_fields, v_tables, total_rhs, profiler);
+    }
     if (solve_info !== 0) {
-      console.error(`LU solver failed with code: ${solve_info}`);
+      throw Error(`Solver failed with code: ${solve_info}`);
     }
   }
 
+  solve_fields_once(v_fields: Float32ModuleNdarray, v_tables: Float32ModuleNdarray, total_rhs: number, profiler?: Profiler): number {
+    if (this.solver === undefined) {
+      throw Error(`Solver has not been created yet. Call bake() first`);
+    }
+    profiler?.begin("create_b", "Generate b column vectors from forcing voltage potentials");
+    const rhs_info = this.module.create_laplace_rhs(v_fields, this.v_index_beta, v_tables, total_rhs);
+    profiler?.end();
+    if (rhs_info !== 0) {
+      throw Error(`Failed to create b column vectors with code: ${rhs_info}`);
+    }
+
+    const metadata: MetaData = {
+      "Total RHS": `${total_rhs}`,
+    };
+    profiler?.begin("solve_v_field", "Solve for voltage fields in system AX=B", metadata);
+    const solve_info = this.solver.solve_many(v_fields, total_rhs);
+    profiler?.end();
+    if (profiler !== undefined) Object.assign(metadata, get_solve_metadata(this.solver));
+    return solve_info;
+  }
+
+  // Copy a voltage field from run_many() into this grid
+  load_v_field(v_fields: Float32ModuleNdarray, index: number) {
+    const total_voltages = this.v_field.length;
+    const offset = index*total_voltages;
+    this.v_field.array_view.set(v_fields.array_view.subarray(offset, offset+total_voltages));
+    this._is_e_field_stale = true;
+  }
+
   calculate_impedance(profiler?: Profiler): ImpedanceResult {
-    profiler?.begin("energy_homogenous", "Calculate energy stored without dielectric material");
-    const energy_homogenous = this.module.calculate_homogenous_energy_2d(
-      this.ex_field, this.ey_field,
+    profiler?.begin("energy", "Calculate energy stored with and without dielectric material from voltage field");
+    const energy = this.module.calculate_energy_2d(
+      this.v_field,
+      this.dx, this.dy,
+      this.ek_table, this.ek_index_beta,
+    );
+    profiler?.end();
+    return this.get_impedance_from_energy(energy.homogenous, energy.inhomogenous);
+  }
+
+  // Canonical hash of the arrays which determine the solution for keying cached measurements
+  hash_inputs(profiler?: Profiler): string {
+    profiler?.begin("hash_inputs", "Hash grid arrays for the measurement cache");
+    const hash = this.module.hash_grid_inputs(
       this.dx, this.dy,
+      this.v_index_beta,
+      this.ek_table, this.ek_index_beta,
     );
     profiler?.end();
+    return hash;
+  }
 
-    profiler?.begin("energy_inhomogenous", "Calculate energy stored with dielectric material");
-    const energy_inhomogenous = this.module.calculate_inhomogenous_energy_2d(
-      this.ex_field, this.ey_field,
+  // Per cell error indicator of the energy integral for the current voltage field with shape [Ny,Nx]
+  calculate_energy_error(profiler?: Profiler): Float32Array {
+    const [Ny,Nx] = this.size;
+    const error = Float32ModuleNdarray.from_shape(this.module, [Ny,Nx]);
+    profiler?.begin("energy_error", "Calculate error of energy integral in each cell from voltage field");
+    this.module.calculate_energy_error_2d(
+      error,
+      this.v_field,
       this.dx, this.dy,
       this.ek_table, this.ek_index_beta,
     );
     profiler?.end();
+    const error_copy = new Float32Array(error.array_view);
+    error.delete();
+    return error_copy;
+  }
 
-    const epsilon_0 = 8.85e-12
-    const c_0 = 3e8;
+  get_impedance_from_energy(energy_homogenous: number, energy_inhomogenous: number): ImpedanceResult {
     const v0: number = this.v_input;
     const Ch = 1/(v0**2) * epsilon_0 * energy_homogenous;
     const Lh = 1/((c_0**2) * Ch);
@@ -300,6 +629,200 @@ export class Grid extends ManagedObject {
     };
   }
 
+  // v_table indices of conductors that have fixed voltage nodes excluding the ground at index 0
+  get_conductor_indices(): number[] {
+    const indices = new Set<number>();
+    for (const packed of this.v_index_beta.array_view) {
+      const { index, beta } = Grid.unpack_index_beta(packed);
+      if (index !== 0 && beta > 0.5) indices.add(index);
+    }
+    return Array.from(indices).sort((a,b) => a-b);
+  }
+
+  clear_basis() {
+    if (this._basis !== undefined) {
+      this._child_objects.delete(this._basis.v_fields);
+      this._basis.v_fields.delete();
+    }
+    this._basis = undefined;
+    this._basis_energy = undefined;
+  }
+
+  // Solve each conductor at unit voltage once so any v_table can be built without solving again
+  update_basis(profiler?: Profiler): BasisSolution {
+    if (this._basis !== undefined) return this._basis;
+    const conductor_indices = this.get_conductor_indices();
+    const table_length = Math.max(...conductor_indices, this.v_table.length-1)+1;
+    const v_tables = Float32ModuleNdarray.from_shape(this.module, [conductor_indices.length, table_length]);
+    conductor_indices.forEach((index, i) => v_tables.array_view[i*table_length+index] = 1.0);
+    profiler?.begin("solve_basis", "Solve voltage field of each conductor at unit voltage", {
+      "Total Conductors": `${conductor_indices.length}`,
+    });
+    const v_fields = this.run_many(v_tables, profiler);
+    profiler?.end();
+    v_tables.delete();
+    this._child_objects.add(v_fields);
+    this._basis = { conductor_indices, v_fields };
+    this._basis_energy = undefined;
+    return this._basis;
+  }
+
+  // Cross energies only need to be recalculated if the ek_table changes length since the values are applied afterwards
+  update_basis_energy(profiler?: Profiler): BasisEnergy {
+    const basis = this.update_basis(profiler);
+    const K = this.ek_table.length;
+    const cached = this._basis_energy;
+    if (cached !== undefined && cached.table_length === K) return cached;
+    const N = basis.conductor_indices.length;
+    const homogenous = Float32ModuleNdarray.from_shape(this.module, [N,N]);
+    const partial_inhomogenous = Float32ModuleNdarray.from_shape(this.module, [K,N,N]);
+    profiler?.begin("energy_matrix", "Calculate cross energies between basis voltage fields per dielectric", {
+      "Total Dielectrics": `${K}`,
+    });
+    const info = this.module.calculate_partial_energy_matrix_2d(
+      homogenous, partial_inhomogenous,
+      basis.v_fields,
+      this.dx, this.dy,
+      this.ek_index_beta,
+    );
+    profiler?.end();
+    this._basis_energy = {
+      table_length: K,
+      homogenous: new Float32Array(homogenous.array_view),
+      partial_inhomogenous: new Float32Array(partial_inhomogenous.array_view),
+    };
+    homogenous.delete();
+    partial_inhomogenous.delete();
+    if (info !== 0) {
+      this._basis_energy = undefined;
+      throw Error(`Dielectric index is outside of ek_table with length ${K} with error code: ${info}`);
+    }
+    return this._basis_energy;
+  }
+
+  // Inhomogenous cross energies [N,N] for an ek_table in O(K*N^2) without a grid pass
+  get_basis_inhomogenous_energy(energy: BasisEnergy, ek_table: ArrayLike<number>): Float32Array {
+    const K = energy.table_length;
+    if (ek_table.length !== K) {
+      throw Error(`Expected ek_table to have ${K} elements but got ${ek_table.length}`);
+    }
+    const total_matrix = energy.homogenous.length;
+    const inhomogenous = new Float64Array(total_matrix);
+    for (let m = 0; m < K; m++) {
+      const er = ek_table[m];
+      if (er === 0) continue;
+      const offset = m*total_matrix;
+      for (let i = 0; i < total_matrix; i++) {
+        inhomogenous[i] += er*energy.partial_inhomogenous[offset+i];
+      }
+    }
+    return new Float32Array(inhomogenous);
+  }
+
+  get_basis_weights(basis: BasisSolution): number[] {
+    const v_table = this.v_table.array_view;
+    return basis.conductor_indices.map(index => v_table[index]-v_table[0]);
+  }
+
+  // Build the voltage field for the current v_table from the basis solutions
+  load_basis_v_field(profiler?: Profiler) {
+    const basis = this.update_basis(profiler);
+    const weights = this.get_basis_weights(basis);
+    const v_field = this.v_field.array_view;
+    const v_fields = basis.v_fields.array_view;
+    const total_voltages = v_field.length;
+    v_field.fill(this.v_table.array_view[0]);
+    weights.forEach((weight, i) => {
+      if (weight === 0) return;
+      const offset = i*total_voltages;
+      for (let j = 0; j < total_voltages; j++) {
+        v_field[j] += weight*v_fields[offset+j];
+      }
+    });
+    this._is_e_field_stale = true;
+  }
+
+  // Same as calculate_impedance() for the current v_table and ek_table without a full grid pass
+  // since the energy of a superposition is the quadratic form a^T M a of the cross energies
+  calculate_impedance_from_basis(profiler?: Profiler): ImpedanceResult {
+    return this.calculate_impedance_sweep([this.ek_table.array_view], profiler)[0];
+  }
+
+  // Impedance of the current v_table for each ek_table, e.g. dielectric constants across a frequency sweep
+  // Only the first ek_table of a given length costs a grid pass, every other table is O(K*N^2)
+  calculate_impedance_sweep(ek_tables: ArrayLike<number>[], profiler?: Profiler): ImpedanceResult[] {
+    const basis = this.update_basis(profiler);
+    const energy = this.update_basis_energy(profiler);
+    const weights = this.get_basis_weights(basis);
+    const N = weights.length;
+    const quadratic_form = (matrix: ArrayLike<number>) => {
+      let sum = 0;
+      for (let i = 0; i < N; i++) {
+        for (let j = 0; j < N; j++) {
+          sum += weights[i]*weights[j]*matrix[i*N+j];
+        }
+      }
+      return sum;
+    };
+    const energy_homogenous = quadratic_form(energy.homogenous);
+    return ek_tables.map(ek_table => {
+      const energy_inhomogenous = quadratic_form(this.get_basis_inhomogenous_energy(energy, ek_table));
+      return this.get_impedance_from_energy(energy_homogenous, energy_inhomogenous);
+    });
+  }
+
+  // Full capacitance and inductance matrices with modal impedances for N coupled conductors
+  calculate_conductor_matrices(profiler?: Profiler): ConductorMatrices {
+    const basis = this.update_basis(profiler);
+    const energy = this.update_basis_energy(profiler);
+    const N = basis.conductor_indices.length;
+
+    const energy_homogenous = Float32ModuleNdarray.from_shape(this.module, [N,N]);
+    const energy_inhomogenous = Float32ModuleNdarray.from_shape(this.module, [N,N]);
+    const Ch = Float64ModuleNdarray.from_shape(this.module, [N,N]);
+    const Cih = Float64ModuleNdarray.from_shape(this.module, [N,N]);
+    const Lh = Float64ModuleNdarray.from_shape(this.module, [N,N]);
+    const Z0 = Float64ModuleNdarray.from_shape(this.module, [N]);
+    const velocity = Float64ModuleNdarray.from_shape(this.module, [N]);
+    const vectors = Float64ModuleNdarray.from_shape(this.module, [N,N]);
+    try {
+      energy_homogenous.array_view.set(energy.homogenous);
+      energy_inhomogenous.array_view.set(this.get_basis_inhomogenous_energy(energy, this.ek_table.array_view));
+      profiler?.begin("conductor_matrices", "Calculate capacitance, inductance and modal impedances", {
+        "Total Conductors": `${N}`,
+      });
+      let info = this.module.calculate_conductor_matrices(Ch, Cih, Lh, energy_homogenous, energy_inhomogenous);
+      if (info === 0) {
+        info = this.module.calculate_modal_impedances(Z0, velocity, vectors, Lh, Cih);
+      }
+      profiler?.end();
+      if (info !== 0) {
+        throw Error(`Capacitance matrix is not positive definite with error code: ${info}`);
+      }
+      const modes: ConductorMode[] = [];
+      for (let m = 0; m < N; m++) {
+        const propagation_speed = velocity.array_view[m];
+        modes.push({
+          vector: vectors.array_view.slice(m*N, (m+1)*N),
+          Z0: Z0.array_view[m],
+          propagation_speed,
+          effective_er: (c_0/propagation_speed)**2,
+        });
+      }
+      return {
+        conductor_indices: basis.conductor_indices.slice(),
+        Ch: Ch.array_view.slice(),
+        Cih: Cih.array_view.slice(),
+        Lh: Lh.array_view.slice(),
+        modes,
+      };
+    } finally {
+      for (const buffer of [energy_homogenous, energy_inhomogenous, Ch, Cih, Lh, Z0, velocity, vectors]) {
+        buffer.delete();
+      }
+    }
+  }
+
   get width(): number {
     return this.dx.length;
   }
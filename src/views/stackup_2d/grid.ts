@@ -1,11 +1,12 @@
 import { type EpsilonParameter, type Voltage } from "./stackup.ts";
-import { ManagedObject, WasmModule } from "../../wasm/index.ts";
+import { ManagedObject, WasmModule, Float64ModuleBuffer, Int32ModuleBuffer, RegionPrimitive } from "../../wasm/index.ts";
 import { type StackupLayout, type TrapezoidShape, type InfinitePlaneShape } from "./layout.ts";
 import { Float32ModuleNdarray } from "../../utility/module_ndarray.ts";
 
-import { Grid } from "./electrostatic_2d.ts";
+import { Grid, type SolverMode } from "./electrostatic_2d.ts";
 import { LinesBuilder } from "../../utility/lines_builder.ts";
 import { generate_region_mesh_segments, type RegionSpecification, RegionToGridMap } from "../../utility/regions.ts";
+import { mark_largest_errors } from "../../utility/mesher.ts";
 import { Profiler } from "../../utility/profiler.ts";
 
 function get_log_median(dims: number[]): number {
@@ -19,28 +20,6 @@ function get_log_median(dims: number[]): number {
   return median_dim;
 }
 
-// x=0,y=0 is top left
-type SDF = (y: number, x: number) => number;
-const sdf_slope_bottom_left: SDF = (y: number, x: number) => (y >= x) ? 1.0 : 0.0;
-const sdf_slope_bottom_right: SDF = (y: number, x: number) => (y >= 1-x) ? 1.0 : 0.0;
-const sdf_slope_top_left: SDF = (y: number, x: number) => (y <= 1-x) ? 1.0 : 0.0;
-const sdf_slope_top_right: SDF = (y: number, x: number) => (y <= x) ? 1.0 : 0.0;
-
-type MultisampledSDF = (y: number, x: number, height: number, width: number) => number;
-function get_sdf_multisample(sdf: SDF): MultisampledSDF {
-  function transform(y: number, x: number, dy: number, dx: number): number {
-    // multisampling
-    let total_beta = 0;
-    total_beta += sdf(y-dy, x-dx);
-    total_beta += sdf(y-dy, x+dx);
-    total_beta += sdf(y+dy, x-dx);
-    total_beta += sdf(y+dy, x+dx);
-    const beta = total_beta/4;
-    return beta;
-  }
-  return transform;
-}
-
 interface TrapezoidRegion {
   ix_taper_left: number;
   ix_signal_left: number;
@@ -101,9 +80,28 @@ export interface StackupGridConfig {
   min_y_subdivisions: number; // minimum number of grid lines each region should have
   min_epsilon_resolution: number; // smallest possible difference in dielectric epsilon values before they are considered the same
   signal_amplitude: number; // voltage value to use for +/- signals
+  max_refinement_steps: number; // maximum number of adaptive mesh refinements after the initial solve (0 to disable)
+  refinement_tolerance: number; // relative change in impedance between refinements before the mesh is considered converged
+  solver_mode: SolverMode; // linear solver used to bake each grid
+}
+
+// grid lines split by one refine_mesh() step
+export interface MeshRefinement {
+  is_x_split: boolean[];
+  is_y_split: boolean[];
+}
+
+// Solved state of a measured grid which can be loaded into a grid of the same layout on another thread
+// - The mesh is rebuilt from the layout and the refinements are replayed so only the voltage field is sent
+export interface StackupGridSolution {
+  mesh_refinements: MeshRefinement[];
+  v_field: Float32Array;
 }
 
 export class StackupGrid extends ManagedObject {
+  // fraction of the total energy error covered by the grid lines that are split in each refinement
+  static readonly REFINEMENT_ERROR_FRACTION = 0.5;
+
   layout: StackupLayout;
   voltage_indexes: {
     v_table: Record<Voltage, number>,
@@ -119,6 +117,7 @@ export class StackupGrid extends ManagedObject {
   y_region_lines_builder: LinesBuilder;
   x_region_to_grid_map: RegionToGridMap;
   y_region_to_grid_map: RegionToGridMap;
+  mesh_refinements: MeshRefinement[];
   config: StackupGridConfig;
   grid: Grid;
   profiler?: Profiler;
@@ -155,14 +154,91 @@ export class StackupGrid extends ManagedObject {
     this.setup_merge_nearby_grid_lines();
     this.x_region_to_grid_map = this.setup_create_x_region_to_grid_map();
     this.y_region_to_grid_map = this.setup_create_y_region_to_grid_map();
+    this.mesh_refinements = [];
+    this.grid = this.setup_simulation_grid();
+  }
+
+  setup_simulation_grid(): Grid {
     this.grid = this.setup_create_simulation_grid();
-    this.setup_fill_dielectric_regions();
-    this.setup_fill_voltage_regions();
+    const region_primitives: number[] = [];
+    this.setup_fill_dielectric_regions(region_primitives);
+    this.setup_fill_voltage_regions(region_primitives);
+    this.setup_rasterise_regions(region_primitives);
 
     // fit voltage and epsilon_k table
     this.grid.v_table = Float32ModuleNdarray.from_shape(this.module, [3]);
     this.grid.ek_table = Float32ModuleNdarray.from_shape(this.module, [this.epsilon_indexes.ek_table.length]);
     this._child_objects.add(this.grid);
+    return this.grid;
+  }
+
+  // Split the dx/dy grid segments where the energy integral of the current voltage field has the largest error
+  // NOTE: this replaces the simulation grid so it needs to be baked and solved again
+  refine_mesh(): { total_x_splits: number, total_y_splits: number } {
+    this.profiler?.begin("refine_mesh");
+    const [Ny,Nx] = this.grid.size;
+    const error = this.grid.calculate_energy_error(this.profiler);
+    // a grid line splits every cell along it so cells are ranked by the total error along each column and row
+    const x_error = new Float64Array(Nx);
+    const y_error = new Float64Array(Ny);
+    for (let y = 0; y < Ny; y++) {
+      for (let x = 0; x < Nx; x++) {
+        const cell_error = error[x + y*Nx];
+        x_error[x] += cell_error;
+        y_error[y] += cell_error;
+      }
+    }
+    const is_x_split = mark_largest_errors(x_error, StackupGrid.REFINEMENT_ERROR_FRACTION);
+    const is_y_split = mark_largest_errors(y_error, StackupGrid.REFINEMENT_ERROR_FRACTION);
+    this.apply_mesh_refinement({ is_x_split, is_y_split });
+    this.profiler?.end();
+    return {
+      total_x_splits: is_x_split.filter(is_split => is_split).length,
+      total_y_splits: is_y_split.filter(is_split => is_split).length,
+    };
+  }
+
+  apply_mesh_refinement(refinement: MeshRefinement) {
+    this.x_region_to_grid_map = this.x_region_to_grid_map.refine(refinement.is_x_split);
+    this.y_region_to_grid_map = this.y_region_to_grid_map.refine(refinement.is_y_split);
+    this.mesh_refinements.push(refinement);
+
+    // iterative solvers start from the coarse basis interpolated onto the refined mesh
+    const prev_grid = this.grid;
+    this._child_objects.delete(prev_grid);
+    this.grid = this.setup_simulation_grid();
+    this.grid.load_initial_guess(prev_grid);
+    prev_grid.delete();
+  }
+
+  // NOTE: this should be called after perform_measurement(...)
+  export_solution(): StackupGridSolution {
+    return {
+      mesh_refinements: this.mesh_refinements,
+      v_field: this.grid.v_field.array_view.slice(),
+    };
+  }
+
+  // Restore a solution exported from a grid of the same layout and config without solving it again
+  load_solution(solution: StackupGridSolution) {
+    if (this.mesh_refinements.length > 0) {
+      throw Error(`Expected an unrefined grid to load a solution into but it was refined ${this.mesh_refinements.length} times`);
+    }
+    for (const refinement of solution.mesh_refinements) {
+      this.apply_mesh_refinement(refinement);
+    }
+    if (this.grid.v_field.length !== solution.v_field.length) {
+      throw Error(`Expected a voltage field with ${this.grid.v_field.length} elements but got ${solution.v_field.length}`);
+    }
+    this.grid.v_field.array_view.set(solution.v_field);
+    this.grid._is_e_field_stale = true;
+    // same setup that perform_measurement(...) leaves the grid in
+    this.configure_masked_dielectric();
+    if (this.is_differential_pair()) {
+      this.configure_odd_mode_diffpair_voltage();
+    } else {
+      this.configure_single_ended_voltage();
+    }
   }
 
   get_infinite_plane_region(shape: InfinitePlaneShape): InfinitePlaneRegion {
@@ -352,6 +428,7 @@ export class StackupGrid extends ManagedObject {
     );
     grid.dx.array_view.set(this.x_region_to_grid_map.grid_segments);
     grid.dy.array_view.set(this.y_region_to_grid_map.grid_segments);
+    grid.solver_mode = this.config.solver_mode;
     this.profiler?.end();
     return grid;
   }
@@ -372,120 +449,41 @@ export class StackupGrid extends ManagedObject {
     return index;
   }
 
-  fill_dielectric_constant(
-    gx_start: number, gx_end: number, gy_start: number, gy_end: number,
-    ek_index: number,
-  ) {
-    const grid = this.grid.ek_index_beta.ndarray;
-    const [_Ny, Nx] = grid.shape;
-    const buf = grid.data;
-    const width = gx_end-gx_start;
-    const value = Grid.pack_index_beta(ek_index, 1.0);
-    for (let y = gy_start; y < gy_end; y++) {
-      const gi = gx_start + y*Nx;
-      buf.fill(value, gi, gi+width);
-    }
-  }
-
-  fill_dielectric_sdf(
-    gx_start: number, gx_end: number, gy_start: number, gy_end: number,
-    ek_index: number, sdf: SDF,
-  ) {
-    const grid = this.grid.ek_index_beta.ndarray;
-    const [_Ny, Nx] = grid.shape;
-    const buf = grid.data;
-
-    const X = this.x_region_to_grid_map.grid_lines.slice(gx_start, gx_end);
-    const Y = this.y_region_to_grid_map.grid_lines.slice(gy_start, gy_end);
-    const dX = this.x_region_to_grid_map.grid_segments.slice(gx_start, gx_end);
-    const dY = this.y_region_to_grid_map.grid_segments.slice(gy_start, gy_end);
-    const abs_width = dX.reduce((a,b) => a+b, 0);
-    const abs_height = dY.reduce((a,b) => a+b, 0);
-    const norm_dX = dX.map(dx => dx/abs_width);
-    const norm_dY = dY.map(dy => dy/abs_height);
-    const norm_X = X.map(x => (x-X[0])/abs_width);
-    const norm_Y = Y.map(y => (y-Y[0])/abs_height);
-
-    const width = gx_end-gx_start;
-    const height = gy_end-gy_start;
-
-    const multisampled_sdf = get_sdf_multisample(sdf);
-    function index_beta_sdf(y: number, x: number, height: number, width: number): number {
-      const beta = multisampled_sdf(y+height/2, x+width/2, height/2, width/2);
-      return Grid.pack_index_beta(ek_index, beta);
-    }
-
-    for (let y = 0; y < height; y++) {
-      const norm_y = norm_Y[y];
-      const norm_dy = norm_dY[y];
-      const gy = gy_start+y;
-      for (let x = 0; x < width; x++) {
-        const norm_x = norm_X[x];
-        const norm_dx = norm_dX[x];
-        const gx = gx_start+x;
-        const gi = gx + gy*Nx;
-        const value = index_beta_sdf(norm_y, norm_x, norm_dy, norm_dx);
-        buf[gi] = value;
-      }
-    }
-  }
-
-  fill_dielectric_plane(region: InfinitePlaneRegion, ek_index: number) {
+  push_plane_primitive(primitives: number[], target: number, region: InfinitePlaneRegion, index: number) {
     const gy_start = this.y_region_to_grid_map.id_to_grid_index(region.iy_start);
     const gy_end = this.y_region_to_grid_map.id_to_grid_index(region.iy_end);
-    const gx_start = 0;
-    const gx_end = this.x_region_to_grid_map.total_grid_segments;
-    this.fill_dielectric_constant(
-      gx_start, gx_end, gy_start, gy_end,
-      ek_index,
+    primitives.push(
+      target, RegionPrimitive.PLANE, index,
+      gy_start, gy_end, 0, 0, 0, 0,
     );
-  };
+  }
 
-  fill_dielectric_trapezoid(region: TrapezoidRegion, ek_index: number) {
+  push_trapezoid_primitive(primitives: number[], target: number, region: TrapezoidRegion, index: number) {
     const gx_signal_left = this.x_region_to_grid_map.id_to_grid_index(region.ix_signal_left);
     const gx_taper_left = this.x_region_to_grid_map.id_to_grid_index(region.ix_taper_left);
     const gx_taper_right = this.x_region_to_grid_map.id_to_grid_index(region.ix_taper_right);
     const gx_signal_right = this.x_region_to_grid_map.id_to_grid_index(region.ix_signal_right);
-
     const gy_base = this.y_region_to_grid_map.id_to_grid_index(region.iy_base);
     const gy_taper = this.y_region_to_grid_map.id_to_grid_index(region.iy_taper);
-    const gy_start = Math.min(gy_base, gy_taper);
-    const gy_end = Math.max(gy_base, gy_taper);
-
-    if (gx_signal_left < gx_taper_left && gy_start < gy_end) {
-      const sdf = (gy_taper > gy_base) ? sdf_slope_top_right : sdf_slope_bottom_right;
-      this.fill_dielectric_sdf(
-        gx_signal_left, gx_taper_left, gy_start, gy_end,
-        ek_index, sdf,
-      );
-    }
-    if (gx_taper_left < gx_taper_right && gy_start < gy_end) {
-      this.fill_dielectric_constant(
-        gx_taper_left, gx_taper_right, gy_start, gy_end,
-        ek_index,
-      );
-    }
-    if (gx_taper_right < gx_signal_right && gy_start < gy_end) {
-      const sdf = (gy_taper > gy_base) ? sdf_slope_top_left: sdf_slope_bottom_left;
-      this.fill_dielectric_sdf(
-        gx_taper_right, gx_signal_right, gy_start, gy_end,
-        ek_index, sdf,
-      );
-    }
-  };
+    primitives.push(
+      target, RegionPrimitive.TRAPEZOID, index,
+      gx_signal_left, gx_taper_left, gx_taper_right, gx_signal_right, gy_base, gy_taper,
+    );
+  }
 
-  setup_fill_dielectric_regions() {
+  setup_fill_dielectric_regions(primitives: number[]) {
     this.profiler?.begin("fill_dielectric_regions");
     const er0 = 1.0; // dielectric of vacuum
     const index_er0 = this.push_epsilon(er0, "core");
     this.grid.ek_index_beta.ndarray.fill(Grid.pack_index_beta(index_er0, 0.0));
 
+    const target = RegionPrimitive.TARGET_DIELECTRIC;
     for (const dielectric_region of this.dielectric_regions) {
       switch (dielectric_region.type) {
         case "plane": {
           const { region } = dielectric_region;
           const ek_index = this.push_epsilon(dielectric_region.epsilon, "core");
-          this.fill_dielectric_plane(region, ek_index);
+          this.push_plane_primitive(primitives, target, region, ek_index);
           break;
         };
         case "soldermask": {
@@ -493,9 +491,9 @@ export class StackupGrid extends ManagedObject {
           const ek_index = this.push_epsilon(dielectric_region.epsilon, "soldermask");
           this.epsilon_indexes.soldermask_indices.add(ek_index);
           const { base_region, trace_regions } = dielectric_region;
-          this.fill_dielectric_plane(base_region, ek_index);
+          this.push_plane_primitive(primitives, target, base_region, ek_index);
           for (const region of trace_regions) {
-            this.fill_dielectric_trapezoid(region, ek_index);
+            this.push_trapezoid_primitive(primitives, target, region, ek_index);
           }
           break;
         };
@@ -509,136 +507,18 @@ export class StackupGrid extends ManagedObject {
     return this.voltage_indexes.v_table[voltage];
   }
 
-  fill_voltage_constant(
-    gx_start: number, gx_end: number, gy_start: number, gy_end: number,
-    v_index: number,
-  ) {
-    const grid = this.grid.v_index_beta.ndarray;
-    const [Ny, Nx] = grid.shape;
-    const buf = grid.data;
-
-    // include boundary of grid cell
-    gx_end = Math.min(Nx, gx_end+1);
-    gy_end = Math.min(Ny, gy_end+1);
-    const width = gx_end-gx_start;
-    const value = Grid.pack_index_beta(v_index, 1.0);
-    for (let y = gy_start; y < gy_end; y++) {
-      const gi = gx_start + y*Nx;
-      buf.fill(value, gi, gi+width);
-    }
-  }
-
-  fill_voltage_sdf(
-    gx_start: number, gx_end: number, gy_start: number, gy_end: number,
-    v_index: number, sdf: SDF,
-  ) {
-    const grid = this.grid.v_index_beta.ndarray;
-    const [Ny, Nx] = grid.shape;
-    const buf = grid.data;
-
-    const dX = this.x_region_to_grid_map.grid_segments.slice(gx_start, gx_end);
-    const dY = this.y_region_to_grid_map.grid_segments.slice(gy_start, gy_end);
-    const abs_width = dX.reduce((a,b) => a+b, 0);
-    const abs_height = dY.reduce((a,b) => a+b, 0);
-    const norm_dX = dX.map(dx => dx/abs_width);
-    const norm_dY = dY.map(dy => dy/abs_height);
-
-    // include boundary of grid cell
-    gx_end = Math.min(Nx, gx_end+1);
-    gy_end = Math.min(Ny, gy_end+1);
-    const width = gx_end-gx_start;
-    const height = gy_end-gy_start;
-    const X = this.x_region_to_grid_map.grid_lines.slice(gx_start, gx_end);
-    const Y = this.y_region_to_grid_map.grid_lines.slice(gy_start, gy_end);
-    const norm_X = X.map(x => (x-X[0])/abs_width);
-    const norm_Y = Y.map(y => (y-Y[0])/abs_height);
-
-    const multisampled_sdf = get_sdf_multisample(sdf);
-    function index_beta_sdf(y: number, x: number, dy: number, dx: number): number {
-      const beta = multisampled_sdf(y, x, dy/2, dx/2);
-      return Grid.pack_index_beta(v_index, beta);
-    }
-
-    for (let y = 0; y < height; y++) {
-      const norm_y = norm_Y[y];
-      const norm_dy = norm_dY[y] ?? norm_dY[norm_dY.length-1];
-      const gy = gy_start+y;
-      for (let x = 0; x < width; x++) {
-        const norm_x = norm_X[x];
-        const norm_dx = norm_dX[x] ?? norm_dX[norm_dX.length-1];
-        const gx = gx_start+x;
-        const gi = gx + gy*Nx;
-        const value = index_beta_sdf(norm_y, norm_x, norm_dy, norm_dx);
-        buf[gi] = value;
-      }
-    }
-  }
-
-
-  fill_voltage_plane(region: InfinitePlaneRegion, voltage: Voltage) {
-    const gy_start = this.y_region_to_grid_map.id_to_grid_index(region.iy_start);
-    const gy_end = this.y_region_to_grid_map.id_to_grid_index(region.iy_end);
-    const gx_start = 0;
-    const gx_end = this.x_region_to_grid_map.total_grid_segments;
-
-    const v_index = this.push_voltage(voltage);
-    this.fill_voltage_constant(
-      gx_start, gx_end, gy_start, gy_end,
-      v_index,
-    );
-  };
-
-  fill_voltage_trapezoid(region: TrapezoidRegion, voltage: Voltage) {
-    const gx_signal_left = this.x_region_to_grid_map.id_to_grid_index(region.ix_signal_left);
-    const gx_taper_left = this.x_region_to_grid_map.id_to_grid_index(region.ix_taper_left);
-    const gx_taper_right = this.x_region_to_grid_map.id_to_grid_index(region.ix_taper_right);
-    const gx_signal_right = this.x_region_to_grid_map.id_to_grid_index(region.ix_signal_right);
-
-    const gy_base = this.y_region_to_grid_map.id_to_grid_index(region.iy_base);
-    const gy_taper = this.y_region_to_grid_map.id_to_grid_index(region.iy_taper);
-    const gy_start = Math.min(gy_base, gy_taper);
-    let gy_end = Math.max(gy_base, gy_taper);
-    // also set edge of region to voltage
-    gy_end = Math.min(gy_end+1, this.y_region_to_grid_map.total_grid_lines);
-
-    const v_index = this.push_voltage(voltage);
-
-    if (gx_signal_left < gx_taper_left) {
-      const sdf = (gy_taper > gy_base) ? sdf_slope_top_right : sdf_slope_bottom_right;
-      this.fill_voltage_sdf(
-        gx_signal_left, gx_taper_left, gy_start, gy_end,
-        v_index, sdf,
-      );
-    }
-    if (gx_taper_left <= gx_taper_right) {
-      this.fill_voltage_constant(
-        gx_taper_left, gx_taper_right, gy_start, gy_end,
-        v_index,
-      );
-    }
-    if (gx_taper_right < gx_signal_right) {
-      const sdf = (gy_taper > gy_base) ? sdf_slope_top_left : sdf_slope_bottom_left;
-      this.fill_voltage_sdf(
-        gx_taper_right, gx_signal_right, gy_start, gy_end,
-        v_index, sdf,
-      );
-    }
-  };
-
-  setup_fill_voltage_regions() {
+  setup_fill_voltage_regions(primitives: number[]) {
     this.profiler?.begin("fill_voltage_regions");
+    const target = RegionPrimitive.TARGET_VOLTAGE;
     for (const conductor of this.conductor_regions) {
+      const v_index = this.push_voltage(conductor.voltage);
       switch (conductor.type) {
         case "plane": {
-          this.profiler?.begin("fill_voltage_plane");
-          this.fill_voltage_plane(conductor.region, conductor.voltage);
-          this.profiler?.end();
+          this.push_plane_primitive(primitives, target, conductor.region, v_index);
           break;
         }
         case "trace": {
-          this.profiler?.begin("fill_voltage_trace");
-          this.fill_voltage_trapezoid(conductor.region, conductor.voltage);
-          this.profiler?.end();
+          this.push_trapezoid_primitive(primitives, target, conductor.region, v_index);
           break;
         }
       }
@@ -646,6 +526,25 @@ export class StackupGrid extends ManagedObject {
     this.profiler?.end();
   }
 
+  // multisampled edges of dielectric and voltage regions are drawn natively in one pass
+  setup_rasterise_regions(primitives: number[]) {
+    this.profiler?.begin("rasterise_regions");
+    const dx = Float64ModuleBuffer.create(this.module, this.x_region_to_grid_map.grid_segments);
+    const dy = Float64ModuleBuffer.create(this.module, this.y_region_to_grid_map.grid_segments);
+    const primitives_buffer = Int32ModuleBuffer.create(this.module, primitives);
+    try {
+      this.module.rasterise_regions(
+        this.grid.ek_index_beta, this.grid.v_index_beta,
+        dx, dy, primitives_buffer,
+      );
+    } finally {
+      dx.delete();
+      dy.delete();
+      primitives_buffer.delete();
+    }
+    this.profiler?.end();
+  }
+
   is_differential_pair(): boolean {
     const v_set =  this.voltage_indexes.v_set;
     return v_set.has("positive") && v_set.has("negative");
@@ -679,6 +578,23 @@ export class StackupGrid extends ManagedObject {
     this.grid.v_input = this.config.signal_amplitude;
   }
 
+  // Key of the measurement of this grid which covers every input that perform_measurement(...) depends on
+  // NOTE: this leaves the masked dielectric configured which every measurement starts from anyway
+  get_measurement_cache_key(): string {
+    this.configure_masked_dielectric();
+    const grid_hash = this.grid.hash_inputs(this.profiler);
+    const soldermask_indices = Array.from(this.epsilon_indexes.soldermask_indices).sort((a,b) => a-b);
+    const { signal_amplitude, max_refinement_steps, refinement_tolerance } = this.config;
+    return [
+      grid_hash,
+      soldermask_indices.join(","),
+      signal_amplitude,
+      max_refinement_steps,
+      refinement_tolerance,
+      this.grid.solver_mode,
+    ].join(":");
+  }
+
   configure_masked_dielectric() {
     const src_ek_table = this.epsilon_indexes.ek_table;
     const dst_ek_table = this.grid.ek_table.array_view;
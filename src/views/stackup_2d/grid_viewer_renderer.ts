@@ -42,6 +42,7 @@ const assert = {
   },
 }
 
+// f16 textures are packed directly from the module arrays without staging in f32
 const upload_texture = {
   index_beta: (gpu_device: GPUDevice, texture: GPUTexture, table: Float32ModuleNdarray, index_beta: Uint32ModuleNdarray) => {
     assert.array_dim(index_beta, 2);
@@ -54,23 +55,8 @@ const upload_texture = {
     const module = table.module;
     const total_channels = 2;
     const sizeof_f16 = 2;
-    const f32_data = Float32ModuleNdarray.from_shape(module, [...shape, total_channels]);
-    {
-      const data_arr = f32_data.array_view;
-      const table_arr = table.array_view;
-      const index_beta_arr = index_beta.array_view;
-      for (let y = 0; y < height; y++) {
-        for (let x = 0; x < width; x++) {
-          const iv = x + y*width;
-          const { index, beta } = Grid.unpack_index_beta(index_beta_arr[iv]);
-          const v_value = table_arr[index];
-          data_arr[total_channels*iv+0] = v_value;
-          data_arr[total_channels*iv+1] = beta;
-        }
-      }
-    }
-    const f16_data = Uint16ModuleNdarray.from_shape(module, f32_data.shape);
-    module.convert_f32_to_f16(f32_data, f16_data);
+    const f16_data = Uint16ModuleNdarray.from_shape(module, [...shape, total_channels]);
+    module.pack_index_beta_f16(f16_data, table, index_beta);
     gpu_device.queue.writeTexture(
       { texture },
       f16_data.array_view,
@@ -78,7 +64,6 @@ const upload_texture = {
       { width, height },
     );
     f16_data.delete();
-    f32_data.delete();
   },
   scalar: (gpu_device: GPUDevice, texture: GPUTexture, f32_data: Float32ModuleNdarray) => {
     assert.array_dim(f32_data, 2);
@@ -112,24 +97,8 @@ const upload_texture = {
 
     const total_channels = 2;
     const sizeof_f16 = 2;
-    const shape = [Ny,Nx,total_channels];
-    const f32_data = Float32ModuleNdarray.from_shape(module, shape);
-    {
-      const x_arr = x_data.array_view;
-      const y_arr = y_data.array_view;
-      const data_arr = f32_data.array_view;
-      for (let y = 0; y < Ny; y++) {
-        for (let x = 0; x < Nx; x++) {
-          const iex = x + y*Nx;
-          const iey = x + y*(Nx+1);
-          const ie = 2*(x + y*Nx);
-          data_arr[ie+0] = x_arr[iex];
-          data_arr[ie+1] = y_arr[iey];
-        }
-      }
-    }
-    const f16_data = Uint16ModuleNdarray.from_shape(module, shape);
-    module.convert_f32_to_f16(f32_data, f16_data);
+    const f16_data = Uint16ModuleNdarray.from_shape(module, [Ny,Nx,total_channels]);
+    module.pack_xy_components_f16(f16_data, x_data, y_data, Nx, Ny);
     gpu_device.queue.writeTexture(
       { texture },
       f16_data.array_view,
@@ -137,7 +106,6 @@ const upload_texture = {
       { width: Nx, height: Ny },
     );
     f16_data.delete();
-    f32_data.delete();
   },
 };
 
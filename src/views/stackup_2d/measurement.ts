@@ -1,12 +1,14 @@
-import { type ImpedanceResult } from "./electrostatic_2d.ts";
+import { type ImpedanceResult, type ConductorMatrices } from "./electrostatic_2d.ts";
 import { Profiler } from "../../utility/profiler.ts";
 import { StackupGrid } from "./grid.ts";
+import { type DirectSolver } from "../../wasm/index.ts";
 
 export interface SingleEndedMeasurement {
   type: "single";
   masked: ImpedanceResult;
   unmasked?: ImpedanceResult;
   effective_er: number;
+  conductor_matrices: ConductorMatrices; // masked
 }
 
 export interface DifferentialMeasurement {
@@ -16,45 +18,92 @@ export interface DifferentialMeasurement {
   odd_unmasked?: ImpedanceResult;
   coupling_factor: number;
   effective_er: number;
+  conductor_matrices: ConductorMatrices; // masked
 }
 
 export type Measurement = SingleEndedMeasurement | DifferentialMeasurement;
 
-export function perform_measurement(stackup: StackupGrid, profiler?: Profiler): Measurement {
+interface VoltageSetup {
+  label: string;
+  configure: () => void;
+}
+
+function get_measurement_impedance(measurement: Measurement): number {
+  return measurement.type == "single" ? measurement.masked.Z0 : measurement.odd_masked.Z0;
+}
+
+// Measure and then refine the mesh where the energy error is largest until the impedance converges
+// NOTE: reuse_direct_solver is consumed and will either be owned by the grid or deleted
+export function perform_measurement(stackup: StackupGrid, profiler?: Profiler, reuse_direct_solver?: DirectSolver): Measurement {
+  let measurement = perform_grid_measurement(stackup, profiler, reuse_direct_solver);
+  const { max_refinement_steps, refinement_tolerance } = stackup.config;
+  for (let step = 0; step < max_refinement_steps; step++) {
+    const Z0_prev = get_measurement_impedance(measurement);
+    const { total_x_splits, total_y_splits } = stackup.refine_mesh();
+    if (total_x_splits == 0 && total_y_splits == 0) break;
+
+    const [Ny,Nx] = stackup.grid.size;
+    profiler?.begin(`refinement_${step}`, "Measure impedance on refined mesh", {
+      "Total Columns": `${Nx}`,
+      "Total Rows": `${Ny}`,
+      "Split Columns": `${total_x_splits}`,
+      "Split Rows": `${total_y_splits}`,
+    });
+    measurement = perform_grid_measurement(stackup, profiler);
+    profiler?.end();
+
+    const Z0 = get_measurement_impedance(measurement);
+    if (Math.abs(Z0-Z0_prev) <= refinement_tolerance*Math.abs(Z0)) break;
+  }
+  return measurement;
+}
+
+function perform_grid_measurement(stackup: StackupGrid, profiler?: Profiler, reuse_direct_solver?: DirectSolver): Measurement {
   const grid = stackup.grid;
   profiler?.begin("bake");
-  grid.bake(profiler);
+  grid.bake(profiler, reuse_direct_solver);
   profiler?.end();
 
-  const calculate = (label: string): ImpedanceResult => {
+  // Solve each conductor once since the voltage setups and dielectric only change how the solutions are combined
+  // NOTE: symmetric stackups solve these on half the grid with even/odd mirror boundaries (see Mirror_Solver)
+  profiler?.begin("grid.update_basis");
+  grid.update_basis(profiler);
+  profiler?.end();
+
+  const calculate = (label: string, setup: VoltageSetup): ImpedanceResult => {
     profiler?.begin(label, `Calculating with setup ${label}`);
+    setup.configure();
 
-    profiler?.begin("grid.run");
-    grid.run(profiler);
+    profiler?.begin("grid.calculate_impedance_from_basis");
+    const impedance = grid.calculate_impedance_from_basis(profiler);
     profiler?.end();
 
-    profiler?.begin("grid.calculate_impedance");
-    const impedance = grid.calculate_impedance(profiler);
     profiler?.end();
+    return impedance;
+  };
 
+  // Reuses the cross energies of the masked dielectric from the last setup
+  const calculate_conductor_matrices = (): ConductorMatrices => {
+    profiler?.begin("grid.calculate_conductor_matrices");
+    const conductor_matrices = grid.calculate_conductor_matrices(profiler);
     profiler?.end();
-    return impedance;
+    return conductor_matrices;
   };
 
   profiler?.begin("calculate_setups");
   const is_single_ended = !stackup.is_differential_pair();
   let measurement: Measurement | undefined = undefined;
   if (is_single_ended) {
+    const single_ended: VoltageSetup = { label: "single_ended", configure: () => stackup.configure_single_ended_voltage() };
+
     let unmasked = undefined;
     if (stackup.has_soldermask()) {
-      stackup.configure_single_ended_voltage();
       stackup.configure_unmasked_dielectric();
-      unmasked = calculate("unmasked");
+      unmasked = calculate("unmasked", single_ended);
     }
 
-    stackup.configure_single_ended_voltage();
     stackup.configure_masked_dielectric();
-    const masked = calculate("masked");
+    const masked = calculate("masked", single_ended);
 
     const effective_er = masked.Cih/masked.Ch;
 
@@ -63,23 +112,24 @@ export function perform_measurement(stackup: StackupGrid, profiler?: Profiler):
       masked,
       unmasked,
       effective_er,
+      conductor_matrices: calculate_conductor_matrices(),
     }
   } else {
+    const odd_mode: VoltageSetup = { label: "odd_mode", configure: () => stackup.configure_odd_mode_diffpair_voltage() };
+    const even_mode: VoltageSetup = { label: "even_mode", configure: () => stackup.configure_even_mode_diffpair_voltage() };
+
     let odd_unmasked = undefined;
     if (stackup.has_soldermask()) {
-      stackup.configure_odd_mode_diffpair_voltage();
       stackup.configure_unmasked_dielectric();
-      odd_unmasked = calculate("odd_unmasked");
+      odd_unmasked = calculate("odd_unmasked", odd_mode);
     }
 
-    stackup.configure_even_mode_diffpair_voltage();
     stackup.configure_masked_dielectric();
-    const even_masked = calculate("even_masked");
+    const even_masked = calculate("even_masked", even_mode);
 
     // NOTE: do this last so that final grid setup has expected differential voltage and soldermask
-    stackup.configure_odd_mode_diffpair_voltage();
     stackup.configure_masked_dielectric();
-    const odd_masked = calculate("odd_masked");
+    const odd_masked = calculate("odd_masked", odd_mode);
 
     const Z_odd = odd_masked.Z0;
     const Z_even = even_masked.Z0;
@@ -94,9 +144,15 @@ export function perform_measurement(stackup: StackupGrid, profiler?: Profiler):
       odd_unmasked,
       coupling_factor,
       effective_er,
+      conductor_matrices: calculate_conductor_matrices(),
     }
   }
   profiler?.end();
 
+  // Viewer expects the voltage field of the final setup
+  profiler?.begin("grid.load_basis_v_field");
+  grid.load_basis_v_field(profiler);
+  profiler?.end();
+
   return measurement;
 }
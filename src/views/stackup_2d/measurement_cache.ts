@@ -0,0 +1,181 @@
+import { type Measurement } from "./measurement.ts";
+
+// impedance of a search candidate which is kept to bracket later searches over the same stackup
+export interface SearchSample {
+  value: number;
+  impedance: number;
+}
+
+export interface SearchBracket {
+  v_initial: number;
+  v_min: number;
+  v_max: number;
+}
+
+interface SerialisedCache {
+  version: string;
+  measurements: [string, Measurement][];
+  searches: [string, SearchSample[]][];
+}
+
+// JSON has no typed arrays so the Float64Array fields of the conductor matrices are tagged
+const FLOAT64_ARRAY_TAG = "$float64";
+
+function replace_typed_arrays(_key: string, value: unknown): unknown {
+  if (value instanceof Float64Array) return { [FLOAT64_ARRAY_TAG]: Array.from(value) };
+  return value;
+}
+
+function revive_typed_arrays(_key: string, value: unknown): unknown {
+  if (typeof value === "object" && value !== null && FLOAT64_ARRAY_TAG in value) {
+    return new Float64Array((value as Record<string, number[]>)[FLOAT64_ARRAY_TAG]);
+  }
+  return value;
+}
+
+// move key to the most recently used end of the map
+function touch<T>(map: Map<string, T>, key: string, value: T, max_entries: number) {
+  map.delete(key);
+  map.set(key, value);
+  while (map.size > max_entries) {
+    const oldest_key = map.keys().next().value as string;
+    map.delete(oldest_key);
+  }
+}
+
+// Persistent LRU cache of measurements keyed by StackupGrid.get_measurement_cache_key()
+// - Maps iterate in insertion order so the first entry is always the least recently used
+// - Search samples are grouped by a key of the stackup without the searched parameters so that
+//   a new search can start from a bracket of cached neighbours instead of searching for one
+// - Saved to local storage as JSON so it survives reloads, and is dropped if the version changes
+// - Version includes a hash of the wasm module and mesher sources so results of an older solver are dropped
+export class MeasurementCache {
+  static readonly FORMAT_VERSION = 1;
+  static readonly VERSION = `${MeasurementCache.FORMAT_VERSION}:${__SOLVER_REVISION__}`;
+  static readonly STORAGE_KEY = "stackup_2d.measurement_cache";
+  static readonly MAX_MEASUREMENTS = 256;
+  static readonly MAX_SEARCHES = 64;
+  static readonly MAX_SEARCH_SAMPLES = 64;
+
+  storage?: Storage;
+  measurements = new Map<string, Measurement>();
+  searches = new Map<string, SearchSample[]>();
+  total_hits: number = 0;
+  total_misses: number = 0;
+
+  constructor(storage?: Storage) {
+    this.storage = storage;
+    this.load();
+  }
+
+  get_measurement(key: string): Measurement | undefined {
+    const measurement = this.measurements.get(key);
+    if (measurement === undefined) {
+      this.total_misses++;
+      return undefined;
+    }
+    this.total_hits++;
+    touch(this.measurements, key, measurement, MeasurementCache.MAX_MEASUREMENTS);
+    return measurement;
+  }
+
+  set_measurement(key: string, measurement: Measurement) {
+    touch(this.measurements, key, measurement, MeasurementCache.MAX_MEASUREMENTS);
+  }
+
+  add_search_sample(search_key: string, sample: SearchSample) {
+    const samples = (this.searches.get(search_key) ?? []).filter(other => other.value !== sample.value);
+    samples.push(sample);
+    if (samples.length > MeasurementCache.MAX_SEARCH_SAMPLES) {
+      samples.splice(0, samples.length-MeasurementCache.MAX_SEARCH_SAMPLES);
+    }
+    touch(this.searches, search_key, samples, MeasurementCache.MAX_SEARCHES);
+  }
+
+  // Closest cached samples either side of the target with the initial value linearly interpolated between them
+  // NOTE: error has the same sign convention as the parameter search so it increases with the value
+  get_search_bracket(
+    search_key: string, target_impedance: number, impedance_correlation: "positive" | "negative",
+    v_min?: number, v_max?: number,
+  ): SearchBracket | undefined {
+    const samples = this.searches.get(search_key);
+    if (samples === undefined) return undefined;
+    let lower: { value: number, error: number } | undefined = undefined;
+    let upper: { value: number, error: number } | undefined = undefined;
+    for (const sample of samples) {
+      if (v_min !== undefined && sample.value < v_min) continue;
+      if (v_max !== undefined && sample.value > v_max) continue;
+      const error_impedance = target_impedance-sample.impedance;
+      const error = impedance_correlation == "positive" ? -error_impedance : error_impedance;
+      if (error <= 0 && (lower === undefined || sample.value > lower.value)) {
+        lower = { value: sample.value, error };
+      }
+      if (error >= 0 && (upper === undefined || sample.value < upper.value)) {
+        upper = { value: sample.value, error };
+      }
+    }
+    if (lower === undefined || upper === undefined) return undefined;
+    if (lower.value >= upper.value) {
+      // the target lands exactly on a sample which is then the only point searched
+      if (lower.value == upper.value) return { v_initial: lower.value, v_min: lower.value, v_max: lower.value };
+      return undefined; // samples are not monotonic so they cannot be trusted as a bracket
+    }
+    touch(this.searches, search_key, samples, MeasurementCache.MAX_SEARCHES);
+    const ratio = lower.error/(lower.error-upper.error);
+    const v_initial = lower.value + (upper.value-lower.value)*ratio;
+    return { v_initial, v_min: lower.value, v_max: upper.value };
+  }
+
+  clear() {
+    this.measurements.clear();
+    this.searches.clear();
+    this.storage?.removeItem(MeasurementCache.STORAGE_KEY);
+  }
+
+  load() {
+    const text = this.storage?.getItem(MeasurementCache.STORAGE_KEY);
+    if (text === undefined || text === null) return;
+    try {
+      const data = JSON.parse(text, revive_typed_arrays) as SerialisedCache;
+      if (data.version !== MeasurementCache.VERSION) return;
+      this.measurements = new Map(data.measurements);
+      this.searches = new Map(data.searches);
+    } catch (error) {
+      console.error(`Failed to load measurement cache: ${String(error)}`);
+    }
+  }
+
+  save() {
+    if (this.storage === undefined) return;
+    const data: SerialisedCache = {
+      version: MeasurementCache.VERSION,
+      measurements: Array.from(this.measurements.entries()),
+      searches: Array.from(this.searches.entries()),
+    };
+    try {
+      this.storage.setItem(MeasurementCache.STORAGE_KEY, JSON.stringify(data, replace_typed_arrays));
+    } catch (error) {
+      // local storage quota is shared with the rest of the app so the oldest half is dropped
+      console.warn(`Failed to save measurement cache, dropping the oldest entries: ${String(error)}`);
+      const total_drop = Math.ceil(this.measurements.size/2);
+      Array.from(this.measurements.keys()).slice(0, total_drop).forEach(key => this.measurements.delete(key));
+      data.measurements = Array.from(this.measurements.entries());
+      try {
+        this.storage.setItem(MeasurementCache.STORAGE_KEY, JSON.stringify(data, replace_typed_arrays));
+      } catch {
+        this.storage.removeItem(MeasurementCache.STORAGE_KEY);
+      }
+    }
+  }
+}
+
+let measurement_cache: MeasurementCache | undefined = undefined;
+
+// shared by every search in this page and loaded from local storage on first use
+export function get_measurement_cache(): MeasurementCache {
+  if (measurement_cache === undefined) {
+    const storage = (typeof localStorage !== "undefined") ? localStorage : undefined;
+    measurement_cache = new MeasurementCache(storage);
+  }
+  return measurement_cache;
+}
@@ -1,26 +1,27 @@
-import { type Parameter, type Stackup } from "./stackup.ts";
-import { create_layout_from_stackup } from "./layout.ts";
-import { type StackupGridConfig, StackupGrid } from "./grid.ts";
+import { type EpsilonParameter, type Parameter, type Stackup } from "./stackup.ts";
+import { type StackupLayout, create_layout_from_stackup } from "./layout.ts";
+import { type StackupGridConfig, type StackupGridSolution, StackupGrid } from "./grid.ts";
 import { type Measurement, perform_measurement } from "./measurement.ts";
+import { get_measurement_cache } from "./measurement_cache.ts";
+import type { SearchWorkerRequest, SearchWorkerResponse } from "./search_worker.ts";
 import { Profiler } from "../../utility/profiler.ts";
 import { ToastManager } from "../../providers/toast/toast.ts";
-import { WasmModule } from "../../wasm/index.ts";
+import { WasmModule, type DirectSolver } from "../../wasm/index.ts";
 
 export interface ParameterSearchConfig {
-  max_steps: number; // number of search steps
+  max_steps: number; // number of search steps, each step measures all parallel candidates
   impedance_tolerance: number; // how much error in search impedance
   search_precision: number; // smallest difference between search points
+  parallel_candidates: number; // number of search points evaluated concurrently per round
 }
 
-function run_parameter_search<T extends { error: number }>(
-  config: ParameterSearchConfig,
-  func: (value: number) => T,
-  v_initial?: number, v_min?: number, v_max?: number,
-): T {
-  const max_steps = config.max_steps;
-  const error_threshold = config.impedance_tolerance;
-  const value_threshold = config.search_precision;
+interface SearchRange {
+  v_initial: number;
+  v_min: number;
+  v_max?: number;
+}
 
+function get_search_range(v_initial?: number, v_min?: number, v_max?: number): SearchRange {
   v_min = v_min ?? 0; // unless specified default search to [0,Infinity)
   if (v_max && v_max < v_min) {
     throw Error(`Maximum search value ${v_max} is less than minimum search value ${v_min}`);
@@ -53,22 +54,47 @@ function run_parameter_search<T extends { error: number }>(
     console.warn(`Initial value was 0 and will be replaced with a non-zero finite value ${v_initial}`);
   }
 
-  let v_lower: number = v_min;
+  return { v_initial, v_min, v_max };
+}
+
+function clamp(value: number, min: number, max: number) {
+  return Math.max(Math.min(value, max), min);
+}
+
+// weighted bisection point for faster convergence of naiive binary search
+function get_weighted_bisection(v_lower: number, v_upper: number, e_lower?: number, e_upper?: number): number {
+  let ratio = 0.5;
+  if (e_lower !== undefined && e_upper !== undefined) {
+    ratio = e_upper/(e_upper-e_lower);
+  }
+  // avoid trusting the weights too much since a bad curve can cause convergence to be extremely slow
+  const ratio_margin = 0.2;
+  ratio = clamp(ratio, ratio_margin, 1-ratio_margin);
+  return v_lower*ratio+v_upper*(1-ratio);
+}
+
+function run_parameter_search<T extends { error: number }>(
+  config: ParameterSearchConfig,
+  func: (value: number) => T,
+  v_initial?: number, v_min?: number, v_max?: number,
+): T {
+  const max_steps = config.max_steps;
+  const error_threshold = config.impedance_tolerance;
+  const value_threshold = config.search_precision;
+
+  const range = get_search_range(v_initial, v_min, v_max);
+  let v_lower: number = range.v_min;
   let e_lower: number | undefined = undefined;
-  let v_upper: number | undefined = v_max;
+  let v_upper: number | undefined = range.v_max;
   let e_upper: number | undefined = undefined;
-  let v_unbounded_search = v_initial; // used if v_upper is unknown
+  let v_unbounded_search = range.v_initial; // used if v_upper is unknown
 
   let best_result: T | undefined = undefined;
 
   // parameter search should include endpoints and initial value
   const v_required_search: number[] = [];
-  if (v_max !== undefined) v_required_search.push(v_max);
-  v_required_search.push(v_min, v_initial);
-
-  function clamp(value: number, min: number, max: number) {
-    return Math.max(Math.min(value, max), min);
-  }
+  if (range.v_max !== undefined) v_required_search.push(range.v_max);
+  v_required_search.push(range.v_min, range.v_initial);
 
   const results = new Map<number, T>();
   let curr_step = 0;
@@ -81,16 +107,9 @@ function run_parameter_search<T extends { error: number }>(
     // phase 2: find upper bound
     } else if (v_upper == undefined) {
       v_search = v_unbounded_search;
-    // phase 3: weighted bisection search for faster convergence of naiive binary search
+    // phase 3: weighted bisection search
     } else {
-      let ratio = 0.5;
-      if (e_lower !== undefined && e_upper !== undefined) {
-        ratio = e_upper/(e_upper-e_lower);
-      }
-      // avoid trusting the weights too much since a bad curve can cause convergence to be extremely slow
-      const ratio_margin = 0.2;
-      ratio = clamp(ratio, ratio_margin, 1-ratio_margin);
-      v_search = v_lower*ratio+v_upper*(1-ratio);
+      v_search = get_weighted_bisection(v_lower, v_upper, e_lower, e_upper);
     }
 
     // exit if search range reaches target resolution while narrowing upper and lower bound
@@ -153,6 +172,137 @@ function run_parameter_search<T extends { error: number }>(
   return best_result;
 }
 
+// k-section of the bracket with the closest point replaced by the weighted bisection
+function get_batched_search_points(
+  total_points: number,
+  v_lower: number, v_upper: number,
+  e_lower?: number, e_upper?: number,
+): number[] {
+  const v_weighted = get_weighted_bisection(v_lower, v_upper, e_lower, e_upper);
+  if (total_points <= 1) return [v_weighted];
+  const points: number[] = [];
+  for (let i = 0; i < total_points; i++) {
+    points.push(v_lower+(v_upper-v_lower)*(i+1)/(total_points+1));
+  }
+  let closest_index = 0;
+  for (let i = 1; i < total_points; i++) {
+    if (Math.abs(points[i]-v_weighted) < Math.abs(points[closest_index]-v_weighted)) {
+      closest_index = i;
+    }
+  }
+  points[closest_index] = v_weighted;
+  return points;
+}
+
+// Evaluates up to parallel_candidates search points per step so each step can be run concurrently
+// - phase 1: endpoints and initial value
+// - phase 2: parallel bracket expansion with doubling values to find the upper bound
+// - phase 3: k-section of the bracket with one point replaced by the weighted bisection
+async function run_batched_parameter_search<T extends { error: number }>(
+  config: ParameterSearchConfig,
+  func: (values: number[]) => Promise<T[]>,
+  v_initial?: number, v_min?: number, v_max?: number,
+): Promise<T> {
+  const max_steps = config.max_steps;
+  const error_threshold = config.impedance_tolerance;
+  const value_threshold = config.search_precision;
+  const total_candidates = Math.max(Math.floor(config.parallel_candidates), 1);
+
+  const range = get_search_range(v_initial, v_min, v_max);
+  let v_lower: number = range.v_min;
+  let e_lower: number | undefined = undefined;
+  let v_upper: number | undefined = range.v_max;
+  let e_upper: number | undefined = undefined;
+  let v_unbounded_search = range.v_initial; // used if v_upper is unknown
+
+  let best_result: T | undefined = undefined;
+
+  const v_required_search: number[] = [range.v_initial, range.v_min];
+  if (range.v_max !== undefined) v_required_search.push(range.v_max);
+
+  const results = new Map<number, T>();
+  let curr_step = 0;
+  while (curr_step < max_steps) {
+    const v_candidates = new Set<number>();
+    const add_candidate = (value: number) => {
+      if (v_candidates.size < total_candidates && !results.has(value)) {
+        v_candidates.add(value);
+      }
+    };
+
+    // phase 1: endpoints and initial value
+    const is_required = v_required_search.length > 0;
+    while (v_required_search.length > 0 && v_candidates.size < total_candidates) {
+      add_candidate(v_required_search.shift()!);
+    }
+    // phase 2: find upper bound
+    if (v_upper === undefined) {
+      while (v_candidates.size < total_candidates) {
+        add_candidate(v_unbounded_search);
+        v_unbounded_search *= 2;
+      }
+    // phase 3: k-section search
+    } else {
+      // exit if search range reaches target resolution while narrowing upper and lower bound
+      if (!is_required && (Math.abs(v_upper-v_lower) < value_threshold)) {
+        break;
+      }
+      const total_points = total_candidates-v_candidates.size;
+      if (total_points > 0) {
+        const points = get_batched_search_points(total_points, v_lower, v_upper, e_lower, e_upper);
+        points.forEach(add_candidate);
+      }
+    }
+
+    if (v_candidates.size == 0) {
+      console.warn("Exiting parameter search early due to no new search values");
+      break;
+    }
+
+    const v_search = Array.from(v_candidates);
+    const round_results = await func(v_search);
+    curr_step += 1;
+
+    let is_search_narrowed = false;
+    for (let i = 0; i < v_search.length; i++) {
+      const value = v_search[i];
+      const result = round_results[i];
+      results.set(value, result);
+      if (best_result === undefined || (Math.abs(result.error) < Math.abs(best_result.error))) {
+        best_result = result;
+      }
+      // narrow upper bound
+      if (result.error > 0) {
+        if (v_upper === undefined || e_upper === undefined || value < v_upper) {
+          v_upper = value;
+          e_upper = result.error;
+          is_search_narrowed = true;
+        }
+      }
+      // narrow lower bound
+      if (result.error < 0) {
+        if (e_lower === undefined || value > v_lower) {
+          v_lower = value;
+          e_lower = result.error;
+          is_search_narrowed = true;
+        }
+      }
+    }
+
+    if (best_result !== undefined && Math.abs(best_result.error) < error_threshold) break;
+    // search range did not narrow
+    if (!is_required && v_upper !== undefined && !is_search_narrowed) {
+      console.warn("Exiting parameter search early due to search range not being narrowed");
+      break;
+    }
+  }
+
+  if (best_result === undefined) {
+    throw Error("Failed to find any best result");
+  }
+  return best_result;
+}
+
 
 export class SearchResult {
   value: number;
@@ -201,7 +351,177 @@ export class SearchResults {
   }
 }
 
-export function search_parameters(
+// structured clone cannot copy functions such as viewer callbacks so they are dropped
+// while keeping shared references intact
+function clone_without_functions<T>(value: T, cloned: Map<object, unknown>): T {
+  if (typeof value !== "object" || value === null) return value;
+  const existing = cloned.get(value);
+  if (existing !== undefined) return existing as T;
+  if (Array.isArray(value)) {
+    const array: unknown[] = [];
+    cloned.set(value, array);
+    for (const element of value) {
+      array.push(typeof element === "function" ? undefined : clone_without_functions(element, cloned));
+    }
+    return array as T;
+  }
+  const object: Record<string, unknown> = {};
+  cloned.set(value, object);
+  for (const [key, element] of Object.entries(value)) {
+    if (typeof element === "function") continue;
+    object[key] = clone_without_functions(element, cloned);
+  }
+  return object as T;
+}
+
+type SearchWorkerJob = Omit<SearchWorkerRequest, "id">;
+
+// copy fields since the config can be a class with accessors that structured clone and JSON drop
+function copy_stackup_grid_config(stackup_config: StackupGridConfig): StackupGridConfig {
+  return {
+    minimum_grid_resolution: stackup_config.minimum_grid_resolution,
+    padding_size_multiplier: stackup_config.padding_size_multiplier,
+    max_x_ratio: stackup_config.max_x_ratio,
+    min_x_subdivisions: stackup_config.min_x_subdivisions,
+    max_y_ratio: stackup_config.max_y_ratio,
+    min_y_subdivisions: stackup_config.min_y_subdivisions,
+    min_epsilon_resolution: stackup_config.min_epsilon_resolution,
+    signal_amplitude: stackup_config.signal_amplitude,
+    max_refinement_steps: stackup_config.max_refinement_steps,
+    refinement_tolerance: stackup_config.refinement_tolerance,
+    solver_mode: stackup_config.solver_mode,
+  };
+}
+
+const PARAMETER_TYPES = new Set(["size", "etch_factor", "epsilon"]);
+
+// Key of every search over this stackup and mesh config with the same searched parameters
+// - Searched parameters are replaced with a placeholder so that samples at any value share the key
+// - Only the fields of other parameters that change the layout are kept so validation errors are ignored
+// - Returns undefined if the stackup cannot be serialised so the search runs without seeding
+function get_search_cache_key(
+  stackup: Stackup, params: Parameter[], stackup_config: StackupGridConfig,
+): string | undefined {
+  const searched = new Set<unknown>(params);
+  try {
+    const stackup_key = JSON.stringify(stackup, (_key: string, value: unknown) => {
+      if (searched.has(value)) return "*";
+      if (typeof value === "object" && value !== null && "type" in value && PARAMETER_TYPES.has(value.type as string)) {
+        const param = value as Parameter;
+        return [param.type, param.value, "unit" in param ? param.unit : null, "placeholder_value" in param ? param.placeholder_value : null];
+      }
+      return value;
+    });
+    return `${stackup_key}:${JSON.stringify(copy_stackup_grid_config(stackup_config))}`;
+  } catch (error) {
+    console.warn(`Failed to create search cache key: ${String(error)}`);
+    return undefined;
+  }
+}
+
+// Key of a candidate measurement from the search key and searched value so no grid is needed to look it up
+function get_candidate_cache_key(search_key: string, value: number): string {
+  return `${search_key}=${value}`;
+}
+
+function create_search_worker_job(
+  layout: StackupLayout,
+  get_parameter: (param: Parameter) => number,
+  stackup_config: StackupGridConfig,
+): SearchWorkerJob {
+  const cloned = new Map<object, unknown>();
+  const cloned_layout = clone_without_functions(layout, cloned);
+  // workers cannot call get_parameter(...) so epsilon values are resolved ahead of time
+  const epsilons = new Map<EpsilonParameter, number>();
+  for (const layer_layout of layout.layers) {
+    const layer = layer_layout.parent;
+    if (!("epsilon" in layer)) continue;
+    const param = cloned.get(layer.epsilon) as EpsilonParameter;
+    epsilons.set(param, get_parameter(layer.epsilon));
+  }
+  return {
+    layout: cloned_layout,
+    epsilons,
+    stackup_config: copy_stackup_grid_config(stackup_config),
+  };
+}
+
+type SearchWorkerResult = Omit<Extract<SearchWorkerResponse, { type: "measurement" }>, "id" | "type">;
+
+// Pool of workers that each own a wasm module instance for measuring search candidates in parallel
+class SearchWorkerPool {
+  workers: Worker[];
+  pending = new Map<number, { resolve: (result: SearchWorkerResult) => void, reject: (error: Error) => void }>();
+  next_id: number = 0;
+
+  constructor(total_workers: number) {
+    this.workers = [];
+    for (let i = 0; i < total_workers; i++) {
+      const worker = new Worker(new URL("./search_worker.ts", import.meta.url), { type: "module" });
+      worker.onmessage = (event: MessageEvent<SearchWorkerResponse>) => this.on_response(event.data);
+      worker.onerror = (event: ErrorEvent) => this.on_error(Error(`Search worker failed with: ${event.message}`));
+      this.workers.push(worker);
+    }
+  }
+
+  get total_workers(): number {
+    return this.workers.length;
+  }
+
+  measure(jobs: SearchWorkerJob[]): Promise<SearchWorkerResult[]> {
+    return Promise.all(jobs.map((job, index) => new Promise<SearchWorkerResult>((resolve, reject) => {
+      const id = this.next_id++;
+      this.pending.set(id, { resolve, reject });
+      const request: SearchWorkerRequest = { id, ...job };
+      this.workers[index % this.workers.length].postMessage(request);
+    })));
+  }
+
+  on_response(response: SearchWorkerResponse) {
+    const pending = this.pending.get(response.id);
+    if (pending === undefined) return;
+    this.pending.delete(response.id);
+    if (response.type == "measurement") {
+      const { measurement, cache_key, solution } = response;
+      pending.resolve({ measurement, cache_key, solution });
+    } else {
+      pending.reject(Error(response.error));
+    }
+  }
+
+  on_error(error: Error) {
+    // worker state is unknown after an uncaught error so the pool is discarded
+    if (search_worker_pool === this) {
+      search_worker_pool = undefined;
+    }
+    this.terminate(error);
+  }
+
+  terminate(error?: Error) {
+    for (const worker of this.workers) {
+      worker.terminate();
+    }
+    this.workers = [];
+    for (const pending of this.pending.values()) {
+      pending.reject(error ?? Error("Search worker pool was terminated"));
+    }
+    this.pending.clear();
+  }
+}
+
+// workers are kept alive between searches to avoid reinitialising their wasm modules
+let search_worker_pool: SearchWorkerPool | undefined = undefined;
+
+function get_search_worker_pool(total_candidates: number): SearchWorkerPool {
+  const total_workers = Math.max(Math.min(total_candidates, navigator.hardwareConcurrency ?? total_candidates), 1);
+  if (search_worker_pool === undefined || search_worker_pool.total_workers != total_workers) {
+    search_worker_pool?.terminate();
+    search_worker_pool = new SearchWorkerPool(total_workers);
+  }
+  return search_worker_pool;
+}
+
+export async function search_parameters(
   module: WasmModule,
   target_impedance: number,
   stackup: Stackup, params: Parameter[],
@@ -210,7 +530,7 @@ export function search_parameters(
   search_config: ParameterSearchConfig,
   profiler: Profiler,
   toast: ToastManager,
-): SearchResults {
+): Promise<SearchResults> {
   if (params.length <= 0) {
     throw Error("Got 0 parameters in parametric search");
   }
@@ -232,9 +552,58 @@ export function search_parameters(
     .filter(name => name !== undefined)
     .join(",");
 
+  // measurements are shared between searches and persisted so that repeated searches skip most solves
+  const cache = get_measurement_cache();
+  const search_key = get_search_cache_key(stackup, params, stackup_config);
+  const initial_cache_hits = cache.total_hits;
+  const initial_cache_misses = cache.total_misses;
+
   const results: SearchResult[] = [];
   let best_result: SearchResult | undefined = undefined;
   let best_stackup_grid: StackupGrid | undefined = undefined;
+  // solution of the best candidate measured in a search worker which is loaded into best_stackup_grid
+  let best_solution: StackupGridSolution | undefined = undefined;
+  // Direct solver from a discarded grid which can be refactorised if the next grid has the same mesh shape
+  let reuse_direct_solver: DirectSolver | undefined = undefined;
+
+  const discard_stackup_grid = (stackup_grid?: StackupGrid) => {
+    if (stackup_grid === undefined) return;
+    const direct_solver = stackup_grid.grid.take_direct_solver();
+    if (direct_solver !== undefined) {
+      reuse_direct_solver?.delete();
+      reuse_direct_solver = direct_solver;
+    }
+    stackup_grid.delete(); // avoid leaking memory
+  };
+
+  const create_search_result = (
+    value: number, measurement: Measurement,
+    metadata: Partial<Record<string, string>>,
+  ): SearchResult => {
+    const actual_impedance = measurement.type == "single" ? measurement.masked.Z0 : measurement.odd_masked.Z0;
+    const error_impedance = target_impedance-actual_impedance;
+    const error = impedance_correlation == "positive" ? -error_impedance : error_impedance;
+    if (search_key !== undefined) {
+      cache.add_search_sample(search_key, { value, impedance: actual_impedance });
+    }
+
+    metadata.name = parameter_label;
+    metadata.value = `${value.toPrecision(3)}`;
+    metadata.target_impedance = `${target_impedance.toPrecision(3)}`;
+    metadata.actual_impedance = `${actual_impedance.toPrecision(3)}`;
+    metadata.error_impedance = `${error_impedance.toPrecision(3)}`;
+    metadata.error = `${error.toPrecision(3)}`;
+
+    const result = new SearchResult(
+      value,
+      actual_impedance,
+      results.length,
+      error,
+      measurement,
+    );
+    results.push(result);
+    return result;
+  };
 
   const search_function = (value: number): SearchResult => {
     for (const param of params) {
@@ -253,48 +622,126 @@ export function search_parameters(
 
     profiler.begin("create_grid", "Create simulation grid from layout");
     const stackup_grid = new StackupGrid(module, layout, get_parameter, profiler, stackup_config);
+    const cache_key = stackup_grid.get_measurement_cache_key();
     profiler.end();
 
-    profiler.begin("run", "Perform impedance measurements", {
-      "Total Columns": `${stackup_grid.grid.width}`,
-      "Total Rows": `${stackup_grid.grid.height}`,
-      "Total Cells": `${stackup_grid.grid.width*stackup_grid.grid.height}`,
-    });
-    const measurement = perform_measurement(stackup_grid, profiler);
-    profiler.end();
+    let measurement = cache.get_measurement(cache_key);
+    const is_cached = measurement !== undefined;
+    metadata.cache = is_cached ? "hit" : "miss";
+    if (measurement === undefined) {
+      profiler.begin("run", "Perform impedance measurements", {
+        "Total Columns": `${stackup_grid.grid.width}`,
+        "Total Rows": `${stackup_grid.grid.height}`,
+        "Total Cells": `${stackup_grid.grid.width*stackup_grid.grid.height}`,
+      });
+      measurement = perform_measurement(stackup_grid, profiler, reuse_direct_solver);
+      reuse_direct_solver = undefined;
+      profiler.end();
+      cache.set_measurement(cache_key, measurement);
+    }
 
     profiler.end();
 
-    const actual_impedance = measurement.type == "single" ? measurement.masked.Z0 : measurement.odd_masked.Z0;
-    const error_impedance = target_impedance-actual_impedance;
-    const error = impedance_correlation == "positive" ? -error_impedance : error_impedance;
-
-    metadata.name = parameter_label;
-    metadata.value = `${value.toPrecision(3)}`;
-    metadata.target_impedance = `${target_impedance.toPrecision(3)}`;
-    metadata.actual_impedance = `${actual_impedance.toPrecision(3)}`;
-    metadata.error_impedance = `${error_impedance.toPrecision(3)}`;
-    metadata.error = `${error.toPrecision(3)}`;
-
-    const result = new SearchResult(
-      value,
-      actual_impedance,
-      curr_iter,
-      error,
-      measurement,
-    );
-
-    results.push(result);
+    // grids of cached measurements are never solved so the best grid is recreated after the search
+    const solved_stackup_grid = is_cached ? undefined : stackup_grid;
+    if (is_cached) stackup_grid.delete();
+    const result = create_search_result(value, measurement, metadata);
     if (best_result === undefined || Math.abs(result.error) < Math.abs(best_result.error)) {
       best_result = result;
-      best_stackup_grid?.delete(); // avoid leaking memory
-      best_stackup_grid = stackup_grid;
+      discard_stackup_grid(best_stackup_grid);
+      best_stackup_grid = solved_stackup_grid;
     } else {
-      stackup_grid.delete(); // avoid leaking memory
+      discard_stackup_grid(solved_stackup_grid);
     }
     return result;
   };
 
+  // candidates are measured in workers and the best grid is rebuilt from its solution afterwards for the viewer
+  // NOTE: cache is looked up by the searched value since meshing a grid on this thread for its key is expensive
+  //       and worker measurements are also stored under their grid key for searches which aren't batched
+  const search_function_batched = async (values: number[]): Promise<SearchResult[]> => {
+    const worker_pool = get_search_worker_pool(values.length);
+    const jobs: SearchWorkerJob[] = [];
+    const job_cache_keys: (string | undefined)[] = [];
+    const measurements: (Measurement | undefined)[] = [];
+    const solutions: (StackupGridSolution | undefined)[] = [];
+    const metadatas: Partial<Record<string, string>>[] = [];
+    for (const value of values) {
+      for (const param of params) {
+        param.value = value;
+      }
+
+      const curr_iter = results.length+metadatas.length;
+      const metadata: Partial<Record<string, string>> = {
+        iteration: `${curr_iter}`,
+      };
+      profiler.begin(`search_${curr_iter}`, undefined, metadata);
+      profiler.begin("create_layout", "Create layout from transmission line stackup");
+      const layout = create_layout_from_stackup(stackup, get_parameter, profiler);
+      profiler.end();
+
+      const cache_key = (search_key !== undefined) ? get_candidate_cache_key(search_key, value) : undefined;
+      const measurement = (cache_key !== undefined) ? cache.get_measurement(cache_key) : undefined;
+      metadata.cache = measurement !== undefined ? "hit" : "miss";
+      if (measurement === undefined) {
+        jobs.push(create_search_worker_job(layout, get_parameter, stackup_config));
+        job_cache_keys.push(cache_key);
+      }
+      measurements.push(measurement);
+      solutions.push(undefined);
+      metadatas.push(metadata);
+      profiler.end();
+    }
+
+    if (jobs.length > 0) {
+      profiler.begin("run", "Perform impedance measurements in search workers", {
+        "Total Candidates": `${jobs.length}`,
+        "Total Workers": `${worker_pool.total_workers}`,
+      });
+      const job_results = await worker_pool.measure(jobs);
+      profiler.end();
+      let job_index = 0;
+      for (let i = 0; i < measurements.length; i++) {
+        if (measurements[i] !== undefined) continue;
+        const { measurement, cache_key, solution } = job_results[job_index];
+        const candidate_cache_key = job_cache_keys[job_index];
+        measurements[i] = measurement;
+        solutions[i] = solution;
+        if (candidate_cache_key !== undefined) cache.set_measurement(candidate_cache_key, measurement);
+        cache.set_measurement(cache_key, measurement);
+        job_index++;
+      }
+    }
+
+    return values.map((value, index) => {
+      const result = create_search_result(value, measurements[index]!, metadatas[index]);
+      if (best_result === undefined || Math.abs(result.error) < Math.abs(best_result.error)) {
+        best_result = result;
+        best_solution = solutions[index];
+      }
+      return result;
+    });
+  };
+
+  // grid of the best result is only solved again if its measurement came from the cache
+  const create_best_stackup_grid = () => {
+    if (best_result === undefined) return;
+    for (const param of params) {
+      param.value = best_result.value;
+    }
+    profiler.begin("create_best_grid", "Recreate simulation grid for best search result");
+    const layout = create_layout_from_stackup(stackup, get_parameter, profiler);
+    best_stackup_grid = new StackupGrid(module, layout, get_parameter, profiler, stackup_config);
+    if (best_solution !== undefined) {
+      profiler.begin("load_solution", "Load solution of best search result from search worker");
+      best_stackup_grid.load_solution(best_solution);
+      profiler.end();
+    } else {
+      best_result.measurement = perform_measurement(best_stackup_grid, profiler);
+    }
+    profiler.end();
+  };
+
   // get search range that satisfies all parameters constraints
   let min_value: number | undefined = undefined;
   let max_value: number | undefined = undefined;
@@ -307,20 +754,50 @@ export function search_parameters(
     }
   }
 
-  profiler.begin("run_binary_search");
-  const initial_value = ref_param.value;
+  // start from the closest cached samples either side of the target if this stackup was searched before
+  let initial_value = ref_param.value;
+  const search_metadata: Partial<Record<string, string>> = {};
+  const bracket = (search_key !== undefined) ?
+    cache.get_search_bracket(search_key, target_impedance, impedance_correlation, min_value, max_value) :
+    undefined;
+  if (bracket !== undefined) {
+    initial_value = bracket.v_initial;
+    min_value = bracket.v_min;
+    max_value = bracket.v_max;
+    search_metadata.seeded_range = `[${bracket.v_min.toPrecision(3)},${bracket.v_max.toPrecision(3)}]`;
+  }
+
+  profiler.begin("run_binary_search", undefined, search_metadata);
+  const is_batched = search_config.parallel_candidates > 1 && typeof Worker !== "undefined";
   try {
-    run_parameter_search(
-      search_config,
-      search_function,
-      initial_value,
-      min_value, max_value,
-    );
+    if (is_batched) {
+      await run_batched_parameter_search(
+        search_config,
+        search_function_batched,
+        initial_value,
+        min_value, max_value,
+      );
+    } else {
+      run_parameter_search(
+        search_config,
+        search_function,
+        initial_value,
+        min_value, max_value,
+      );
+    }
   } catch (error) {
     const curr_iter = results.length;
     toast.warning(`Search function failed early at step ${curr_iter+1} with: ${String(error)}`);
   }
   profiler.end();
+  reuse_direct_solver?.delete();
+  search_metadata.cache_hits = `${cache.total_hits-initial_cache_hits}`;
+  search_metadata.cache_misses = `${cache.total_misses-initial_cache_misses}`;
+  cache.save();
+
+  if (best_stackup_grid === undefined) {
+    create_best_stackup_grid();
+  }
 
   if (best_result === undefined || best_stackup_grid === undefined) {
     throw Error("Parameter search failed to generate any results");
@@ -0,0 +1,63 @@
+import { type EpsilonParameter } from "./stackup.ts";
+import { type StackupLayout } from "./layout.ts";
+import { type StackupGridConfig, type StackupGridSolution, StackupGrid } from "./grid.ts";
+import { type Measurement, perform_measurement } from "./measurement.ts";
+import { WasmModule, type DirectSolver } from "../../wasm/index.ts";
+
+// Worker that owns its own wasm module so search candidates can be measured in parallel
+// NOTE: Layout and epsilon map are sent in the same message so structured clone keeps
+//       the epsilon parameter keys identical to the ones referenced by the layout
+export interface SearchWorkerRequest {
+  id: number;
+  layout: StackupLayout;
+  epsilons: Map<EpsilonParameter, number>;
+  stackup_config: StackupGridConfig;
+}
+
+// The solution is sent back so the best candidate can be displayed without solving it again on the main thread
+export type SearchWorkerResponse =
+  { id: number, type: "measurement", measurement: Measurement, cache_key: string, solution: StackupGridSolution } |
+  { id: number, type: "error", error: string };
+
+// NOTE: candidates are already spread across one worker per core so a threaded module would oversubscribe
+const module_promise = WasmModule.init({ allow_threads: false });
+// Direct solver from the previous candidate which can be refactorised if the next grid has the same mesh shape
+let reuse_direct_solver: DirectSolver | undefined = undefined;
+
+async function on_request(request: SearchWorkerRequest): Promise<SearchWorkerResponse> {
+  const { id, layout, epsilons, stackup_config } = request;
+  try {
+    const module = await module_promise;
+    const get_epsilon = (param: EpsilonParameter): number => {
+      const value = epsilons.get(param);
+      if (value === undefined) {
+        throw Error(`Missing epsilon value for parameter ${param.name ?? "unnamed"}`);
+      }
+      return value;
+    };
+    const stackup_grid = new StackupGrid(module, layout, get_epsilon, undefined, stackup_config);
+    try {
+      // NOTE: key is of the unrefined grid so it has to be taken before the measurement refines it
+      const cache_key = stackup_grid.get_measurement_cache_key();
+      // perform_measurement(...) consumes the solver even if it throws
+      const direct_solver = reuse_direct_solver;
+      reuse_direct_solver = undefined;
+      const measurement = perform_measurement(stackup_grid, undefined, direct_solver);
+      reuse_direct_solver = stackup_grid.grid.take_direct_solver();
+      const solution = stackup_grid.export_solution();
+      return { id, type: "measurement", measurement, cache_key, solution };
+    } finally {
+      stackup_grid.delete();
+    }
+  } catch (error) {
+    reuse_direct_solver?.delete();
+    reuse_direct_solver = undefined;
+    return { id, type: "error", error: String(error) };
+  }
+}
+
+self.onmessage = async (event: MessageEvent<SearchWorkerRequest>) => {
+  const response = await on_request(event.data);
+  const transfer = (response.type == "measurement") ? [response.solution.v_field.buffer] : [];
+  self.postMessage(response, { transfer });
+};
@@ -6,7 +6,17 @@ import {
   type Uint32PinnedArray, type Int32PinnedArray,
   type Float32PinnedArray, type Float64PinnedArray,
   type LU_Solver as _LU_Solver,
+  type Cholesky_Solver as _Cholesky_Solver,
+  type Mirror_Solver as _Mirror_Solver,
+  type Iterative_Solver as _Iterative_Solver,
+  type Multigrid_Solver as _Multigrid_Solver,
   type ZipFile as _ZipFile,
+  type ZipStream as _ZipStream,
+  type FDTD_3D_Engine as _FDTD_3D_Engine,
+  type Pinned_Pool_Stats,
+  type LU_Solver_Stats,
+  type Cholesky_Solver_Stats,
+  type Kernel_Timing,
 } from "./build/wasm_module.js";
 
 export {
@@ -14,8 +24,34 @@ export {
   type Uint16PinnedArray, type Int16PinnedArray,
   type Uint32PinnedArray, type Int32PinnedArray,
   type Float32PinnedArray, type Float64PinnedArray,
+  type Pinned_Pool_Stats,
+  type LU_Solver_Stats,
+  type Cholesky_Solver_Stats,
+  type Kernel_Timing,
 } from "./build/wasm_module.js";
 
+// NOTE: The pthreads build is optional so glob it instead of importing it directly,
+//       this resolves to an empty map if it wasn't built and the single threaded build is used instead
+const threaded_module_loaders = import.meta.glob<{ default: typeof init_module }>("./build/wasm_module_threads.js");
+
+export interface WasmModuleOptions {
+  // load the pthreads build if the page is cross origin isolated (SharedArrayBuffer is available)
+  allow_threads?: boolean;
+}
+
+async function load_module_factory(allow_threads: boolean): Promise<{ factory: typeof init_module, is_threaded: boolean }> {
+  const threaded_loader = Object.values(threaded_module_loaders)[0];
+  if (allow_threads && globalThis.crossOriginIsolated && threaded_loader !== undefined) {
+    try {
+      const threaded_module = await threaded_loader();
+      return { factory: threaded_module.default, is_threaded: true };
+    } catch (error) {
+      console.warn("Failed to load threaded wasm module, falling back to single threaded build: ", error);
+    }
+  }
+  return { factory: init_module, is_threaded: false };
+}
+
 export interface ReferenceCount {
   count: number;
 }
@@ -67,6 +103,7 @@ interface FinalizationEntry {
 // Wrap around the emscripten typescript bindings with something less jank
 export class WasmModule {
   main: MainModule;
+  readonly is_threaded: boolean;
   heap_objects = {
     stack_trace: new WeakMap<ManagedObject, StackTrace>(),
     weak_refs: new WeakMap<ManagedObject, FinalizationEntry>(),
@@ -75,14 +112,17 @@ export class WasmModule {
   finalisation_registry: FinalizationRegistry<FinalizationEntry>;
   debug_console?: Console = import.meta.env.DEV ? console : undefined;
 
-  private constructor(main: MainModule) {
+  private constructor(main: MainModule, is_threaded: boolean) {
     this.main = main;
+    this.is_threaded = is_threaded;
     this.finalisation_registry = this.create_finalization_registry();
   }
 
-  static async init(): Promise<WasmModule> {
-    const module = await init_module();
-    return new WasmModule(module);
+  static async init(options?: WasmModuleOptions): Promise<WasmModule> {
+    const allow_threads = options?.allow_threads ?? true;
+    const { factory, is_threaded } = await load_module_factory(allow_threads);
+    const module = await factory();
+    return new WasmModule(module, is_threaded);
   }
 
   // module memory management
@@ -240,11 +280,390 @@ export class WasmModule {
     );
   }
 
+  // Fused calculate_e_field() with both energy integrals which never writes out the electric field
+  calculate_energy_2d(
+    v_field: Float32ModuleBuffer,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    er_table: Float32ModuleBuffer, er_index_beta: Uint32ModuleBuffer,
+  ): { homogenous: number, inhomogenous: number } {
+    this.assert_owned(v_field);
+    this.assert_owned(dx);
+    this.assert_owned(dy);
+    this.assert_owned(er_table);
+    this.assert_owned(er_index_beta);
+
+    return this.main.calculate_energy_2d(
+      v_field.pin,
+      dx.pin, dy.pin,
+      er_table.pin, er_index_beta.pin,
+    );
+  }
+
+  // Per cell error indicator of the energy integral with shape [Ny,Nx] used for adaptive mesh refinement
+  calculate_energy_error_2d(
+    error_out: Float32ModuleBuffer,
+    v_field: Float32ModuleBuffer,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    er_table: Float32ModuleBuffer, er_index_beta: Uint32ModuleBuffer,
+  ): void {
+    this.assert_owned(error_out);
+    this.assert_owned(v_field);
+    this.assert_owned(dx);
+    this.assert_owned(dy);
+    this.assert_owned(er_table);
+    this.assert_owned(er_index_beta);
+
+    const Nx = dx.length;
+    const Ny = dy.length;
+    if (error_out.length !== Ny*Nx) {
+      throw Error(`Expected error to have ${Ny}x${Nx} elements but got ${error_out.length}`);
+    }
+    if (v_field.length !== (Ny+1)*(Nx+1)) {
+      throw Error(`Expected voltage field to have ${Ny+1}x${Nx+1} elements but got ${v_field.length}`);
+    }
+    if (er_index_beta.length !== Ny*Nx) {
+      throw Error(`Expected er_index_beta to have ${Ny}x${Nx} elements but got ${er_index_beta.length}`);
+    }
+    return this.main.calculate_energy_error_2d(
+      error_out.pin,
+      v_field.pin,
+      dx.pin, dy.pin,
+      er_table.pin, er_index_beta.pin,
+    );
+  }
+
+  // Cross energies between k voltage fields with shape [k,Ny+1,Nx+1] written to [k,k] matrices
+  calculate_energy_matrix_2d(
+    homogenous_out: Float32ModuleBuffer, inhomogenous_out: Float32ModuleBuffer,
+    v_fields: Float32ModuleBuffer,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    er_table: Float32ModuleBuffer, er_index_beta: Uint32ModuleBuffer,
+  ): void {
+    this.assert_owned(homogenous_out);
+    this.assert_owned(inhomogenous_out);
+    this.assert_owned(v_fields);
+    this.assert_owned(dx);
+    this.assert_owned(dy);
+    this.assert_owned(er_table);
+    this.assert_owned(er_index_beta);
+
+    const total_voltages = (dx.length+1)*(dy.length+1);
+    const total_fields = v_fields.length / total_voltages;
+    if (!Number.isInteger(total_fields)) {
+      throw Error(`Expected voltage fields to be a multiple of ${total_voltages} elements but got ${v_fields.length}`);
+    }
+    const total_matrix = total_fields*total_fields;
+    if (homogenous_out.length !== total_matrix || inhomogenous_out.length !== total_matrix) {
+      throw Error(`Expected energy matrices to have ${total_fields}x${total_fields} elements`);
+    }
+    return this.main.calculate_energy_matrix_2d(
+      homogenous_out.pin, inhomogenous_out.pin,
+      v_fields.pin,
+      dx.pin, dy.pin,
+      er_table.pin, er_index_beta.pin,
+    );
+  }
+
+  // Cross energies between k voltage fields with the inhomogenous part split per dielectric index into [table_length,k,k]
+  // For any er_table of that length the inhomogenous matrix is sum_m er_table[m]*partial_out[m]
+  // Returns 0 on success or ENERGY_INVALID_INDEX (-1) if er_index_beta references an index outside of the table
+  calculate_partial_energy_matrix_2d(
+    homogenous_out: Float32ModuleBuffer, partial_out: Float32ModuleBuffer,
+    v_fields: Float32ModuleBuffer,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    er_index_beta: Uint32ModuleBuffer,
+  ): number {
+    this.assert_owned(homogenous_out);
+    this.assert_owned(partial_out);
+    this.assert_owned(v_fields);
+    this.assert_owned(dx);
+    this.assert_owned(dy);
+    this.assert_owned(er_index_beta);
+
+    const total_voltages = (dx.length+1)*(dy.length+1);
+    const total_fields = v_fields.length / total_voltages;
+    if (!Number.isInteger(total_fields)) {
+      throw Error(`Expected voltage fields to be a multiple of ${total_voltages} elements but got ${v_fields.length}`);
+    }
+    const total_matrix = total_fields*total_fields;
+    if (homogenous_out.length !== total_matrix) {
+      throw Error(`Expected homogenous energy matrix to have ${total_fields}x${total_fields} elements`);
+    }
+    if (total_matrix === 0 || partial_out.length % total_matrix !== 0) {
+      throw Error(`Expected partial energy matrices to be a multiple of ${total_fields}x${total_fields} elements`);
+    }
+    if (er_index_beta.length !== dx.length*dy.length) {
+      throw Error(`Expected dielectric index to have ${dx.length*dy.length} elements but got ${er_index_beta.length}`);
+    }
+    return this.main.calculate_partial_energy_matrix_2d(
+      homogenous_out.pin, partial_out.pin,
+      v_fields.pin,
+      dx.pin, dy.pin,
+      er_index_beta.pin,
+    );
+  }
+
+  // Maxwell capacitance with and without dielectric and inductance from cross energies of unit voltage fields
+  // Returns 0 on success or CONDUCTOR_MATRIX_NOT_POSITIVE_DEFINITE (-1)
+  calculate_conductor_matrices(
+    Ch_out: Float64ModuleBuffer, Cih_out: Float64ModuleBuffer, Lh_out: Float64ModuleBuffer,
+    energy_homogenous: Float32ModuleBuffer, energy_inhomogenous: Float32ModuleBuffer,
+  ): number {
+    this.assert_owned(Ch_out);
+    this.assert_owned(Cih_out);
+    this.assert_owned(Lh_out);
+    this.assert_owned(energy_homogenous);
+    this.assert_owned(energy_inhomogenous);
+
+    const total_matrix = energy_homogenous.length;
+    if (
+      energy_inhomogenous.length !== total_matrix ||
+      Ch_out.length !== total_matrix || Cih_out.length !== total_matrix || Lh_out.length !== total_matrix
+    ) {
+      throw Error(`Expected all conductor matrices to have ${total_matrix} elements`);
+    }
+    return this.main.calculate_conductor_matrices(
+      Ch_out.pin, Cih_out.pin, Lh_out.pin,
+      energy_homogenous.pin, energy_inhomogenous.pin,
+    );
+  }
+
+  // Propagation modes of N conductors sorted from fastest to slowest with unit length mode vectors as rows of [N,N]
+  calculate_modal_impedances(
+    Z0_out: Float64ModuleBuffer, velocity_out: Float64ModuleBuffer, vectors_out: Float64ModuleBuffer,
+    Lh: Float64ModuleBuffer, Cih: Float64ModuleBuffer,
+  ): number {
+    this.assert_owned(Z0_out);
+    this.assert_owned(velocity_out);
+    this.assert_owned(vectors_out);
+    this.assert_owned(Lh);
+    this.assert_owned(Cih);
+
+    const N = Z0_out.length;
+    if (velocity_out.length !== N || vectors_out.length !== N*N || Lh.length !== N*N || Cih.length !== N*N) {
+      throw Error(`Expected modal outputs and matrices for ${N} conductors`);
+    }
+    return this.main.calculate_modal_impedances(
+      Z0_out.pin, velocity_out.pin, vectors_out.pin,
+      Lh.pin, Cih.pin,
+    );
+  }
+
+  // Solves every conductor at unit voltage in one batched pass over the LU factors then forms the matrices
+  // Returns the LU solve info or calculate_conductor_matrices(...) error code
+  // Returns LAPLACE_INVALID_INDEX (-2) if a conductor index is negative
+  extract_conductor_matrices(
+    Ch_out: Float64ModuleBuffer, Cih_out: Float64ModuleBuffer, Lh_out: Float64ModuleBuffer,
+    v_fields_out: Float32ModuleBuffer,
+    solver: LU_Solver, conductor_indices: Int32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    er_table: Float32ModuleBuffer, er_index_beta: Uint32ModuleBuffer,
+  ): number {
+    this.assert_owned(Ch_out);
+    this.assert_owned(Cih_out);
+    this.assert_owned(Lh_out);
+    this.assert_owned(v_fields_out);
+    this.assert_owned(conductor_indices);
+    this.assert_owned(v_index_beta);
+    this.assert_owned(dx);
+    this.assert_owned(dy);
+    this.assert_owned(er_table);
+    this.assert_owned(er_index_beta);
+
+    const N = conductor_indices.length;
+    if (Ch_out.length !== N*N || Cih_out.length !== N*N || Lh_out.length !== N*N) {
+      throw Error(`Expected conductor matrices to have ${N}x${N} elements`);
+    }
+    if (v_fields_out.length !== N*v_index_beta.length) {
+      throw Error(`Expected voltage fields to have ${N}x${v_index_beta.length} elements but got ${v_fields_out.length}`);
+    }
+    return this.main.extract_conductor_matrices(
+      Ch_out.pin, Cih_out.pin, Lh_out.pin,
+      v_fields_out.pin,
+      solver.inner, conductor_indices.pin,
+      v_index_beta.pin,
+      dx.pin, dy.pin,
+      er_table.pin, er_index_beta.pin,
+    );
+  }
+
+  // Threads used by row parallel kernels which is always 1 for the single threaded build
+  get total_threads(): number {
+    return this.main.get_total_threads();
+  }
+
+  set total_threads(total_threads: number) {
+    this.main.set_total_threads(total_threads);
+  }
+
+  // Owned pinned arrays come from a size class pool which reuses released buffers across grids
+  get pinned_pool_stats(): Pinned_Pool_Stats {
+    return this.main.get_pinned_pool_stats();
+  }
+
+  get pinned_pool_max_cached_bytes(): number {
+    return this.main.get_pinned_pool_max_cached_bytes();
+  }
+
+  set pinned_pool_max_cached_bytes(max_cached_bytes: number) {
+    this.main.set_pinned_pool_max_cached_bytes(max_cached_bytes);
+  }
+
+  // Wall clock timings of native kernels in the order they were first called since the last reset
+  get kernel_timings(): Kernel_Timing[] {
+    const vector = this.main.get_kernel_timings();
+    const timings: Kernel_Timing[] = [];
+    for (let i = 0; i < vector.size(); i++) {
+      const timing = vector.get(i);
+      if (timing !== undefined) timings.push(timing);
+    }
+    vector.delete();
+    return timings;
+  }
+
+  reset_kernel_timings(): void {
+    this.main.reset_kernel_timings();
+  }
+
+  // Return cached buffers to malloc so other allocations can use the space
+  trim_pinned_pool(): void {
+    this.main.trim_pinned_pool();
+  }
+
   convert_f32_to_f16(f32_in: Float32ModuleBuffer, f16_out: Uint16ModuleBuffer): void {
+    this.assert_owned(f32_in);
+    this.assert_owned(f16_out);
+
+    if (f16_out.length !== f32_in.length) {
+      throw Error(`Expected f16 output to have ${f32_in.length} elements but got ${f16_out.length}`);
+    }
     return this.main.convert_f32_to_f16(f32_in.pin, f16_out.pin);
   }
+
+  // interleaved (table[index], beta) pairs for each packed index_beta
+  pack_index_beta_f16(
+    f16_out: Uint16ModuleBuffer,
+    table: Float32ModuleBuffer, index_beta: Uint32ModuleBuffer,
+  ): void {
+    this.assert_owned(f16_out);
+    this.assert_owned(table);
+    this.assert_owned(index_beta);
+
+    if (f16_out.length !== 2*index_beta.length) {
+      throw Error(`Expected f16 output to have ${index_beta.length}x2 elements but got ${f16_out.length}`);
+    }
+    return this.main.pack_index_beta_f16(f16_out.pin, table.pin, index_beta.pin);
+  }
+
+  // interleaved (x,y) pairs from staggered x_data[Ny+1,Nx] and y_data[Ny,Nx+1]
+  pack_xy_components_f16(
+    f16_out: Uint16ModuleBuffer,
+    x_data: Float32ModuleBuffer, y_data: Float32ModuleBuffer,
+    Nx: number, Ny: number,
+  ): void {
+    this.assert_owned(f16_out);
+    this.assert_owned(x_data);
+    this.assert_owned(y_data);
+
+    if (x_data.length !== (Ny+1)*Nx) {
+      throw Error(`Expected x_data to have ${Ny+1}x${Nx} elements but got ${x_data.length}`);
+    }
+    if (y_data.length !== Ny*(Nx+1)) {
+      throw Error(`Expected y_data to have ${Ny}x${Nx+1} elements but got ${y_data.length}`);
+    }
+    if (f16_out.length !== Ny*Nx*2) {
+      throw Error(`Expected f16 output to have ${Ny}x${Nx}x2 elements but got ${f16_out.length}`);
+    }
+    return this.main.pack_xy_components_f16(f16_out.pin, x_data.pin, y_data.pin, Nx, Ny);
+  }
+
+  // returns nonzero if v_tables does not have total_rhs columns or a forced voltage is outside of the table
+  create_laplace_rhs(
+    B_out: Float32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+    v_tables: Float32ModuleBuffer, total_rhs: number,
+  ): number {
+    this.assert_owned(B_out);
+    this.assert_owned(v_index_beta);
+    this.assert_owned(v_tables);
+
+    if (total_rhs <= 0) {
+      throw Error(`Expected at least one right hand side but got ${total_rhs}`);
+    }
+    if (B_out.length !== v_index_beta.length*total_rhs) {
+      throw Error(`Expected B to have ${v_index_beta.length}x${total_rhs} elements but got ${B_out.length}`);
+    }
+    if (v_tables.length % total_rhs !== 0) {
+      throw Error(`Expected v_tables to have ${total_rhs} columns but got ${v_tables.length} elements`);
+    }
+    return this.main.create_laplace_rhs(B_out.pin, v_index_beta.pin, v_tables.pin, total_rhs);
+  }
+
+  // draws region primitives into ek_index_beta[Ny,Nx] and v_index_beta[Ny+1,Nx+1] in order (see RegionPrimitive)
+  rasterise_regions(
+    ek_index_beta: Uint32ModuleBuffer, v_index_beta: Uint32ModuleBuffer,
+    dx: Float64ModuleBuffer, dy: Float64ModuleBuffer,
+    primitives: Int32ModuleBuffer,
+  ): void {
+    this.assert_owned(ek_index_beta);
+    this.assert_owned(v_index_beta);
+    this.assert_owned(dx);
+    this.assert_owned(dy);
+    this.assert_owned(primitives);
+
+    const Nx = dx.length;
+    const Ny = dy.length;
+    if (ek_index_beta.length !== Ny*Nx) {
+      throw Error(`Expected ek_index_beta to have ${Ny}x${Nx} elements but got ${ek_index_beta.length}`);
+    }
+    if (v_index_beta.length !== (Ny+1)*(Nx+1)) {
+      throw Error(`Expected v_index_beta to have ${Ny+1}x${Nx+1} elements but got ${v_index_beta.length}`);
+    }
+    if (primitives.length % RegionPrimitive.STRIDE !== 0) {
+      throw Error(`Expected primitives to be a multiple of ${RegionPrimitive.STRIDE} elements but got ${primitives.length}`);
+    }
+    const status = this.main.rasterise_regions(ek_index_beta.pin, v_index_beta.pin, dx.pin, dy.pin, primitives.pin);
+    if (status !== 0) {
+      throw Error(`Failed to rasterise regions since a primitive is outside of the ${Ny}x${Nx} grid`);
+    }
+  }
+
+  // Canonical hash of the grid inputs of a solve as 32 hex characters for keying cached results
+  hash_grid_inputs(
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+    ek_table: Float32ModuleBuffer, ek_index_beta: Uint32ModuleBuffer,
+  ): string {
+    this.assert_owned(dx);
+    this.assert_owned(dy);
+    this.assert_owned(v_index_beta);
+    this.assert_owned(ek_table);
+    this.assert_owned(ek_index_beta);
+
+    const Nx = dx.length;
+    const Ny = dy.length;
+    if (v_index_beta.length !== (Ny+1)*(Nx+1)) {
+      throw Error(`Expected v_index_beta to have ${Ny+1}x${Nx+1} elements but got ${v_index_beta.length}`);
+    }
+    if (ek_index_beta.length !== Ny*Nx) {
+      throw Error(`Expected ek_index_beta to have ${Ny}x${Nx} elements but got ${ek_index_beta.length}`);
+    }
+    return this.main.hash_grid_inputs(dx.pin, dy.pin, v_index_beta.pin, ek_table.pin, ek_index_beta.pin);
+  }
 }
 
+// layout of the int32 rows passed to WasmModule.rasterise_regions(...)
+// - plane:     [target, PLANE, index, gy_start, gy_end, 0, 0, 0, 0]
+// - trapezoid: [target, TRAPEZOID, index, gx_signal_left, gx_taper_left, gx_taper_right, gx_signal_right, gy_base, gy_taper]
+export const RegionPrimitive = {
+  STRIDE: 9,
+  TARGET_DIELECTRIC: 0,
+  TARGET_VOLTAGE: 1,
+  PLANE: 0,
+  TRAPEZOID: 1,
+} as const;
+
 export type TypedPinnedArray =
   Uint8PinnedArray | Int8PinnedArray |
   Uint16PinnedArray | Int16PinnedArray |
@@ -438,13 +857,17 @@ export type TypedModuleBuffer =
 export class LU_Solver extends ManagedObject {
   readonly inner: _LU_Solver;
 
-  constructor(
+  constructor(module: WasmModule, inner: _LU_Solver) {
+    super(module);
+    this.inner = inner;
+  }
+
+  static create(
     module: WasmModule,
     A_non_zero_data: Float32ModuleBuffer,
     A_col_indices: Int32ModuleBuffer, A_row_index_pointers: Int32ModuleBuffer,
     total_rows: number, total_columns: number
-  ) {
-    super(module);
+  ): LU_Solver {
     module.assert_owned(A_non_zero_data);
     module.assert_owned(A_col_indices);
     module.assert_owned(A_row_index_pointers);
@@ -464,7 +887,48 @@ export class LU_Solver extends ManagedObject {
     if (solver === null) {
       throw Error(`WASM module LU_Solver.create returned null with error code: ${lu_factor_info}`);
     }
-    this.inner = solver;
+    return new LU_Solver(module, solver);
+  }
+
+  // Assembles the div(E)=0 CSR matrix for a (Ny+1)x(Nx+1) voltage grid inside the module
+  static create_from_grid(
+    module: WasmModule,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+  ): LU_Solver {
+    module.assert_owned(dx);
+    module.assert_owned(dy);
+    module.assert_owned(v_index_beta);
+
+    const total_voltages = (dx.length+1)*(dy.length+1);
+    if (v_index_beta.length !== total_voltages) {
+      throw new Error(`Mismatching number of voltage cells (${v_index_beta.length}) and grid size (${dy.length}+1)x(${dx.length}+1)`);
+    }
+
+    const { solver, lu_factor_info } = module.main.LU_Solver.create_from_grid(dx.pin, dy.pin, v_index_beta.pin);
+    if (solver === null) {
+      throw Error(`WASM module LU_Solver.create_from_grid returned null with error code: ${lu_factor_info}`);
+    }
+    return new LU_Solver(module, solver);
+  }
+
+  // Reuses the column permutation and elimination tree of the last factorisation
+  // If is_same_row_permutation is true then the row permutation and L/U storage are also reused
+  // Returns non-zero on failure after which this solver should be discarded
+  refactor(A_non_zero_data: Float32ModuleBuffer, is_same_row_permutation: boolean): number {
+    this.module.assert_owned(A_non_zero_data);
+    return this.inner.refactor(A_non_zero_data.pin, is_same_row_permutation);
+  }
+
+  refactor_from_grid(
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+    is_same_row_permutation: boolean,
+  ): number {
+    this.module.assert_owned(dx);
+    this.module.assert_owned(dy);
+    this.module.assert_owned(v_index_beta);
+    return this.inner.refactor_from_grid(dx.pin, dy.pin, v_index_beta.pin, is_same_row_permutation);
   }
 
   solve(b: Float32ModuleBuffer): number {
@@ -474,6 +938,259 @@ export class LU_Solver extends ManagedObject {
     return this.inner.solve(b.pin);
   }
 
+  // B is column-major with total_rhs columns which are all solved in one pass over the LU factors
+  solve_many(B: Float32ModuleBuffer, total_rhs: number): number {
+    if (this.total_cols*total_rhs !== B.length) {
+      throw Error(`Mismatch between LU factorised matrix which expects B with ${this.total_cols}x${total_rhs} elements but got ${B.length}`);
+    }
+    return this.inner.solve_many(B.pin, total_rhs);
+  }
+
+  get total_rows(): number { return this.inner.total_rows; }
+  get total_cols(): number { return this.inner.total_cols; }
+
+  // Fill-in, flops, timings and memory of the factorisation with flops and timings of the last solve
+  get stats(): LU_Solver_Stats { return this.inner.get_stats(); }
+
+  override on_delete() {
+    this.inner.delete();
+    super.on_delete();
+  }
+}
+
+// LDL^T factorisation of the symmetric system of unknown voltages in nested dissection order
+// Takes the same right hand side as LU_Solver and stores roughly half the factors
+export class Cholesky_Solver extends ManagedObject {
+  readonly inner: _Cholesky_Solver;
+
+  constructor(module: WasmModule, inner: _Cholesky_Solver) {
+    super(module);
+    this.inner = inner;
+  }
+
+  static create_from_grid(
+    module: WasmModule,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+  ): Cholesky_Solver {
+    module.assert_owned(dx);
+    module.assert_owned(dy);
+    module.assert_owned(v_index_beta);
+
+    const total_voltages = (dx.length+1)*(dy.length+1);
+    if (v_index_beta.length !== total_voltages) {
+      throw new Error(`Mismatching number of voltage cells (${v_index_beta.length}) and grid size (${dy.length}+1)x(${dx.length}+1)`);
+    }
+
+    const { solver, factor_info } = module.main.Cholesky_Solver.create_from_grid(dx.pin, dy.pin, v_index_beta.pin);
+    if (solver === null) {
+      throw Error(`WASM module Cholesky_Solver.create_from_grid returned null with error code: ${factor_info}`);
+    }
+    return new Cholesky_Solver(module, solver);
+  }
+
+  // Reuses the ordering and elimination tree if the grid has the same size and forced voltage cells
+  // Returns non-zero on failure after which this solver should be discarded
+  refactor_from_grid(dx: Float32ModuleBuffer, dy: Float32ModuleBuffer, v_index_beta: Uint32ModuleBuffer): number {
+    this.module.assert_owned(dx);
+    this.module.assert_owned(dy);
+    this.module.assert_owned(v_index_beta);
+    return this.inner.refactor_from_grid(dx.pin, dy.pin, v_index_beta.pin);
+  }
+
+  solve(b: Float32ModuleBuffer): number {
+    if (this.total_cols !== b.length) {
+      throw Error(`Mismatch between Cholesky factorised matrix which has ${this.total_cols} columns and expects b with ${this.total_cols} rows but got ${b.length}`);
+    }
+    return this.inner.solve(b.pin);
+  }
+
+  // B is column-major with total_rhs columns which are all solved in one pass over the factors
+  solve_many(B: Float32ModuleBuffer, total_rhs: number): number {
+    if (this.total_cols*total_rhs !== B.length) {
+      throw Error(`Mismatch between Cholesky factorised matrix which expects B with ${this.total_cols}x${total_rhs} elements but got ${B.length}`);
+    }
+    return this.inner.solve_many(B.pin, total_rhs);
+  }
+
+  get total_rows(): number { return this.inner.total_rows; }
+  get total_cols(): number { return this.inner.total_cols; }
+
+  get stats(): Cholesky_Solver_Stats { return this.inner.get_stats(); }
+
+  override on_delete() {
+    this.inner.delete();
+    super.on_delete();
+  }
+}
+
+// Half grid Cholesky factorisations of a grid which is mirror symmetric about a vertical axis
+// Right hand sides are split into even and odd parts which are solved on the left half and mirrored back
+export class Mirror_Solver extends ManagedObject {
+  static readonly AXIS_NONE = 0;
+  static readonly AXIS_ON_NODE = 1;
+  static readonly AXIS_IN_CELL = 2;
+  static readonly CREATE_NOT_SYMMETRIC = 1;
+
+  readonly inner: _Mirror_Solver;
+
+  constructor(module: WasmModule, inner: _Mirror_Solver) {
+    super(module);
+    this.inner = inner;
+  }
+
+  // AXIS_NONE if mirroring dx and the forced voltage cells does not give the same grid
+  static find_axis(module: WasmModule, dx: Float32ModuleBuffer, v_index_beta: Uint32ModuleBuffer): number {
+    module.assert_owned(dx);
+    module.assert_owned(v_index_beta);
+    return module.main.Mirror_Solver.find_axis(dx.pin, v_index_beta.pin);
+  }
+
+  static create_from_grid(
+    module: WasmModule,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+  ): Mirror_Solver {
+    module.assert_owned(dx);
+    module.assert_owned(dy);
+    module.assert_owned(v_index_beta);
+
+    const total_voltages = (dx.length+1)*(dy.length+1);
+    if (v_index_beta.length !== total_voltages) {
+      throw new Error(`Mismatching number of voltage cells (${v_index_beta.length}) and grid size (${dy.length}+1)x(${dx.length}+1)`);
+    }
+
+    const { solver, create_info } = module.main.Mirror_Solver.create_from_grid(dx.pin, dy.pin, v_index_beta.pin);
+    if (solver === null) {
+      throw Error(`WASM module Mirror_Solver.create_from_grid returned null with error code: ${create_info}`);
+    }
+    return new Mirror_Solver(module, solver);
+  }
+
+  // Reuses the orderings of both halves if the grid has the same size, mirror axis and forced voltage cells
+  // Returns non-zero on failure after which this solver should be discarded
+  refactor_from_grid(dx: Float32ModuleBuffer, dy: Float32ModuleBuffer, v_index_beta: Uint32ModuleBuffer): number {
+    this.module.assert_owned(dx);
+    this.module.assert_owned(dy);
+    this.module.assert_owned(v_index_beta);
+    return this.inner.refactor_from_grid(dx.pin, dy.pin, v_index_beta.pin);
+  }
+
+  solve(b: Float32ModuleBuffer): number {
+    if (this.total_cols !== b.length) {
+      throw Error(`Mismatch between mirrored matrix which has ${this.total_cols} columns and expects b with ${this.total_cols} rows but got ${b.length}`);
+    }
+    return this.inner.solve(b.pin);
+  }
+
+  // B is column-major with total_rhs columns which are all solved in one pass over each half
+  solve_many(B: Float32ModuleBuffer, total_rhs: number): number {
+    if (this.total_cols*total_rhs !== B.length) {
+      throw Error(`Mismatch between mirrored matrix which expects B with ${this.total_cols}x${total_rhs} elements but got ${B.length}`);
+    }
+    return this.inner.solve_many(B.pin, total_rhs);
+  }
+
+  get axis(): number { return this.inner.axis; }
+  // odd half is only factorised once a right hand side is not symmetric
+  get has_odd_solver(): boolean { return this.inner.has_odd_solver; }
+  get total_rows(): number { return this.inner.total_rows; }
+  get total_cols(): number { return this.inner.total_cols; }
+
+  // Summed over the factorised halves
+  get stats(): Cholesky_Solver_Stats { return this.inner.get_stats(); }
+
+  override on_delete() {
+    this.inner.delete();
+    super.on_delete();
+  }
+}
+
+// BiCGSTAB with ILU(0) preconditioning which uses O(nnz) memory for grids too large to LU factorise
+export class Iterative_Solver extends ManagedObject {
+  readonly inner: _Iterative_Solver;
+
+  constructor(module: WasmModule, inner: _Iterative_Solver) {
+    super(module);
+    this.inner = inner;
+  }
+
+  static create(
+    module: WasmModule,
+    A_non_zero_data: Float32ModuleBuffer,
+    A_col_indices: Int32ModuleBuffer, A_row_index_pointers: Int32ModuleBuffer,
+    total_rows: number, total_columns: number
+  ): Iterative_Solver {
+    module.assert_owned(A_non_zero_data);
+    module.assert_owned(A_col_indices);
+    module.assert_owned(A_row_index_pointers);
+
+    if (A_non_zero_data.length !== A_col_indices.length) {
+      throw new Error(`Mismatching number of non-zero elements in data (${A_non_zero_data.length}) and number of column-indices (${A_col_indices.length})`);
+    }
+    if (A_row_index_pointers.length !== (total_rows+1)) {
+      throw new Error(`Mismatching number of row index pointers (${A_row_index_pointers.length}) and total_rows+1 (${total_rows}+1)`);
+    }
+
+    const { solver, ilu_factor_info } = module.main.Iterative_Solver.create(
+      A_non_zero_data.pin,
+      A_col_indices.pin, A_row_index_pointers.pin,
+      total_rows, total_columns,
+    );
+    if (solver === null) {
+      throw Error(`WASM module Iterative_Solver.create returned null with error code: ${ilu_factor_info}`);
+    }
+    return new Iterative_Solver(module, solver);
+  }
+
+  static create_from_grid(
+    module: WasmModule,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+  ): Iterative_Solver {
+    module.assert_owned(dx);
+    module.assert_owned(dy);
+    module.assert_owned(v_index_beta);
+
+    const total_voltages = (dx.length+1)*(dy.length+1);
+    if (v_index_beta.length !== total_voltages) {
+      throw new Error(`Mismatching number of voltage cells (${v_index_beta.length}) and grid size (${dy.length}+1)x(${dx.length}+1)`);
+    }
+
+    const { solver, ilu_factor_info } = module.main.Iterative_Solver.create_from_grid(dx.pin, dy.pin, v_index_beta.pin);
+    if (solver === null) {
+      throw Error(`WASM module Iterative_Solver.create_from_grid returned null with error code: ${ilu_factor_info}`);
+    }
+    return new Iterative_Solver(module, solver);
+  }
+
+  solve(b: Float32ModuleBuffer): number {
+    if (this.total_cols !== b.length) {
+      throw Error(`Mismatch between matrix which has ${this.total_cols} columns and expects b with ${this.total_cols} rows but got ${b.length}`);
+    }
+    return this.inner.solve(b.pin);
+  }
+
+  solve_many(B: Float32ModuleBuffer, total_rhs: number): number {
+    if (this.total_cols*total_rhs !== B.length) {
+      throw Error(`Mismatch between matrix which expects B with ${this.total_cols}x${total_rhs} elements but got ${B.length}`);
+    }
+    return this.inner.solve_many(B.pin, total_rhs);
+  }
+
+  set_initial_guess(X: Float32ModuleBuffer, total_rhs: number) {
+    if (this.total_cols*total_rhs !== X.length) {
+      throw Error(`Mismatch between matrix which expects X with ${this.total_cols}x${total_rhs} elements but got ${X.length}`);
+    }
+    this.inner.set_initial_guess(X.pin, total_rhs);
+  }
+
+  get tolerance(): number { return this.inner.tolerance; }
+  set tolerance(tolerance: number) { this.inner.tolerance = tolerance; }
+  get max_iterations(): number { return this.inner.max_iterations; }
+  set max_iterations(max_iterations: number) { this.inner.max_iterations = max_iterations; }
+  get last_iterations(): number { return this.inner.last_iterations; }
+  get last_relative_residual(): number { return this.inner.last_relative_residual; }
   get total_rows(): number { return this.inner.total_rows; }
   get total_cols(): number { return this.inner.total_cols; }
 
@@ -483,6 +1200,134 @@ export class LU_Solver extends ManagedObject {
   }
 }
 
+// Conjugate gradient preconditioned by a geometric multigrid V-cycle with Galerkin coarse operators on the dx/dy mesh
+export class Multigrid_Solver extends ManagedObject {
+  readonly inner: _Multigrid_Solver;
+
+  constructor(module: WasmModule, inner: _Multigrid_Solver) {
+    super(module);
+    this.inner = inner;
+  }
+
+  static create_from_grid(
+    module: WasmModule,
+    dx: Float32ModuleBuffer, dy: Float32ModuleBuffer,
+    v_index_beta: Uint32ModuleBuffer,
+  ): Multigrid_Solver {
+    module.assert_owned(dx);
+    module.assert_owned(dy);
+    module.assert_owned(v_index_beta);
+
+    const total_voltages = (dx.length+1)*(dy.length+1);
+    if (v_index_beta.length !== total_voltages) {
+      throw new Error(`Mismatching number of voltage cells (${v_index_beta.length}) and grid size (${dy.length}+1)x(${dx.length}+1)`);
+    }
+
+    const { solver, create_info } = module.main.Multigrid_Solver.create_from_grid(dx.pin, dy.pin, v_index_beta.pin);
+    if (solver === null) {
+      throw Error(`WASM module Multigrid_Solver.create_from_grid returned null with error code: ${create_info}`);
+    }
+    return new Multigrid_Solver(module, solver);
+  }
+
+  solve(b: Float32ModuleBuffer): number {
+    if (this.total_cols !== b.length) {
+      throw Error(`Mismatch between matrix which has ${this.total_cols} columns and expects b with ${this.total_cols} rows but got ${b.length}`);
+    }
+    return this.inner.solve(b.pin);
+  }
+
+  solve_many(B: Float32ModuleBuffer, total_rhs: number): number {
+    if (this.total_cols*total_rhs !== B.length) {
+      throw Error(`Mismatch between matrix which expects B with ${this.total_cols}x${total_rhs} elements but got ${B.length}`);
+    }
+    return this.inner.solve_many(B.pin, total_rhs);
+  }
+
+  set_initial_guess(X: Float32ModuleBuffer, total_rhs: number) {
+    if (this.total_cols*total_rhs !== X.length) {
+      throw Error(`Mismatch between matrix which expects X with ${this.total_cols}x${total_rhs} elements but got ${X.length}`);
+    }
+    this.inner.set_initial_guess(X.pin, total_rhs);
+  }
+
+  get tolerance(): number { return this.inner.tolerance; }
+  set tolerance(tolerance: number) { this.inner.tolerance = tolerance; }
+  get max_cycles(): number { return this.inner.max_cycles; }
+  set max_cycles(max_cycles: number) { this.inner.max_cycles = max_cycles; }
+  get last_cycles(): number { return this.inner.last_cycles; }
+  get last_relative_residual(): number { return this.inner.last_relative_residual; }
+  get total_levels(): number { return this.inner.total_levels; }
+  get total_rows(): number { return this.inner.total_rows; }
+  get total_cols(): number { return this.inner.total_cols; }
+
+  override on_delete() {
+    this.inner.delete();
+    super.on_delete();
+  }
+}
+
+// factorised solvers which can be kept and refactored for a grid with the same structure
+export type DirectSolver = LU_Solver | Cholesky_Solver | Mirror_Solver;
+export type LinearSolver = LU_Solver | Cholesky_Solver | Mirror_Solver | Iterative_Solver | Multigrid_Solver;
+
+// CPU version of the wgpu_kernels/fdtd_3d kernels using the same [Nx,Ny,Nz,3] E/H and [Nx,Ny,Nz] A0/A1 layout
+export class FDTD_3D_Engine extends ManagedObject {
+  readonly inner: _FDTD_3D_Engine;
+  readonly size: [number, number, number];
+
+  constructor(module: WasmModule, size: [number, number, number]) {
+    super(module);
+    const inner = module.main.FDTD_3D_Engine.create(size[0], size[1], size[2]);
+    if (inner === null) throw Error(`WASM module FDTD_3D_Engine.create returned null for size (${size.join(',')})`);
+    this.inner = inner;
+    this.size = size;
+  }
+
+  override on_delete() {
+    this.inner.delete();
+    super.on_delete();
+  }
+
+  // signal[t] is added to Ex inside the region for timesteps t < signal.length
+  add_source(offset: [number, number, number], size: [number, number, number], signal: Float32ModuleBuffer) {
+    this.module.assert_owned(signal);
+    this.inner.add_source(offset[0], offset[1], offset[2], size[0], size[1], size[2], signal.pin);
+  }
+
+  clear_sources() {
+    this.inner.clear_sources();
+  }
+
+  step(
+    E: Float32ModuleBuffer, H: Float32ModuleBuffer,
+    A0: Float32ModuleBuffer, A1: Float32ModuleBuffer,
+    b0: number, timestep: number, total_steps: number,
+  ) {
+    this.module.assert_owned(E);
+    this.module.assert_owned(H);
+    this.module.assert_owned(A0);
+    this.module.assert_owned(A1);
+
+    const total_cells = this.size.reduce((a,b) => a*b, 1);
+    if (E.length !== 3*total_cells || H.length !== 3*total_cells) {
+      throw Error(`Expected E and H fields to have ${3*total_cells} elements but got E=${E.length}, H=${H.length}`);
+    }
+    if (A0.length !== total_cells || A1.length !== total_cells) {
+      throw Error(`Expected A0 and A1 to have ${total_cells} elements but got A0=${A0.length}, A1=${A1.length}`);
+    }
+    this.inner.step(E.pin, H.pin, A0.pin, A1.pin, b0, timestep, total_steps);
+  }
+
+  // timesteps swept through the grid together which is limited by max_time_block and cache_size_bytes
+  get time_block(): number { return this.inner.time_block; }
+  get max_time_block(): number { return this.inner.max_time_block; }
+  set max_time_block(max_time_block: number) { this.inner.max_time_block = max_time_block; }
+  get cache_size_bytes(): number { return this.inner.cache_size_bytes; }
+  set cache_size_bytes(cache_size_bytes: number) { this.inner.cache_size_bytes = cache_size_bytes; }
+  get total_sources(): number { return this.inner.total_sources; }
+}
+
 export class ZipFile extends ManagedObject {
   readonly inner: _ZipFile;
 
@@ -511,3 +1356,96 @@ export class ZipFile extends ManagedObject {
     return new Uint8ModuleBuffer(this.module, data, true);
   }
 }
+
+// Builds a zip archive as a sequence of chunks so the archive is never held in the heap
+// - Entries share ownership of owned module buffers so they can be deleted once added
+// - Non owning buffers (views) are copied when added since their memory can be freed before it is read
+// - Level 0 stores the entry uncompressed and 1 to 9 deflate it
+export class ZipStream extends ManagedObject {
+  readonly inner: _ZipStream;
+  static readonly DEFAULT_LEVEL = 6;
+
+  constructor(
+    module: WasmModule,
+  ) {
+    super(module);
+    const inner = module.main.ZipStream.create();
+    if (inner === null) throw Error("WASM module ZipStream.create returned null");
+    this.inner = inner;
+  }
+
+  override on_delete() {
+    this.inner.delete();
+    super.on_delete();
+  }
+
+  // shares the buffer's PinnedArray so the entry keeps an owned buffer alive after the caller deletes it
+  private get_bytes_pin(data: IModuleBuffer): Uint8PinnedArray {
+    this.module.assert_owned(data);
+    const view = data.module_data_view;
+    const pin = view.pin;
+    view.delete();
+    return pin;
+  }
+
+  add_entry(name: string, data: IModuleBuffer, level: number = ZipStream.DEFAULT_LEVEL) {
+    const pin = this.get_bytes_pin(data);
+    try {
+      const status = this.inner.add_entry(name, pin, level);
+      if (status !== 0) throw Error(`ZipStream.add_entry failed for '${name}' with ${status}`);
+    } finally {
+      pin.delete();
+    }
+  }
+
+  // descr is the numpy type string (e.g. "<f4") and data is the array in C order
+  add_npy_entry(
+    name: string, data: IModuleBuffer, descr: string, shape: number[],
+    level: number = ZipStream.DEFAULT_LEVEL,
+  ) {
+    const pin = this.get_bytes_pin(data);
+    const shape_buffer = Int32ModuleBuffer.create(this.module, shape);
+    try {
+      const status = this.inner.add_npy_entry(name, pin, descr, shape_buffer.pin, level);
+      if (status !== 0) throw Error(`ZipStream.add_npy_entry failed for '${name}' with ${status}`);
+    } finally {
+      pin.delete();
+      shape_buffer.delete();
+    }
+  }
+
+  finish() {
+    this.inner.finish();
+  }
+
+  // copies out the next chunk which is only valid in the heap until the next read
+  read_chunk(): Uint8Array | null {
+    const pin = this.inner.read_chunk();
+    if (pin === null) {
+      const error = this.inner.error;
+      if (error !== 0) throw Error(`ZipStream.read_chunk failed with ${error}`);
+      return null;
+    }
+    try {
+      return new Uint8Array(this.module.main.HEAP8.buffer, pin.address, pin.length).slice();
+    } finally {
+      pin.delete();
+    }
+  }
+
+  // read all pending chunks which lets the caller release entries that have been written
+  read_chunks(): Uint8Array[] {
+    const chunks: Uint8Array[] = [];
+    while (true) {
+      const chunk = this.read_chunk();
+      if (chunk === null) break;
+      chunks.push(chunk);
+    }
+    return chunks;
+  }
+
+  get is_done(): boolean { return this.inner.is_done; }
+  get total_bytes_written(): number { return this.inner.total_bytes_written; }
+  get block_size(): number { return this.inner.block_size; }
+  set block_size(block_size: number) { this.inner.block_size = block_size; }
+}
@@ -0,0 +1,418 @@
+#include "./Cholesky_Solver.hpp"
+#include "./logging.hpp"
+#include "./kernel_timings.hpp"
+#include <vector>
+
+static inline bool is_fixed_voltage(uint32_t index_beta) {
+    const float beta = float(index_beta & 0xFFFF) / float(0xFFFF);
+    return beta > 0.5f;
+}
+
+// Known voltages have an identity row in the full matrix, which are forced voltages and the grid corners
+// - A mirror edge is inside the full grid so it has no corners
+// - An odd mirror axis on the x=Nx column is always zero
+static std::vector<uint8_t> get_known_voltages(
+    int Nx, int Ny, TypedPinnedArray<uint32_t> v_index_beta, Cholesky_Solver::Mirror_Edge mirror
+) {
+    const bool is_mirror = mirror.mode != Cholesky_Solver::MIRROR_NONE;
+    const bool is_zero_axis = mirror.mode == Cholesky_Solver::MIRROR_ODD && mirror.width == 0.0f;
+    auto is_known = std::vector<uint8_t>((Nx+1)*(Ny+1), 0);
+    for (int y = 0; y < Ny+1; y++) {
+        const bool is_y_inner = (y > 0 && y < Ny);
+        for (int x = 0; x < Nx+1; x++) {
+            const int iv = x + y*(Nx+1);
+            const bool is_x_inner = (x > 0 && (x < Nx || is_mirror));
+            const bool is_zero = is_zero_axis && x == Nx;
+            is_known[iv] = (is_fixed_voltage(v_index_beta[iv]) || is_zero || !(is_x_inner || is_y_inner)) ? 1 : 0;
+        }
+    }
+    return is_known;
+}
+
+// Nested dissection of the rectangle [x0,x1)x[y0,y1) of the 5 point stencil
+// - A single grid line splits the rectangle into two halves which have no coupling between them
+// - Both halves are ordered before the separator so eliminating one half never fills in the other
+// - Small rectangles are ordered row by row since dissecting them further only adds overhead
+static constexpr int NESTED_DISSECTION_LEAF_SIZE = 64;
+
+static void add_nested_dissection(
+    std::vector<int32_t>& order, const uint8_t* is_known, int Nx,
+    int x0, int x1, int y0, int y1
+) {
+    const int width = x1-x0;
+    const int height = y1-y0;
+    if (width <= 0 || height <= 0) return;
+    const auto add_node = [&](int x, int y) {
+        const int iv = x + y*(Nx+1);
+        if (!is_known[iv]) order.push_back(iv);
+    };
+    if (width*height <= NESTED_DISSECTION_LEAF_SIZE) {
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) add_node(x, y);
+        }
+        return;
+    }
+    // split the longer side so separators stay short on thin strips
+    if (width >= height) {
+        const int xs = x0 + width/2;
+        add_nested_dissection(order, is_known, Nx, x0, xs, y0, y1);
+        add_nested_dissection(order, is_known, Nx, xs+1, x1, y0, y1);
+        for (int y = y0; y < y1; y++) add_node(xs, y);
+    } else {
+        const int ys = y0 + height/2;
+        add_nested_dissection(order, is_known, Nx, x0, x1, y0, ys);
+        add_nested_dissection(order, is_known, Nx, x0, x1, ys+1, y1);
+        for (int x = x0; x < x1; x++) add_node(x, ys);
+    }
+}
+
+Cholesky_Solver::Create_Result Cholesky_Solver::create_from_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    return create_from_half_grid(dx_arr, dy_arr, v_index_beta, Mirror_Edge{});
+}
+
+Cholesky_Solver::Create_Result Cholesky_Solver::create_from_half_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta, Mirror_Edge mirror
+) {
+    const int Nx = dx_arr.get_length();
+    const int Ny = dy_arr.get_length();
+    auto solver = std::make_shared<Cholesky_Solver>(Nx, Ny, mirror);
+    solver->m_is_known = get_known_voltages(Nx, Ny, v_index_beta, mirror);
+    solver->load_spacing(dx_arr, dy_arr);
+    solver->create_border_runs();
+    {
+        const auto timer = Kernel_Timer("cholesky_ordering");
+        MODULE_LOG("Ordering unknowns of %dx%d grid by nested dissection\n", Nx+1, Ny+1);
+        solver->create_ordering();
+        solver->create_elimination_tree();
+        solver->m_stats.ordering_ms = timer.get_elapsed_ms();
+    }
+    const int32_t factor_info = solver->factor();
+    if (factor_info != 0) return { nullptr, factor_info };
+    return { solver, factor_info };
+}
+
+int32_t Cholesky_Solver::refactor_from_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    return refactor_from_half_grid(dx_arr, dy_arr, v_index_beta, m_mirror);
+}
+
+int32_t Cholesky_Solver::refactor_from_half_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta, Mirror_Edge mirror
+) {
+    if (dx_arr.get_length() != m_Nx || dy_arr.get_length() != m_Ny || mirror.mode != m_mirror.mode) {
+        MODULE_LOG("Refactor got a grid with a different size or mirror edge\n");
+        return REFACTOR_PATTERN_MISMATCH;
+    }
+    if (get_known_voltages(m_Nx, m_Ny, v_index_beta, mirror) != m_is_known) {
+        MODULE_LOG("Refactor got a grid with different known voltages\n");
+        return REFACTOR_PATTERN_MISMATCH;
+    }
+    m_mirror = mirror;
+    load_spacing(dx_arr, dy_arr);
+    create_border_runs();
+    return factor();
+}
+
+void Cholesky_Solver::load_spacing(TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr) {
+    m_dx.assign(dx_arr.get_data(), dx_arr.get_data() + dx_arr.get_length());
+    m_dy.assign(dy_arr.get_data(), dy_arr.get_data() + dy_arr.get_length());
+}
+
+// Walk the 4 border lines and split them into runs of unknowns between two known voltages
+// NOTE: every line starts and ends on a corner which is always known
+//       except for the bottom and top lines of a half grid which can end on the mirror edge
+void Cholesky_Solver::create_border_runs() {
+    m_border_nodes.clear();
+    m_border_spacing.clear();
+    m_border_runs.clear();
+    const auto add_run = [&](int start, int stride, const float* spacing, int run_start, int run_end, bool is_mirror_end) {
+        Border_Run run;
+        run.start = int(m_border_nodes.size());
+        run.total_nodes = run_end-run_start+1;
+        run.is_mirror_end = is_mirror_end;
+        for (int j = run_start; j <= run_end; j++) {
+            m_border_nodes.push_back(start + j*stride);
+            // spacing after the last node is the distance to its mirror image
+            m_border_spacing.push_back((j < run_end) ? spacing[j] : (is_mirror_end ? m_mirror.width : 0.0f));
+        }
+        m_border_runs.push_back(run);
+    };
+    const auto add_line = [&](int start, int stride, int total_cells, const float* spacing, bool is_mirror_end) {
+        int run_start = 0;
+        for (int i = 1; i <= total_cells; i++) {
+            const int iv = start + i*stride;
+            if (!m_is_known[iv]) continue;
+            if (i-run_start > 1) add_run(start, stride, spacing, run_start, i, false);
+            run_start = i;
+        }
+        if (is_mirror_end && run_start < total_cells) add_run(start, stride, spacing, run_start, total_cells, true);
+    };
+    const bool is_mirror = m_mirror.mode != MIRROR_NONE;
+    const int stride_y = m_Nx+1;
+    add_line(0, 1, m_Nx, m_dx.data(), is_mirror);
+    if (m_Ny > 0) add_line(m_Ny*stride_y, 1, m_Nx, m_dx.data(), is_mirror);
+    add_line(0, stride_y, m_Ny, m_dy.data(), false);
+    if (m_Nx > 0 && !is_mirror) add_line(m_Nx, stride_y, m_Ny, m_dy.data(), false);
+}
+
+void Cholesky_Solver::create_ordering() {
+    const int total_voltages = (m_Nx+1)*(m_Ny+1);
+    m_permute.clear();
+    // the mirror edge is inside the full grid so its column is part of the reduced system
+    const int x_end = (m_mirror.mode != MIRROR_NONE) ? m_Nx+1 : m_Nx;
+    add_nested_dissection(m_permute, m_is_known.data(), m_Nx, 1, x_end, 1, m_Ny);
+    m_reduced_index.assign(total_voltages, -1);
+    for (int k = 0; k < int(m_permute.size()); k++) {
+        m_reduced_index[m_permute[k]] = k;
+    }
+}
+
+// Elimination tree and column counts of L from the lower triangle of the reduced system
+// SRC: Timothy A. Davis, "Algorithm 849: A concise sparse Cholesky factorization package", ldl_symbolic()
+void Cholesky_Solver::create_elimination_tree() {
+    const int n = int(m_permute.size());
+    const int stride_y = m_Nx+1;
+    m_parent.assign(n, -1);
+    auto flag = std::vector<int32_t>(n, -1);
+    auto total_column = std::vector<int32_t>(n, 0);
+    int64_t total_non_zeros = n;
+    for (int k = 0; k < n; k++) {
+        flag[k] = k;
+        const int iv = m_permute[k];
+        const int neighbours[4] = { iv-1, iv+1, iv-stride_y, iv+stride_y };
+        for (int j = 0; j < 4; j++) {
+            if (j == 1 && is_mirror_column(iv % stride_y)) continue; // mirror image
+            int i = m_reduced_index[neighbours[j]];
+            if (i < 0 || i >= k) continue;
+            total_non_zeros++;
+            // walk up the tree from i until reaching a node already visited for row k
+            for (; flag[i] != k; i = m_parent[i]) {
+                if (m_parent[i] == -1) m_parent[i] = k;
+                total_column[i]++;
+                flag[i] = k;
+            }
+        }
+    }
+    m_L_col_ptr.resize(n+1);
+    m_L_col_ptr[0] = 0;
+    for (int k = 0; k < n; k++) {
+        m_L_col_ptr[k+1] = m_L_col_ptr[k] + total_column[k];
+    }
+    m_L_row_indices.resize(m_L_col_ptr[n]);
+    m_L_data.resize(m_L_col_ptr[n]);
+    m_D.resize(n);
+
+    m_stats.total_rows = double(get_total_rows());
+    m_stats.reduced_rows = double(n);
+    m_stats.A_non_zeros = double(total_non_zeros);
+    m_stats.L_non_zeros = double(m_L_col_ptr[n] + n);
+    m_stats.factor_bytes = double(m_L_col_ptr[n])*double(sizeof(int32_t)+sizeof(float)) + double(n)*sizeof(double);
+}
+
+// Couplings of an inner voltage to its [left, right, down, up] neighbours after scaling the row by (dx0+dx1)*(dy0+dy1)
+//  (dy0+dy1)/dx0 * (V[y,x]-V[y,x-1]) + (dy0+dy1)/dx1 * (V[y,x]-V[y,x+1]) +
+//  (dx0+dx1)/dy0 * (V[y,x]-V[y-1,x]) + (dx0+dx1)/dy1 * (V[y,x]-V[y+1,x]) = (dx0+dx1)*(dy0+dy1)*b[y,x]
+// - The coupling between two neighbours is the same from either side which makes the system symmetric
+// - On the mirror edge the right neighbour is the mirror image V[y,x+1] = +/-V[y,x] at a distance of dx1
+//   - even: the right term is zero and the row is only scaled by dx0 if the axis is on this column
+//   - odd: the right term becomes 2*(dy0+dy1)/dx1 * V[y,x] which only adds to the diagonal
+// Returns the diagonal
+double Cholesky_Solver::get_couplings(int iv, double* couplings) const {
+    const int x = iv % (m_Nx+1);
+    const int y = iv / (m_Nx+1);
+    const double dx_0 = m_dx[x-1];
+    const double dx_1 = get_dx_1(x);
+    const double dy_0 = m_dy[y-1];
+    const double dy_1 = m_dy[y];
+    couplings[0] = (dy_0+dy_1)/dx_0;
+    couplings[2] = (dx_0+dx_1)/dy_0;
+    couplings[3] = (dx_0+dx_1)/dy_1;
+    if (!is_mirror_column(x)) {
+        couplings[1] = (dy_0+dy_1)/dx_1;
+        return couplings[0] + couplings[1] + couplings[2] + couplings[3];
+    }
+    couplings[1] = 0.0;
+    const double diagonal = couplings[0] + couplings[2] + couplings[3];
+    return (m_mirror.mode == MIRROR_ODD) ? diagonal + 2.0*(dy_0+dy_1)/dx_1 : diagonal;
+}
+
+// Up looking L*D*L^T factorisation which computes one row of L at a time from the elimination tree
+// SRC: Timothy A. Davis, "Algorithm 849: A concise sparse Cholesky factorization package", ldl_numeric()
+int32_t Cholesky_Solver::factor() {
+    const auto timer = Kernel_Timer("cholesky_factor");
+    const int n = int(m_permute.size());
+    const int stride_y = m_Nx+1;
+    const int32_t* Lp = m_L_col_ptr.data();
+    int32_t* Li = m_L_row_indices.data();
+    float* Lx = m_L_data.data();
+    double* D = m_D.data();
+    auto Y = std::vector<double>(n, 0.0);
+    auto pattern = std::vector<int32_t>(n);
+    auto flag = std::vector<int32_t>(n, -1);
+    auto total_column = std::vector<int32_t>(n, 0);
+    double flops = 0.0;
+
+    MODULE_LOG("Factorising %d unknowns with L*D*L^T\n", n);
+    for (int k = 0; k < n; k++) {
+        // scatter row k of the lower triangle and find the pattern of row k of L from the elimination tree
+        const int iv = m_permute[k];
+        const int neighbours[4] = { iv-1, iv+1, iv-stride_y, iv+stride_y };
+        double couplings[4];
+        const double diagonal = get_couplings(iv, couplings);
+        int top = n;
+        flag[k] = k;
+        for (int j = 0; j < 4; j++) {
+            if (couplings[j] == 0.0) continue; // mirror image
+            int i = m_reduced_index[neighbours[j]];
+            if (i < 0 || i >= k) continue;
+            Y[i] -= couplings[j];
+            int length = 0;
+            for (; flag[i] != k; i = m_parent[i]) {
+                pattern[length++] = i;
+                flag[i] = k;
+            }
+            while (length > 0) pattern[--top] = pattern[--length];
+        }
+        D[k] = diagonal;
+        // sparse triangular solve for row k of L in topological order
+        for (; top < n; top++) {
+            const int i = pattern[top];
+            const double yi = Y[i];
+            Y[i] = 0.0;
+            const int32_t p_end = Lp[i] + total_column[i];
+            for (int32_t p = Lp[i]; p < p_end; p++) {
+                Y[Li[p]] -= double(Lx[p])*yi;
+            }
+            const double l_ki = yi/D[i];
+            D[k] -= l_ki*yi;
+            Li[p_end] = k;
+            Lx[p_end] = float(l_ki);
+            total_column[i]++;
+            flops += 2.0*double(p_end-Lp[i]) + 3.0;
+        }
+        if (!(D[k] > 0.0)) {
+            MODULE_LOG("Pivot %d of reduced system is not positive (%.3e)\n", k, D[k]);
+            return FACTOR_NOT_POSITIVE_DEFINITE;
+        }
+    }
+    m_stats.factor_flops = flops;
+    m_stats.factor_ms = timer.get_elapsed_ms();
+    m_stats.total_factorisations += 1.0;
+    return 0;
+}
+
+// Border rows only contain the voltages along the border so each run is a tridiagonal system
+//  (V[i]-V[i-1])/h0 + (V[i]-V[i+1])/h1 = (h0+h1)*b[i]
+// A run ending on the mirror edge has V[i+1] = +/-V[i] for its last node like get_couplings()
+void Cholesky_Solver::solve_border(float* v) const {
+    auto c_prime = std::vector<double>();
+    auto d_prime = std::vector<double>();
+    for (const auto& run: m_border_runs) {
+        const int32_t* nodes = &m_border_nodes[run.start];
+        const float* spacing = &m_border_spacing[run.start];
+        const int last = run.total_nodes-1;
+        const int last_unknown = run.is_mirror_end ? last : last-1;
+        c_prime.resize(run.total_nodes);
+        d_prime.resize(run.total_nodes);
+        // Thomas algorithm with the known voltages at each end moved into the right hand side
+        for (int i = 1; i <= last_unknown; i++) {
+            const double h_0 = spacing[i-1];
+            const double h_1 = spacing[i];
+            const bool is_mirror_node = (i == last);
+            const double a = -1.0/h_0;
+            double b = 1.0/h_0;
+            double c = 0.0;
+            double d = (h_0+h_1)*double(v[nodes[i]]);
+            if (!is_mirror_node) {
+                b += 1.0/h_1;
+                c = -1.0/h_1;
+            } else if (m_mirror.mode == MIRROR_ODD) {
+                b += 2.0/h_1;
+            }
+            if (i == 1) d -= a*double(v[nodes[0]]);
+            if (i == last-1 && !run.is_mirror_end) {
+                d -= c*double(v[nodes[last]]);
+                c = 0.0;
+            }
+            const double c_prev = (i > 1) ? c_prime[i-1] : 0.0;
+            const double d_prev = (i > 1) ? d_prime[i-1] : 0.0;
+            const double a_prev = (i > 1) ? a : 0.0;
+            const double denominator = b - a_prev*c_prev;
+            c_prime[i] = c/denominator;
+            d_prime[i] = (d - a_prev*d_prev)/denominator;
+        }
+        double x_next = 0.0;
+        for (int i = last_unknown; i >= 1; i--) {
+            const double x = d_prime[i] - c_prime[i]*x_next;
+            v[nodes[i]] = float(x);
+            x_next = x;
+        }
+    }
+}
+
+void Cholesky_Solver::solve_single(float* v, std::vector<double>& y) const {
+    solve_border(v);
+
+    const int n = int(m_permute.size());
+    const int stride_y = m_Nx+1;
+    // move known and border voltages into the right hand side of the reduced system
+    for (int k = 0; k < n; k++) {
+        const int iv = m_permute[k];
+        const int x = iv % stride_y;
+        const int yi = iv / stride_y;
+        const int neighbours[4] = { iv-1, iv+1, iv-stride_y, iv+stride_y };
+        double couplings[4];
+        get_couplings(iv, couplings);
+        double rhs = (double(m_dx[x-1])+get_dx_1(x))*double(m_dy[yi-1]+m_dy[yi])*double(v[iv]);
+        for (int j = 0; j < 4; j++) {
+            if (couplings[j] == 0.0) continue; // mirror image
+            if (m_reduced_index[neighbours[j]] < 0) rhs += couplings[j]*double(v[neighbours[j]]);
+        }
+        y[k] = rhs;
+    }
+
+    const int32_t* Lp = m_L_col_ptr.data();
+    const int32_t* Li = m_L_row_indices.data();
+    const float* Lx = m_L_data.data();
+    // L*z = b
+    for (int j = 0; j < n; j++) {
+        const double yj = y[j];
+        for (int32_t p = Lp[j]; p < Lp[j+1]; p++) y[Li[p]] -= double(Lx[p])*yj;
+    }
+    // D*w = z
+    for (int j = 0; j < n; j++) y[j] /= m_D[j];
+    // L^T*x = w
+    for (int j = n-1; j >= 0; j--) {
+        double yj = y[j];
+        for (int32_t p = Lp[j]; p < Lp[j+1]; p++) yj -= double(Lx[p])*y[Li[p]];
+        y[j] = yj;
+    }
+
+    for (int k = 0; k < n; k++) v[m_permute[k]] = float(y[k]);
+}
+
+int32_t Cholesky_Solver::solve(TypedPinnedArray<float> B_data) {
+    return solve_many(B_data, 1);
+}
+
+// B is column-major with total_rhs columns, known voltages are left as they are
+int32_t Cholesky_Solver::solve_many(TypedPinnedArray<float> B_data, int total_rhs) {
+    if (total_rhs <= 0 || B_data.get_length() != get_total_rows()*total_rhs) return SOLVE_INVALID_SHAPE;
+    const auto timer = Kernel_Timer("cholesky_solve");
+    const int total_voltages = get_total_rows();
+    auto y = std::vector<double>(m_permute.size());
+    MODULE_LOG("Solving for Ax=b using L*D*L^T with %d right hand sides\n", total_rhs);
+    for (int k = 0; k < total_rhs; k++) {
+        solve_single(B_data.get_data() + k*total_voltages, y);
+    }
+    m_stats.solve_ms = timer.get_elapsed_ms();
+    m_stats.total_solves += 1.0;
+    return 0;
+}
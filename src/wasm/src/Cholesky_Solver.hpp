@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "./PinnedArray.hpp"
+
+// Direct solver for div(E)=0 which only factorises the unknown voltages of the (Ny+1)x(Nx+1) grid
+// - Cells with a forced voltage (beta > 0.5) and grid corners are known and moved into the right hand side
+// - Unknowns on the grid border only couple along the border so they are solved as tridiagonal runs first
+// - Scaling each inner row by (dx0+dx1)*(dy0+dy1) makes the remaining system symmetric positive definite
+//   so it is factorised as L*D*L^T, which stores half the factors of a general LU without any pivoting
+// - Unknowns are ordered by nested dissection of the grid which keeps fill-in at O(N*log(N))
+// - Takes the same right hand side from create_laplace_rhs() and returns the same voltages as LU_Solver
+// - The right edge can instead be a mirror axis so that half of a symmetric grid is solved (see Mirror_Solver)
+class Cholesky_Solver
+{
+public:
+    struct Create_Result {
+        std::shared_ptr<Cholesky_Solver> solver = nullptr;
+        int32_t factor_info = 0;
+    };
+    // returned by refactor() if the new grid does not have the same size and known voltages
+    static constexpr int32_t REFACTOR_PATTERN_MISMATCH = -1;
+    // returned by create() or refactor() if a pivot is not positive, e.g. from a zero width cell
+    static constexpr int32_t FACTOR_NOT_POSITIVE_DEFINITE = -2;
+    // returned by solve() if total_rhs <= 0 or B does not have total_rows*total_rhs elements
+    static constexpr int32_t SOLVE_INVALID_SHAPE = -3;
+    // NOTE: counts are doubles since embind has no 64bit integers without BigInt
+    struct Stats {
+        double total_rows = 0.0;
+        double reduced_rows = 0.0;      // unknowns inside the border that are factorised
+        double A_non_zeros = 0.0;       // lower triangle of the reduced system including the diagonal
+        double L_non_zeros = 0.0;       // including the diagonal
+        double factor_flops = 0.0;
+        double ordering_ms = 0.0;       // nested dissection ordering and elimination tree
+        double factor_ms = 0.0;
+        double solve_ms = 0.0;
+        double total_factorisations = 0.0;
+        double total_solves = 0.0;
+        double factor_bytes = 0.0;      // storage of L and D
+    };
+    // unknowns along the border between two known voltages
+    struct Border_Run {
+        int start = 0; // offset into m_border_nodes and m_border_spacing
+        int total_nodes = 0; // including the known voltage at each end
+        bool is_mirror_end = false; // last node is on the mirror edge instead of a known voltage
+    };
+    static constexpr int32_t MIRROR_NONE = 0;
+    static constexpr int32_t MIRROR_EVEN = 1; // voltage is the same on both sides (zero normal field)
+    static constexpr int32_t MIRROR_ODD = 2; // voltage is negated on the other side (zero voltage on the axis)
+    // Right edge (x=Nx) of a half grid which is mirrored to create the full grid
+    struct Mirror_Edge {
+        int32_t mode = MIRROR_NONE;
+        // 0 if the axis is on the x=Nx column, otherwise the width of the cell split by the axis
+        // which is the distance from the x=Nx column to its mirror image
+        float width = 0.0f;
+    };
+private:
+    int m_Nx = 0;
+    int m_Ny = 0;
+    Mirror_Edge m_mirror;
+    std::vector<float> m_dx;
+    std::vector<float> m_dy;
+    std::vector<uint8_t> m_is_known;
+    std::vector<int32_t> m_border_nodes;
+    std::vector<float> m_border_spacing;
+    std::vector<Border_Run> m_border_runs;
+    // reduced system of the unknowns inside the border in nested dissection order
+    std::vector<int32_t> m_permute; // reduced index to grid index
+    std::vector<int32_t> m_reduced_index; // grid index to reduced index or -1
+    std::vector<int32_t> m_parent; // elimination tree
+    // unit lower triangular L stored by column without its diagonal
+    std::vector<int32_t> m_L_col_ptr;
+    std::vector<int32_t> m_L_row_indices;
+    std::vector<float> m_L_data;
+    std::vector<double> m_D;
+    Stats m_stats;
+private:
+    void create_border_runs();
+    void create_ordering();
+    void create_elimination_tree();
+    void load_spacing(TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr);
+    int32_t factor();
+    bool is_mirror_column(int x) const { return m_mirror.mode != MIRROR_NONE && x == m_Nx; }
+    double get_dx_1(int x) const { return (x < m_Nx) ? double(m_dx[x]) : double(m_mirror.width); }
+    double get_couplings(int iv, double* couplings) const;
+    void solve_border(float* v) const;
+    void solve_single(float* v, std::vector<double>& y) const;
+public:
+    Cholesky_Solver(int Nx, int Ny, Mirror_Edge mirror): m_Nx(Nx), m_Ny(Ny), m_mirror(mirror) {}
+    static Create_Result create_from_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta
+    );
+    static Create_Result create_from_half_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta, Mirror_Edge mirror
+    );
+    // Reuses the ordering and elimination tree if the grid has the same size and known voltages
+    int32_t refactor_from_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta
+    );
+    // Same as refactor_from_grid() with a new mirror cell width, the mirror mode has to stay the same
+    int32_t refactor_from_half_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta, Mirror_Edge mirror
+    );
+    int32_t solve(TypedPinnedArray<float> B_data);
+    int32_t solve_many(TypedPinnedArray<float> B_data, int total_rhs);
+    int get_total_rows() const { return (m_Nx+1)*(m_Ny+1); }
+    int get_total_cols() const { return (m_Nx+1)*(m_Ny+1); }
+    Stats get_stats() const { return m_stats; }
+};
@@ -0,0 +1,312 @@
+#include "./FDTD_3D_Engine.hpp"
+#include "./simd.hpp"
+#include "./thread_pool.hpp"
+#include "./logging.hpp"
+#include <algorithm>
+
+// E/H are stored as rows of Nz cells with 3 interleaved components
+// Curl terms of a row are vectorised over the flat row index j = 3*iz + c by loading each
+// neighbour at a fixed offset and selecting per lane which component c that lane belongs to
+// - A group of W cells spans exactly 3 vectors so the lane masks repeat every group
+// - Operations per component are kept in the same order as the wgsl kernels
+static constexpr int TOTAL_DIMS = 3;
+static constexpr int MIN_ROWS_PER_CHUNK = 16;
+static constexpr int DEFAULT_MAX_TIME_BLOCK = 4;
+static constexpr int64_t DEFAULT_CACHE_SIZE_BYTES = 8*1024*1024;
+// E, H, A0, A1
+static constexpr int BYTES_PER_CELL = (2*TOTAL_DIMS + 2)*int(sizeof(float));
+
+struct Component_Masks {
+    // [vector][component][lane] is all bits set if the lane of the vector holds that component
+    uint32_t lanes[TOTAL_DIMS][TOTAL_DIMS][f32_vec::WIDTH];
+};
+
+static Component_Masks create_component_masks() {
+    constexpr int W = f32_vec::WIDTH;
+    Component_Masks masks;
+    for (int k = 0; k < TOTAL_DIMS; k++) {
+        for (int c = 0; c < TOTAL_DIMS; c++) {
+            for (int l = 0; l < W; l++) {
+                masks.lanes[k][c][l] = ((k*W + l) % TOTAL_DIMS == c) ? 0xFFFFFFFFu : 0u;
+            }
+        }
+    }
+    return masks;
+}
+
+static const Component_Masks COMPONENT_MASKS = create_component_masks();
+
+// vector groups are kept 2 cells away from both ends of the row so every load offset stays inside the row
+static inline int get_vector_end(int Nz) {
+    constexpr int W = f32_vec::WIDTH;
+    const int z_start = 2;
+    if (Nz-2 < z_start+W) return z_start;
+    return z_start + ((Nz-2-z_start)/W)*W;
+}
+
+// H_y1 and H_x1 are rows at iy+1 and ix+1 which are zero rows at the boundary (dirichlet)
+static inline void update_e_cell(
+    float* E, const float* H, const float* H_y1, const float* H_x1,
+    int iz, int Nz, float a0, float a1
+) {
+    const int i = TOTAL_DIMS*iz;
+    float dHz_dy = -H[i+2];
+    float dHy_dz = -H[i+1];
+    float dHx_dz = -H[i+0];
+    float dHz_dx = -H[i+2];
+    float dHy_dx = -H[i+1];
+    float dHx_dy = -H[i+0];
+    if (iz < (Nz-1)) {
+        dHy_dz += H[i+TOTAL_DIMS+1];
+        dHx_dz += H[i+TOTAL_DIMS+0];
+    }
+    dHz_dy += H_y1[i+2];
+    dHx_dy += H_y1[i+0];
+    dHz_dx += H_x1[i+2];
+    dHy_dx += H_x1[i+1];
+
+    const float cHx = dHz_dy-dHy_dz;
+    const float cHy = dHx_dz-dHz_dx;
+    const float cHz = dHy_dx-dHx_dy;
+    E[i+0] = a0*(E[i+0] + a1*cHx);
+    E[i+1] = a0*(E[i+1] + a1*cHy);
+    E[i+2] = a0*(E[i+2] + a1*cHz);
+}
+
+// E_y0 and E_x0 are rows at iy-1 and ix-1 which are zero rows at the boundary (dirichlet)
+static inline void update_h_cell(
+    float* H, const float* E, const float* E_y0, const float* E_x0,
+    int iz, float b0
+) {
+    const int i = TOTAL_DIMS*iz;
+    float dEz_dy = E[i+2];
+    float dEy_dz = E[i+1];
+    float dEx_dz = E[i+0];
+    float dEz_dx = E[i+2];
+    float dEy_dx = E[i+1];
+    float dEx_dy = E[i+0];
+    if (iz > 0) {
+        dEy_dz -= E[i-TOTAL_DIMS+1];
+        dEx_dz -= E[i-TOTAL_DIMS+0];
+    }
+    dEz_dy -= E_y0[i+2];
+    dEx_dy -= E_y0[i+0];
+    dEz_dx -= E_x0[i+2];
+    dEy_dx -= E_x0[i+1];
+
+    const float cEx = dEz_dy-dEy_dz;
+    const float cEy = dEx_dz-dEz_dx;
+    const float cEz = dEy_dx-dEx_dy;
+    H[i+0] = H[i+0] - b0*cEx;
+    H[i+1] = H[i+1] - b0*cEy;
+    H[i+2] = H[i+2] - b0*cEz;
+}
+
+static void update_e_row(
+    float* E, const float* H, const float* H_y1, const float* H_x1,
+    const float* a0, const float* a1, int Nz,
+    float* a0_lanes, float* a1_lanes
+) {
+    constexpr int W = f32_vec::WIDTH;
+    const int z_vector_end = get_vector_end(Nz);
+    for (int iz = 0; iz < std::min(2, Nz); iz++) {
+        update_e_cell(E, H, H_y1, H_x1, iz, Nz, a0[iz], a1[iz]);
+    }
+    // coefficients are per cell so they are repeated for each component lane
+    for (int iz = 2; iz < z_vector_end; iz++) {
+        for (int c = 0; c < TOTAL_DIMS; c++) {
+            a0_lanes[TOTAL_DIMS*iz+c] = a0[iz];
+            a1_lanes[TOTAL_DIMS*iz+c] = a1[iz];
+        }
+    }
+    for (int iz = 2; iz < z_vector_end; iz += W) {
+        for (int k = 0; k < TOTAL_DIMS; k++) {
+            const int j = TOTAL_DIMS*iz + k*W;
+            const f32_vec m0 = f32_vec_load_mask(COMPONENT_MASKS.lanes[k][0]);
+            const f32_vec m1 = f32_vec_load_mask(COMPONENT_MASKS.lanes[k][1]);
+            const f32_vec m2 = f32_vec_load_mask(COMPONENT_MASKS.lanes[k][2]);
+            // x: (Hz[y+1]-Hz) - (Hy[z+1]-Hy)
+            // y: (Hx[z+1]-Hx) - (Hz[x+1]-Hz)
+            // z: (Hy[x+1]-Hy) - (Hx[y+1]-Hx)
+            const f32_vec H_m2 = f32_vec_load(&H[j-2]);
+            const f32_vec H_m1 = f32_vec_load(&H[j-1]);
+            const f32_vec H_p1 = f32_vec_load(&H[j+1]);
+            const f32_vec H_p2 = f32_vec_load(&H[j+2]);
+            const f32_vec P1 = f32_vec_select(m0, f32_vec_load(&H_y1[j+2]), f32_vec_select(m1, H_p2, f32_vec_load(&H_x1[j-1])));
+            const f32_vec P2 = f32_vec_select(m0, H_p2, H_m1);
+            const f32_vec P3 = f32_vec_select(m0, f32_vec_load(&H[j+4]), f32_vec_select(m1, f32_vec_load(&H_x1[j+1]), f32_vec_load(&H_y1[j-2])));
+            const f32_vec P4 = f32_vec_select(m2, H_m2, H_p1);
+            const f32_vec curl = (P1-P2) - (P3-P4);
+            const f32_vec a0_vec = f32_vec_load(&a0_lanes[j]);
+            const f32_vec a1_vec = f32_vec_load(&a1_lanes[j]);
+            const f32_vec E_vec = f32_vec_load(&E[j]);
+            f32_vec_store(&E[j], a0_vec*(E_vec + a1_vec*curl));
+        }
+    }
+    for (int iz = std::max(z_vector_end, 2); iz < Nz; iz++) {
+        update_e_cell(E, H, H_y1, H_x1, iz, Nz, a0[iz], a1[iz]);
+    }
+}
+
+static void update_h_row(
+    float* H, const float* E, const float* E_y0, const float* E_x0,
+    float b0, int Nz
+) {
+    constexpr int W = f32_vec::WIDTH;
+    const int z_vector_end = get_vector_end(Nz);
+    for (int iz = 0; iz < std::min(2, Nz); iz++) {
+        update_h_cell(H, E, E_y0, E_x0, iz, b0);
+    }
+    const f32_vec b0_vec = f32_vec(b0);
+    for (int iz = 2; iz < z_vector_end; iz += W) {
+        for (int k = 0; k < TOTAL_DIMS; k++) {
+            const int j = TOTAL_DIMS*iz + k*W;
+            const f32_vec m0 = f32_vec_load_mask(COMPONENT_MASKS.lanes[k][0]);
+            const f32_vec m1 = f32_vec_load_mask(COMPONENT_MASKS.lanes[k][1]);
+            const f32_vec m2 = f32_vec_load_mask(COMPONENT_MASKS.lanes[k][2]);
+            // x: (Ez-Ez[y-1]) - (Ey-Ey[z-1])
+            // y: (Ex-Ex[z-1]) - (Ez-Ez[x-1])
+            // z: (Ey-Ey[x-1]) - (Ex-Ex[y-1])
+            const f32_vec E_m2 = f32_vec_load(&E[j-2]);
+            const f32_vec E_m1 = f32_vec_load(&E[j-1]);
+            const f32_vec E_p1 = f32_vec_load(&E[j+1]);
+            const f32_vec E_p2 = f32_vec_load(&E[j+2]);
+            const f32_vec P1 = f32_vec_select(m0, E_p2, E_m1);
+            const f32_vec P2 = f32_vec_select(m0, f32_vec_load(&E_y0[j+2]), f32_vec_select(m1, f32_vec_load(&E[j-4]), f32_vec_load(&E_x0[j-1])));
+            const f32_vec P3 = f32_vec_select(m2, E_m2, E_p1);
+            const f32_vec P4 = f32_vec_select(m0, E_m2, f32_vec_select(m1, f32_vec_load(&E_x0[j+1]), f32_vec_load(&E_y0[j-2])));
+            const f32_vec curl = (P1-P2) - (P3-P4);
+            const f32_vec H_vec = f32_vec_load(&H[j]);
+            f32_vec_store(&H[j], H_vec - b0_vec*curl);
+        }
+    }
+    for (int iz = std::max(z_vector_end, 2); iz < Nz; iz++) {
+        update_h_cell(H, E, E_y0, E_x0, iz, b0);
+    }
+}
+
+FDTD_3D_Engine::FDTD_3D_Engine(int size_x, int size_y, int size_z)
+: m_size{size_x, size_y, size_z}, m_max_time_block(DEFAULT_MAX_TIME_BLOCK), m_cache_size_bytes(DEFAULT_CACHE_SIZE_BYTES) {}
+
+std::shared_ptr<FDTD_3D_Engine> FDTD_3D_Engine::create(int size_x, int size_y, int size_z) {
+    if (size_x <= 0 || size_y <= 0 || size_z <= 0) return nullptr;
+    return std::make_shared<FDTD_3D_Engine>(size_x, size_y, size_z);
+}
+
+void FDTD_3D_Engine::add_source(
+    int offset_x, int offset_y, int offset_z,
+    int size_x, int size_y, int size_z,
+    TypedPinnedArray<float> signal
+) {
+    Source source;
+    source.offset[0] = offset_x;
+    source.offset[1] = offset_y;
+    source.offset[2] = offset_z;
+    source.size[0] = size_x;
+    source.size[1] = size_y;
+    source.size[2] = size_z;
+    source.signal.assign(signal.get_data(), signal.get_data() + signal.get_length());
+    m_sources.push_back(std::move(source));
+}
+
+void FDTD_3D_Engine::clear_sources() {
+    m_sources.clear();
+}
+
+int FDTD_3D_Engine::get_time_block() const {
+    // a sweep position updates up to T slabs spaced 2 apart and reads one slab either side of them
+    const int64_t slab_bytes = int64_t(m_size[1])*int64_t(m_size[2])*BYTES_PER_CELL;
+    const int64_t total_cached_slabs = m_cache_size_bytes / std::max(slab_bytes, int64_t(1));
+    const int max_fit = int(std::min((total_cached_slabs-1)/2, int64_t(m_size[0])));
+    return std::max(1, std::min(m_max_time_block, max_fit));
+}
+
+// Wavefront over x-slabs with T timesteps in flight
+// - At sweep position s timestep t updates slab x = s-2t
+// - E[t](x) needs H[t-1](x+1) which was updated at s-1 and not yet overwritten by H[t](x+1) at s+1
+// - H[t](x) needs E[t](x-1) which was updated at s-1 and not yet overwritten by E[t+1](x-1) at s+1
+// - All E rows of the active slabs are updated before any H row so rows can be split across threads
+void FDTD_3D_Engine::step(
+    TypedPinnedArray<float> E_arr, TypedPinnedArray<float> H_arr,
+    TypedPinnedArray<float> A0_arr, TypedPinnedArray<float> A1_arr,
+    float b0, int timestep, int total_steps
+) {
+    const int Nx = m_size[0];
+    const int Ny = m_size[1];
+    const int Nz = m_size[2];
+    const int total_cells = Nx*Ny*Nz;
+    if (
+        E_arr.get_length() != TOTAL_DIMS*total_cells || H_arr.get_length() != TOTAL_DIMS*total_cells ||
+        A0_arr.get_length() != total_cells || A1_arr.get_length() != total_cells
+    ) {
+        MODULE_LOG("FDTD_3D_Engine::step() received fields that don't match grid size (%d,%d,%d)\n", Nx, Ny, Nz);
+        return;
+    }
+    float* E = E_arr.get_data();
+    float* H = H_arr.get_data();
+    const float* A0 = A0_arr.get_data();
+    const float* A1 = A1_arr.get_data();
+    const int row_stride = TOTAL_DIMS*Nz;
+    const int slab_stride = row_stride*Ny;
+    const auto zero_row = std::vector<float>(row_stride, 0.0f);
+
+    const auto apply_sources = [&](int curr_timestep, int x, int y) {
+        for (const auto& source: m_sources) {
+            if (curr_timestep < 0 || curr_timestep >= int(source.signal.size())) continue;
+            if (x < source.offset[0] || x >= source.offset[0]+source.size[0]) continue;
+            if (y < source.offset[1] || y >= source.offset[1]+source.size[1]) continue;
+            const float e0 = source.signal[curr_timestep];
+            const int z_start = std::max(source.offset[2], 0);
+            const int z_end = std::min(source.offset[2]+source.size[2], Nz);
+            float* E_row = &E[x*slab_stride + y*row_stride];
+            for (int z = z_start; z < z_end; z++) {
+                E_row[TOTAL_DIMS*z+0] += e0;
+            }
+        }
+    };
+
+    const int time_block = get_time_block();
+    for (int block_start = 0; block_start < total_steps; block_start += time_block) {
+        const int total_block_steps = std::min(time_block, total_steps-block_start);
+        const int block_timestep = timestep + block_start;
+        const int total_sweeps = Nx + 2*(total_block_steps-1);
+        for (int s = 0; s < total_sweeps; s++) {
+            const int t_begin = (s > Nx-1) ? (s-(Nx-1)+1)/2 : 0;
+            const int t_end = std::min(total_block_steps-1, s/2);
+            const int total_rows = (t_end-t_begin+1)*Ny;
+
+            parallel_for_chunks(total_rows, MIN_ROWS_PER_CHUNK, [&](int, int r_start, int r_end) {
+                thread_local std::vector<float> a0_lanes;
+                thread_local std::vector<float> a1_lanes;
+                a0_lanes.resize(row_stride);
+                a1_lanes.resize(row_stride);
+                for (int r = r_start; r < r_end; r++) {
+                    const int t = t_begin + r/Ny;
+                    const int y = r % Ny;
+                    const int x = s-2*t;
+                    apply_sources(block_timestep+t, x, y);
+                    const int i_row = x*slab_stride + y*row_stride;
+                    const float* H_y1 = (y < Ny-1) ? &H[i_row+row_stride] : zero_row.data();
+                    const float* H_x1 = (x < Nx-1) ? &H[i_row+slab_stride] : zero_row.data();
+                    update_e_row(
+                        &E[i_row], &H[i_row], H_y1, H_x1,
+                        &A0[i_row/TOTAL_DIMS], &A1[i_row/TOTAL_DIMS], Nz,
+                        a0_lanes.data(), a1_lanes.data()
+                    );
+                }
+            });
+
+            parallel_for_chunks(total_rows, MIN_ROWS_PER_CHUNK, [&](int, int r_start, int r_end) {
+                for (int r = r_start; r < r_end; r++) {
+                    const int t = t_begin + r/Ny;
+                    const int y = r % Ny;
+                    const int x = s-2*t;
+                    const int i_row = x*slab_stride + y*row_stride;
+                    const float* E_y0 = (y > 0) ? &E[i_row-row_stride] : zero_row.data();
+                    const float* E_x0 = (x > 0) ? &E[i_row-slab_stride] : zero_row.data();
+                    update_h_row(&H[i_row], &E[i_row], E_y0, E_x0, b0, Nz);
+                }
+            });
+        }
+    }
+}
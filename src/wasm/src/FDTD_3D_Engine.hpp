@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "./PinnedArray.hpp"
+
+// CPU implementation of the wgpu_kernels/fdtd_3d update kernels
+// - E and H are interleaved [Nx,Ny,Nz,3] and A0/A1 are [Nx,Ny,Nz] exactly like the gpu buffers
+// - Each step matches the gpu pass order of current sources, E update then H update
+// - Several timesteps are swept through the grid together as a wavefront over x-slabs so that
+//   slabs are reused from cache between the E/H half steps of consecutive timesteps
+class FDTD_3D_Engine
+{
+public:
+    struct Source {
+        int offset[3];
+        int size[3];
+        std::vector<float> signal;
+    };
+private:
+    int m_size[3];
+    std::vector<Source> m_sources;
+    int m_max_time_block;
+    int64_t m_cache_size_bytes;
+public:
+    FDTD_3D_Engine(int size_x, int size_y, int size_z);
+    static std::shared_ptr<FDTD_3D_Engine> create(int size_x, int size_y, int size_z);
+    // signal[t] is added to Ex inside the region for timesteps t < signal length
+    void add_source(
+        int offset_x, int offset_y, int offset_z,
+        int size_x, int size_y, int size_z,
+        TypedPinnedArray<float> signal
+    );
+    void clear_sources();
+    // advance by total_steps starting at timestep which indexes into the source signals
+    // b0 = 1/(mu_k*d_xyz) * dt
+    void step(
+        TypedPinnedArray<float> E, TypedPinnedArray<float> H,
+        TypedPinnedArray<float> A0, TypedPinnedArray<float> A1,
+        float b0, int timestep, int total_steps
+    );
+    // number of timesteps swept together which is further limited so the active slabs fit in cache
+    int get_time_block() const;
+    int get_max_time_block() const { return m_max_time_block; }
+    void set_max_time_block(int max_time_block) { m_max_time_block = (max_time_block < 1) ? 1 : max_time_block; }
+    double get_cache_size_bytes() const { return double(m_cache_size_bytes); }
+    void set_cache_size_bytes(double cache_size_bytes) { m_cache_size_bytes = int64_t(cache_size_bytes); }
+    int get_total_sources() const { return int(m_sources.size()); }
+};
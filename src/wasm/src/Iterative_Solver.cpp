@@ -0,0 +1,257 @@
+#include "./Iterative_Solver.hpp"
+#include "./logging.hpp"
+#include "./kernel_timings.hpp"
+#include <math.h>
+#include <vector>
+
+Iterative_Solver::Create_Result Iterative_Solver::create(
+    TypedPinnedArray<float> A_non_zero_data,
+    TypedPinnedArray<int32_t> A_col_indices, TypedPinnedArray<int32_t> A_row_index_ptr,
+    int total_rows, int total_cols
+) {
+    CSR_Matrix A;
+    A.non_zero_data = std::vector<float>(A_non_zero_data.get_data(), A_non_zero_data.get_data() + A_non_zero_data.get_length());
+    A.col_indices = std::vector<int32_t>(A_col_indices.get_data(), A_col_indices.get_data() + A_col_indices.get_length());
+    A.row_index_ptr = std::vector<int32_t>(A_row_index_ptr.get_data(), A_row_index_ptr.get_data() + A_row_index_ptr.get_length());
+    A.total_rows = total_rows;
+    A.total_cols = total_cols;
+    return create_from_csr(std::move(A));
+}
+
+Iterative_Solver::Create_Result Iterative_Solver::create_from_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    MODULE_LOG("Creating CSR matrix A from grid\n");
+    return create_from_csr(create_laplace_csr_matrix(dx_arr, dy_arr, v_index_beta));
+}
+
+// SRC: Saad, Iterative Methods for Sparse Linear Systems, Algorithm 10.4 ILU(0)
+// - Incomplete LU factorisation which drops any fill-in outside of the sparsity pattern of A
+// - L is unit lower triangular and U is upper triangular, both are stored in place of A
+// - Requires column indices of each row to be sorted in ascending order
+Iterative_Solver::Create_Result Iterative_Solver::create_from_csr(CSR_Matrix&& A) {
+    const auto timer = Kernel_Timer("iterative_setup");
+    const int N = A.total_rows;
+    const int32_t* row_ptr = A.row_index_ptr.data();
+    const int32_t* cols = A.col_indices.data();
+
+    MODULE_LOG("Finding diagonal entries for ILU(0)\n");
+    auto diagonal_index = std::vector<int32_t>(N, -1);
+    for (int i = 0; i < N; i++) {
+        for (int32_t k = row_ptr[i]; k < row_ptr[i+1]; k++) {
+            if (cols[k] == i) {
+                diagonal_index[i] = k;
+                break;
+            }
+        }
+        if (diagonal_index[i] < 0) {
+            MODULE_LOG("Missing diagonal entry on row %d\n", i);
+            return { nullptr, i+1 };
+        }
+    }
+
+    MODULE_LOG("Performing ILU(0) factorisation\n");
+    auto ilu = A.non_zero_data;
+    auto column_to_entry = std::vector<int32_t>(A.total_cols, -1);
+    for (int i = 0; i < N; i++) {
+        const int32_t row_start = row_ptr[i];
+        const int32_t row_end = row_ptr[i+1];
+        for (int32_t k = row_start; k < row_end; k++) {
+            column_to_entry[cols[k]] = k;
+        }
+        for (int32_t ik = row_start; ik < diagonal_index[i]; ik++) {
+            const int32_t k = cols[ik];
+            const float pivot = ilu[diagonal_index[k]];
+            if (pivot == 0.0f) {
+                MODULE_LOG("Zero pivot in ILU(0) on row %d\n", k);
+                return { nullptr, k+1 };
+            }
+            const float L_ik = ilu[ik] / pivot;
+            ilu[ik] = L_ik;
+            for (int32_t kj = diagonal_index[k]+1; kj < row_ptr[k+1]; kj++) {
+                const int32_t ij = column_to_entry[cols[kj]];
+                if (ij >= 0) ilu[ij] -= L_ik*ilu[kj];
+            }
+        }
+        for (int32_t k = row_start; k < row_end; k++) {
+            column_to_entry[cols[k]] = -1;
+        }
+        if (ilu[diagonal_index[i]] == 0.0f) {
+            MODULE_LOG("Zero pivot in ILU(0) on row %d\n", i);
+            return { nullptr, i+1 };
+        }
+    }
+
+    const auto solver = std::make_shared<Iterative_Solver>(std::move(A), std::move(ilu), std::move(diagonal_index));
+    return { solver, 0 };
+}
+
+void Iterative_Solver::apply_A(const float* x, float* y) const {
+    const int N = m_A.total_rows;
+    const int32_t* row_ptr = m_A.row_index_ptr.data();
+    const int32_t* cols = m_A.col_indices.data();
+    const float* data = m_A.non_zero_data.data();
+    for (int i = 0; i < N; i++) {
+        float sum = 0.0f;
+        for (int32_t k = row_ptr[i]; k < row_ptr[i+1]; k++) {
+            sum += data[k]*x[cols[k]];
+        }
+        y[i] = sum;
+    }
+}
+
+// y = (LU)^-1 x
+void Iterative_Solver::apply_preconditioner(const float* x, float* y) const {
+    const int N = m_A.total_rows;
+    const int32_t* row_ptr = m_A.row_index_ptr.data();
+    const int32_t* cols = m_A.col_indices.data();
+    const float* ilu = m_ilu_data.data();
+    // forward substitution with unit lower triangular L
+    for (int i = 0; i < N; i++) {
+        float sum = x[i];
+        for (int32_t k = row_ptr[i]; k < m_diagonal_index[i]; k++) {
+            sum -= ilu[k]*y[cols[k]];
+        }
+        y[i] = sum;
+    }
+    // backward substitution with upper triangular U
+    for (int i = N-1; i >= 0; i--) {
+        float sum = y[i];
+        const int32_t diag = m_diagonal_index[i];
+        for (int32_t k = diag+1; k < row_ptr[i+1]; k++) {
+            sum -= ilu[k]*y[cols[k]];
+        }
+        y[i] = sum / ilu[diag];
+    }
+}
+
+static inline double dot(const std::vector<float>& a, const std::vector<float>& b) {
+    double sum = 0.0;
+    const int N = int(a.size());
+    for (int i = 0; i < N; i++) sum += double(a[i])*double(b[i]);
+    return sum;
+}
+
+// SRC: van der Vorst, Bi-CGSTAB: A fast and smoothly converging variant of Bi-CG (1992)
+// - Preconditioned variant where M = LU from ILU(0)
+// - Solves Ax=b where b is read from B and the solution x is written back into B
+// - X is used as the initial guess and is updated with the solution
+int32_t Iterative_Solver::solve_single(float* B, std::vector<float>& X) {
+    const int N = m_A.total_rows;
+    auto b = std::vector<float>(B, B+N);
+    auto r = std::vector<float>(N);
+    auto r_hat = std::vector<float>(N);
+    auto p = std::vector<float>(N, 0.0f);
+    auto v = std::vector<float>(N, 0.0f);
+    auto y = std::vector<float>(N);
+    auto s = std::vector<float>(N);
+    auto z = std::vector<float>(N);
+    auto t = std::vector<float>(N);
+
+    const double b_norm = sqrt(dot(b, b));
+    m_last_iterations = 0;
+    m_last_relative_residual = 0.0f;
+    if (b_norm == 0.0) {
+        for (int i = 0; i < N; i++) X[i] = 0.0f;
+        for (int i = 0; i < N; i++) B[i] = 0.0f;
+        return 0;
+    }
+    const double threshold = double(m_tolerance)*b_norm;
+
+    // rows with only a diagonal entry (forced voltages) are solved exactly so that the residual is zero there
+    // otherwise r_hat only has support on these rows and becomes orthogonal to later residuals (breakdown)
+    for (int i = 0; i < N; i++) {
+        const int32_t diag = m_diagonal_index[i];
+        const bool is_diagonal_row = (m_A.row_index_ptr[i]+1 == m_A.row_index_ptr[i+1]);
+        if (is_diagonal_row) X[i] = b[i] / m_A.non_zero_data[diag];
+    }
+
+    apply_A(X.data(), r.data());
+    for (int i = 0; i < N; i++) r[i] = b[i]-r[i];
+    r_hat = r;
+
+    double rho_prev = 1.0, alpha = 1.0, omega = 1.0;
+    double r_norm = sqrt(dot(r, r));
+    int32_t info = SOLVE_NOT_CONVERGED;
+    int iteration = 0;
+    if (r_norm <= threshold) info = 0;
+    while (info != 0 && iteration < m_max_iterations) {
+        iteration++;
+        double rho = dot(r_hat, r);
+        if (rho == 0.0) {
+            // restart with the current residual as the new shadow residual
+            r_hat = r;
+            rho = dot(r_hat, r);
+            rho_prev = alpha = omega = 1.0;
+            for (int i = 0; i < N; i++) p[i] = v[i] = 0.0f;
+        }
+        if (omega == 0.0) {
+            info = SOLVE_BREAKDOWN;
+            break;
+        }
+        const double beta = (rho/rho_prev)*(alpha/omega);
+        for (int i = 0; i < N; i++) p[i] = float(r[i] + beta*(p[i] - omega*v[i]));
+        apply_preconditioner(p.data(), y.data());
+        apply_A(y.data(), v.data());
+        const double r_hat_v = dot(r_hat, v);
+        if (r_hat_v == 0.0) {
+            info = SOLVE_BREAKDOWN;
+            break;
+        }
+        alpha = rho/r_hat_v;
+        for (int i = 0; i < N; i++) X[i] += float(alpha*y[i]);
+        for (int i = 0; i < N; i++) s[i] = float(r[i] - alpha*v[i]);
+        const double s_norm = sqrt(dot(s, s));
+        if (s_norm <= threshold) {
+            r_norm = s_norm;
+            info = 0;
+            break;
+        }
+        apply_preconditioner(s.data(), z.data());
+        apply_A(z.data(), t.data());
+        const double t_t = dot(t, t);
+        omega = (t_t == 0.0) ? 0.0 : dot(t, s)/t_t;
+        for (int i = 0; i < N; i++) X[i] += float(omega*z[i]);
+        for (int i = 0; i < N; i++) r[i] = float(s[i] - omega*t[i]);
+        r_norm = sqrt(dot(r, r));
+        if (r_norm <= threshold) info = 0;
+        rho_prev = rho;
+    }
+
+    m_last_iterations = iteration;
+    m_last_relative_residual = float(r_norm/b_norm);
+    MODULE_LOG("BiCGSTAB finished with info=%d after %d iterations with relative residual %.3e\n",
+        info, iteration, m_last_relative_residual);
+    for (int i = 0; i < N; i++) B[i] = X[i];
+    return info;
+}
+
+int32_t Iterative_Solver::solve(TypedPinnedArray<float> B_data) {
+    return solve_many(B_data, 1);
+}
+
+int32_t Iterative_Solver::solve_many(TypedPinnedArray<float> B_data, int total_rhs) {
+    const auto timer = Kernel_Timer("iterative_solve");
+    const int N = m_A.total_rows;
+    if (total_rhs <= 0 || B_data.get_length() != N*total_rhs) return SOLVE_INVALID_SHAPE;
+    if (int(m_previous_solutions.size()) < total_rhs) {
+        m_previous_solutions.resize(total_rhs, std::vector<float>(N, 0.0f));
+    }
+    int32_t info = 0;
+    for (int k = 0; k < total_rhs; k++) {
+        const int32_t rhs_info = solve_single(&B_data[k*N], m_previous_solutions[k]);
+        if (rhs_info != 0) info = rhs_info;
+    }
+    return info;
+}
+
+// Warm start the next solve with an existing solution such as the voltage field of a similar grid
+void Iterative_Solver::set_initial_guess(TypedPinnedArray<float> X_data, int total_rhs) {
+    const int N = m_A.total_rows;
+    m_previous_solutions.resize(total_rhs);
+    for (int k = 0; k < total_rhs; k++) {
+        const float* X = &X_data[k*N];
+        m_previous_solutions[k] = std::vector<float>(X, X+N);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "./PinnedArray.hpp"
+#include "./laplace_matrix.hpp"
+
+// Preconditioned BiCGSTAB solver with an ILU(0) preconditioner
+// - Uses O(nnz) memory unlike LU factorisation which suffers from fill-in on large grids
+// - div(E) matrix is row normalised and non-symmetric so conjugate gradient cannot be used directly
+// - Each right hand side is warm started from its previous solution or set_initial_guess()
+// - Grid.bake() seeds it with the last basis or the coarse basis interpolated onto a refined mesh
+// - Only used when the solver is set to "iterative" in the mesh settings since auto mode picks mirror or multigrid
+class Iterative_Solver
+{
+public:
+    struct Create_Result {
+        std::shared_ptr<Iterative_Solver> solver = nullptr;
+        int32_t ilu_factor_info = 0;
+    };
+    // returned by solve() if the iteration broke down due to a zero inner product
+    static constexpr int32_t SOLVE_BREAKDOWN = -1;
+    // returned by solve() if the residual did not converge within max_iterations
+    static constexpr int32_t SOLVE_NOT_CONVERGED = 1;
+    // returned by solve() if total_rhs <= 0 or B does not have total_rows*total_rhs elements
+    static constexpr int32_t SOLVE_INVALID_SHAPE = -2;
+private:
+    CSR_Matrix m_A;
+    std::vector<float> m_ilu_data; // ILU(0) factors with the same sparsity pattern as A
+    std::vector<int32_t> m_diagonal_index;
+    std::vector<std::vector<float>> m_previous_solutions;
+    float m_tolerance = 1e-6f;
+    int m_max_iterations = 2000;
+    int m_last_iterations = 0;
+    float m_last_relative_residual = 0.0f;
+private:
+    static Create_Result create_from_csr(CSR_Matrix&& A);
+    void apply_A(const float* x, float* y) const;
+    void apply_preconditioner(const float* x, float* y) const;
+    int32_t solve_single(float* B, std::vector<float>& X);
+public:
+    Iterative_Solver(CSR_Matrix&& A, std::vector<float>&& ilu_data, std::vector<int32_t>&& diagonal_index):
+        m_A(std::move(A)), m_ilu_data(std::move(ilu_data)), m_diagonal_index(std::move(diagonal_index))
+    {}
+    static Create_Result create(
+        TypedPinnedArray<float> A_non_zero_data,
+        TypedPinnedArray<int32_t> A_col_indices, TypedPinnedArray<int32_t> A_row_index_ptr,
+        int total_rows, int total_cols
+    );
+    static Create_Result create_from_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta
+    );
+    int32_t solve(TypedPinnedArray<float> B_data);
+    int32_t solve_many(TypedPinnedArray<float> B_data, int total_rhs);
+    void set_initial_guess(TypedPinnedArray<float> X_data, int total_rhs);
+    int get_total_rows() const { return m_A.total_rows; }
+    int get_total_cols() const { return m_A.total_cols; }
+    float get_tolerance() const { return m_tolerance; }
+    void set_tolerance(float tolerance) { m_tolerance = tolerance; }
+    int get_max_iterations() const { return m_max_iterations; }
+    void set_max_iterations(int max_iterations) { m_max_iterations = max_iterations; }
+    int get_last_iterations() const { return m_last_iterations; }
+    float get_last_relative_residual() const { return m_last_relative_residual; }
+};
@@ -1,31 +1,88 @@
 #include "./LU_Solver.hpp"
+#include "./laplace_matrix.hpp"
 #include "./logging.hpp"
+#include "./kernel_timings.hpp"
 #include <vector>
 
 extern "C" {
 #include "slu_sdefs.h"
 }
 
+static superlu_options_t get_default_options() {
+    // from set_default_options()
+    superlu_options_t options;
+    options.Fact = DOFACT;
+    options.Equil = YES;
+    options.ColPerm = COLAMD;
+    options.Trans = NOTRANS;
+    options.IterRefine = NOREFINE;
+    options.DiagPivotThresh = 1.0;
+    options.SymmetricMode = NO;
+    options.PivotGrowth = NO;
+    options.ConditionNumber = NO;
+    options.PrintStat = YES;
+    return options;
+}
+
 LU_Solver::Create_Result LU_Solver::create(
     TypedPinnedArray<float> A_non_zero_data,
     TypedPinnedArray<int32_t> A_col_indices, TypedPinnedArray<int32_t> A_row_index_ptr,
     int total_rows, int total_cols
+) {
+    // NOTE: keep a copy of the sparsity pattern since the caller owns these buffers
+    auto col_indices = std::vector<int32_t>(A_col_indices.get_data(), A_col_indices.get_data() + A_col_indices.get_length());
+    auto row_index_ptr = std::vector<int32_t>(A_row_index_ptr.get_data(), A_row_index_ptr.get_data() + A_row_index_ptr.get_length());
+    return create_from_csr(
+        A_non_zero_data.get_data(), std::move(col_indices), std::move(row_index_ptr),
+        total_rows, total_cols
+    );
+}
+
+// NOTE: sgstrf() accumulates into these counters and sgstrs() overwrites them, so they are cleared
+//       before every call to only read the cost of that call
+static void clear_stat_counters(SuperLUStat_t& stat) {
+    stat.ops[FACT] = 0.0f;
+    stat.ops[SOLVE] = 0.0f;
+    stat.ops[TRSV] = 0.0f;
+    stat.ops[GEMV] = 0.0f;
+    stat.TinyPivots = 0;
+    stat.expansions = 0;
+}
+
+// DOC: SuperLU sgstrf() - info <= n is an exactly singular U(info,info) after the factorisation completed
+//      while info > n is an allocation failure and info < 0 an illegal argument, where L and U are not usable
+static bool is_lu_allocated(int_t lu_factor_info, int total_cols) {
+    return lu_factor_info >= 0 && lu_factor_info <= int_t(total_cols);
+}
+
+void LU_Solver::record_factor_stats(Stats& stats, SuperLUStat_t& stat, double factor_ms) {
+    stats.factor_flops = double(stat.ops[FACT]);
+    stats.factor_ms = factor_ms;
+    stats.tiny_pivots = double(stat.TinyPivots);
+    stats.memory_expansions = double(stat.expansions);
+    stats.total_factorisations += 1.0;
+}
+
+LU_Solver::Create_Result LU_Solver::create_from_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    MODULE_LOG("Creating CSR matrix A from grid\n");
+    // NOTE: sgstrf does not take ownership of A so the CSR values can be freed once factorised
+    CSR_Matrix A = create_laplace_csr_matrix(dx_arr, dy_arr, v_index_beta);
+    return create_from_csr(
+        A.non_zero_data.data(), std::move(A.col_indices), std::move(A.row_index_ptr),
+        A.total_rows, A.total_cols
+    );
+}
+
+LU_Solver::Create_Result LU_Solver::create_from_csr(
+    float* A_non_zero_data,
+    std::vector<int32_t>&& A_col_indices, std::vector<int32_t>&& A_row_index_ptr,
+    int total_rows, int total_cols
 ) {
     MODULE_LOG("Setting default options for superlu\n");
-    // from set_default_options()
-    superlu_options_t options;
-    {
-        options.Fact = DOFACT;
-        options.Equil = YES;
-        options.ColPerm = COLAMD;
-        options.Trans = NOTRANS;
-        options.IterRefine = NOREFINE;
-        options.DiagPivotThresh = 1.0;
-        options.SymmetricMode = NO;
-        options.PivotGrowth = NO;
-        options.ConditionNumber = NO;
-        options.PrintStat = YES;
-    }
+    superlu_options_t options = get_default_options();
 
     // DOC: SuperLU Page 19 Section 2.3 - Matrix data structures
     // SRC: void sCreate_CompCol_Matrix(...)
@@ -41,35 +98,46 @@ LU_Solver::Create_Result LU_Solver::create(
     A.ncol = total_rows;
     NCformat Astore;
     A.Store = (void*)(&Astore);
-    Astore.nnz = A_non_zero_data.get_length();
-    Astore.nzval = A_non_zero_data.get_data();
-    Astore.rowind = A_col_indices.get_data();
-    Astore.colptr = A_row_index_ptr.get_data();
+    Astore.nnz = int_t(A_col_indices.size());
+    Astore.nzval = A_non_zero_data;
+    Astore.rowind = A_col_indices.data();
+    Astore.colptr = A_row_index_ptr.data();
+
+    Stats stats;
+    stats.total_rows = double(total_rows);
+    stats.A_non_zeros = double(A_col_indices.size());
 
     // NOTE: Following steps are taken from sgssv()
     MODULE_LOG("Permute columns for A to convert from SLU_NC to SLU_NCP format\n");
     auto permute_col = std::vector<int>(A.ncol);
-    if (options.ColPerm != MY_PERMC && options.Fact == DOFACT) {
-        get_perm_c(options.ColPerm, &A, permute_col.data());
-    }
     auto elimination_tree = std::vector<int>(A.ncol);
     SuperMatrix A_column_permuted;
-    sp_preorder(&options, &A, permute_col.data(), elimination_tree.data(), &A_column_permuted);
+    {
+        const auto timer = Kernel_Timer("lu_ordering");
+        if (options.ColPerm != MY_PERMC && options.Fact == DOFACT) {
+            get_perm_c(options.ColPerm, &A, permute_col.data());
+        }
+        sp_preorder(&options, &A, permute_col.data(), elimination_tree.data(), &A_column_permuted);
+        stats.ordering_ms = timer.get_elapsed_ms();
+    }
 
     MODULE_LOG("Initialize the statistics variables\n");
     SuperLUStat_t stat;
     StatInit(&stat);
+    clear_stat_counters(stat);
 
     MODULE_LOG("Perform LU factorisation using sgstrf() with row permutations for partial pivoting\n");
     auto permute_row = std::vector<int>(A.nrow);
     SuperMatrix L;
     SuperMatrix U;
+    // NOTE: Glu keeps the allocation sizes of L and U which are needed to reuse them in refactor()
+    GlobalLU_t Glu;
     int_t lu_factor_info = 0;
     {
+        const auto timer = Kernel_Timer("lu_factor");
         const int panel_size = sp_ienv(1);
         const int relax = sp_ienv(2);
         const int work_array_size = 0; // 0 = allocate space internally by system malloc
-        GlobalLU_t Glu;
         sgstrf(
             &options, &A_column_permuted,
             relax, panel_size, elimination_tree.data(),
@@ -78,49 +146,201 @@ LU_Solver::Create_Result LU_Solver::create(
             &L, &U,
             &Glu, &stat, &lu_factor_info
         );
+        record_factor_stats(stats, stat, timer.get_elapsed_ms());
     }
 
     Destroy_CompCol_Permuted(&A_column_permuted);
 
     if (lu_factor_info != 0) {
         StatFree(&stat);
-        Destroy_SuperNode_Matrix(&L);
-        Destroy_CompCol_Matrix(&U);
+        if (is_lu_allocated(lu_factor_info, A.ncol)) {
+            Destroy_SuperNode_Matrix(&L);
+            Destroy_CompCol_Matrix(&U);
+        }
         return { nullptr, lu_factor_info };
     }
 
     const auto solver = std::make_shared<LU_Solver>(
+        std::move(A_col_indices), std::move(A_row_index_ptr),
         std::move(permute_col), std::move(permute_row), std::move(elimination_tree),
-        stat, transpose_mode, L, U,
+        stat, transpose_mode, L, U, Glu,
         total_rows, total_cols
     );
+    solver->m_stats = stats;
     return { solver, lu_factor_info };
 }
 
+int32_t LU_Solver::refactor(TypedPinnedArray<float> A_non_zero_data, bool is_same_row_permutation) {
+    if (A_non_zero_data.get_length() != int(m_A_col_indices.size())) {
+        MODULE_LOG("Refactor got %d non-zero values but sparsity pattern has %d\n",
+            A_non_zero_data.get_length(), int(m_A_col_indices.size()));
+        return REFACTOR_PATTERN_MISMATCH;
+    }
+    return refactor_from_csr(A_non_zero_data.get_data(), is_same_row_permutation);
+}
+
+int32_t LU_Solver::refactor_from_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta,
+    bool is_same_row_permutation
+) {
+    MODULE_LOG("Creating CSR matrix A from grid for refactorisation\n");
+    CSR_Matrix A = create_laplace_csr_matrix(dx_arr, dy_arr, v_index_beta);
+    if (
+        A.total_rows != m_total_rows || A.total_cols != m_total_cols ||
+        A.row_index_ptr != m_A_row_index_ptr || A.col_indices != m_A_col_indices
+    ) {
+        MODULE_LOG("Refactor got a grid with a different sparsity pattern\n");
+        return REFACTOR_PATTERN_MISMATCH;
+    }
+    return refactor_from_csr(A.non_zero_data.data(), is_same_row_permutation);
+}
+
+// DOC: SuperLU Section 2.4 - Options argument
+// - SamePattern: reuse the column permutation and elimination tree, but pivot again and allocate new L and U
+// - SamePattern_SameRowPerm: also reuse the row permutation and the L and U storage from the last factorisation
+//                            this skips pivoting, so is only stable if the values of A change by a small amount
+// NOTE: If this fails then L and U are freed and solve() returns SOLVE_NOT_FACTORISED until a refactor succeeds
+int32_t LU_Solver::refactor_from_csr(float* A_non_zero_data, bool is_same_row_permutation) {
+    // SamePattern_SameRowPerm reuses the storage of L and U which a failed refactor has already freed
+    if (!m_is_factorised && is_same_row_permutation) {
+        MODULE_LOG("Refactor needs the L and U storage of a previous factorisation\n");
+        return SOLVE_NOT_FACTORISED;
+    }
+    superlu_options_t options = get_default_options();
+    options.Fact = is_same_row_permutation ? SamePattern_SameRowPerm : SamePattern;
+
+    SuperMatrix A;
+    A.Stype = SLU_NC;
+    A.Dtype = SLU_S;
+    A.Mtype = SLU_GE;
+    A.nrow = m_total_cols;
+    A.ncol = m_total_rows;
+    NCformat Astore;
+    A.Store = (void*)(&Astore);
+    Astore.nnz = int_t(m_A_col_indices.size());
+    Astore.nzval = A_non_zero_data;
+    Astore.rowind = m_A_col_indices.data();
+    Astore.colptr = m_A_row_index_ptr.data();
+
+    MODULE_LOG("Permute columns for A with existing column permutation\n");
+    SuperMatrix A_column_permuted;
+    {
+        const auto timer = Kernel_Timer("lu_ordering");
+        sp_preorder(&options, &A, m_permute_col.data(), m_elimination_tree.data(), &A_column_permuted);
+        m_stats.ordering_ms = timer.get_elapsed_ms();
+    }
+
+    if (options.Fact == SamePattern) {
+        MODULE_LOG("Freeing previous LU factors since they will be reallocated\n");
+        free_factors();
+    }
+
+    MODULE_LOG("Perform LU refactorisation using sgstrf() with Fact=%s\n",
+        is_same_row_permutation ? "SamePattern_SameRowPerm" : "SamePattern");
+    int_t lu_factor_info = 0;
+    {
+        const auto timer = Kernel_Timer("lu_factor");
+        const int panel_size = sp_ienv(1);
+        const int relax = sp_ienv(2);
+        const int work_array_size = 0; // 0 = allocate space internally by system malloc
+        clear_stat_counters(m_stat);
+        sgstrf(
+            &options, &A_column_permuted,
+            relax, panel_size, m_elimination_tree.data(),
+            nullptr, work_array_size,
+            m_permute_col.data(), m_permute_row.data(),
+            &m_L, &m_U,
+            &m_Glu, &m_stat, &lu_factor_info
+        );
+        record_factor_stats(m_stats, m_stat, timer.get_elapsed_ms());
+    }
+
+    Destroy_CompCol_Permuted(&A_column_permuted);
+    m_is_factorised = (lu_factor_info == 0);
+    if (lu_factor_info != 0) {
+        if (is_lu_allocated(lu_factor_info, m_total_rows)) {
+            m_is_factorised = true;
+            free_factors();
+        } else {
+            // NOTE: L and U may be partially allocated so they are leaked rather than risking a double free
+            m_L.Store = nullptr;
+            m_U.Store = nullptr;
+        }
+    }
+    return int32_t(lu_factor_info);
+}
+
+void LU_Solver::free_factors() {
+    if (!m_is_factorised) return;
+    Destroy_SuperNode_Matrix(&m_L);
+    Destroy_CompCol_Matrix(&m_U);
+    m_L.Store = nullptr;
+    m_U.Store = nullptr;
+    m_is_factorised = false;
+}
+
 int32_t LU_Solver::solve(TypedPinnedArray<float> B_data) {
+    return solve_many(B_data, 1);
+}
+
+// B is column-major with total_rhs columns so sgstrs solves them all in one sweep over L and U
+int32_t LU_Solver::solve_many(TypedPinnedArray<float> B_data, int total_rhs) {
     // DOC: SuperLU Page 19 Section 2.3 - Matrix data structures
     // SRC: void sCreate_Dense_Matrix(...)
     SuperMatrix B;
     B.Stype = SLU_DN;
     B.Dtype = SLU_S;
     B.Mtype = SLU_GE;
-    B.nrow = B_data.get_length();
-    B.ncol = 1;
+    B.nrow = B_data.get_length() / total_rhs;
+    B.ncol = total_rhs;
     DNformat Bstore;
     B.Store = (void*)(&Bstore);
     Bstore.lda = B.nrow;
     Bstore.nzval = B_data.get_data();
 
+    if (!m_is_factorised) return SOLVE_NOT_FACTORISED;
+    if (total_rhs <= 0 || B_data.get_length() != m_total_cols*total_rhs) return SOLVE_INVALID_SHAPE;
+
     // NOTE: Following steps are taken from sgssv()
-    MODULE_LOG("Solving for Ax=b using sgstrs\n");
+    MODULE_LOG("Solving for Ax=b using sgstrs with %d right hand sides\n", total_rhs);
     int_t solve_info = 0;
+    const auto timer = Kernel_Timer("lu_solve");
+    clear_stat_counters(m_stat);
     sgstrs(m_transpose_mode, &m_L, &m_U, m_permute_col.data(), m_permute_row.data(), &B, &m_stat, &solve_info);
+    m_stats.solve_flops = double(m_stat.ops[SOLVE]);
+    m_stats.solve_ms = timer.get_elapsed_ms();
+    m_stats.total_solves += 1.0;
     return solve_info;
 }
 
+int64_t LU_Solver::get_lu_non_zeros() const {
+    if (!m_is_factorised) return 0;
+    // DOC: SuperLU Page 19 Section 2.3 - L is stored as supernodes (SCformat) and U as compressed columns (NCformat)
+    const auto* L_store = reinterpret_cast<const SCformat*>(m_L.Store);
+    const auto* U_store = reinterpret_cast<const NCformat*>(m_U.Store);
+    return int64_t(L_store->nnz) + int64_t(U_store->nnz);
+}
+
+// L and U sizes are read when queried since refactor() with SamePattern reallocates them
+LU_Solver::Stats LU_Solver::get_stats() {
+    Stats stats = m_stats;
+    if (!m_is_factorised) return stats;
+    const auto* L_store = reinterpret_cast<const SCformat*>(m_L.Store);
+    const auto* U_store = reinterpret_cast<const NCformat*>(m_U.Store);
+    stats.L_non_zeros = double(L_store->nnz);
+    stats.U_non_zeros = double(U_store->nnz);
+    // DOC: SuperLU Page 19 Section 2.3 - nsuper is the index of the last supernode
+    stats.total_supernodes = double(L_store->nsuper+1);
+    mem_usage_t memory;
+    sQuerySpace(&m_L, &m_U, &memory);
+    stats.lu_bytes = double(memory.for_lu);
+    stats.total_bytes = double(memory.total_needed);
+    return stats;
+}
+
 LU_Solver::~LU_Solver() {
     MODULE_LOG("Freeing LU solver\n");
     StatFree(&m_stat);
-    Destroy_SuperNode_Matrix(&m_L);
-    Destroy_CompCol_Matrix(&m_U);
-}
\ No newline at end of file
+    free_factors();
+}
@@ -8,14 +8,43 @@ extern "C" {
 #include <vector>
 #include "./PinnedArray.hpp"
 
-class LU_Solver 
+class LU_Solver
 {
 public:
     struct Create_Result {
         std::shared_ptr<LU_Solver> solver = nullptr;
         int_t lu_factor_info = 0;
     };
+    // returned by refactor() if the new matrix does not have the same sparsity pattern
+    static constexpr int32_t REFACTOR_PATTERN_MISMATCH = -1;
+    // returned by solve() if the last refactor() failed and left no L and U factors
+    static constexpr int32_t SOLVE_NOT_FACTORISED = -2;
+    // returned by solve() if total_rhs <= 0 or B does not have total_rows*total_rhs elements
+    static constexpr int32_t SOLVE_INVALID_SHAPE = -3;
+    // Cost of the factorisation for diagnosing fill-in, timings and flops are for the last call
+    // NOTE: counts are doubles since embind has no 64bit integers without BigInt
+    struct Stats {
+        double total_rows = 0.0;
+        double A_non_zeros = 0.0;
+        double L_non_zeros = 0.0;       // including the diagonal
+        double U_non_zeros = 0.0;
+        double total_supernodes = 0.0;
+        double factor_flops = 0.0;
+        double solve_flops = 0.0;
+        double ordering_ms = 0.0;       // column permutation and elimination tree
+        double factor_ms = 0.0;
+        double solve_ms = 0.0;
+        double total_factorisations = 0.0;
+        double total_solves = 0.0;
+        double tiny_pivots = 0.0;       // pivots replaced since they were too small
+        double memory_expansions = 0.0; // reallocations of L and U during factorisation
+        double lu_bytes = 0.0;          // storage of L and U from sQuerySpace()
+        double total_bytes = 0.0;       // peak working storage from sQuerySpace()
+    };
 private:
+    // sparsity pattern of A is kept so that it can be refactorised with new values
+    std::vector<int32_t> m_A_col_indices;
+    std::vector<int32_t> m_A_row_index_ptr;
     std::vector<int> m_permute_col;
     std::vector<int> m_permute_row;
     std::vector<int> m_elimination_tree;
@@ -23,16 +52,31 @@ private:
     trans_t m_transpose_mode;
     SuperMatrix m_L;
     SuperMatrix m_U;
+    bool m_is_factorised = true; // false if a failed refactor() left L and U freed or undefined
+    GlobalLU_t m_Glu;
     int m_total_rows;
     int m_total_cols;
+    Stats m_stats;
+private:
+    static Create_Result create_from_csr(
+        float* A_non_zero_data,
+        std::vector<int32_t>&& A_col_indices, std::vector<int32_t>&& A_row_index_ptr,
+        int total_rows, int total_cols
+    );
+    int32_t refactor_from_csr(float* A_non_zero_data, bool is_same_row_permutation);
+    static void record_factor_stats(Stats& stats, SuperLUStat_t& stat, double factor_ms);
+    void free_factors();
 public:
     LU_Solver(
+        std::vector<int32_t>&& A_col_indices, std::vector<int32_t>&& A_row_index_ptr,
         std::vector<int>&& permute_col, std::vector<int>&& permute_row, std::vector<int>&& elimination_tree,
-        SuperLUStat_t stat, trans_t transpose_mode, SuperMatrix L, SuperMatrix U,
+        SuperLUStat_t stat, trans_t transpose_mode, SuperMatrix L, SuperMatrix U, GlobalLU_t Glu,
         int total_rows, int total_cols
-    ): 
-        m_permute_col(permute_col), m_permute_row(permute_row), m_elimination_tree(elimination_tree),
-        m_stat(stat), m_transpose_mode(transpose_mode), m_L(L), m_U(U),
+    ):
+        m_A_col_indices(std::move(A_col_indices)), m_A_row_index_ptr(std::move(A_row_index_ptr)),
+        m_permute_col(std::move(permute_col)), m_permute_row(std::move(permute_row)),
+        m_elimination_tree(std::move(elimination_tree)),
+        m_stat(stat), m_transpose_mode(transpose_mode), m_L(L), m_U(U), m_Glu(Glu),
         m_total_rows(total_rows), m_total_cols(total_cols)
     {}
     ~LU_Solver();
@@ -41,7 +85,21 @@ public:
         TypedPinnedArray<int32_t> A_col_indices, TypedPinnedArray<int32_t> A_row_index_ptr,
         int total_rows, int total_cols
     );
+    static Create_Result create_from_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta
+    );
+    int32_t refactor(TypedPinnedArray<float> A_non_zero_data, bool is_same_row_permutation);
+    int32_t refactor_from_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta,
+        bool is_same_row_permutation
+    );
     int32_t solve(TypedPinnedArray<float> B_data);
+    int32_t solve_many(TypedPinnedArray<float> B_data, int total_rhs);
     int get_total_rows() const { return m_total_rows; }
     int get_total_cols() const { return m_total_cols; }
+    // total non-zeros stored in L (including the diagonal) and U, or 0 if not factorised
+    int64_t get_lu_non_zeros() const;
+    Stats get_stats();
 };
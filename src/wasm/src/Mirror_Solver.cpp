@@ -0,0 +1,198 @@
+#include "./Mirror_Solver.hpp"
+#include "./logging.hpp"
+#include "./kernel_timings.hpp"
+#include <math.h>
+
+static inline bool is_fixed_voltage(uint32_t index_beta) {
+    const float beta = float(index_beta & 0xFFFF) / float(0xFFFF);
+    return beta > 0.5f;
+}
+
+Mirror_Solver::Mirror_Solver(int Nx, int Ny, int32_t axis): m_Nx(Nx), m_Ny(Ny), m_axis(axis) {
+    // left half up to and including the column on the axis or the column left of the split cell
+    m_half_Nx = (axis == AXIS_ON_NODE) ? Nx/2 : (Nx-1)/2;
+}
+
+// NOTE: only the known voltages have to be mirrored since their values are split into even and odd parts
+//       so conductors are free to swap voltage index with their mirror image like a differential pair
+int32_t Mirror_Solver::find_axis(TypedPinnedArray<float> dx_arr, TypedPinnedArray<uint32_t> v_index_beta) {
+    const auto timer = Kernel_Timer("mirror_find_axis");
+    const int Nx = dx_arr.get_length();
+    const int total_voltages = v_index_beta.get_length();
+    // each half needs at least one cell
+    if (Nx < 2 || total_voltages % (Nx+1) != 0) return AXIS_NONE;
+    const int Ny = total_voltages/(Nx+1) - 1;
+    for (int x = 0; x < Nx/2; x++) {
+        const float dx_left = dx_arr[x];
+        const float dx_right = dx_arr[Nx-1-x];
+        if (fabsf(dx_left-dx_right) > DX_TOLERANCE*fmaxf(dx_left, dx_right)) return AXIS_NONE;
+    }
+    for (int y = 0; y < Ny+1; y++) {
+        const uint32_t* row = &v_index_beta[y*(Nx+1)];
+        for (int x = 0; x < (Nx+1)/2; x++) {
+            if (is_fixed_voltage(row[x]) != is_fixed_voltage(row[Nx-x])) return AXIS_NONE;
+        }
+    }
+    return (Nx % 2 == 0) ? AXIS_ON_NODE : AXIS_IN_CELL;
+}
+
+Cholesky_Solver::Mirror_Edge Mirror_Solver::get_mirror_edge(int32_t mode) const {
+    Cholesky_Solver::Mirror_Edge edge;
+    edge.mode = mode;
+    edge.width = (m_axis == AXIS_IN_CELL) ? m_mirror_width : 0.0f;
+    return edge;
+}
+
+void Mirror_Solver::load_half_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    const int half_stride = m_half_Nx+1;
+    m_half_dx = TypedPinnedArray<float>::owned_pin_from_malloc(m_half_Nx);
+    m_half_dy = TypedPinnedArray<float>::owned_pin_from_malloc(m_Ny);
+    m_half_v_index_beta = TypedPinnedArray<uint32_t>::owned_pin_from_malloc(half_stride*(m_Ny+1));
+    for (int x = 0; x < m_half_Nx; x++) (*m_half_dx)[x] = dx_arr[x];
+    for (int y = 0; y < m_Ny; y++) (*m_half_dy)[y] = dy_arr[y];
+    for (int y = 0; y < m_Ny+1; y++) {
+        for (int x = 0; x < half_stride; x++) {
+            (*m_half_v_index_beta)[x + y*half_stride] = v_index_beta[x + y*(m_Nx+1)];
+        }
+    }
+    m_mirror_width = (m_axis == AXIS_IN_CELL) ? dx_arr[m_half_Nx] : 0.0f;
+}
+
+Mirror_Solver::Create_Result Mirror_Solver::create_from_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    const int32_t axis = find_axis(dx_arr, v_index_beta);
+    if (axis == AXIS_NONE) return { nullptr, CREATE_NOT_SYMMETRIC };
+    const int Nx = dx_arr.get_length();
+    const int Ny = dy_arr.get_length();
+    auto solver = std::make_shared<Mirror_Solver>(Nx, Ny, axis);
+    solver->load_half_grid(dx_arr, dy_arr, v_index_beta);
+    MODULE_LOG("Factorising even half of %dx%d grid with %d columns\n", Nx+1, Ny+1, solver->m_half_Nx+1);
+    const auto result = Cholesky_Solver::create_from_half_grid(
+        *solver->m_half_dx, *solver->m_half_dy, *solver->m_half_v_index_beta,
+        solver->get_mirror_edge(Cholesky_Solver::MIRROR_EVEN)
+    );
+    if (result.solver == nullptr) return { nullptr, result.factor_info };
+    solver->m_even_solver = result.solver;
+    return { solver, 0 };
+}
+
+int32_t Mirror_Solver::refactor_from_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    if (dx_arr.get_length() != m_Nx || dy_arr.get_length() != m_Ny || find_axis(dx_arr, v_index_beta) != m_axis) {
+        MODULE_LOG("Refactor got a grid with a different size or mirror axis\n");
+        return REFACTOR_PATTERN_MISMATCH;
+    }
+    load_half_grid(dx_arr, dy_arr, v_index_beta);
+    const int32_t factor_info = m_even_solver->refactor_from_half_grid(
+        *m_half_dx, *m_half_dy, *m_half_v_index_beta, get_mirror_edge(Cholesky_Solver::MIRROR_EVEN)
+    );
+    if (factor_info != 0) return factor_info;
+    if (m_odd_solver != nullptr) {
+        const int32_t odd_info = m_odd_solver->refactor_from_half_grid(
+            *m_half_dx, *m_half_dy, *m_half_v_index_beta, get_mirror_edge(Cholesky_Solver::MIRROR_ODD)
+        );
+        // factorised again from scratch if an odd part shows up
+        if (odd_info != 0) m_odd_solver = nullptr;
+    }
+    return 0;
+}
+
+int32_t Mirror_Solver::factor_odd_solver() {
+    MODULE_LOG("Factorising odd half of %dx%d grid with %d columns\n", m_Nx+1, m_Ny+1, m_half_Nx+1);
+    const auto result = Cholesky_Solver::create_from_half_grid(
+        *m_half_dx, *m_half_dy, *m_half_v_index_beta, get_mirror_edge(Cholesky_Solver::MIRROR_ODD)
+    );
+    m_odd_solver = result.solver;
+    return result.factor_info;
+}
+
+int32_t Mirror_Solver::solve(TypedPinnedArray<float> B_data) {
+    return solve_many(B_data, 1);
+}
+
+// B is column-major with total_rhs columns, known voltages are left as they are
+int32_t Mirror_Solver::solve_many(TypedPinnedArray<float> B_data, int total_rhs) {
+    if (total_rhs <= 0 || B_data.get_length() != get_total_rows()*total_rhs) return SOLVE_INVALID_SHAPE;
+    const auto timer = Kernel_Timer("mirror_solve");
+    const int stride = m_Nx+1;
+    const int half_stride = m_half_Nx+1;
+    const int total_voltages = get_total_rows();
+    const int total_half_voltages = half_stride*(m_Ny+1);
+    auto B_even = *TypedPinnedArray<float>::owned_pin_from_malloc(total_half_voltages*total_rhs);
+    auto B_odd = *TypedPinnedArray<float>::owned_pin_from_malloc(total_half_voltages*total_rhs);
+
+    // split into even and odd parts on the left half
+    // NOTE: odd part is exactly zero if the forced voltages are symmetric since mirrored values are identical
+    bool has_odd_part = false;
+    for (int k = 0; k < total_rhs; k++) {
+        const float* B = B_data.get_data() + k*total_voltages;
+        float* even = B_even.get_data() + k*total_half_voltages;
+        float* odd = B_odd.get_data() + k*total_half_voltages;
+        for (int y = 0; y < m_Ny+1; y++) {
+            for (int x = 0; x < half_stride; x++) {
+                const float v = B[x + y*stride];
+                const float v_mirror = B[(m_Nx-x) + y*stride];
+                const int iv = x + y*half_stride;
+                even[iv] = 0.5f*(v+v_mirror);
+                odd[iv] = 0.5f*(v-v_mirror);
+                has_odd_part = has_odd_part || (v != v_mirror);
+            }
+        }
+    }
+
+    int32_t solve_info = m_even_solver->solve_many(B_even, total_rhs);
+    if (solve_info != 0) return solve_info;
+    if (has_odd_part) {
+        if (m_odd_solver == nullptr) {
+            const int32_t factor_info = factor_odd_solver();
+            if (factor_info != 0) return factor_info;
+        }
+        solve_info = m_odd_solver->solve_many(B_odd, total_rhs);
+        if (solve_info != 0) return solve_info;
+    }
+
+    // V = even + odd on the left half and even - odd on the mirrored right half
+    for (int k = 0; k < total_rhs; k++) {
+        float* V = B_data.get_data() + k*total_voltages;
+        const float* even = B_even.get_data() + k*total_half_voltages;
+        const float* odd = B_odd.get_data() + k*total_half_voltages;
+        for (int y = 0; y < m_Ny+1; y++) {
+            for (int x = 0; x < half_stride; x++) {
+                const int iv = x + y*half_stride;
+                const float v_odd = has_odd_part ? odd[iv] : 0.0f;
+                V[(m_Nx-x) + y*stride] = even[iv] - v_odd;
+                V[x + y*stride] = even[iv] + v_odd;
+            }
+        }
+    }
+    m_solve_ms = timer.get_elapsed_ms();
+    m_total_solves += 1.0;
+    return 0;
+}
+
+Cholesky_Solver::Stats Mirror_Solver::get_stats() const {
+    Cholesky_Solver::Stats stats;
+    stats.total_rows = double(get_total_rows());
+    for (const auto& solver: { m_even_solver, m_odd_solver }) {
+        if (solver == nullptr) continue;
+        const auto half_stats = solver->get_stats();
+        stats.reduced_rows += half_stats.reduced_rows;
+        stats.A_non_zeros += half_stats.A_non_zeros;
+        stats.L_non_zeros += half_stats.L_non_zeros;
+        stats.factor_flops += half_stats.factor_flops;
+        stats.ordering_ms += half_stats.ordering_ms;
+        stats.factor_ms += half_stats.factor_ms;
+        stats.total_factorisations += half_stats.total_factorisations;
+        stats.factor_bytes += half_stats.factor_bytes;
+    }
+    stats.solve_ms = m_solve_ms;
+    stats.total_solves = m_total_solves;
+    return stats;
+}
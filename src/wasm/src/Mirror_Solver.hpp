@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include "./PinnedArray.hpp"
+#include "./Cholesky_Solver.hpp"
+
+// Direct solver for grids which are mirror symmetric about a vertical axis, e.g. centred traces and differential pairs
+// - Any right hand side splits into an even part B+mirror(B) and odd part B-mirror(B) which are solved separately
+// - Even part is solved on the left half with the same voltage across the axis (zero normal field)
+// - Odd part is solved on the left half with the negated voltage across the axis (zero voltage on the axis)
+// - Both solutions are mirrored back to the full grid so the energy integrals see the same voltage field
+// - Each half factorisation covers half the unknowns and the odd half is only factorised once an odd part shows up
+//   which never happens for a single conductor on the axis since its forced voltages are already symmetric
+// - Only the forced voltage cells and dx need to be symmetric since the dielectric does not change the solve
+class Mirror_Solver
+{
+public:
+    struct Create_Result {
+        std::shared_ptr<Mirror_Solver> solver = nullptr;
+        int32_t create_info = 0;
+    };
+    // returned by create() if the grid is not mirror symmetric
+    static constexpr int32_t CREATE_NOT_SYMMETRIC = 1;
+    // returned by refactor() if the new grid has a different mirror axis or known voltages
+    static constexpr int32_t REFACTOR_PATTERN_MISMATCH = Cholesky_Solver::REFACTOR_PATTERN_MISMATCH;
+    // returned by solve() if total_rhs <= 0 or B does not have total_rows*total_rhs elements
+    static constexpr int32_t SOLVE_INVALID_SHAPE = Cholesky_Solver::SOLVE_INVALID_SHAPE;
+    static constexpr int32_t AXIS_NONE = 0;
+    static constexpr int32_t AXIS_ON_NODE = 1; // axis on the voltage column x=Nx/2 for even Nx
+    static constexpr int32_t AXIS_IN_CELL = 2; // axis through the middle of cell (Nx-1)/2 for odd Nx
+    // relative difference allowed between mirrored dx since the mesh is generated in floating point
+    static constexpr float DX_TOLERANCE = 1e-4f;
+private:
+    int m_Nx = 0;
+    int m_Ny = 0;
+    int32_t m_axis = AXIS_NONE;
+    int m_half_Nx = 0;
+    float m_mirror_width = 0.0f; // width of the cell split by the axis
+    // left half grid which is kept so the odd half can be factorised when first needed
+    std::shared_ptr<TypedPinnedArray<float>> m_half_dx = nullptr;
+    std::shared_ptr<TypedPinnedArray<float>> m_half_dy = nullptr;
+    std::shared_ptr<TypedPinnedArray<uint32_t>> m_half_v_index_beta = nullptr;
+    std::shared_ptr<Cholesky_Solver> m_even_solver = nullptr;
+    std::shared_ptr<Cholesky_Solver> m_odd_solver = nullptr;
+    double m_solve_ms = 0.0;
+    double m_total_solves = 0.0;
+private:
+    Cholesky_Solver::Mirror_Edge get_mirror_edge(int32_t mode) const;
+    void load_half_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta
+    );
+    int32_t factor_odd_solver();
+public:
+    Mirror_Solver(int Nx, int Ny, int32_t axis);
+    // AXIS_NONE if mirroring dx and the forced voltage cells about a vertical axis does not give the same grid
+    static int32_t find_axis(TypedPinnedArray<float> dx_arr, TypedPinnedArray<uint32_t> v_index_beta);
+    static Create_Result create_from_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta
+    );
+    // Reuses the orderings of both halves if the grid has the same size, mirror axis and known voltages
+    int32_t refactor_from_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta
+    );
+    int32_t solve(TypedPinnedArray<float> B_data);
+    int32_t solve_many(TypedPinnedArray<float> B_data, int total_rhs);
+    int get_total_rows() const { return (m_Nx+1)*(m_Ny+1); }
+    int get_total_cols() const { return (m_Nx+1)*(m_Ny+1); }
+    int32_t get_axis() const { return m_axis; }
+    bool get_has_odd_solver() const { return m_odd_solver != nullptr; }
+    // Sum over the factorised halves with total_rows of the full grid
+    Cholesky_Solver::Stats get_stats() const;
+};
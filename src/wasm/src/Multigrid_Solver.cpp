@@ -0,0 +1,709 @@
+#include "./Multigrid_Solver.hpp"
+#include "./logging.hpp"
+#include "./kernel_timings.hpp"
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+static constexpr int MAX_LEVELS = 24;
+// updated residual drifts from the true residual in single precision so conjugate gradient is restarted from it
+static constexpr int MAX_RESTARTS = 4;
+
+static inline bool is_fixed_voltage(uint32_t index_beta) {
+    const float beta = float(index_beta & 0xFFFF) / float(0xFFFF);
+    return beta > 0.5f;
+}
+
+// Merge pairs of neighbouring cells so coarse grid lines are the even fine grid lines and the last grid line
+// Returns the fine grid line index for each coarse grid line
+static std::vector<int> get_coarse_grid_lines(int N) {
+    std::vector<int> lines;
+    if (N <= 2) {
+        for (int i = 0; i <= N; i++) lines.push_back(i);
+        return lines;
+    }
+    for (int i = 0; i < N; i += 2) lines.push_back(i);
+    lines.push_back(N);
+    return lines;
+}
+
+static std::vector<float> get_coarse_cells(const std::vector<float>& d, const std::vector<int>& lines) {
+    std::vector<float> coarse;
+    for (size_t i = 0; i+1 < lines.size(); i++) {
+        float size = 0.0f;
+        for (int j = lines[i]; j < lines[i+1]; j++) size += d[j];
+        coarse.push_back(size);
+    }
+    return coarse;
+}
+
+// Linear interpolation weights of each fine grid line from its two enclosing coarse grid lines on a non-uniform axis
+// - Fine grid lines on a coarse grid line only have weight_0 so neighbouring fine grid lines never have
+//   nonzero weights on coarse grid lines more than one apart
+static std::vector<Multigrid_Solver::Transfer_Weights> get_transfer_weights(
+    const std::vector<float>& d, const std::vector<int>& lines
+) {
+    const int N = int(d.size());
+    auto position = std::vector<float>(N+1, 0.0f);
+    for (int i = 0; i < N; i++) position[i+1] = position[i] + d[i];
+
+    auto weights = std::vector<Multigrid_Solver::Transfer_Weights>(N+1);
+    for (size_t ic = 0; ic+1 < lines.size(); ic++) {
+        const int f0 = lines[ic];
+        const int f1 = lines[ic+1];
+        const float width = position[f1]-position[f0];
+        for (int f = f0; f <= f1; f++) {
+            Multigrid_Solver::Transfer_Weights w;
+            w.coarse_index_0 = int(ic);
+            w.coarse_index_1 = int(ic+1);
+            w.weight_1 = (position[f]-position[f0])/width;
+            w.weight_0 = 1.0f-w.weight_1;
+            weights[f] = w;
+        }
+    }
+    return weights;
+}
+
+// Coupling between (x,y) and its neighbour (x+ox,y+oy) which has to be inside the level
+static inline float get_coupling(const Multigrid_Solver::Level& level, int x, int y, int ox, int oy) {
+    const int W = level.Nx+1;
+    const int i = x + y*W;
+    switch ((ox+1) + (oy+1)*3) {
+        case 0: return level.north_east[i-W-1];
+        case 1: return level.north[i-W];
+        case 2: return level.north_west[i-W+1];
+        case 3: return level.east[i-1];
+        case 4: return level.center[i];
+        case 5: return level.east[i];
+        case 6: return level.north_west[i];
+        case 7: return level.north[i];
+        case 8: return level.north_east[i];
+        default: return 0.0f;
+    }
+}
+
+static void resize_level(Multigrid_Solver::Level& level) {
+    const int N = (level.Nx+1)*(level.Ny+1);
+    level.center.resize(N, 0.0f);
+    level.east.resize(N, 0.0f);
+    level.north.resize(N, 0.0f);
+    level.north_east.resize(N, 0.0f);
+    level.north_west.resize(N, 0.0f);
+    level.is_known.resize(N, 0);
+    level.v.resize(N, 0.0f);
+    level.f.resize(N, 0.0f);
+    level.r.resize(N, 0.0f);
+}
+
+// Galerkin coarse operator P^T*A*P where P is the bilinear interpolation with zero rows on known voltages
+// - Coarse voltages which only interpolate onto known voltages have an empty row and are marked as known
+static Multigrid_Solver::Level create_coarse_level(const Multigrid_Solver::Level& fine, int coarse_Nx, int coarse_Ny) {
+    Multigrid_Solver::Level coarse;
+    coarse.Nx = coarse_Nx;
+    coarse.Ny = coarse_Ny;
+    resize_level(coarse);
+    const int cW = coarse.Nx+1;
+    // all 9 couplings of each coarse row indexed by (ox+1) + (oy+1)*3
+    auto A = std::vector<float>(9*coarse.center.size(), 0.0f);
+    struct Parent {
+        int x = 0;
+        int y = 0;
+        float weight = 0.0f;
+    };
+    auto get_parents = [&fine](int x, int y, Parent* parents) -> int {
+        const auto& wx = fine.x_restrict[x];
+        const auto& wy = fine.y_restrict[y];
+        int total = 0;
+        const int cx[2] = { wx.coarse_index_0, wx.coarse_index_1 };
+        const int cy[2] = { wy.coarse_index_0, wy.coarse_index_1 };
+        const float weight_x[2] = { wx.weight_0, wx.weight_1 };
+        const float weight_y[2] = { wy.weight_0, wy.weight_1 };
+        for (int j = 0; j < 2; j++) {
+            for (int i = 0; i < 2; i++) {
+                const float weight = weight_x[i]*weight_y[j];
+                if (weight == 0.0f) continue;
+                parents[total++] = { cx[i], cy[j], weight };
+            }
+        }
+        return total;
+    };
+
+    Parent row_parents[4];
+    Parent col_parents[4];
+    for (int y = 0; y <= fine.Ny; y++) {
+        for (int x = 0; x <= fine.Nx; x++) {
+            if (fine.is_known[x + y*(fine.Nx+1)]) continue;
+            const int total_row_parents = get_parents(x, y, row_parents);
+            for (int oy = -1; oy <= 1; oy++) {
+                const int ny = y+oy;
+                if (ny < 0 || ny > fine.Ny) continue;
+                for (int ox = -1; ox <= 1; ox++) {
+                    const int nx = x+ox;
+                    if (nx < 0 || nx > fine.Nx) continue;
+                    const float a = get_coupling(fine, x, y, ox, oy);
+                    if (a == 0.0f) continue;
+                    const int total_col_parents = get_parents(nx, ny, col_parents);
+                    for (int i = 0; i < total_row_parents; i++) {
+                        const auto& I = row_parents[i];
+                        float* A_row = &A[9*(I.x + I.y*cW)];
+                        for (int j = 0; j < total_col_parents; j++) {
+                            const auto& J = col_parents[j];
+                            A_row[(J.x-I.x+1) + (J.y-I.y+1)*3] += I.weight*a*J.weight;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const int total_coarse = int(coarse.center.size());
+    for (int i = 0; i < total_coarse; i++) {
+        const float* A_row = &A[9*i];
+        if (A_row[4] <= 0.0f) {
+            coarse.center[i] = 1.0f;
+            coarse.is_known[i] = 1;
+            continue;
+        }
+        coarse.center[i] = A_row[4];
+        coarse.east[i] = A_row[5];
+        coarse.north[i] = A_row[7];
+        coarse.north_east[i] = A_row[8];
+        coarse.north_west[i] = A_row[6];
+    }
+    return coarse;
+}
+
+Multigrid_Solver::Create_Result Multigrid_Solver::create_from_grid(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    const auto timer = Kernel_Timer("multigrid_setup");
+    const int Nx = dx_arr.get_length();
+    const int Ny = dy_arr.get_length();
+    if (Nx == 0 || Ny == 0 || v_index_beta.get_length() != (Nx+1)*(Ny+1)) {
+        return { nullptr, -1 };
+    }
+    auto dx = std::vector<float>(dx_arr.get_data(), dx_arr.get_data() + Nx);
+    auto dy = std::vector<float>(dy_arr.get_data(), dy_arr.get_data() + Ny);
+    auto is_fixed = std::vector<uint8_t>((Nx+1)*(Ny+1));
+    for (int y = 0; y <= Ny; y++) {
+        for (int x = 0; x <= Nx; x++) {
+            const int i = x + y*(Nx+1);
+            // corners have no div(E) constraint so they are fixed
+            const bool is_corner = (x == 0 || x == Nx) && (y == 0 || y == Ny);
+            is_fixed[i] = (is_corner || is_fixed_voltage(v_index_beta[i])) ? 1 : 0;
+        }
+    }
+    const auto solver = std::make_shared<Multigrid_Solver>(std::move(dx), std::move(dy), std::move(is_fixed));
+    return { solver, 0 };
+}
+
+void Multigrid_Solver::create_levels() {
+    auto dx = m_dx;
+    auto dy = m_dy;
+    // finest level is the reduced system with the border and forced voltages known
+    {
+        Level level;
+        level.Nx = int(dx.size());
+        level.Ny = int(dy.size());
+        resize_level(level);
+        const int W = level.Nx+1;
+        for (int y = 0; y <= level.Ny; y++) {
+            for (int x = 0; x <= level.Nx; x++) {
+                const int i = x + y*W;
+                const bool is_border = (x == 0 || x == level.Nx || y == 0 || y == level.Ny);
+                level.is_known[i] = (is_border || m_is_fixed[i]) ? 1 : 0;
+            }
+        }
+        for (int y = 1; y < level.Ny; y++) {
+            const float sy = dy[y-1]+dy[y];
+            for (int x = 1; x < level.Nx; x++) {
+                const int i = x + y*W;
+                if (level.is_known[i]) continue;
+                const float sx = dx[x-1]+dx[x];
+                level.center[i] = sy*(1.0f/dx[x-1] + 1.0f/dx[x]) + sx*(1.0f/dy[y-1] + 1.0f/dy[y]);
+                if (!level.is_known[i+1]) level.east[i] = -sy/dx[x];
+                if (!level.is_known[i+W]) level.north[i] = -sx/dy[y];
+            }
+        }
+        for (int i = 0; i < int(level.center.size()); i++) {
+            if (level.is_known[i]) level.center[i] = 1.0f;
+        }
+        m_levels.push_back(std::move(level));
+    }
+
+    MODULE_LOG("Creating multigrid levels by merging pairs of cells\n");
+    while (true) {
+        Level& fine = m_levels.back();
+        if (fine.Nx <= 2 && fine.Ny <= 2) break;
+        if (int(m_levels.size()) >= MAX_LEVELS) break;
+        const auto x_lines = get_coarse_grid_lines(fine.Nx);
+        const auto y_lines = get_coarse_grid_lines(fine.Ny);
+        fine.x_restrict = get_transfer_weights(dx, x_lines);
+        fine.y_restrict = get_transfer_weights(dy, y_lines);
+        auto coarse = create_coarse_level(fine, int(x_lines.size())-1, int(y_lines.size())-1);
+        dx = get_coarse_cells(dx, x_lines);
+        dy = get_coarse_cells(dy, y_lines);
+        m_levels.push_back(std::move(coarse));
+    }
+    MODULE_LOG("Created %d multigrid levels with coarsest level %dx%d\n",
+        int(m_levels.size()), m_levels.back().Ny, m_levels.back().Nx);
+
+    const int N = get_total_rows();
+    m_residual.resize(N, 0.0f);
+    m_direction.resize(N, 0.0f);
+    m_A_direction.resize(N, 0.0f);
+}
+
+// Solve every second row exactly along x with the Thomas algorithm while holding its neighbouring rows constant
+void Multigrid_Solver::smooth_x_lines(Level& level, int start_row) const {
+    const int Nx = level.Nx;
+    const int Ny = level.Ny;
+    const int W = Nx+1;
+    float* v = level.v.data();
+    const float* f = level.f.data();
+    const float* center = level.center.data();
+    const float* east = level.east.data();
+    const float* north = level.north.data();
+    const float* north_east = level.north_east.data();
+    const float* north_west = level.north_west.data();
+    auto c_prime = std::vector<float>(Nx+1);
+    for (int y = start_row; y <= Ny; y += 2) {
+        float* v_row = &v[y*W];
+        // forward elimination
+        float c_prev = 0.0f;
+        float d_prev = 0.0f;
+        for (int x = 0; x <= Nx; x++) {
+            const int i = x + y*W;
+            const float a = (x > 0) ? east[i-1] : 0.0f;
+            const float b = center[i];
+            const float c = east[i];
+            float d = f[i];
+            if (y > 0) {
+                const int s = i-W;
+                d -= north[s]*v[s];
+                if (x > 0) d -= north_east[s-1]*v[s-1];
+                if (x < Nx) d -= north_west[s+1]*v[s+1];
+            }
+            if (y < Ny) {
+                const int n = i+W;
+                d -= north[i]*v[n];
+                if (x < Nx) d -= north_east[i]*v[n+1];
+                if (x > 0) d -= north_west[i]*v[n-1];
+            }
+            const float m = 1.0f/(b - a*c_prev);
+            c_prev = c*m;
+            d_prev = (d - a*d_prev)*m;
+            c_prime[x] = c_prev;
+            v_row[x] = d_prev;
+        }
+        // back substitution
+        for (int x = Nx-1; x >= 0; x--) {
+            v_row[x] -= c_prime[x]*v_row[x+1];
+        }
+    }
+}
+
+// Solve every second column exactly along y with the Thomas algorithm while holding its neighbouring columns constant
+void Multigrid_Solver::smooth_y_lines(Level& level, int start_column) const {
+    const int Nx = level.Nx;
+    const int Ny = level.Ny;
+    const int W = Nx+1;
+    float* v = level.v.data();
+    const float* f = level.f.data();
+    const float* center = level.center.data();
+    const float* east = level.east.data();
+    const float* north = level.north.data();
+    const float* north_east = level.north_east.data();
+    const float* north_west = level.north_west.data();
+    auto c_prime = std::vector<float>(Ny+1);
+    for (int x = start_column; x <= Nx; x += 2) {
+        // forward elimination
+        float c_prev = 0.0f;
+        float d_prev = 0.0f;
+        for (int y = 0; y <= Ny; y++) {
+            const int i = x + y*W;
+            const float a = (y > 0) ? north[i-W] : 0.0f;
+            const float b = center[i];
+            const float c = north[i];
+            float d = f[i];
+            if (x > 0) {
+                const int w = i-1;
+                d -= east[w]*v[w];
+                if (y > 0) d -= north_east[w-W]*v[w-W];
+                if (y < Ny) d -= north_west[i]*v[w+W];
+            }
+            if (x < Nx) {
+                const int e = i+1;
+                d -= east[i]*v[e];
+                if (y < Ny) d -= north_east[i]*v[e+W];
+                if (y > 0) d -= north_west[e-W]*v[e-W];
+            }
+            const float m = 1.0f/(b - a*c_prev);
+            c_prev = c*m;
+            d_prev = (d - a*d_prev)*m;
+            c_prime[y] = c_prev;
+            v[i] = d_prev;
+        }
+        // back substitution
+        for (int y = Ny-1; y >= 0; y--) {
+            v[x + y*W] -= c_prime[y]*v[x + (y+1)*W];
+        }
+    }
+}
+
+// Alternating zebra line Gauss-Seidel
+// - Point smoothers fail to damp errors along the strongly coupled axis of anisotropic cells
+// - Solving lines along both axes handles either direction of anisotropy on the graded mesh
+// - Reversed order is the adjoint of the forward sweep which keeps the V-cycle symmetric
+void Multigrid_Solver::smooth(Level& level, int total_sweeps, bool is_reversed) const {
+    for (int sweep = 0; sweep < total_sweeps; sweep++) {
+        if (!is_reversed) {
+            smooth_x_lines(level, 0);
+            smooth_x_lines(level, 1);
+            smooth_y_lines(level, 0);
+            smooth_y_lines(level, 1);
+        } else {
+            smooth_y_lines(level, 1);
+            smooth_y_lines(level, 0);
+            smooth_x_lines(level, 1);
+            smooth_x_lines(level, 0);
+        }
+    }
+}
+
+void Multigrid_Solver::apply_stencil(const Level& level, const float* v, float* y_out) const {
+    const int Nx = level.Nx;
+    const int Ny = level.Ny;
+    const int W = Nx+1;
+    const float* center = level.center.data();
+    const float* east = level.east.data();
+    const float* north = level.north.data();
+    const float* north_east = level.north_east.data();
+    const float* north_west = level.north_west.data();
+    for (int y = 0; y <= Ny; y++) {
+        for (int x = 0; x <= Nx; x++) {
+            const int i = x + y*W;
+            float Av = center[i]*v[i];
+            if (x > 0) Av += east[i-1]*v[i-1];
+            if (x < Nx) Av += east[i]*v[i+1];
+            if (y > 0) {
+                const int s = i-W;
+                Av += north[s]*v[s];
+                if (x > 0) Av += north_east[s-1]*v[s-1];
+                if (x < Nx) Av += north_west[s+1]*v[s+1];
+            }
+            if (y < Ny) {
+                const int n = i+W;
+                Av += north[i]*v[n];
+                if (x < Nx) Av += north_east[i]*v[n+1];
+                if (x > 0) Av += north_west[i]*v[n-1];
+            }
+            y_out[i] = Av;
+        }
+    }
+}
+
+void Multigrid_Solver::calculate_residual(Level& level) const {
+    apply_stencil(level, level.v.data(), level.r.data());
+    const int N = int(level.r.size());
+    for (int i = 0; i < N; i++) level.r[i] = level.f[i]-level.r[i];
+}
+
+// Transpose of the interpolation since the rows of the scaled system are already integrated over each control volume
+void Multigrid_Solver::restrict_residual(const Level& fine, Level& coarse) const {
+    const int Nx = fine.Nx;
+    const int Ny = fine.Ny;
+    const int cNx = coarse.Nx;
+    std::fill(coarse.f.begin(), coarse.f.end(), 0.0f);
+    for (int y = 0; y <= Ny; y++) {
+        const auto& wy = fine.y_restrict[y];
+        for (int x = 0; x <= Nx; x++) {
+            const int i = x + y*(Nx+1);
+            if (fine.is_known[i]) continue;
+            const auto& wx = fine.x_restrict[x];
+            const float r = fine.r[i];
+            coarse.f[wx.coarse_index_0 + wy.coarse_index_0*(cNx+1)] += wx.weight_0*wy.weight_0*r;
+            coarse.f[wx.coarse_index_1 + wy.coarse_index_0*(cNx+1)] += wx.weight_1*wy.weight_0*r;
+            coarse.f[wx.coarse_index_0 + wy.coarse_index_1*(cNx+1)] += wx.weight_0*wy.weight_1*r;
+            coarse.f[wx.coarse_index_1 + wy.coarse_index_1*(cNx+1)] += wx.weight_1*wy.weight_1*r;
+        }
+    }
+    const int total_coarse = int(coarse.f.size());
+    for (int i = 0; i < total_coarse; i++) {
+        if (coarse.is_known[i]) coarse.f[i] = 0.0f;
+    }
+}
+
+void Multigrid_Solver::prolong_correction(const Level& coarse, Level& fine) const {
+    const int Nx = fine.Nx;
+    const int Ny = fine.Ny;
+    const int cNx = coarse.Nx;
+    const float* e = coarse.v.data();
+    for (int y = 0; y <= Ny; y++) {
+        const auto& wy = fine.y_restrict[y];
+        for (int x = 0; x <= Nx; x++) {
+            const int i = x + y*(Nx+1);
+            if (fine.is_known[i]) continue;
+            const auto& wx = fine.x_restrict[x];
+            const float correction =
+                wy.weight_0*(wx.weight_0*e[wx.coarse_index_0 + wy.coarse_index_0*(cNx+1)] +
+                             wx.weight_1*e[wx.coarse_index_1 + wy.coarse_index_0*(cNx+1)]) +
+                wy.weight_1*(wx.weight_0*e[wx.coarse_index_0 + wy.coarse_index_1*(cNx+1)] +
+                             wx.weight_1*e[wx.coarse_index_1 + wy.coarse_index_1*(cNx+1)]);
+            fine.v[i] += correction;
+        }
+    }
+}
+
+// Coarsest level has at most 3x3 voltages so a dense LU factorisation with partial pivoting is used
+void Multigrid_Solver::factor_coarsest_level() {
+    const Level& level = m_levels.back();
+    const int Nx = level.Nx;
+    const int Ny = level.Ny;
+    const int N = (Nx+1)*(Ny+1);
+    m_coarse_lu.assign(N*N, 0.0f);
+    m_coarse_pivot.resize(N);
+    float* A = m_coarse_lu.data();
+    for (int y = 0; y <= Ny; y++) {
+        for (int x = 0; x <= Nx; x++) {
+            const int i = x + y*(Nx+1);
+            float* row = &A[i*N];
+            for (int oy = -1; oy <= 1; oy++) {
+                if (y+oy < 0 || y+oy > Ny) continue;
+                for (int ox = -1; ox <= 1; ox++) {
+                    if (x+ox < 0 || x+ox > Nx) continue;
+                    row[(x+ox) + (y+oy)*(Nx+1)] = get_coupling(level, x, y, ox, oy);
+                }
+            }
+        }
+    }
+    for (int k = 0; k < N; k++) {
+        int pivot = k;
+        for (int i = k+1; i < N; i++) {
+            if (fabsf(A[i*N+k]) > fabsf(A[pivot*N+k])) pivot = i;
+        }
+        m_coarse_pivot[k] = pivot;
+        if (pivot != k) {
+            for (int j = 0; j < N; j++) std::swap(A[k*N+j], A[pivot*N+j]);
+        }
+        for (int i = k+1; i < N; i++) {
+            const float L_ik = A[i*N+k]/A[k*N+k];
+            A[i*N+k] = L_ik;
+            for (int j = k+1; j < N; j++) A[i*N+j] -= L_ik*A[k*N+j];
+        }
+    }
+}
+
+void Multigrid_Solver::solve_coarsest_level() {
+    Level& level = m_levels.back();
+    const int N = int(level.v.size());
+    const float* A = m_coarse_lu.data();
+    float* v = level.v.data();
+    for (int i = 0; i < N; i++) v[i] = level.f[i];
+    for (int k = 0; k < N; k++) {
+        const int pivot = m_coarse_pivot[k];
+        if (pivot != k) std::swap(v[k], v[pivot]);
+        for (int i = k+1; i < N; i++) v[i] -= A[i*N+k]*v[k];
+    }
+    for (int i = N-1; i >= 0; i--) {
+        float sum = v[i];
+        for (int j = i+1; j < N; j++) sum -= A[i*N+j]*v[j];
+        v[i] = sum/A[i*N+i];
+    }
+}
+
+void Multigrid_Solver::v_cycle(int level_index) {
+    if (level_index == int(m_levels.size())-1) {
+        solve_coarsest_level();
+        return;
+    }
+    Level& fine = m_levels[level_index];
+    Level& coarse = m_levels[level_index+1];
+    smooth(fine, m_total_pre_smooth, false);
+    calculate_residual(fine);
+    restrict_residual(fine, coarse);
+    std::fill(coarse.v.begin(), coarse.v.end(), 0.0f);
+    v_cycle(level_index+1);
+    prolong_correction(coarse, fine);
+    smooth(fine, m_total_post_smooth, true);
+}
+
+// One V-cycle from a zero initial guess which leaves the preconditioned residual in the finest level's v
+void Multigrid_Solver::apply_preconditioner(const float* r) {
+    Level& level = m_levels[0];
+    std::copy(r, r+level.f.size(), level.f.begin());
+    std::fill(level.v.begin(), level.v.end(), 0.0f);
+    v_cycle(0);
+}
+
+// Border rows only contain the voltages along the border so each border line is a tridiagonal system
+// between the fixed corners
+void Multigrid_Solver::solve_border(float* v, const float* B) const {
+    const int Nx = int(m_dx.size());
+    const int Ny = int(m_dy.size());
+    const int W = Nx+1;
+    struct Border_Line {
+        int start;
+        int stride;
+        const std::vector<float>& d;
+    };
+    const Border_Line lines[4] = {
+        { 0, 1, m_dx },
+        { Ny*W, 1, m_dx },
+        { 0, W, m_dy },
+        { Nx, W, m_dy },
+    };
+    auto c_prime = std::vector<float>(std::max(Nx, Ny)+1);
+    for (const auto& line: lines) {
+        const int N = int(line.d.size());
+        float c_prev = 0.0f;
+        float d_prev = 0.0f;
+        for (int j = 0; j <= N; j++) {
+            const int i = line.start + j*line.stride;
+            float a = 0.0f, b = 1.0f, c = 0.0f, d = B[i];
+            if (!m_is_fixed[i]) {
+                const float d0 = line.d[j-1];
+                const float d1 = line.d[j];
+                a = -1.0f/d0;
+                b = 1.0f/d0 + 1.0f/d1;
+                c = -1.0f/d1;
+                d = (d0+d1)*B[i];
+            }
+            const float m = 1.0f/(b - a*c_prev);
+            c_prev = c*m;
+            d_prev = (d - a*d_prev)*m;
+            c_prime[j] = c_prev;
+            v[i] = d_prev;
+        }
+        for (int j = N-1; j >= 0; j--) {
+            const int i = line.start + j*line.stride;
+            v[i] -= c_prime[j]*v[i+line.stride];
+        }
+    }
+}
+
+// Residual of the scaled inner rows which includes the couplings to known voltages, and zero on known voltages
+void Multigrid_Solver::calculate_reduced_residual(const float* v, const float* B, float* r) const {
+    const Level& level = m_levels[0];
+    const int Nx = level.Nx;
+    const int Ny = level.Ny;
+    const int W = Nx+1;
+    for (int y = 0; y <= Ny; y++) {
+        for (int x = 0; x <= Nx; x++) {
+            const int i = x + y*W;
+            if (level.is_known[i]) {
+                r[i] = 0.0f;
+                continue;
+            }
+            const float sx = m_dx[x-1]+m_dx[x];
+            const float sy = m_dy[y-1]+m_dy[y];
+            const float Av =
+                level.center[i]*v[i]
+                - sy*(v[i-1]/m_dx[x-1] + v[i+1]/m_dx[x])
+                - sx*(v[i-W]/m_dy[y-1] + v[i+W]/m_dy[y]);
+            r[i] = sx*sy*B[i] - Av;
+        }
+    }
+}
+
+static inline double get_dot(const float* a, const float* b, int N) {
+    double sum = 0.0;
+    for (int i = 0; i < N; i++) sum += double(a[i])*double(b[i]);
+    return sum;
+}
+
+int32_t Multigrid_Solver::solve_single(float* B, std::vector<float>& X) {
+    const Level& level = m_levels[0];
+    const int N = get_total_rows();
+    float* x = X.data();
+    float* r = m_residual.data();
+    float* p = m_direction.data();
+    float* q = m_A_direction.data();
+    const float* z = level.v.data();
+    for (int i = 0; i < N; i++) {
+        if (m_is_fixed[i]) x[i] = B[i];
+    }
+    solve_border(x, B);
+
+    // right hand side of the reduced system is the residual with every unknown voltage at zero
+    for (int i = 0; i < N; i++) p[i] = level.is_known[i] ? x[i] : 0.0f;
+    calculate_reduced_residual(p, B, r);
+    const double b_norm = sqrt(get_dot(r, r, N));
+    m_last_cycles = 0;
+    m_last_relative_residual = 0.0f;
+    int32_t info = SOLVE_NOT_CONVERGED;
+    if (b_norm == 0.0) {
+        for (int i = 0; i < N; i++) {
+            if (!level.is_known[i]) x[i] = 0.0f;
+        }
+        info = 0;
+    } else {
+        int cycle = 0;
+        for (int restart = 0; ; restart++) {
+            calculate_reduced_residual(x, B, r);
+            m_last_relative_residual = float(sqrt(get_dot(r, r, N))/b_norm);
+            if (m_last_relative_residual <= m_tolerance) {
+                info = 0;
+                break;
+            }
+            if (cycle >= m_max_cycles || restart >= MAX_RESTARTS) break;
+
+            apply_preconditioner(r);
+            std::copy(z, z+N, p);
+            double rz = get_dot(r, z, N);
+            while (cycle < m_max_cycles) {
+                apply_stencil(level, p, q);
+                const double pq = get_dot(p, q, N);
+                // search direction has no energy left to reduce
+                if (!(pq > 0.0)) break;
+                const float alpha = float(rz/pq);
+                for (int i = 0; i < N; i++) {
+                    x[i] += alpha*p[i];
+                    r[i] -= alpha*q[i];
+                }
+                cycle++;
+                if (sqrt(get_dot(r, r, N))/b_norm <= m_tolerance) break;
+                apply_preconditioner(r);
+                const double rz_next = get_dot(r, z, N);
+                const float beta = float(rz_next/rz);
+                rz = rz_next;
+                for (int i = 0; i < N; i++) p[i] = z[i] + beta*p[i];
+            }
+        }
+        m_last_cycles = cycle;
+    }
+    MODULE_LOG("Multigrid preconditioned CG finished with info=%d after %d V-cycles with relative residual %.3e\n",
+        info, m_last_cycles, m_last_relative_residual);
+    for (int i = 0; i < N; i++) B[i] = x[i];
+    return info;
+}
+
+int32_t Multigrid_Solver::solve(TypedPinnedArray<float> B_data) {
+    return solve_many(B_data, 1);
+}
+
+int32_t Multigrid_Solver::solve_many(TypedPinnedArray<float> B_data, int total_rhs) {
+    const auto timer = Kernel_Timer("multigrid_solve");
+    const int N = get_total_rows();
+    if (total_rhs <= 0 || B_data.get_length() != N*total_rhs) return SOLVE_INVALID_SHAPE;
+    if (int(m_previous_solutions.size()) < total_rhs) {
+        m_previous_solutions.resize(total_rhs, std::vector<float>(N, 0.0f));
+    }
+    int32_t info = 0;
+    for (int k = 0; k < total_rhs; k++) {
+        const int32_t rhs_info = solve_single(&B_data[k*N], m_previous_solutions[k]);
+        if (rhs_info != 0) info = rhs_info;
+    }
+    return info;
+}
+
+void Multigrid_Solver::set_initial_guess(TypedPinnedArray<float> X_data, int total_rhs) {
+    const int N = get_total_rows();
+    m_previous_solutions.resize(total_rhs);
+    for (int k = 0; k < total_rhs; k++) {
+        const float* X = &X_data[k*N];
+        m_previous_solutions[k] = std::vector<float>(X, X+N);
+    }
+}
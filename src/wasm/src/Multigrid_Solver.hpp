@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "./PinnedArray.hpp"
+
+// Conjugate gradient solver for div(E)=0 on the (Ny+1)x(Nx+1) tensor product voltage grid preconditioned by one
+// geometric multigrid V-cycle per iteration
+// - Cells with a forced voltage (beta > 0.5) and grid corners are known, and the border is solved first since its
+//   unknowns only couple along the border (same reduced system as Cholesky_Solver)
+// - Scaling each inner row by (dx0+dx1)*(dy0+dy1) makes the remaining system symmetric positive definite
+// - Each level merges pairs of neighbouring dx/dy cells and its operator is the Galerkin product P^T*A*P
+//   which stays consistent with the fine grid around conductors that don't line up with the coarse grid lines
+// - Smoothing uses alternating zebra line Gauss-Seidel since graded meshes produce highly anisotropic cells
+// - Post smoothing runs in the reverse order of pre smoothing so the V-cycle is a symmetric preconditioner
+// - Memory is O(Nx*Ny) without any fill-in
+class Multigrid_Solver
+{
+public:
+    struct Create_Result {
+        std::shared_ptr<Multigrid_Solver> solver = nullptr;
+        int32_t create_info = 0;
+    };
+    // returned by solve() if the residual did not converge within max_cycles
+    static constexpr int32_t SOLVE_NOT_CONVERGED = 1;
+    // returned by solve() if total_rhs <= 0 or B does not have total_rows*total_rhs elements
+    static constexpr int32_t SOLVE_INVALID_SHAPE = -1;
+    // transfer weights between a fine grid line and its two enclosing coarse grid lines
+    struct Transfer_Weights {
+        int coarse_index_0 = 0;
+        int coarse_index_1 = 0;
+        float weight_0 = 1.0f;
+        float weight_1 = 0.0f;
+    };
+    // Symmetric 9 point stencil where the coupling between two neighbours is only stored by one of them
+    // - west, south, south west and south east couplings are read from the east, north, north east and north west
+    //   couplings of the neighbour
+    // - Known voltages have an identity row so corrections on them are always zero
+    struct Level {
+        int Nx = 0;
+        int Ny = 0;
+        std::vector<float> center;
+        std::vector<float> east;
+        std::vector<float> north;
+        std::vector<float> north_east;
+        std::vector<float> north_west;
+        std::vector<uint8_t> is_known;
+        std::vector<float> v; // correction
+        std::vector<float> f; // right hand side
+        std::vector<float> r; // residual
+        // transfer from this level to the next coarser level
+        std::vector<Transfer_Weights> x_restrict;
+        std::vector<Transfer_Weights> y_restrict;
+    };
+private:
+    std::vector<float> m_dx;
+    std::vector<float> m_dy;
+    std::vector<uint8_t> m_is_fixed;
+    std::vector<Level> m_levels;
+    std::vector<float> m_coarse_lu; // dense LU factors of the coarsest level
+    std::vector<int> m_coarse_pivot;
+    std::vector<std::vector<float>> m_previous_solutions;
+    // conjugate gradient vectors
+    std::vector<float> m_residual;
+    std::vector<float> m_direction;
+    std::vector<float> m_A_direction;
+    int m_total_pre_smooth = 1;
+    int m_total_post_smooth = 1;
+    float m_tolerance = 1e-5f; // single precision residual stagnates around 1e-6 on large grids
+    int m_max_cycles = 200;
+    int m_last_cycles = 0;
+    float m_last_relative_residual = 0.0f;
+private:
+    void create_levels();
+    void factor_coarsest_level();
+    void solve_coarsest_level();
+    void smooth_x_lines(Level& level, int start_row) const;
+    void smooth_y_lines(Level& level, int start_column) const;
+    void smooth(Level& level, int total_sweeps, bool is_reversed) const;
+    void apply_stencil(const Level& level, const float* v, float* y) const;
+    void calculate_residual(Level& level) const;
+    void restrict_residual(const Level& fine, Level& coarse) const;
+    void prolong_correction(const Level& coarse, Level& fine) const;
+    void v_cycle(int level_index);
+    void apply_preconditioner(const float* r);
+    void solve_border(float* v, const float* B) const;
+    void calculate_reduced_residual(const float* v, const float* B, float* r) const;
+    int32_t solve_single(float* B, std::vector<float>& X);
+public:
+    Multigrid_Solver(std::vector<float>&& dx, std::vector<float>&& dy, std::vector<uint8_t>&& is_fixed):
+        m_dx(std::move(dx)), m_dy(std::move(dy)), m_is_fixed(std::move(is_fixed))
+    {
+        create_levels();
+        factor_coarsest_level();
+    }
+    static Create_Result create_from_grid(
+        TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+        TypedPinnedArray<uint32_t> v_index_beta
+    );
+    int32_t solve(TypedPinnedArray<float> B_data);
+    int32_t solve_many(TypedPinnedArray<float> B_data, int total_rhs);
+    void set_initial_guess(TypedPinnedArray<float> X_data, int total_rhs);
+    int get_total_rows() const { return int(m_is_fixed.size()); }
+    int get_total_cols() const { return int(m_is_fixed.size()); }
+    int get_total_levels() const { return int(m_levels.size()); }
+    float get_tolerance() const { return m_tolerance; }
+    void set_tolerance(float tolerance) { m_tolerance = tolerance; }
+    // conjugate gradient iterations which each apply one V-cycle
+    int get_max_cycles() const { return m_max_cycles; }
+    void set_max_cycles(int max_cycles) { m_max_cycles = max_cycles; }
+    int get_last_cycles() const { return m_last_cycles; }
+    float get_last_relative_residual() const { return m_last_relative_residual; }
+};
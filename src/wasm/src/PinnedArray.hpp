@@ -4,35 +4,39 @@
 #include <stdio.h>
 #include <memory>
 #include "./logging.hpp"
+#include "./pinned_pool.hpp"
 
 // Map between wasm module's ArrayBuffer heap and C++ environment
 // SRC: https://kapadia.github.io/emscripten/2013/09/13/emscripten-pointers-and-pointers.html
 // SRC: https://emscripten.org/docs/porting/connecting_cpp_and_javascript/Interacting-with-code.html#access-memory-from-javascript
+// NOTE: Addresses are intptr_t which is 32bit on wasm32 and wide enough for native builds
 class PinnedArray
 {
 private:
-    const int32_t m_address;
+    const intptr_t m_address;
     const int m_length;
     const bool m_owned;
 public:
-    PinnedArray(int32_t address, int length, bool owned)
+    PinnedArray(intptr_t address, int length, bool owned)
     : m_address(address), m_length(length), m_owned(owned) {}
     ~PinnedArray() {
         if (m_owned) {
-            MODULE_LOG("Freeing pinned array at addr=%d, len=%d\n", m_address, m_length);
-            free(reinterpret_cast<void*>(m_address));
+            MODULE_LOG("Freeing pinned array at addr=%ld, len=%d\n", long(m_address), m_length);
+            pinned_pool_release(reinterpret_cast<void*>(m_address), size_t(m_length));
         }
     }
+    // zero initialised buffer from the size class pool (see pinned_pool.hpp)
     static std::shared_ptr<PinnedArray> owned_pin_from_malloc(int length) {
-        int32_t address = reinterpret_cast<int32_t>(calloc(length, 1));
+        intptr_t address = reinterpret_cast<intptr_t>(pinned_pool_allocate(size_t(length)));
         return std::make_shared<PinnedArray>(address, length, true);
     }
-    static std::shared_ptr<PinnedArray> weak_pin_from_address_length(int32_t address, int length) {
+    static std::shared_ptr<PinnedArray> weak_pin_from_address_length(intptr_t address, int length) {
         return std::make_shared<PinnedArray>(address, length, false);
     }
-    inline int32_t get_address() const { return m_address; };
+    inline intptr_t get_address() const { return m_address; };
     inline int get_length() const { return m_length; }
     inline void* get_data() const { return reinterpret_cast<void*>(m_address); }
+    inline bool get_is_owned() const { return m_owned; }
 };
 
 template <typename T>
@@ -49,11 +53,11 @@ public:
         auto pin = PinnedArray::owned_pin_from_malloc(length * sizeof(T));
         return std::make_shared<TypedPinnedArray<T>>(pin);
     }
-    static std::shared_ptr<TypedPinnedArray<T>> weak_pin_from_address_length(int32_t address, int length) {
+    static std::shared_ptr<TypedPinnedArray<T>> weak_pin_from_address_length(intptr_t address, int length) {
         auto pin = PinnedArray::weak_pin_from_address_length(address, length * sizeof(T));
         return std::make_shared<TypedPinnedArray<T>>(pin);
     }
-    inline int32_t get_address() const { return m_pin->get_address(); }
+    inline intptr_t get_address() const { return m_pin->get_address(); }
     inline int get_length() const { return m_pin->get_length() / sizeof(T); }
     inline T* get_data() const { return reinterpret_cast<T*>(m_pin->get_data()); }
     inline T& operator[](int i) { return get_data()[i]; }
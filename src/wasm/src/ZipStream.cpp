@@ -0,0 +1,421 @@
+#include "./ZipStream.hpp"
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "./thread_pool.hpp"
+// NOTE: miniz is compiled into the vendored zip library so we only need its declarations
+#define MINIZ_HEADER_FILE_ONLY
+#include <miniz.h>
+
+// DOC: https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr uint32_t DATA_DESCRIPTOR_SIGNATURE = 0x08074b50;
+constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+constexpr uint32_t END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+constexpr uint16_t FLAG_DATA_DESCRIPTOR = 1u << 3;
+constexpr uint16_t FLAG_UTF8_NAME = 1u << 11;
+constexpr uint16_t METHOD_STORE = 0;
+constexpr uint16_t METHOD_DEFLATE = 8;
+constexpr uint16_t VERSION_STORE = 10;
+constexpr uint16_t VERSION_DEFLATE = 20;
+constexpr uint64_t MAX_ZIP32_SIZE = 0xFFFFFFFFull;
+constexpr uint64_t MAX_ZIP32_ENTRIES = 0xFFFFull;
+
+static void append_u16(std::vector<uint8_t>& buf, uint16_t v) {
+    buf.push_back(uint8_t(v & 0xFF));
+    buf.push_back(uint8_t((v >> 8) & 0xFF));
+}
+
+static void append_u32(std::vector<uint8_t>& buf, uint32_t v) {
+    append_u16(buf, uint16_t(v & 0xFFFF));
+    append_u16(buf, uint16_t((v >> 16) & 0xFFFF));
+}
+
+static void append_string(std::vector<uint8_t>& buf, const std::string& str) {
+    buf.insert(buf.end(), str.begin(), str.end());
+}
+
+// Combine crc(A) and crc(B) into crc(A|B) so blocks can be checksummed in parallel
+// SRC: zlib/crc32.c crc32_combine()
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+static uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t length2) {
+    if (length2 == 0) return crc1;
+    uint32_t even[32];
+    uint32_t odd[32];
+    // operator for one zero bit
+    odd[0] = 0xEDB88320u;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; n++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    // operators for two and four zero bits
+    gf2_matrix_square(even, odd);
+    gf2_matrix_square(odd, even);
+    // apply length2 zero bytes to crc1
+    do {
+        gf2_matrix_square(even, odd);
+        if (length2 & 1) crc1 = gf2_matrix_times(even, crc1);
+        length2 >>= 1;
+        if (length2 == 0) break;
+        gf2_matrix_square(odd, even);
+        if (length2 & 1) crc1 = gf2_matrix_times(odd, crc1);
+        length2 >>= 1;
+    } while (length2 != 0);
+    return crc1 ^ crc2;
+}
+
+// Each block is an independent raw deflate stream ended on a byte boundary with a sync flush
+// so that their concatenation is a single valid stream as long as only the last block is final
+static bool deflate_block(std::vector<uint8_t>& out, const uint8_t* data, size_t length, int level, bool is_last) {
+    mz_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (mz_deflateInit2(&stream, level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 8, MZ_DEFAULT_STRATEGY) != MZ_OK) {
+        return false;
+    }
+    // extra space for the sync flush marker
+    out.resize(size_t(mz_deflateBound(&stream, mz_ulong(length))) + 64);
+    stream.next_in = data;
+    stream.avail_in = (unsigned int)length;
+    stream.next_out = out.data();
+    stream.avail_out = (unsigned int)out.size();
+    const int flush = is_last ? MZ_FINISH : MZ_SYNC_FLUSH;
+    bool is_success = true;
+    while (true) {
+        const int status = mz_deflate(&stream, flush);
+        if (status == MZ_STREAM_END) break;
+        if (status != MZ_OK && status != MZ_BUF_ERROR) {
+            is_success = false;
+            break;
+        }
+        if (flush == MZ_SYNC_FLUSH && stream.avail_in == 0 && stream.avail_out != 0) break;
+        if (stream.avail_out == 0) {
+            const size_t used = out.size();
+            out.resize(used*2);
+            stream.next_out = out.data() + used;
+            stream.avail_out = (unsigned int)(out.size() - used);
+        }
+    }
+    out.resize(size_t(stream.total_out));
+    mz_deflateEnd(&stream);
+    return is_success;
+}
+
+ZipStream::ZipStream() {
+    const time_t now = time(nullptr);
+    struct tm local;
+#if defined(_WIN32)
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    const int year = std::max(local.tm_year + 1900, 1980);
+    m_dos_time = uint16_t((local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+    m_dos_date = uint16_t(((year - 1980) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday);
+}
+
+std::shared_ptr<ZipStream> ZipStream::create() {
+    return std::make_shared<ZipStream>();
+}
+
+int32_t ZipStream::add_entry(const std::string& name, TypedPinnedArray<uint8_t> data, int level) {
+    if (m_is_finished) return ALREADY_FINISHED;
+    if (level < 0 || level > MAX_LEVEL) return INVALID_LEVEL;
+    if (name.size() > 0xFFFF) return NAME_TOO_LONG;
+    Entry entry;
+    entry.name = name;
+    entry.level = level;
+    entry.data = data.m_pin;
+    // NOTE: a weak pin is a view into memory the caller can free before the entry is read
+    if (entry.data != nullptr && !entry.data->get_is_owned()) {
+        const int length = entry.data->get_length();
+        auto owned = PinnedArray::owned_pin_from_malloc(length);
+        if (length > 0 && owned->get_data() == nullptr) return OUT_OF_MEMORY;
+        if (length > 0) memcpy(owned->get_data(), entry.data->get_data(), size_t(length));
+        entry.data = std::move(owned);
+    }
+    entry.uncompressed_size = uint64_t(data.get_length());
+    m_entries.push_back(std::move(entry));
+    return 0;
+}
+
+int32_t ZipStream::add_npy_entry(
+    const std::string& name, TypedPinnedArray<uint8_t> data,
+    const std::string& descr, TypedPinnedArray<int32_t> shape, int level
+) {
+    // NUMPY file format version 1.0 which matches Ndarray.export_as_numpy_bytecode()
+    // magic | version | descriptor_length | descriptor | padding | newline
+    //       | 2 bytes | 2 bytes           |            |         | 1 byte
+    // DOC: https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+    const int total_dims = shape.get_length();
+    if (total_dims == 0) return INVALID_NPY_SHAPE;
+    std::string descriptor = "{'descr':'" + descr + "','fortran_order':False,'shape':(";
+    for (int i = 0; i < total_dims; i++) {
+        if (shape[i] < 0) return INVALID_NPY_SHAPE;
+        descriptor += std::to_string(shape[i]) + ",";
+    }
+    descriptor += "),}";
+
+    constexpr int magic_length = 8;
+    constexpr int padding_alignment = 64;
+    const int unpadded_length = magic_length + 2 + int(descriptor.size()) + 1;
+    const int padded_length = (unpadded_length + padding_alignment - 1) / padding_alignment * padding_alignment;
+    const int total_padding = padded_length - unpadded_length;
+    if (padded_length - magic_length - 2 > 0xFFFF) return INVALID_NPY_SHAPE;
+
+    std::vector<uint8_t> header;
+    header.reserve(size_t(padded_length));
+    const uint8_t magic[magic_length] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 0x01, 0x00 };
+    header.insert(header.end(), magic, magic + magic_length);
+    append_u16(header, uint16_t(descriptor.size() + total_padding + 1));
+    append_string(header, descriptor);
+    header.insert(header.end(), size_t(total_padding), uint8_t(' '));
+    header.push_back(uint8_t('\n'));
+
+    const int32_t status = add_entry(name, data, level);
+    if (status != 0) return status;
+    Entry& entry = m_entries.back();
+    entry.uncompressed_size += uint64_t(header.size());
+    entry.prefix = std::move(header);
+    return 0;
+}
+
+void ZipStream::finish() {
+    m_is_finished = true;
+}
+
+void ZipStream::split_blocks(const Entry& entry) {
+    m_blocks.clear();
+    const auto add_blocks = [&](const uint8_t* data, size_t length) {
+        for (size_t offset = 0; offset < length; offset += size_t(m_block_size)) {
+            m_blocks.push_back({ data + offset, std::min(size_t(m_block_size), length - offset) });
+        }
+    };
+    add_blocks(entry.prefix.data(), entry.prefix.size());
+    if (entry.data != nullptr) {
+        add_blocks(reinterpret_cast<const uint8_t*>(entry.data->get_data()), size_t(entry.data->get_length()));
+    }
+    // empty entries still need a final deflate block
+    if (m_blocks.empty()) {
+        m_blocks.push_back({ nullptr, 0 });
+    }
+    m_current_block = 0;
+}
+
+uint32_t ZipStream::calculate_crc32(const Entry& entry) {
+    split_blocks(entry);
+    const int total_blocks = int(m_blocks.size());
+    m_block_crc32.resize(size_t(total_blocks));
+    parallel_for_chunks(total_blocks, 1, [&](int, int start, int end) {
+        for (int i = start; i < end; i++) {
+            const auto& block = m_blocks[size_t(i)];
+            m_block_crc32[size_t(i)] = uint32_t(mz_crc32(MZ_CRC32_INIT, block.data, block.length));
+        }
+    });
+    uint32_t crc = 0;
+    for (int i = 0; i < total_blocks; i++) {
+        crc = crc32_combine(crc, m_block_crc32[size_t(i)], m_blocks[size_t(i)].length);
+    }
+    return crc;
+}
+
+bool ZipStream::deflate_next_blocks(Entry& entry) {
+    const int total_blocks = int(m_blocks.size());
+    const int total_batch = std::min(get_total_threads(), total_blocks - m_current_block);
+    const int batch_start = m_current_block;
+    m_block_outputs.resize(size_t(std::max(total_batch, int(m_block_outputs.size()))));
+    m_block_crc32.resize(size_t(total_batch));
+    std::vector<uint8_t> is_success(size_t(total_batch), 0);
+    parallel_for_chunks(total_batch, 1, [&](int, int start, int end) {
+        for (int i = start; i < end; i++) {
+            const int block_index = batch_start + i;
+            const auto& block = m_blocks[size_t(block_index)];
+            const bool is_last = block_index == total_blocks-1;
+            m_block_crc32[size_t(i)] = uint32_t(mz_crc32(MZ_CRC32_INIT, block.data, block.length));
+            is_success[size_t(i)] = deflate_block(m_block_outputs[size_t(i)], block.data, block.length, entry.level, is_last);
+        }
+    });
+
+    for (int i = 0; i < total_batch; i++) {
+        if (!is_success[size_t(i)]) return false;
+        const auto& output = m_block_outputs[size_t(i)];
+        m_chunk.insert(m_chunk.end(), output.begin(), output.end());
+        entry.crc32 = crc32_combine(entry.crc32, m_block_crc32[size_t(i)], m_blocks[size_t(batch_start + i)].length);
+        entry.compressed_size += uint64_t(output.size());
+    }
+    m_current_block += total_batch;
+    return true;
+}
+
+void ZipStream::write_local_header(const Entry& entry) {
+    const bool is_deflate = entry.level > 0;
+    append_u32(m_chunk, LOCAL_HEADER_SIGNATURE);
+    append_u16(m_chunk, is_deflate ? VERSION_DEFLATE : VERSION_STORE);
+    append_u16(m_chunk, FLAG_UTF8_NAME | (is_deflate ? FLAG_DATA_DESCRIPTOR : 0));
+    append_u16(m_chunk, is_deflate ? METHOD_DEFLATE : METHOD_STORE);
+    append_u16(m_chunk, m_dos_time);
+    append_u16(m_chunk, m_dos_date);
+    // sizes and crc of deflated entries are only known after compression so they go in the data descriptor
+    append_u32(m_chunk, is_deflate ? 0 : entry.crc32);
+    append_u32(m_chunk, is_deflate ? 0 : uint32_t(entry.compressed_size));
+    append_u32(m_chunk, is_deflate ? 0 : uint32_t(entry.uncompressed_size));
+    append_u16(m_chunk, uint16_t(entry.name.size()));
+    append_u16(m_chunk, 0); // extra field length
+    append_string(m_chunk, entry.name);
+}
+
+void ZipStream::write_data_descriptor(const Entry& entry) {
+    append_u32(m_chunk, DATA_DESCRIPTOR_SIGNATURE);
+    append_u32(m_chunk, entry.crc32);
+    append_u32(m_chunk, uint32_t(entry.compressed_size));
+    append_u32(m_chunk, uint32_t(entry.uncompressed_size));
+}
+
+void ZipStream::write_central_directory() {
+    const uint64_t central_directory_offset = m_total_bytes_written;
+    for (const auto& entry: m_entries) {
+        const bool is_deflate = entry.level > 0;
+        append_u32(m_chunk, CENTRAL_HEADER_SIGNATURE);
+        append_u16(m_chunk, VERSION_DEFLATE); // version made by
+        append_u16(m_chunk, is_deflate ? VERSION_DEFLATE : VERSION_STORE);
+        append_u16(m_chunk, FLAG_UTF8_NAME | (is_deflate ? FLAG_DATA_DESCRIPTOR : 0));
+        append_u16(m_chunk, is_deflate ? METHOD_DEFLATE : METHOD_STORE);
+        append_u16(m_chunk, m_dos_time);
+        append_u16(m_chunk, m_dos_date);
+        append_u32(m_chunk, entry.crc32);
+        append_u32(m_chunk, uint32_t(entry.compressed_size));
+        append_u32(m_chunk, uint32_t(entry.uncompressed_size));
+        append_u16(m_chunk, uint16_t(entry.name.size()));
+        append_u16(m_chunk, 0); // extra field length
+        append_u16(m_chunk, 0); // comment length
+        append_u16(m_chunk, 0); // disk number
+        append_u16(m_chunk, 0); // internal attributes
+        append_u32(m_chunk, 0); // external attributes
+        append_u32(m_chunk, uint32_t(entry.local_header_offset));
+        append_string(m_chunk, entry.name);
+    }
+    const uint64_t central_directory_size = uint64_t(m_chunk.size());
+    append_u32(m_chunk, END_OF_CENTRAL_DIRECTORY_SIGNATURE);
+    append_u16(m_chunk, 0); // disk number
+    append_u16(m_chunk, 0); // disk with central directory
+    append_u16(m_chunk, uint16_t(m_entries.size()));
+    append_u16(m_chunk, uint16_t(m_entries.size()));
+    append_u32(m_chunk, uint32_t(central_directory_size));
+    append_u32(m_chunk, uint32_t(central_directory_offset));
+    append_u16(m_chunk, 0); // comment length
+}
+
+std::shared_ptr<TypedPinnedArray<uint8_t>> ZipStream::emit(const uint8_t* data, size_t length) {
+    m_total_bytes_written += uint64_t(length);
+    return TypedPinnedArray<uint8_t>::weak_pin_from_address_length(reinterpret_cast<intptr_t>(data), int(length));
+}
+
+std::shared_ptr<TypedPinnedArray<uint8_t>> ZipStream::emit_chunk() {
+    return emit(m_chunk.data(), m_chunk.size());
+}
+
+std::shared_ptr<TypedPinnedArray<uint8_t>> ZipStream::read_chunk() {
+    m_last_stored_data = nullptr;
+    while (m_error == 0) {
+        switch (m_state) {
+        case State::ENTRY_START: {
+            if (m_current_entry >= int(m_entries.size())) {
+                if (!m_is_finished) return nullptr;
+                m_state = State::CENTRAL_DIRECTORY;
+                break;
+            }
+            Entry& entry = m_entries[size_t(m_current_entry)];
+            entry.local_header_offset = m_total_bytes_written;
+            if (entry.local_header_offset > MAX_ZIP32_SIZE || entry.uncompressed_size > MAX_ZIP32_SIZE) {
+                m_error = ARCHIVE_TOO_LARGE;
+                return nullptr;
+            }
+            if (entry.level == 0) {
+                entry.crc32 = calculate_crc32(entry);
+                entry.compressed_size = entry.uncompressed_size;
+                m_state = State::ENTRY_PREFIX;
+            } else {
+                split_blocks(entry);
+                m_state = State::ENTRY_DATA;
+            }
+            m_chunk.clear();
+            write_local_header(entry);
+            return emit_chunk();
+        }
+        case State::ENTRY_PREFIX: {
+            const Entry& entry = m_entries[size_t(m_current_entry)];
+            m_state = State::ENTRY_DATA;
+            if (!entry.prefix.empty()) {
+                return emit(entry.prefix.data(), entry.prefix.size());
+            }
+            break;
+        }
+        case State::ENTRY_DATA: {
+            Entry& entry = m_entries[size_t(m_current_entry)];
+            // stored entries are returned as a view of the caller's pinned array
+            if (entry.level == 0) {
+                m_state = State::ENTRY_START;
+                m_current_entry++;
+                if (entry.data != nullptr && entry.data->get_length() > 0) {
+                    // entry pins are owning so holding it keeps the returned view valid until the next read_chunk()
+                    auto data = entry.data;
+                    entry.data = nullptr;
+                    const auto chunk = emit(reinterpret_cast<const uint8_t*>(data->get_data()), size_t(data->get_length()));
+                    m_last_stored_data = std::move(data);
+                    return chunk;
+                }
+                break;
+            }
+            m_chunk.clear();
+            if (!deflate_next_blocks(entry)) {
+                m_error = DEFLATE_FAILED;
+                return nullptr;
+            }
+            if (m_current_block >= int(m_blocks.size())) {
+                if (entry.compressed_size > MAX_ZIP32_SIZE) {
+                    m_error = ARCHIVE_TOO_LARGE;
+                    return nullptr;
+                }
+                write_data_descriptor(entry);
+                // release the entry's pinned array once it has been fully compressed
+                entry.data = nullptr;
+                entry.prefix.clear();
+                entry.prefix.shrink_to_fit();
+                m_blocks.clear();
+                m_state = State::ENTRY_START;
+                m_current_entry++;
+            }
+            return emit_chunk();
+        }
+        case State::CENTRAL_DIRECTORY: {
+            if (m_total_bytes_written > MAX_ZIP32_SIZE || uint64_t(m_entries.size()) > MAX_ZIP32_ENTRIES) {
+                m_error = ARCHIVE_TOO_LARGE;
+                return nullptr;
+            }
+            m_chunk.clear();
+            write_central_directory();
+            m_state = State::DONE;
+            return emit_chunk();
+        }
+        case State::DONE:
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "./PinnedArray.hpp"
+
+// Writes a zip archive incrementally so that the whole archive is never held in the heap
+// - Entries share ownership of the caller's pinned arrays which are only read when their chunks are produced
+// - Weak pins don't keep their memory alive so they are copied into an owned buffer when added
+// - Stored entries are emitted straight from the pinned array without a copy
+// - Deflated entries are split into blocks which are compressed in parallel on the threaded build
+// - Usage is add_entry(...) and read_chunk() until it returns nullptr, then finish() and read_chunk()
+//   for the central directory
+class ZipStream
+{
+public:
+    static constexpr int32_t INVALID_LEVEL = -1;
+    static constexpr int32_t ALREADY_FINISHED = -2;
+    static constexpr int32_t NAME_TOO_LONG = -3;
+    static constexpr int32_t INVALID_NPY_SHAPE = -4;
+    static constexpr int32_t DEFLATE_FAILED = -5;
+    // zip64 is not supported so archives and entries are limited to 4GB
+    static constexpr int32_t ARCHIVE_TOO_LARGE = -6;
+    static constexpr int32_t OUT_OF_MEMORY = -7;
+    // level 0 stores entries uncompressed and 1 to 9 deflates them
+    static constexpr int MAX_LEVEL = 9;
+    static constexpr int DEFAULT_LEVEL = 6;
+    static constexpr int DEFAULT_BLOCK_SIZE = 512*1024;
+private:
+    struct Entry {
+        std::string name;
+        int level;
+        // npy header which is written before data
+        std::vector<uint8_t> prefix;
+        // always an owning pin (see add_entry)
+        std::shared_ptr<PinnedArray> data;
+        uint32_t crc32 = 0;
+        uint64_t compressed_size = 0;
+        uint64_t uncompressed_size = 0;
+        uint64_t local_header_offset = 0;
+    };
+    struct Block {
+        const uint8_t* data;
+        size_t length;
+    };
+    enum class State {
+        ENTRY_START,
+        ENTRY_PREFIX,
+        ENTRY_DATA,
+        CENTRAL_DIRECTORY,
+        DONE,
+    };
+    std::vector<Entry> m_entries;
+    int m_current_entry = 0;
+    State m_state = State::ENTRY_START;
+    bool m_is_finished = false;
+    int32_t m_error = 0;
+    uint64_t m_total_bytes_written = 0;
+    uint16_t m_dos_time = 0;
+    uint16_t m_dos_date = 0;
+    int m_block_size = DEFAULT_BLOCK_SIZE;
+    // deflate blocks of the current entry
+    std::vector<Block> m_blocks;
+    int m_current_block = 0;
+    std::vector<std::vector<uint8_t>> m_block_outputs;
+    std::vector<uint32_t> m_block_crc32;
+    // bytes returned by the last read_chunk() which stay valid until the next call
+    std::vector<uint8_t> m_chunk;
+    std::shared_ptr<PinnedArray> m_last_stored_data;
+private:
+    void split_blocks(const Entry& entry);
+    uint32_t calculate_crc32(const Entry& entry);
+    void write_local_header(const Entry& entry);
+    void write_data_descriptor(const Entry& entry);
+    void write_central_directory();
+    bool deflate_next_blocks(Entry& entry);
+    std::shared_ptr<TypedPinnedArray<uint8_t>> emit(const uint8_t* data, size_t length);
+    std::shared_ptr<TypedPinnedArray<uint8_t>> emit_chunk();
+public:
+    ZipStream();
+    static std::shared_ptr<ZipStream> create();
+    int32_t add_entry(const std::string& name, TypedPinnedArray<uint8_t> data, int level);
+    // descr is the numpy type string (e.g. "<f4") and data is the raw array in C order
+    int32_t add_npy_entry(
+        const std::string& name, TypedPinnedArray<uint8_t> data,
+        const std::string& descr, TypedPinnedArray<int32_t> shape, int level
+    );
+    // no more entries can be added and the central directory is emitted once all entries are read
+    void finish();
+    // next part of the archive as a view into the heap which is valid until the next call
+    // returns nullptr when all added entries have been emitted or an error occured
+    std::shared_ptr<TypedPinnedArray<uint8_t>> read_chunk();
+    bool get_is_done() const { return m_state == State::DONE; }
+    int32_t get_error() const { return m_error; }
+    double get_total_bytes_written() const { return double(m_total_bytes_written); }
+    int get_block_size() const { return m_block_size; }
+    void set_block_size(int block_size) { m_block_size = (block_size < 4096) ? 4096 : block_size; }
+};
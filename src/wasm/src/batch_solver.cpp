@@ -0,0 +1,395 @@
+// Native batch solver for grid bundles exported from the stackup editor
+// - Each bundle is a zip of npy files (dx, dy, v_table, v_index_beta, ek_table, ek_index_beta)
+// - Bundles are solved concurrently on the process wide thread pool with one bundle per worker at a time
+// - Prints Z0, Ch, Cih, Lh and er_eff of each bundle in input order as CSV or JSON on stdout
+// - Module debug logs and per bundle errors go to stderr so stdout can be piped straight into a CSV or JSON parser
+// - Exits with 1 if any bundle failed to load or solve so nightly regression sweeps can flag it
+// - Usage: batch_solver [--format csv|json] [--threads N] [--v-input V] bundle.zip ...
+#include "./LU_Solver.hpp"
+#include "./laplace_matrix.hpp"
+#include "./energy_integral.hpp"
+#include "./thread_pool.hpp"
+#include <zip.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// same constants as electrostatic_2d.ts so results match the app
+static constexpr double EPSILON_0 = 8.85e-12;
+static constexpr double C_0 = 3e8;
+
+enum class Output_Format {
+    CSV,
+    JSON,
+};
+
+struct Batch_Config {
+    Output_Format format = Output_Format::CSV;
+    int total_threads = 0; // 0 = keep default
+    double v_input = 0.0; // 0 = peak to peak of v_table
+    std::vector<const char*> bundle_paths;
+};
+
+struct Grid_Bundle {
+    int Nx = 0;
+    int Ny = 0;
+    std::shared_ptr<TypedPinnedArray<float>> dx;
+    std::shared_ptr<TypedPinnedArray<float>> dy;
+    std::shared_ptr<TypedPinnedArray<float>> v_table;
+    std::shared_ptr<TypedPinnedArray<uint32_t>> v_index_beta;
+    std::shared_ptr<TypedPinnedArray<float>> ek_table;
+    std::shared_ptr<TypedPinnedArray<uint32_t>> ek_index_beta;
+};
+
+struct Bundle_Result {
+    std::string error; // empty if solved
+    int Nx = 0;
+    int Ny = 0;
+    double v_input = 0.0;
+    double energy_homogenous = 0.0;
+    double energy_inhomogenous = 0.0;
+    double Z0 = 0.0;
+    double Ch = 0.0;
+    double Cih = 0.0;
+    double Lh = 0.0;
+    double er_eff = 0.0;
+};
+
+struct Npy_Header {
+    char type = 0;              // kind from the numpy descr, e.g. 'f' or 'u'
+    int item_size = 0;
+    std::vector<int> shape;
+    size_t data_offset = 0;
+};
+
+static const char* read_zip_entry(struct zip_t* zip, const char* name, std::vector<uint8_t>& data) {
+    if (zip_entry_open(zip, name) != 0) return "missing entry";
+    data.resize(size_t(zip_entry_size(zip)));
+    const ssize_t total_read = zip_entry_noallocread(zip, data.data(), data.size());
+    zip_entry_close(zip);
+    if (total_read < 0 || size_t(total_read) != data.size()) return "failed to decompress entry";
+    return nullptr;
+}
+
+// returns the text after 'key': inside the header dictionary
+static const char* find_npy_key(const std::string& header, const char* key) {
+    const std::string quoted_key = std::string("'") + key + "'";
+    const size_t key_offset = header.find(quoted_key);
+    if (key_offset == std::string::npos) return nullptr;
+    const size_t colon_offset = header.find(':', key_offset+quoted_key.size());
+    if (colon_offset == std::string::npos) return nullptr;
+    const char* curr = header.c_str() + colon_offset + 1;
+    while (*curr == ' ') curr++;
+    return curr;
+}
+
+// SRC: https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+static const char* parse_npy_header(const std::vector<uint8_t>& data, Npy_Header& header) {
+    static const uint8_t MAGIC[6] = { 0x93, 'N', 'U', 'M', 'P', 'Y' };
+    if (data.size() < 10 || memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0) return "not a npy file";
+    const uint8_t major_version = data[6];
+    size_t header_length = 0;
+    size_t header_offset = 0;
+    if (major_version == 1) {
+        header_length = size_t(data[8]) | (size_t(data[9]) << 8);
+        header_offset = 10;
+    } else if (major_version == 2 || major_version == 3) {
+        if (data.size() < 12) return "truncated npy header";
+        header_length = size_t(data[8]) | (size_t(data[9]) << 8) | (size_t(data[10]) << 16) | (size_t(data[11]) << 24);
+        header_offset = 12;
+    } else {
+        return "unsupported npy version";
+    }
+    if (header_offset+header_length > data.size()) return "truncated npy header";
+    const std::string text(reinterpret_cast<const char*>(data.data()+header_offset), header_length);
+
+    const char* descr = find_npy_key(text, "descr");
+    if (descr == nullptr || descr[0] != '\'') return "npy header is missing descr";
+    // NOTE: big endian arrays are never exported so they are rejected instead of swapped
+    const char byte_order = descr[1];
+    if (byte_order != '<' && byte_order != '|' && byte_order != '=') return "npy data is not little endian";
+    header.type = descr[2];
+    header.item_size = atoi(&descr[3]);
+
+    const char* fortran_order = find_npy_key(text, "fortran_order");
+    if (fortran_order == nullptr) return "npy header is missing fortran_order";
+    if (strncmp(fortran_order, "False", 5) != 0) return "npy data is not in C order";
+
+    const char* shape = find_npy_key(text, "shape");
+    if (shape == nullptr || shape[0] != '(') return "npy header is missing shape";
+    header.shape.clear();
+    const char* curr = shape+1;
+    while (*curr != ')' && *curr != '\0') {
+        char* end = nullptr;
+        const long dim = strtol(curr, &end, 10);
+        if (end == curr) {
+            curr++;
+            continue;
+        }
+        if (dim < 0 || dim > INT32_MAX) return "invalid npy shape";
+        header.shape.push_back(int(dim));
+        curr = end;
+    }
+    header.data_offset = header_offset+header_length;
+    return nullptr;
+}
+
+template <typename T>
+static const char* read_npy_entry(
+    struct zip_t* zip, const char* name, char type,
+    std::shared_ptr<TypedPinnedArray<T>>& array_out, std::vector<int>& shape_out
+) {
+    std::vector<uint8_t> data;
+    const char* error = read_zip_entry(zip, name, data);
+    if (error != nullptr) return error;
+    Npy_Header header;
+    error = parse_npy_header(data, header);
+    if (error != nullptr) return error;
+    if (header.type != type || header.item_size != int(sizeof(T))) return "unexpected npy dtype";
+    int64_t total_items = 1;
+    for (const int dim: header.shape) {
+        total_items *= int64_t(dim);
+        if (total_items*int64_t(sizeof(T)) > INT32_MAX) return "npy array is too large";
+    }
+    const size_t total_bytes = size_t(total_items)*sizeof(T);
+    if (header.data_offset+total_bytes > data.size()) return "truncated npy data";
+    array_out = TypedPinnedArray<T>::owned_pin_from_malloc(int(total_items));
+    if (array_out->get_data() == nullptr) return "out of memory";
+    memcpy(array_out->get_data(), data.data()+header.data_offset, total_bytes);
+    shape_out = header.shape;
+    return nullptr;
+}
+
+// index of each fixed voltage or dielectric cell must be inside its table
+static bool is_index_beta_valid(TypedPinnedArray<uint32_t> index_beta, int table_length, bool is_voltage) {
+    const int N = index_beta.get_length();
+    for (int i = 0; i < N; i++) {
+        const uint32_t value = index_beta[i];
+        // see is_fixed_voltage() in laplace_matrix.cpp
+        if (is_voltage && float(value & 0xFFFF)/float(0xFFFF) <= 0.5f) continue;
+        if (int(value >> 16) >= table_length) return false;
+    }
+    return true;
+}
+
+static std::string load_bundle(const char* path, Grid_Bundle& bundle) {
+    struct zip_t* zip = zip_open(path, 0, 'r');
+    if (zip == nullptr) return "failed to open zip";
+
+    const char* failed_entry = nullptr;
+    const char* error = nullptr;
+    const auto read_entry = [&](const char* name, char type, auto& array_out, std::vector<int>& shape_out) {
+        if (error != nullptr) return;
+        error = read_npy_entry(zip, name, type, array_out, shape_out);
+        if (error != nullptr) failed_entry = name;
+    };
+    std::vector<int> dx_shape, dy_shape, v_table_shape, v_index_beta_shape, ek_table_shape, ek_index_beta_shape;
+    read_entry("dx.npy", 'f', bundle.dx, dx_shape);
+    read_entry("dy.npy", 'f', bundle.dy, dy_shape);
+    read_entry("v_table.npy", 'f', bundle.v_table, v_table_shape);
+    read_entry("v_index_beta.npy", 'u', bundle.v_index_beta, v_index_beta_shape);
+    read_entry("ek_table.npy", 'f', bundle.ek_table, ek_table_shape);
+    read_entry("ek_index_beta.npy", 'u', bundle.ek_index_beta, ek_index_beta_shape);
+    zip_close(zip);
+    if (error != nullptr) return std::string(failed_entry) + ": " + error;
+
+    if (dx_shape.size() != 1 || dy_shape.size() != 1) return "dx and dy must be 1D";
+    const int Nx = dx_shape[0];
+    const int Ny = dy_shape[0];
+    if (Nx < 1 || Ny < 1) return "grid is empty";
+    if (v_index_beta_shape != std::vector<int>{ Ny+1, Nx+1 }) return "v_index_beta must have shape [Ny+1,Nx+1]";
+    if (ek_index_beta_shape != std::vector<int>{ Ny, Nx }) return "ek_index_beta must have shape [Ny,Nx]";
+    if (v_table_shape.size() != 1 || v_table_shape[0] < 1) return "v_table must be a non-empty 1D array";
+    if (ek_table_shape.size() != 1 || ek_table_shape[0] < 1) return "ek_table must be a non-empty 1D array";
+    if (!is_index_beta_valid(*bundle.v_index_beta, v_table_shape[0], true)) {
+        return "v_index_beta has an index outside of v_table";
+    }
+    if (!is_index_beta_valid(*bundle.ek_index_beta, ek_table_shape[0], false)) {
+        return "ek_index_beta has an index outside of ek_table";
+    }
+    bundle.Nx = Nx;
+    bundle.Ny = Ny;
+    return "";
+}
+
+// NOTE: Exported bundles only store v_table and not the excitation amplitude, so by default
+//       v_input is taken as the peak to peak of v_table. This matches the single ended [0,V,0] and
+//       odd mode [0,V,-V] setups used for the final measurement, otherwise pass --v-input
+static double get_default_v_input(TypedPinnedArray<float> v_table) {
+    const float* begin = v_table.get_data();
+    const float* end = begin + v_table.get_length();
+    return double(*std::max_element(begin, end)) - double(*std::min_element(begin, end));
+}
+
+static Bundle_Result solve_bundle(const char* path, const Batch_Config& config) {
+    Bundle_Result result;
+    Grid_Bundle bundle;
+    result.error = load_bundle(path, bundle);
+    if (!result.error.empty()) return result;
+    result.Nx = bundle.Nx;
+    result.Ny = bundle.Ny;
+
+    const auto lu = LU_Solver::create_from_grid(*bundle.dx, *bundle.dy, *bundle.v_index_beta);
+    if (lu.solver == nullptr) {
+        result.error = "factorisation failed with info=" + std::to_string(int(lu.lu_factor_info));
+        return result;
+    }
+    auto v_field = *TypedPinnedArray<float>::owned_pin_from_malloc((bundle.Nx+1)*(bundle.Ny+1));
+    const int32_t rhs_info = create_laplace_rhs(v_field, *bundle.v_index_beta, *bundle.v_table, 1);
+    if (rhs_info != 0) {
+        result.error = "invalid voltage table with info=" + std::to_string(int(rhs_info));
+        return result;
+    }
+    const int32_t solve_info = lu.solver->solve(v_field);
+    if (solve_info != 0) {
+        result.error = "solve failed with info=" + std::to_string(int(solve_info));
+        return result;
+    }
+    const auto energy = calculate_energy_2d(v_field, *bundle.dx, *bundle.dy, *bundle.ek_table, *bundle.ek_index_beta);
+
+    // same as Grid.get_impedance_from_energy(...) in electrostatic_2d.ts
+    const double v0 = (config.v_input > 0.0) ? config.v_input : get_default_v_input(*bundle.v_table);
+    if (!(v0 > 0.0)) {
+        result.error = "v_table has no voltage difference";
+        return result;
+    }
+    result.v_input = v0;
+    result.energy_homogenous = double(energy.homogenous);
+    result.energy_inhomogenous = double(energy.inhomogenous);
+    result.Ch = 1.0/(v0*v0) * EPSILON_0 * result.energy_homogenous;
+    result.Lh = 1.0/(C_0*C_0 * result.Ch);
+    result.Cih = 1.0/(v0*v0) * EPSILON_0 * result.energy_inhomogenous;
+    result.Z0 = sqrt(result.Lh/result.Cih);
+    result.er_eff = result.Cih/result.Ch;
+    return result;
+}
+
+// bundle paths are written as is so they must not contain quotes, commas or newlines
+static void print_csv(const Batch_Config& config, const std::vector<Bundle_Result>& results) {
+    printf("bundle,Nx,Ny,v_input,energy_homogenous,energy_inhomogenous,Z0,Ch,Cih,Lh,er_eff,error\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        printf("%s,%d,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%s\n",
+            config.bundle_paths[i], result.Nx, result.Ny, result.v_input,
+            result.energy_homogenous, result.energy_inhomogenous,
+            result.Z0, result.Ch, result.Cih, result.Lh, result.er_eff,
+            result.error.c_str()
+        );
+    }
+}
+
+static void print_json_string(const char* text) {
+    putchar('"');
+    for (const char* curr = text; *curr != '\0'; curr++) {
+        const char c = *curr;
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (uint8_t(c) < 0x20) {
+            printf("\\u%04x", int(c));
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+static void print_json(const Batch_Config& config, const std::vector<Bundle_Result>& results) {
+    printf("{\n");
+    printf("  \"total_threads\": %d,\n", get_total_threads());
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        printf("    {\"bundle\": ");
+        print_json_string(config.bundle_paths[i]);
+        if (result.error.empty()) {
+            printf(", \"Nx\": %d, \"Ny\": %d, \"v_input\": %.9g, \"energy_homogenous\": %.9g, \"energy_inhomogenous\": %.9g,"
+                " \"Z0\": %.9g, \"Ch\": %.9g, \"Cih\": %.9g, \"Lh\": %.9g, \"er_eff\": %.9g}",
+                result.Nx, result.Ny, result.v_input, result.energy_homogenous, result.energy_inhomogenous,
+                result.Z0, result.Ch, result.Cih, result.Lh, result.er_eff
+            );
+        } else {
+            printf(", \"error\": ");
+            print_json_string(result.error.c_str());
+            printf("}");
+        }
+        printf("%s\n", (i+1 == results.size()) ? "" : ",");
+    }
+    printf("  ]\n");
+    printf("}\n");
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s [--format csv|json] [--threads N] [--v-input V] bundle.zip ...\n",
+        program
+    );
+}
+
+int main(int argc, char** argv) {
+    Batch_Config config;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const bool has_value = (i+1) < argc;
+        if (strcmp(arg, "--format") == 0 && has_value) {
+            const char* format = argv[++i];
+            if (strcmp(format, "csv") == 0) {
+                config.format = Output_Format::CSV;
+            } else if (strcmp(format, "json") == 0) {
+                config.format = Output_Format::JSON;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(arg, "--threads") == 0 && has_value) {
+            config.total_threads = atoi(argv[++i]);
+        } else if (strcmp(arg, "--v-input") == 0 && has_value) {
+            config.v_input = atof(argv[++i]);
+        } else if (strncmp(arg, "--", 2) == 0) {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            config.bundle_paths.push_back(arg);
+        }
+    }
+    if (config.bundle_paths.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (config.total_threads > 0) {
+        set_total_threads(config.total_threads);
+    }
+
+    // NOTE: Bundles differ a lot in size so each worker pulls the next bundle instead of taking a fixed range
+    //       Kernels called from inside a worker run serially since the pool is already busy (see thread_pool.hpp)
+    const int total_bundles = int(config.bundle_paths.size());
+    auto results = std::vector<Bundle_Result>(size_t(total_bundles));
+    std::atomic<int> next_bundle{0};
+    const int total_workers = std::min(get_total_threads(), total_bundles);
+    parallel_for_chunks(total_workers, 1, [&](int, int, int) {
+        int i;
+        while ((i = next_bundle.fetch_add(1)) < total_bundles) {
+            results[size_t(i)] = solve_bundle(config.bundle_paths[size_t(i)], config);
+        }
+    });
+
+    if (config.format == Output_Format::JSON) {
+        print_json(config, results);
+    } else {
+        print_csv(config, results);
+    }
+    int total_failed = 0;
+    for (int i = 0; i < total_bundles; i++) {
+        const auto& result = results[size_t(i)];
+        if (result.error.empty()) continue;
+        fprintf(stderr, "%s: %s\n", config.bundle_paths[size_t(i)], result.error.c_str());
+        total_failed++;
+    }
+    return (total_failed > 0) ? 1 : 0;
+}
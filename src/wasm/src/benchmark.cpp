@@ -0,0 +1,476 @@
+// Native benchmark for the solver and field kernels
+// - Generates synthetic stackup grids with graded dx/dy over a range of cell counts
+// - Reports LU, Cholesky, mirror and multigrid factor/solve times, nnz(L+U), peak RSS and kernel throughput as JSON on stdout
+// - Also times the 3D FDTD engine on a grid the size of the app_3d default simulation
+// - Usage: benchmark [--cells 10000,100000,...] [--repeats N] [--threads N] [--max-lu-cells N]
+//                   [--fdtd-size Nx,Ny,Nz] [--fdtd-steps N]
+#include "./LU_Solver.hpp"
+#include "./Cholesky_Solver.hpp"
+#include "./Mirror_Solver.hpp"
+#include "./Multigrid_Solver.hpp"
+#include "./FDTD_3D_Engine.hpp"
+#include "./laplace_matrix.hpp"
+#include "./energy_integral.hpp"
+#include "./convert_f32_to_f16.hpp"
+#include "./thread_pool.hpp"
+#include "./simd.hpp"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+struct Benchmark_Config {
+    std::vector<int> total_cells = { 10'000, 40'000, 160'000, 640'000, 2'560'000, 5'120'000 };
+    int total_repeats = 5;
+    int total_threads = 0; // 0 = keep default
+    int max_lu_cells = 5'120'000; // LU fill-in grows quickly so larger grids can skip factorisation
+    std::vector<int> fdtd_size = { 16, 128, 256 }; // "--fdtd-size 0" leaves this empty to skip
+    int fdtd_steps = 64;
+};
+
+struct Timing {
+    double best_ms = 0.0;
+    double mean_ms = 0.0;
+};
+
+struct Synthetic_Grid {
+    int Nx;
+    int Ny;
+    TypedPinnedArray<float> dx;
+    TypedPinnedArray<float> dy;
+    TypedPinnedArray<uint32_t> v_index_beta;
+    TypedPinnedArray<float> v_table;
+    TypedPinnedArray<float> ek_table;
+    TypedPinnedArray<uint32_t> ek_index_beta;
+};
+
+static constexpr uint32_t FIXED_BETA = 0xFFFF;
+
+static double get_elapsed_ms(std::chrono::steady_clock::time_point start) {
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end-start).count();
+}
+
+static Timing measure(int total_repeats, const std::function<void()>& fn) {
+    Timing timing;
+    timing.best_ms = INFINITY;
+    double total_ms = 0.0;
+    for (int i = 0; i < total_repeats; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const double elapsed_ms = get_elapsed_ms(start);
+        timing.best_ms = std::min(timing.best_ms, elapsed_ms);
+        total_ms += elapsed_ms;
+    }
+    timing.mean_ms = total_ms / double(total_repeats);
+    return timing;
+}
+
+static double get_peak_rss_bytes() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+#if defined(__APPLE__)
+    return double(usage.ru_maxrss);
+#else
+    return double(usage.ru_maxrss) * 1024.0;
+#endif
+#else
+    return 0.0;
+#endif
+}
+
+static double get_throughput_gbps(double total_bytes, double elapsed_ms) {
+    if (elapsed_ms <= 0.0) return 0.0;
+    return total_bytes / (elapsed_ms * 1e-3) * 1e-9;
+}
+
+// Graded widths which are finest at the centre and grow geometrically towards the edges like the mesher
+// NOTE: widths are mirror symmetric so the mirror solver is timed on the same grid as the other solvers
+static void fill_graded_widths(TypedPinnedArray<float> widths, float min_width, float growth_ratio, float max_width) {
+    const int N = widths.get_length();
+    for (int i = 0; i < N; i++) {
+        const int distance = abs(2*i+1-N)/2;
+        widths[i] = std::min(min_width*powf(growth_ratio, float(distance)), max_width);
+    }
+}
+
+// Microstrip like layout with ground planes at the top and bottom, a signal trace in the middle
+// and a dielectric filling the lower half of the grid
+static Synthetic_Grid create_synthetic_grid(int total_cells) {
+    // stackup grids are usually wider than they are tall
+    const int Ny = std::max(int(sqrtf(float(total_cells)/2.0f)), 8);
+    const int Nx = std::max(total_cells/Ny, 8);
+    Synthetic_Grid grid = {
+        Nx, Ny,
+        *TypedPinnedArray<float>::owned_pin_from_malloc(Nx),
+        *TypedPinnedArray<float>::owned_pin_from_malloc(Ny),
+        *TypedPinnedArray<uint32_t>::owned_pin_from_malloc((Nx+1)*(Ny+1)),
+        *TypedPinnedArray<float>::owned_pin_from_malloc(3),
+        *TypedPinnedArray<float>::owned_pin_from_malloc(2),
+        *TypedPinnedArray<uint32_t>::owned_pin_from_malloc(Nx*Ny),
+    };
+
+    fill_graded_widths(grid.dx, 0.01f, 1.01f, 1.0f);
+    fill_graded_widths(grid.dy, 0.005f, 1.02f, 0.5f);
+
+    const int y_trace = Ny/2;
+    const int x_trace_start = Nx/2 - Nx/8;
+    const int x_trace_end = Nx - x_trace_start;
+    for (int y = 0; y <= Ny; y++) {
+        for (int x = 0; x <= Nx; x++) {
+            uint32_t index_beta = 0;
+            if (y == 0 || y == Ny) {
+                index_beta = (0u << 16) | FIXED_BETA;
+            } else if (y >= y_trace-1 && y <= y_trace+1 && x >= x_trace_start && x <= x_trace_end) {
+                index_beta = (1u << 16) | FIXED_BETA;
+            }
+            grid.v_index_beta[x + y*(Nx+1)] = index_beta;
+        }
+    }
+    grid.v_table[0] = 0.0f;
+    grid.v_table[1] = 1.0f;
+    grid.v_table[2] = -1.0f;
+
+    grid.ek_table[0] = 1.0f;
+    grid.ek_table[1] = 4.1f;
+    for (int y = 0; y < Ny; y++) {
+        for (int x = 0; x < Nx; x++) {
+            grid.ek_index_beta[x + y*Nx] = (y > y_trace) ? ((1u << 16) | FIXED_BETA) : 0u;
+        }
+    }
+    return grid;
+}
+
+static void print_timing(const char* name, Timing timing, double total_bytes, bool is_last) {
+    printf("        \"%s\": {\"best_ms\": %.4f, \"mean_ms\": %.4f", name, timing.best_ms, timing.mean_ms);
+    if (total_bytes > 0.0) {
+        printf(", \"bytes\": %.0f, \"best_gbps\": %.4f", total_bytes, get_throughput_gbps(total_bytes, timing.best_ms));
+    }
+    printf("}%s\n", is_last ? "" : ",");
+}
+
+static void run_benchmark(const Benchmark_Config& config, int total_cells, bool is_last) {
+    Synthetic_Grid grid = create_synthetic_grid(total_cells);
+    const int Nx = grid.Nx;
+    const int Ny = grid.Ny;
+    const int total_voltages = (Nx+1)*(Ny+1);
+    const int total_repeats = config.total_repeats;
+
+    auto v_field = *TypedPinnedArray<float>::owned_pin_from_malloc(total_voltages);
+    auto ex_field = *TypedPinnedArray<float>::owned_pin_from_malloc((Ny+1)*Nx);
+    auto ey_field = *TypedPinnedArray<float>::owned_pin_from_malloc(Ny*(Nx+1));
+    auto v_field_f16 = *TypedPinnedArray<uint16_t>::owned_pin_from_malloc(total_voltages);
+
+    printf("    {\n");
+    printf("      \"Nx\": %d, \"Ny\": %d, \"total_cells\": %d, \"total_voltages\": %d,\n",
+        Nx, Ny, Nx*Ny, total_voltages);
+
+    // direct solver
+    const bool is_lu_run = Nx*Ny <= config.max_lu_cells;
+    printf("      \"lu\": ");
+    if (is_lu_run) {
+        LU_Solver::Create_Result result;
+        const auto factor_start = std::chrono::steady_clock::now();
+        result = LU_Solver::create_from_grid(grid.dx, grid.dy, grid.v_index_beta);
+        const double factor_ms = get_elapsed_ms(factor_start);
+        if (result.solver == nullptr) {
+            printf("{\"error\": \"factorisation failed\", \"lu_factor_info\": %d},\n", int(result.lu_factor_info));
+        } else {
+            // solve both signal polarities as two right hand sides like the measurement does
+            const int total_rhs = 2;
+            auto v_tables = *TypedPinnedArray<float>::owned_pin_from_malloc(3*total_rhs);
+            for (int i = 0; i < 3; i++) {
+                v_tables[i] = grid.v_table[i];
+                v_tables[3+i] = (i == 1) ? grid.v_table[2] : grid.v_table[i];
+            }
+            auto B = *TypedPinnedArray<float>::owned_pin_from_malloc(total_voltages*total_rhs);
+            int32_t solve_info = 0;
+            const auto solve_timing = measure(total_repeats, [&]() {
+                solve_info = create_laplace_rhs(B, grid.v_index_beta, v_tables, total_rhs);
+                if (solve_info == 0) solve_info = result.solver->solve_many(B, total_rhs);
+            });
+            memcpy(v_field.get_data(), B.get_data(), sizeof(float)*size_t(total_voltages));
+            const auto stats = result.solver->get_stats();
+            printf("{\"factor_ms\": %.4f, \"solve_best_ms\": %.4f, \"solve_mean_ms\": %.4f, \"total_rhs\": %d, \"solve_info\": %d, \"nnz_lu\": %lld, "
+                "\"total_supernodes\": %.0f, \"factor_flops\": %.4g, \"solve_flops\": %.4g, \"lu_bytes\": %.0f},\n",
+                factor_ms, solve_timing.best_ms, solve_timing.mean_ms, total_rhs, int(solve_info),
+                (long long)result.solver->get_lu_non_zeros(),
+                stats.total_supernodes, stats.factor_flops, stats.solve_flops, stats.lu_bytes);
+        }
+    } else {
+        printf("null,\n");
+    }
+    printf("      \"cholesky\": ");
+    if (is_lu_run) {
+        const auto factor_start = std::chrono::steady_clock::now();
+        const auto result = Cholesky_Solver::create_from_grid(grid.dx, grid.dy, grid.v_index_beta);
+        const double factor_ms = get_elapsed_ms(factor_start);
+        if (result.solver == nullptr) {
+            printf("{\"error\": \"factorisation failed\", \"factor_info\": %d},\n", int(result.factor_info));
+        } else {
+            const int total_rhs = 2;
+            auto v_tables = *TypedPinnedArray<float>::owned_pin_from_malloc(3*total_rhs);
+            for (int i = 0; i < 3; i++) {
+                v_tables[i] = grid.v_table[i];
+                v_tables[3+i] = (i == 1) ? grid.v_table[2] : grid.v_table[i];
+            }
+            auto B = *TypedPinnedArray<float>::owned_pin_from_malloc(total_voltages*total_rhs);
+            int32_t solve_info = 0;
+            const auto solve_timing = measure(total_repeats, [&]() {
+                solve_info = create_laplace_rhs(B, grid.v_index_beta, v_tables, total_rhs);
+                if (solve_info == 0) solve_info = result.solver->solve_many(B, total_rhs);
+            });
+            const auto stats = result.solver->get_stats();
+            printf("{\"factor_ms\": %.4f, \"solve_best_ms\": %.4f, \"solve_mean_ms\": %.4f, \"total_rhs\": %d, \"solve_info\": %d, "
+                "\"reduced_rows\": %.0f, \"nnz_l\": %.0f, \"factor_flops\": %.4g, \"factor_bytes\": %.0f},\n",
+                factor_ms, solve_timing.best_ms, solve_timing.mean_ms, total_rhs, int(solve_info),
+                stats.reduced_rows, stats.L_non_zeros, stats.factor_flops, stats.factor_bytes);
+        }
+    } else {
+        printf("null,\n");
+    }
+    // mirror solver is what Grid picks for grids below the multigrid threshold
+    printf("      \"mirror\": ");
+    if (is_lu_run) {
+        const auto factor_start = std::chrono::steady_clock::now();
+        const auto result = Mirror_Solver::create_from_grid(grid.dx, grid.dy, grid.v_index_beta);
+        const double factor_ms = get_elapsed_ms(factor_start);
+        if (result.solver == nullptr) {
+            printf("{\"error\": \"factorisation failed\", \"create_info\": %d},\n", int(result.create_info));
+        } else {
+            const int total_rhs = 2;
+            auto v_tables = *TypedPinnedArray<float>::owned_pin_from_malloc(3*total_rhs);
+            for (int i = 0; i < 3; i++) {
+                v_tables[i] = grid.v_table[i];
+                v_tables[3+i] = (i == 1) ? grid.v_table[2] : grid.v_table[i];
+            }
+            auto B = *TypedPinnedArray<float>::owned_pin_from_malloc(total_voltages*total_rhs);
+            int32_t solve_info = 0;
+            const auto solve_timing = measure(total_repeats, [&]() {
+                solve_info = create_laplace_rhs(B, grid.v_index_beta, v_tables, total_rhs);
+                if (solve_info == 0) solve_info = result.solver->solve_many(B, total_rhs);
+            });
+            // v_field holds the LU solution of the first right hand side
+            float max_error = 0.0f;
+            for (int i = 0; i < total_voltages; i++) max_error = std::max(max_error, fabsf(B[i]-v_field[i]));
+            const auto stats = result.solver->get_stats();
+            printf("{\"factor_ms\": %.4f, \"solve_best_ms\": %.4f, \"solve_mean_ms\": %.4f, \"total_rhs\": %d, \"solve_info\": %d, "
+                "\"axis\": %d, \"has_odd_solver\": %s, \"reduced_rows\": %.0f, \"nnz_l\": %.0f, \"factor_bytes\": %.0f, "
+                "\"max_error_vs_lu\": %g},\n",
+                factor_ms, solve_timing.best_ms, solve_timing.mean_ms, total_rhs, int(solve_info),
+                int(result.solver->get_axis()), result.solver->get_has_odd_solver() ? "true" : "false",
+                stats.reduced_rows, stats.L_non_zeros, stats.factor_bytes, double(max_error));
+        }
+    } else {
+        printf("null,\n");
+    }
+    // multigrid has no fill-in so it also runs on grids that skip factorisation
+    // NOTE: each repeat starts from a zero initial guess since the solver warm starts from its last solution
+    printf("      \"multigrid\": ");
+    {
+        const auto setup_start = std::chrono::steady_clock::now();
+        const auto result = Multigrid_Solver::create_from_grid(grid.dx, grid.dy, grid.v_index_beta);
+        const double setup_ms = get_elapsed_ms(setup_start);
+        if (result.solver == nullptr) {
+            printf("{\"error\": \"setup failed\", \"create_info\": %d},\n", int(result.create_info));
+        } else {
+            auto B = *TypedPinnedArray<float>::owned_pin_from_malloc(total_voltages);
+            auto zero_guess = *TypedPinnedArray<float>::owned_pin_from_malloc(total_voltages);
+            int32_t solve_info = 0;
+            const auto solve_timing = measure(total_repeats, [&]() {
+                result.solver->set_initial_guess(zero_guess, 1);
+                solve_info = create_laplace_rhs(B, grid.v_index_beta, grid.v_table, 1);
+                if (solve_info == 0) solve_info = result.solver->solve(B);
+            });
+            // v_field holds the LU solution of the same voltage table
+            float max_error = 0.0f;
+            if (is_lu_run) {
+                for (int i = 0; i < total_voltages; i++) max_error = std::max(max_error, fabsf(B[i]-v_field[i]));
+            }
+            printf("{\"setup_ms\": %.4f, \"solve_best_ms\": %.4f, \"solve_mean_ms\": %.4f, \"solve_info\": %d, "
+                "\"total_levels\": %d, \"cycles\": %d, \"relative_residual\": %.4g, \"max_error_vs_lu\": %s},\n",
+                setup_ms, solve_timing.best_ms, solve_timing.mean_ms, int(solve_info),
+                result.solver->get_total_levels(), result.solver->get_last_cycles(),
+                double(result.solver->get_last_relative_residual()),
+                is_lu_run ? std::to_string(max_error).c_str() : "null");
+        }
+    }
+    // kernels need a smooth field even when the factorisation is skipped
+    if (!is_lu_run) {
+        for (int y = 0; y <= Ny; y++) {
+            for (int x = 0; x <= Nx; x++) {
+                v_field[x + y*(Nx+1)] = sinf(float(x)*0.01f) * cosf(float(y)*0.02f);
+            }
+        }
+    }
+
+    // kernel throughput is measured from the minimum bytes each kernel has to read and write
+    const double f32 = double(sizeof(float));
+    const double widths_bytes = f32*double(Nx+Ny);
+    const double v_bytes = f32*double(total_voltages);
+    const double ex_bytes = f32*double((Ny+1)*Nx);
+    const double ey_bytes = f32*double(Ny*(Nx+1));
+    const double ek_bytes = double(sizeof(uint32_t))*double(Nx*Ny);
+
+    const auto e_field_timing = measure(total_repeats, [&]() {
+        calculate_e_field(ex_field, ey_field, v_field, grid.dx, grid.dy);
+    });
+    volatile float energy_sink = 0.0f;
+    const auto homogenous_timing = measure(total_repeats, [&]() {
+        energy_sink = calculate_homogenous_energy_2d(ex_field, ey_field, grid.dx, grid.dy);
+    });
+    const auto inhomogenous_timing = measure(total_repeats, [&]() {
+        energy_sink = calculate_inhomogenous_energy_2d(
+            ex_field, ey_field, grid.dx, grid.dy, grid.ek_table, grid.ek_index_beta);
+    });
+    const auto energy_timing = measure(total_repeats, [&]() {
+        const auto energy = calculate_energy_2d(v_field, grid.dx, grid.dy, grid.ek_table, grid.ek_index_beta);
+        energy_sink = energy.homogenous + energy.inhomogenous;
+    });
+    const auto f16_timing = measure(total_repeats, [&]() {
+        convert_f32_to_f16(v_field, v_field_f16);
+    });
+    (void)energy_sink;
+
+    printf("      \"kernels\": {\n");
+    print_timing("calculate_e_field", e_field_timing, v_bytes+widths_bytes+ex_bytes+ey_bytes, false);
+    print_timing("calculate_homogenous_energy_2d", homogenous_timing, ex_bytes+ey_bytes+widths_bytes, false);
+    print_timing("calculate_inhomogenous_energy_2d", inhomogenous_timing, ex_bytes+ey_bytes+widths_bytes+ek_bytes, false);
+    print_timing("calculate_energy_2d", energy_timing, v_bytes+widths_bytes+ek_bytes, false);
+    print_timing("convert_f32_to_f16", f16_timing, v_bytes+double(sizeof(uint16_t))*double(total_voltages), true);
+    printf("      },\n");
+    // NOTE: peak RSS is process wide so it only grows over the run
+    printf("      \"peak_rss_bytes\": %.0f\n", get_peak_rss_bytes());
+    printf("    }%s\n", is_last ? "" : ",");
+    fflush(stdout);
+}
+
+// Free space with a lossy block in the middle driven by a single source like the app_3d setup
+static void run_fdtd_benchmark(const Benchmark_Config& config) {
+    const int Nx = config.fdtd_size[0];
+    const int Ny = config.fdtd_size[1];
+    const int Nz = config.fdtd_size[2];
+    const int total_cells = Nx*Ny*Nz;
+    const int total_steps = config.fdtd_steps;
+    auto E = *TypedPinnedArray<float>::owned_pin_from_malloc(3*total_cells);
+    auto H = *TypedPinnedArray<float>::owned_pin_from_malloc(3*total_cells);
+    auto A0 = *TypedPinnedArray<float>::owned_pin_from_malloc(total_cells);
+    auto A1 = *TypedPinnedArray<float>::owned_pin_from_malloc(total_cells);
+    auto signal = *TypedPinnedArray<float>::owned_pin_from_malloc(total_steps);
+    // same coefficients as SimulationGrid.bake() for dt=1ps, d_xyz=1mm
+    const float dt = 1e-12f;
+    const float d_xyz = 1e-3f;
+    const float epsilon_0 = 8.85e-12f;
+    const float mu_0 = 1.26e-6f;
+    for (int i = 0; i < total_cells; i++) {
+        const int x = i / (Ny*Nz);
+        const float sigma_k = (x == Nx/2) ? 1e-2f : 0.0f;
+        const float epsilon_k = epsilon_0 * ((x < Nx/2) ? 4.1f : 1.0f);
+        A0[i] = 1.0f/(1.0f+sigma_k/epsilon_k*dt);
+        A1[i] = dt/(epsilon_k*d_xyz);
+    }
+    const float b0 = dt/(mu_0*d_xyz);
+    for (int i = 0; i < total_steps; i++) {
+        signal[i] = powf(sinf(3.14159265f*float(i)/float(total_steps)), 2.0f);
+    }
+
+    auto engine = FDTD_3D_Engine::create(Nx, Ny, Nz);
+    if (engine == nullptr) return;
+    engine->add_source(Nx/2, Ny/4, Nz/2, 1, Ny/2, 1, signal);
+
+    printf("  \"fdtd_3d\": {\n");
+    printf("    \"Nx\": %d, \"Ny\": %d, \"Nz\": %d, \"total_steps\": %d,\n", Nx, Ny, Nz, total_steps);
+    // E and H are read and written with A0/A1 read once per step
+    const double bytes_per_step = double(total_cells)*double(sizeof(float))*(4.0*3.0 + 2.0);
+    const int max_time_block = engine->get_max_time_block();
+    const int time_blocks[2] = { 1, max_time_block };
+    for (int i = 0; i < 2; i++) {
+        engine->set_max_time_block(time_blocks[i]);
+        const auto timing = measure(config.total_repeats, [&]() {
+            memset(E.get_data(), 0, sizeof(float)*size_t(3*total_cells));
+            memset(H.get_data(), 0, sizeof(float)*size_t(3*total_cells));
+            engine->step(E, H, A0, A1, b0, 0, total_steps);
+        });
+        const double cells_per_second = double(total_cells)*double(total_steps) / (timing.best_ms*1e-3);
+        printf("    \"time_block_%d\": {\"time_block\": %d, \"best_ms\": %.4f, \"mean_ms\": %.4f, \"mcells_per_second\": %.2f, \"best_gbps\": %.4f}%s\n",
+            time_blocks[i], engine->get_time_block(), timing.best_ms, timing.mean_ms, cells_per_second*1e-6,
+            get_throughput_gbps(bytes_per_step*double(total_steps), timing.best_ms), (i == 1) ? "" : ",");
+    }
+    printf("  },\n");
+    fflush(stdout);
+}
+
+static std::vector<int> parse_int_list(const char* text) {
+    std::vector<int> values;
+    const char* curr = text;
+    while (*curr != '\0') {
+        char* end = nullptr;
+        const long value = strtol(curr, &end, 10);
+        if (end == curr) break;
+        if (value > 0) values.push_back(int(value));
+        curr = (*end == ',') ? end+1 : end;
+    }
+    return values;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s [--cells 10000,100000,...] [--repeats N] [--threads N] [--max-lu-cells N]"
+        " [--fdtd-size Nx,Ny,Nz] [--fdtd-steps N]\n",
+        program
+    );
+}
+
+int main(int argc, char** argv) {
+    Benchmark_Config config;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const bool has_value = (i+1) < argc;
+        if (strcmp(arg, "--cells") == 0 && has_value) {
+            config.total_cells = parse_int_list(argv[++i]);
+        } else if (strcmp(arg, "--repeats") == 0 && has_value) {
+            config.total_repeats = std::max(atoi(argv[++i]), 1);
+        } else if (strcmp(arg, "--threads") == 0 && has_value) {
+            config.total_threads = atoi(argv[++i]);
+        } else if (strcmp(arg, "--max-lu-cells") == 0 && has_value) {
+            config.max_lu_cells = atoi(argv[++i]);
+        } else if (strcmp(arg, "--fdtd-size") == 0 && has_value) {
+            config.fdtd_size = parse_int_list(argv[++i]);
+        } else if (strcmp(arg, "--fdtd-steps") == 0 && has_value) {
+            config.fdtd_steps = std::max(atoi(argv[++i]), 1);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.total_threads > 0) {
+        set_total_threads(config.total_threads);
+    }
+
+    printf("{\n");
+    printf("  \"simd\": \"%s\",\n", SIMD_NAME);
+    printf("  \"simd_width\": %d,\n", f32_vec::WIDTH);
+    printf("  \"total_threads\": %d,\n", get_total_threads());
+    printf("  \"total_repeats\": %d,\n", config.total_repeats);
+    if (config.fdtd_size.size() == 3) {
+        run_fdtd_benchmark(config);
+    }
+    printf("  \"results\": [\n");
+    const int total_sizes = int(config.total_cells.size());
+    for (int i = 0; i < total_sizes; i++) {
+        run_benchmark(config, config.total_cells[i], i == total_sizes-1);
+    }
+    printf("  ]\n");
+    printf("}\n");
+    return 0;
+}
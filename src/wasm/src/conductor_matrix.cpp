@@ -0,0 +1,242 @@
+#include "./conductor_matrix.hpp"
+#include "./energy_integral.hpp"
+#include "./laplace_matrix.hpp"
+#include "./kernel_timings.hpp"
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+// NOTE: Same constants as the scalar impedance calculation so both agree exactly
+static constexpr double EPSILON_0 = 8.85e-12;
+static constexpr double C_0 = 3e8;
+
+// In place lower triangular factor A = G*G^T, returns false if A is not positive definite
+static bool cholesky_factor(std::vector<double>& A, int N) {
+    for (int j = 0; j < N; j++) {
+        double diagonal = A[j*N+j];
+        for (int k = 0; k < j; k++) diagonal -= A[j*N+k]*A[j*N+k];
+        if (!(diagonal > 0.0)) return false;
+        const double G_jj = sqrt(diagonal);
+        A[j*N+j] = G_jj;
+        for (int i = j+1; i < N; i++) {
+            double sum = A[i*N+j];
+            for (int k = 0; k < j; k++) sum -= A[i*N+k]*A[j*N+k];
+            A[i*N+j] = sum/G_jj;
+        }
+        for (int i = 0; i < j; i++) A[i*N+j] = 0.0;
+    }
+    return true;
+}
+
+// Inverse of the lower triangular factor G written in place
+static void invert_lower_triangular(std::vector<double>& G, int N) {
+    for (int j = 0; j < N; j++) {
+        G[j*N+j] = 1.0/G[j*N+j];
+        for (int i = j+1; i < N; i++) {
+            double sum = 0.0;
+            for (int k = j; k < i; k++) sum -= G[i*N+k]*G[k*N+j];
+            G[i*N+j] = sum/G[i*N+i];
+        }
+    }
+}
+
+// Cyclic Jacobi eigen decomposition of symmetric A with eigenvectors as columns of V
+// SRC: Golub and Van Loan, Matrix Computations, 8.5 Jacobi methods
+// NOTE: N is the number of conductors so the O(N^3) sweeps are negligible next to the field solve
+static void jacobi_eigen(std::vector<double>& A, std::vector<double>& V, int N) {
+    constexpr int MAX_SWEEPS = 64;
+    V.assign(N*N, 0.0);
+    for (int i = 0; i < N; i++) V[i*N+i] = 1.0;
+    for (int sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+        double off_diagonal = 0.0;
+        double diagonal = 0.0;
+        for (int i = 0; i < N; i++) {
+            diagonal += A[i*N+i]*A[i*N+i];
+            for (int j = i+1; j < N; j++) off_diagonal += A[i*N+j]*A[i*N+j];
+        }
+        if (off_diagonal <= 1e-30*diagonal) break;
+        for (int p = 0; p < N; p++) {
+            for (int q = p+1; q < N; q++) {
+                const double A_pq = A[p*N+q];
+                if (A_pq == 0.0) continue;
+                const double theta = (A[q*N+q]-A[p*N+p])/(2.0*A_pq);
+                const double t = (theta >= 0.0 ? 1.0 : -1.0)/(fabs(theta) + sqrt(theta*theta + 1.0));
+                const double c = 1.0/sqrt(t*t + 1.0);
+                const double s = t*c;
+                for (int k = 0; k < N; k++) {
+                    const double A_kp = A[k*N+p];
+                    const double A_kq = A[k*N+q];
+                    A[k*N+p] = c*A_kp - s*A_kq;
+                    A[k*N+q] = s*A_kp + c*A_kq;
+                }
+                for (int k = 0; k < N; k++) {
+                    const double A_pk = A[p*N+k];
+                    const double A_qk = A[q*N+k];
+                    A[p*N+k] = c*A_pk - s*A_qk;
+                    A[q*N+k] = s*A_pk + c*A_qk;
+                }
+                for (int k = 0; k < N; k++) {
+                    const double V_kp = V[k*N+p];
+                    const double V_kq = V[k*N+q];
+                    V[k*N+p] = c*V_kp - s*V_kq;
+                    V[k*N+q] = s*V_kp + c*V_kq;
+                }
+            }
+        }
+    }
+}
+
+int32_t calculate_conductor_matrices(
+    TypedPinnedArray<double> Ch_out, TypedPinnedArray<double> Cih_out, TypedPinnedArray<double> Lh_out,
+    TypedPinnedArray<float> energy_homogenous, TypedPinnedArray<float> energy_inhomogenous
+) {
+    const int total_matrix = energy_homogenous.get_length();
+    const int N = int(sqrt(double(total_matrix)) + 0.5);
+    for (int i = 0; i < total_matrix; i++) {
+        Ch_out[i] = EPSILON_0*double(energy_homogenous[i]);
+        Cih_out[i] = EPSILON_0*double(energy_inhomogenous[i]);
+    }
+
+    // Lh = (G*G^T)^-1/c0^2 = G^-T*G^-1/c0^2
+    auto G = std::vector<double>(Ch_out.get_data(), Ch_out.get_data()+total_matrix);
+    if (!cholesky_factor(G, N)) return CONDUCTOR_MATRIX_NOT_POSITIVE_DEFINITE;
+    invert_lower_triangular(G, N);
+    const double scale = 1.0/(C_0*C_0);
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j <= i; j++) {
+            double sum = 0.0;
+            for (int k = i; k < N; k++) sum += G[k*N+i]*G[k*N+j];
+            Lh_out[i*N+j] = scale*sum;
+            Lh_out[j*N+i] = scale*sum;
+        }
+    }
+    return 0;
+}
+
+int32_t calculate_modal_impedances(
+    TypedPinnedArray<double> Z0_out, TypedPinnedArray<double> velocity_out, TypedPinnedArray<double> vectors_out,
+    TypedPinnedArray<double> Lh, TypedPinnedArray<double> Cih
+) {
+    const int N = Z0_out.get_length();
+    const int total_matrix = N*N;
+
+    // Lh*Cih*t = (1/v^2)*t is symmetrised with Cih = G*G^T and t = G^-T*y into G^T*Lh*G*y = (1/v^2)*y
+    auto G = std::vector<double>(Cih.get_data(), Cih.get_data()+total_matrix);
+    if (!cholesky_factor(G, N)) return CONDUCTOR_MATRIX_NOT_POSITIVE_DEFINITE;
+    auto LG = std::vector<double>(total_matrix, 0.0);
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            double sum = 0.0;
+            for (int k = j; k < N; k++) sum += Lh[i*N+k]*G[k*N+j];
+            LG[i*N+j] = sum;
+        }
+    }
+    auto S = std::vector<double>(total_matrix, 0.0);
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            double sum = 0.0;
+            for (int k = i; k < N; k++) sum += G[k*N+i]*LG[k*N+j];
+            S[i*N+j] = sum;
+        }
+    }
+    auto Y = std::vector<double>();
+    jacobi_eigen(S, Y, N);
+
+    // t = G^-T*y has t^T*Cih*t = 1 with modes stored as rows of T
+    invert_lower_triangular(G, N);
+    auto order = std::vector<int>(N);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return S[a*N+a] < S[b*N+b]; });
+    auto lambda = std::vector<double>(N);
+    auto T = std::vector<double>(total_matrix, 0.0);
+    for (int m = 0; m < N; m++) {
+        const int e = order[m];
+        lambda[m] = std::max(S[e*N+e], 0.0);
+        for (int i = 0; i < N; i++) {
+            double sum = 0.0;
+            for (int k = i; k < N; k++) sum += G[k*N+i]*Y[k*N+e];
+            T[m*N+i] = sum;
+        }
+    }
+
+    // Modes with the same velocity (e.g. homogenous dielectric) can be any mix of each other
+    // so pick the mix that is also orthogonal in the euclidean sense which gives odd/even for a symmetric pair
+    constexpr double DEGENERATE_TOLERANCE = 1e-6;
+    for (int m_start = 0; m_start < N;) {
+        int m_end = m_start+1;
+        while (m_end < N && (lambda[m_end]-lambda[m_start]) <= DEGENERATE_TOLERANCE*lambda[m_end]) m_end++;
+        const int total_group = m_end-m_start;
+        if (total_group > 1) {
+            auto K = std::vector<double>(total_group*total_group, 0.0);
+            for (int i = 0; i < total_group; i++) {
+                for (int j = 0; j < total_group; j++) {
+                    double sum = 0.0;
+                    for (int k = 0; k < N; k++) sum += T[(m_start+i)*N+k]*T[(m_start+j)*N+k];
+                    K[i*total_group+j] = sum;
+                }
+            }
+            auto W = std::vector<double>();
+            jacobi_eigen(K, W, total_group);
+            auto T_group = std::vector<double>(total_group*N, 0.0);
+            for (int j = 0; j < total_group; j++) {
+                for (int i = 0; i < total_group; i++) {
+                    for (int k = 0; k < N; k++) T_group[j*N+k] += W[i*total_group+j]*T[(m_start+i)*N+k];
+                }
+            }
+            std::copy(T_group.begin(), T_group.end(), T.begin()+m_start*N);
+        }
+        m_start = m_end;
+    }
+
+    // rescaling to unit length gives modal capacitance 1/|t|^2 and Z0 = sqrt(lambda)/c
+    for (int m = 0; m < N; m++) {
+        const double* t = &T[m*N];
+        double length_squared = 0.0;
+        int largest = 0;
+        for (int i = 0; i < N; i++) {
+            length_squared += t[i]*t[i];
+            if (fabs(t[i]) > fabs(t[largest])+1e-12*fabs(t[largest])) largest = i;
+        }
+        const double sign = (t[largest] < 0.0) ? -1.0 : 1.0;
+        const double length = sqrt(length_squared);
+        Z0_out[m] = sqrt(lambda[m])*length_squared;
+        velocity_out[m] = 1.0/sqrt(lambda[m]);
+        for (int i = 0; i < N; i++) vectors_out[m*N+i] = sign*t[i]/length;
+    }
+    return 0;
+}
+
+int32_t extract_conductor_matrices(
+    TypedPinnedArray<double> Ch_out, TypedPinnedArray<double> Cih_out, TypedPinnedArray<double> Lh_out,
+    TypedPinnedArray<float> v_fields_out,
+    LU_Solver& solver, TypedPinnedArray<int32_t> conductor_indices,
+    TypedPinnedArray<uint32_t> v_index_beta,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<float> er_table, TypedPinnedArray<uint32_t> er_index_beta
+) {
+    const auto timer = Kernel_Timer("extract_conductor_matrices");
+    const int N = conductor_indices.get_length();
+    const int32_t* indices = conductor_indices.get_data();
+    // NOTE: indices past the end are reported by create_laplace_rhs() since the table is sized to fit them
+    for (int i = 0; i < N; i++) {
+        if (indices[i] < 0) return LAPLACE_INVALID_INDEX;
+    }
+    const int table_length = (N > 0) ? *std::max_element(indices, indices+N)+1 : 1;
+    auto v_tables = *TypedPinnedArray<float>::owned_pin_from_malloc(N*table_length);
+    for (int i = 0; i < N; i++) {
+        v_tables[i*table_length + indices[i]] = 1.0f;
+    }
+    const int32_t rhs_info = create_laplace_rhs(v_fields_out, v_index_beta, v_tables, N);
+    if (rhs_info != 0) return rhs_info;
+    const int32_t solve_info = solver.solve_many(v_fields_out, N);
+    if (solve_info != 0) return solve_info;
+
+    auto energy_homogenous = *TypedPinnedArray<float>::owned_pin_from_malloc(N*N);
+    auto energy_inhomogenous = *TypedPinnedArray<float>::owned_pin_from_malloc(N*N);
+    calculate_energy_matrix_2d(
+        energy_homogenous, energy_inhomogenous,
+        v_fields_out, dx_arr, dy_arr, er_table, er_index_beta
+    );
+    return calculate_conductor_matrices(Ch_out, Cih_out, Lh_out, energy_homogenous, energy_inhomogenous);
+}
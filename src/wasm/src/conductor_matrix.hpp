@@ -0,0 +1,38 @@
+#pragma once
+
+#include "./PinnedArray.hpp"
+#include "./LU_Solver.hpp"
+#include <stdint.h>
+
+// Maxwell matrices of N conductors with the v_table index 0 conductor as ground
+// All matrices are row major with shape [N,N] in per unit length SI units
+// returned if the capacitance matrix is not positive definite (e.g. a conductor has no field)
+constexpr int32_t CONDUCTOR_MATRIX_NOT_POSITIVE_DEFINITE = -1;
+
+// Ch = e0*M_homogenous, Cih = e0*M_inhomogenous, Lh = Ch^-1/c0^2
+// Cross energies are from calculate_energy_matrix_2d(...) of unit voltage solutions
+int32_t calculate_conductor_matrices(
+    TypedPinnedArray<double> Ch_out, TypedPinnedArray<double> Cih_out, TypedPinnedArray<double> Lh_out,
+    TypedPinnedArray<float> energy_homogenous, TypedPinnedArray<float> energy_inhomogenous
+);
+
+// Propagation modes from the eigenvectors of Lh*Cih sorted from fastest to slowest
+// Each mode vector has unit length with its largest component positive so that
+// a symmetric pair gives the per line odd and even mode impedances
+int32_t calculate_modal_impedances(
+    TypedPinnedArray<double> Z0_out, TypedPinnedArray<double> velocity_out, TypedPinnedArray<double> vectors_out,
+    TypedPinnedArray<double> Lh, TypedPinnedArray<double> Cih
+);
+
+// Solve all unit excitations in one batched pass over the LU factors then form the matrices
+// v_fields_out has shape [N,Ny+1,Nx+1] and conductor_indices are the v_table indices of each row
+// Returns the nonzero info of create_laplace_rhs() or solver.solve_many() if either fails, e.g. N = 0
+// Returns LAPLACE_INVALID_INDEX if a conductor index is negative
+int32_t extract_conductor_matrices(
+    TypedPinnedArray<double> Ch_out, TypedPinnedArray<double> Cih_out, TypedPinnedArray<double> Lh_out,
+    TypedPinnedArray<float> v_fields_out,
+    LU_Solver& solver, TypedPinnedArray<int32_t> conductor_indices,
+    TypedPinnedArray<uint32_t> v_index_beta,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<float> er_table, TypedPinnedArray<uint32_t> er_index_beta
+);
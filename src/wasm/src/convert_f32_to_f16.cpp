@@ -1,32 +1,87 @@
 #include "./convert_f32_to_f16.hpp"
+#include "./thread_pool.hpp"
+#include "./simd.hpp"
 #include <stdint.h>
 
-template <typename T>
-static inline T clamp(T v, T v_min, T v_max) {
-    if (v < v_min) return v_min;
-    if (v > v_max) return v_max;
-    return v;
-}
+static constexpr int MIN_ELEMENTS_PER_CHUNK = 16384;
+static constexpr int MIN_ROWS_PER_CHUNK = 16;
 
 void convert_f32_to_f16(TypedPinnedArray<float> X, TypedPinnedArray<uint16_t> Y) {
-    auto Z = static_cast<TypedPinnedArray<uint32_t>>(X);
+    constexpr int W = f32_vec::WIDTH;
     const int N = X.get_length();
+    const float* x = X.get_data();
+    uint16_t* y = Y.get_data();
+
+    parallel_for_chunks(N, MIN_ELEMENTS_PER_CHUNK, [&](int, int i_start, int i_end) {
+        int i = i_start;
+        for (; i+W <= i_end; i += W) {
+            f32_vec_store_f16(&y[i], f32_vec_load(&x[i]));
+        }
+        for (; i < i_end; i++) {
+            y[i] = f32_to_f16(x[i]);
+        }
+    });
+}
 
-    for (int i = 0; i < N; i++) {
-        // IEEE.754 32bit floating point format
-        // sign: 1, exponent: 8, mantissa: 23
-        // value = (-1)^sign * 2^(exponent-127) * (1 + mantissa*2^-23)
-        const uint32_t z = Z[i];
-        const uint32_t f32_sign = z >> 31;
-        const int32_t f32_exponent = int32_t((z >> 23) & 0xFF) - 127;
-        const uint32_t f32_mantissa = z & 0x7FFFFF;
+void pack_index_beta_f16(
+    TypedPinnedArray<uint16_t> Y,
+    TypedPinnedArray<float> table, TypedPinnedArray<uint32_t> index_beta
+) {
+    constexpr int W = f32_vec::WIDTH;
+    constexpr int TOTAL_CHANNELS = 2;
+    const int N = index_beta.get_length();
+    const int total_table = table.get_length();
+    const float* table_data = table.get_data();
+    const uint32_t* index_beta_data = index_beta.get_data();
+    uint16_t* y = Y.get_data();
+    // match Grid.unpack_index_beta() which divides instead of multiplying by the reciprocal
+    const f32_vec beta_scale = float(0xFFFF);
+    // out of range indices read as zero instead of past the end of the table
+    const auto load_table = [&](uint32_t packed) -> float {
+        const uint32_t index = packed >> 16;
+        return (int(index) < total_table) ? table_data[index] : 0.0f;
+    };
 
-        // IEEE.754 16bit floating point
-        // sign: 1, exponent: 5, mantissa: 10
-        // value = (-1)^sign * 2^(exponent-15) * (1 + mantissa*2^-10)
-        const uint16_t f16_sign = uint16_t(f32_sign);
-        const uint16_t f16_exponent = uint16_t(clamp<int32_t>(f32_exponent+15, 0, 31));
-        const uint16_t f16_mantissa = uint16_t(f32_mantissa >> 13);
-        Y[i] = (f16_sign << 15) | (f16_exponent << 10) | f16_mantissa;
-    }
-}
\ No newline at end of file
+    parallel_for_chunks(N, MIN_ELEMENTS_PER_CHUNK, [&](int, int i_start, int i_end) {
+        int i = i_start;
+        for (; i+W <= i_end; i += W) {
+            float values[W];
+            for (int j = 0; j < W; j++) values[j] = load_table(index_beta_data[i+j]);
+            const f32_vec beta = f32_vec_load_u16_lower(&index_beta_data[i]) / beta_scale;
+            f32_vec_store_f16x2(&y[TOTAL_CHANNELS*i], f32_vec_load(values), beta);
+        }
+        for (; i < i_end; i++) {
+            const uint32_t packed = index_beta_data[i];
+            y[TOTAL_CHANNELS*i+0] = f32_to_f16(load_table(packed));
+            y[TOTAL_CHANNELS*i+1] = f32_to_f16(float(packed & 0xFFFF) / float(0xFFFF));
+        }
+    });
+}
+
+void pack_xy_components_f16(
+    TypedPinnedArray<uint16_t> Y,
+    TypedPinnedArray<float> x_data, TypedPinnedArray<float> y_data,
+    int Nx, int Ny
+) {
+    constexpr int W = f32_vec::WIDTH;
+    constexpr int TOTAL_CHANNELS = 2;
+    const float* x_field = x_data.get_data();
+    const float* y_field = y_data.get_data();
+    uint16_t* y_out = Y.get_data();
+
+    parallel_for_chunks(Ny, MIN_ROWS_PER_CHUNK, [&](int, int y_start, int y_end) {
+        for (int y = y_start; y < y_end; y++) {
+            const float* x_row = &x_field[y*Nx];
+            const float* y_row = &y_field[y*(Nx+1)];
+            uint16_t* out_row = &y_out[TOTAL_CHANNELS*y*Nx];
+            int x = 0;
+            for (; x+W <= Nx; x += W) {
+                f32_vec_store_f16x2(&out_row[TOTAL_CHANNELS*x], f32_vec_load(&x_row[x]), f32_vec_load(&y_row[x]));
+            }
+            for (; x < Nx; x++) {
+                out_row[TOTAL_CHANNELS*x+0] = f32_to_f16(x_row[x]);
+                out_row[TOTAL_CHANNELS*x+1] = f32_to_f16(y_row[x]);
+            }
+        }
+    });
+}
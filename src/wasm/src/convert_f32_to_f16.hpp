@@ -1,4 +1,18 @@
 #pragma once
 #include "./PinnedArray.hpp"
 
-void convert_f32_to_f16(TypedPinnedArray<float> X, TypedPinnedArray<uint16_t> Y);
\ No newline at end of file
+// All conversions round to nearest even and handle denormals, infinity and NaN
+void convert_f32_to_f16(TypedPinnedArray<float> X, TypedPinnedArray<uint16_t> Y);
+
+// Texture upload packers which read their sources once and write interleaved f16 without staging in f32
+// Y[Ny,Nx,2] = (table[index], beta) from index_beta[Ny,Nx] packed as (index << 16) | (0xFFFF*beta)
+void pack_index_beta_f16(
+    TypedPinnedArray<uint16_t> Y,
+    TypedPinnedArray<float> table, TypedPinnedArray<uint32_t> index_beta
+);
+// Y[Ny,Nx,2] = (x_data[y,x], y_data[y,x]) from staggered x_data[Ny+1,Nx] and y_data[Ny,Nx+1]
+void pack_xy_components_f16(
+    TypedPinnedArray<uint16_t> Y,
+    TypedPinnedArray<float> x_data, TypedPinnedArray<float> y_data,
+    int Nx, int Ny
+);
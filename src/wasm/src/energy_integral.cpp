@@ -1,4 +1,8 @@
 #include "./energy_integral.hpp"
+#include "./simd.hpp"
+#include "./thread_pool.hpp"
+#include "./kernel_timings.hpp"
+#include <vector>
 
 // Source: https://en.wikipedia.org/wiki/Gauss%E2%80%93Legendre_quadrature
 // 1. What is the Gauss-Legendre quadrature integral approximation 
@@ -91,59 +95,114 @@
 //      (Ei+1)/2 is the relative position within our yee grid [Dx,Dy] sized cell
 //      E0=-1/sqrt(3), A0=0.21132
 //      E1=+1/sqrt(3), A1=0.78868
-static inline float fsquare(float x) {
+//
+// 6. Vectorisation and accumulation
+// - Every kernel works along rows so ex0,ex1,ey0,ey1,dx are contiguous loads of f32_vec::WIDTH cells
+// - Each row is summed into per lane accumulators which only hold O(Nx/WIDTH) terms
+// - Row sums are accumulated in double precision so the error doesn't grow with millions of cells
+// - Kahan summation is avoided since -ffast-math is allowed to optimise away its compensation term
+template <typename T>
+static inline T fsquare(T x) {
     return x*x;
 }
 
-static inline float get_gauss_legendre_integral(
-    float ex0, float ex1, 
-    float ey0, float ey1, 
-    float dx, float dy
+// two point Gauss Legendre sampling positions mapped onto [0,1]
+static constexpr float A0 = 0.21132;
+static constexpr float A1 = 0.78868;
+
+template <typename T>
+static inline T get_gauss_legendre_integral(
+    T ex0, T ex1,
+    T ey0, T ey1,
+    T dx, T dy
 ) {
-    constexpr float A0 = 0.21132;
-    constexpr float A1 = 0.78868;
 
     // We approximate Ex and Ey as linearly changing along dy and dx inside the cell
     // which under our Gauss Legendre integral will have a low error integral (not true for non-linear fields)
     //  o -- x
     //  |    |
     //  x -- x
-    const float ex0_sample = ex0*A1 + ex1*A0;
-    const float ex1_sample = ex0*A0 + ex1*A1;
-    const float ey0_sample = ey0*A1 + ey1*A0;
-    const float ey1_sample = ey0*A0 + ey1*A1;
+    const T ex0_sample = ex0*A1 + ex1*A0;
+    const T ex1_sample = ex0*A0 + ex1*A1;
+    const T ey0_sample = ey0*A1 + ey1*A0;
+    const T ey1_sample = ey0*A0 + ey1*A1;
 
-    const float f00_sample = fsquare(ex0_sample) + fsquare(ey0_sample);
-    const float f01_sample = fsquare(ex0_sample) + fsquare(ey1_sample);
-    const float f10_sample = fsquare(ex1_sample) + fsquare(ey0_sample);
-    const float f11_sample = fsquare(ex1_sample) + fsquare(ey1_sample);
+    const T f00_sample = fsquare(ex0_sample) + fsquare(ey0_sample);
+    const T f01_sample = fsquare(ex0_sample) + fsquare(ey1_sample);
+    const T f10_sample = fsquare(ex1_sample) + fsquare(ey0_sample);
+    const T f11_sample = fsquare(ex1_sample) + fsquare(ey1_sample);
 
-    const float integral = (f00_sample+f01_sample+f10_sample+f11_sample)*(dx*dy)/4.0;
+    const T integral = (f00_sample+f01_sample+f10_sample+f11_sample)*(dx*dy)*0.25f;
     return integral;
 }
 
+// rows are split into chunks across threads with each chunk's energy summed in row order
+static constexpr int MIN_ROWS_PER_CHUNK = 32;
+
+static inline double sum_chunks(const std::vector<double>& chunks) {
+    double sum = 0.0;
+    for (const double x: chunks) sum += x;
+    return sum;
+}
+
+// er_cell = (1-beta)*er_table[0] + beta*er_table[index]
+static constexpr float BETA_SCALE = 1.0f/float(0xFFFF);
+
+static inline float get_permittivity(const float* er_table, uint32_t index_beta) {
+    const int index = int(index_beta >> 16);
+    const float beta = float(index_beta & 0xFFFF) * BETA_SCALE;
+    return (1.0f-beta)*er_table[0] + beta*er_table[index];
+}
+
+static inline f32_vec get_permittivity(const float* er_table, const uint32_t* index_beta) {
+    constexpr int W = f32_vec::WIDTH;
+    // table lookup has no vector equivalent so it is gathered one lane at a time
+    float er_lanes[W];
+    for (int i = 0; i < W; i++) er_lanes[i] = er_table[index_beta[i] >> 16];
+    const f32_vec beta = f32_vec_load_u16_lower(index_beta) * BETA_SCALE;
+    return (f32_vec(1.0f)-beta)*er_table[0] + beta*f32_vec_load(er_lanes);
+}
+
 float calculate_homogenous_energy_2d(
     TypedPinnedArray<float> ex_field, TypedPinnedArray<float> ey_field,
     TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr
 ) {
     const int Nx = dx_arr.get_length();
     const int Ny = dy_arr.get_length();
+    const float* ex = ex_field.get_data();
+    const float* ey = ey_field.get_data();
+    const float* dx = dx_arr.get_data();
+    constexpr int W = f32_vec::WIDTH;
 
-    float energy = 0.0f;
-    for (int y = 0; y < Ny; y++) {
-        const float dy = dy_arr[y];
-        for (int x = 0; x < Nx; x++) {
-            const float dx = dx_arr[x];
-
-            const float ex0 = ex_field[x + y*Nx];
-            const float ey0 = ey_field[x + y*(Nx+1)];
-            const float ex1 = ex_field[x + (y+1)*Nx];
-            const float ey1 = ey_field[(x+1) + y*(Nx+1)];
-            const float sum = get_gauss_legendre_integral(ex0,ex1,ey0,ey1,dx,dy);
-            energy += sum;
+    const int total_chunks = get_total_chunks(Ny, MIN_ROWS_PER_CHUNK);
+    auto chunk_energy = std::vector<double>(total_chunks, 0.0);
+    parallel_for_total_chunks(Ny, total_chunks, [&](int chunk_index, int y_start, int y_end) {
+        double energy = 0.0;
+        for (int y = y_start; y < y_end; y++) {
+            const float dy = dy_arr[y];
+            const float* ex0 = &ex[y*Nx];
+            const float* ex1 = &ex[(y+1)*Nx];
+            const float* ey0 = &ey[y*(Nx+1)];
+            const float* ey1 = &ey[y*(Nx+1)+1];
+
+            f32_vec row_energy_vec = 0.0f;
+            int x = 0;
+            for (; x+W <= Nx; x += W) {
+                row_energy_vec = row_energy_vec + get_gauss_legendre_integral<f32_vec>(
+                    f32_vec_load(&ex0[x]), f32_vec_load(&ex1[x]),
+                    f32_vec_load(&ey0[x]), f32_vec_load(&ey1[x]),
+                    f32_vec_load(&dx[x]), dy
+                );
+            }
+            float row_energy = f32_vec_reduce_add(row_energy_vec);
+            for (; x < Nx; x++) {
+                row_energy += get_gauss_legendre_integral<float>(ex0[x], ex1[x], ey0[x], ey1[x], dx[x], dy);
+            }
+            energy += double(row_energy);
         }
-    }
-    return energy;
+        chunk_energy[chunk_index] = energy;
+    });
+    return float(sum_chunks(chunk_energy));
 }
 
 float calculate_inhomogenous_energy_2d(
@@ -153,58 +212,516 @@ float calculate_inhomogenous_energy_2d(
 ) {
     const int Nx = dx_arr.get_length();
     const int Ny = dy_arr.get_length();
+    const float* ex = ex_field.get_data();
+    const float* ey = ey_field.get_data();
+    const float* dx = dx_arr.get_data();
+    const float* er = er_table.get_data();
+    constexpr int W = f32_vec::WIDTH;
 
-    const float er0 = er_table[0];
-
-    float energy = 0.0;
-    for (int y = 0; y < Ny-1; y++) {
-        const float dy = dy_arr[y];
-        for (int x = 0; x < Nx-1; x++) {
-            const float dx = dx_arr[x];
+    const int total_chunks = get_total_chunks(Ny-1, MIN_ROWS_PER_CHUNK);
+    auto chunk_energy = std::vector<double>(total_chunks, 0.0);
+    parallel_for_total_chunks(Ny-1, total_chunks, [&](int chunk_index, int y_start, int y_end) {
+        double energy = 0.0;
+        for (int y = y_start; y < y_end; y++) {
+            const float dy = dy_arr[y];
+            const float* ex0 = &ex[y*Nx];
+            const float* ex1 = &ex[(y+1)*Nx];
+            const float* ey0 = &ey[y*(Nx+1)];
+            const float* ey1 = &ey[y*(Nx+1)+1];
+            const uint32_t* index_beta = &er_index_beta[y*Nx];
 
-            const float ex0 = ex_field[x + y*Nx];
-            const float ey0 = ey_field[x + y*(Nx+1)];
-            const float ex1 = ex_field[x + (y+1)*Nx];
-            const float ey1 = ey_field[(x+1) + y*(Nx+1)];
-            const float sum = get_gauss_legendre_integral(ex0,ex1,ey0,ey1,dx,dy);
-
-            const uint32_t index_beta = er_index_beta[x+y*Nx];
-            const int index = int(index_beta >> 16);
-            const float beta = float(index_beta & 0xFFFF) / float(0xFFFF);
-            const float er_cell = (1.0-beta)*er0 + beta*er_table[index];
-            energy += er_cell*sum;
+            f32_vec row_energy_vec = 0.0f;
+            int x = 0;
+            for (; x+W <= Nx-1; x += W) {
+                const f32_vec sum = get_gauss_legendre_integral<f32_vec>(
+                    f32_vec_load(&ex0[x]), f32_vec_load(&ex1[x]),
+                    f32_vec_load(&ey0[x]), f32_vec_load(&ey1[x]),
+                    f32_vec_load(&dx[x]), dy
+                );
+                row_energy_vec = row_energy_vec + get_permittivity(er, &index_beta[x])*sum;
+            }
+            float row_energy = f32_vec_reduce_add(row_energy_vec);
+            for (; x < Nx-1; x++) {
+                const float sum = get_gauss_legendre_integral<float>(ex0[x], ex1[x], ey0[x], ey1[x], dx[x], dy);
+                row_energy += get_permittivity(er, index_beta[x])*sum;
+            }
+            energy += double(row_energy);
         }
-    }
-    return energy;
+        chunk_energy[chunk_index] = energy;
+    });
+    return float(sum_chunks(chunk_energy));
 }
 
 void calculate_e_field(
-    TypedPinnedArray<float> ex_field, TypedPinnedArray<float> ey_field, 
-    TypedPinnedArray<float> v_field, 
+    TypedPinnedArray<float> ex_field, TypedPinnedArray<float> ey_field,
+    TypedPinnedArray<float> v_field,
     TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr
 ) {
+    const auto timer = Kernel_Timer("e_field");
+    const int Nx = dx_arr.get_length();
+    const int Ny = dy_arr.get_length();
+    float* ex = ex_field.get_data();
+    float* ey = ey_field.get_data();
+    const float* v = v_field.get_data();
+    const float* dx = dx_arr.get_data();
+    constexpr int W = f32_vec::WIDTH;
+
+    // Ex = -dV/dx
+    parallel_for_chunks(Ny+1, MIN_ROWS_PER_CHUNK, [&](int, int y_start, int y_end) {
+        for (int y = y_start; y < y_end; y++) {
+            float* ex_row = &ex[y*Nx];
+            const float* v0 = &v[y*(Nx+1)];
+            const float* v1 = &v[y*(Nx+1)+1];
+            int x = 0;
+            for (; x+W <= Nx; x += W) {
+                const f32_vec dv = f32_vec_load(&v0[x]) - f32_vec_load(&v1[x]);
+                f32_vec_store(&ex_row[x], dv / f32_vec_load(&dx[x]));
+            }
+            for (; x < Nx; x++) {
+                ex_row[x] = -(v1[x]-v0[x])/dx[x];
+            }
+        }
+    });
+
+    // Ey = -dV/dy
+    parallel_for_chunks(Ny, MIN_ROWS_PER_CHUNK, [&](int, int y_start, int y_end) {
+        for (int y = y_start; y < y_end; y++) {
+            const float dy = dy_arr[y];
+            float* ey_row = &ey[y*(Nx+1)];
+            const float* v0 = &v[y*(Nx+1)];
+            const float* v1 = &v[(y+1)*(Nx+1)];
+            int x = 0;
+            for (; x+W <= Nx+1; x += W) {
+                const f32_vec dv = f32_vec_load(&v0[x]) - f32_vec_load(&v1[x]);
+                f32_vec_store(&ey_row[x], dv / dy);
+            }
+            for (; x < Nx+1; x++) {
+                ey_row[x] = -(v1[x]-v0[x])/dy;
+            }
+        }
+    });
+}
+
+template <typename T>
+static inline T load_lanes(const float* x);
+template <>
+inline float load_lanes<float>(const float* x) { return *x; }
+template <>
+inline f32_vec load_lanes<f32_vec>(const float* x) { return f32_vec_load(x); }
+
+// Cell integral with Ex,Ey taken from finite differences of the surrounding voltages
+//  v0[x] -- v0[x+1]
+//    |        |
+//  v1[x] -- v1[x+1]
+template <typename T>
+static inline T get_cell_integral_from_v_field(const float* v0, const float* v1, const float* dx, float dy) {
+    const T v00 = load_lanes<T>(v0);
+    const T v01 = load_lanes<T>(v0+1);
+    const T v10 = load_lanes<T>(v1);
+    const T v11 = load_lanes<T>(v1+1);
+    const T dx_cell = load_lanes<T>(dx);
+    const T dy_cell = dy;
+    // E = -grad(V)
+    const T ex0 = (v00-v01)/dx_cell;
+    const T ex1 = (v10-v11)/dx_cell;
+    const T ey0 = (v00-v10)/dy_cell;
+    const T ey1 = (v01-v11)/dy_cell;
+    return get_gauss_legendre_integral<T>(ex0, ex1, ey0, ey1, dx_cell, dy_cell);
+}
+
+// Fused equivalent of calculate_e_field() followed by calculate_homogenous_energy_2d() and calculate_inhomogenous_energy_2d()
+// - Reads the voltage field once and never writes out the electric field
+// - Covers the same cells as the separate kernels so results match up to rounding
+Energy_2D calculate_energy_2d(
+    TypedPinnedArray<float> v_field,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<float> er_table, TypedPinnedArray<uint32_t> er_index_beta
+) {
+    const auto timer = Kernel_Timer("energy");
     const int Nx = dx_arr.get_length();
     const int Ny = dy_arr.get_length();
+    const float* v = v_field.get_data();
+    const float* dx = dx_arr.get_data();
+    const float* er = er_table.get_data();
+    constexpr int W = f32_vec::WIDTH;
+
+    const int total_chunks = get_total_chunks(Ny, MIN_ROWS_PER_CHUNK);
+    auto chunk_homogenous = std::vector<double>(total_chunks, 0.0);
+    auto chunk_inhomogenous = std::vector<double>(total_chunks, 0.0);
+    parallel_for_total_chunks(Ny, total_chunks, [&](int chunk_index, int y_start, int y_end) {
+        double energy_homogenous = 0.0;
+        double energy_inhomogenous = 0.0;
+        for (int y = y_start; y < y_end; y++) {
+            const float dy = dy_arr[y];
+            const float* v0 = &v[y*(Nx+1)];
+            const float* v1 = &v[(y+1)*(Nx+1)];
+            const uint32_t* index_beta = &er_index_beta[y*Nx];
+            // inhomogenous energy excludes the last row and column
+            const int Nx_inhomogenous = (y < Ny-1) ? (Nx-1) : 0;
 
-    for (int y = 0; y < Ny+1; y++) {
-        for (int x = 0; x < Nx; x++) {
-            const float dx = dx_arr[x];
-            const int ie = x + y*Nx;
-            const int iv = x + y*(Nx+1);
-            const int iv_dx = x+1 + y*(Nx+1);
-            // Ex = -dV/dx
-            ex_field[ie] = -(v_field[iv_dx]-v_field[iv])/dx;
+            f32_vec row_homogenous_vec = 0.0f;
+            f32_vec row_inhomogenous_vec = 0.0f;
+            int x = 0;
+            for (; x+W <= Nx_inhomogenous; x += W) {
+                const f32_vec sum = get_cell_integral_from_v_field<f32_vec>(&v0[x], &v1[x], &dx[x], dy);
+                row_homogenous_vec = row_homogenous_vec + sum;
+                row_inhomogenous_vec = row_inhomogenous_vec + get_permittivity(er, &index_beta[x])*sum;
+            }
+            if (Nx_inhomogenous == 0) {
+                for (; x+W <= Nx; x += W) {
+                    const f32_vec sum = get_cell_integral_from_v_field<f32_vec>(&v0[x], &v1[x], &dx[x], dy);
+                    row_homogenous_vec = row_homogenous_vec + sum;
+                }
+            }
+            float row_homogenous = f32_vec_reduce_add(row_homogenous_vec);
+            float row_inhomogenous = f32_vec_reduce_add(row_inhomogenous_vec);
+            for (; x < Nx; x++) {
+                const float sum = get_cell_integral_from_v_field<float>(&v0[x], &v1[x], &dx[x], dy);
+                row_homogenous += sum;
+                if (x < Nx_inhomogenous) row_inhomogenous += get_permittivity(er, index_beta[x])*sum;
+            }
+            energy_homogenous += double(row_homogenous);
+            energy_inhomogenous += double(row_inhomogenous);
+        }
+        chunk_homogenous[chunk_index] = energy_homogenous;
+        chunk_inhomogenous[chunk_index] = energy_inhomogenous;
+    });
+    return { float(sum_chunks(chunk_homogenous)), float(sum_chunks(chunk_inhomogenous)) };
+}
+
+// Gauss Legendre samples [ex0,ex1,ey0,ey1] of a cell from finite differences of the surrounding voltages
+template <typename T>
+static inline void get_cell_samples_from_v_field(const float* v0, const float* v1, const float* dx, float dy, T* samples) {
+    const T v00 = load_lanes<T>(v0);
+    const T v01 = load_lanes<T>(v0+1);
+    const T v10 = load_lanes<T>(v1);
+    const T v11 = load_lanes<T>(v1+1);
+    const T dx_cell = load_lanes<T>(dx);
+    const T dy_cell = dy;
+    const T ex0 = (v00-v01)/dx_cell;
+    const T ex1 = (v10-v11)/dx_cell;
+    const T ey0 = (v00-v10)/dy_cell;
+    const T ey1 = (v01-v11)/dy_cell;
+    samples[0] = ex0*A1 + ex1*A0;
+    samples[1] = ex0*A0 + ex1*A1;
+    samples[2] = ey0*A1 + ey1*A0;
+    samples[3] = ey0*A0 + ey1*A1;
+}
+
+// Bilinear form of get_gauss_legendre_integral() where the 4 sample points sum to 2*dot(samples_i, samples_j)
+template <typename T>
+static inline T get_cross_integral(const T* samples_i, const T* samples_j, T dx, T dy) {
+    const T dot =
+        samples_i[0]*samples_j[0] + samples_i[1]*samples_j[1] +
+        samples_i[2]*samples_j[2] + samples_i[3]*samples_j[3];
+    return dot*(dx*dy)*0.5f;
+}
+
+// Cross energies M[i][j] = integral E_i.E_j between k voltage fields with shape [k,Ny+1,Nx+1]
+// - Uses the same samples and cells as calculate_energy_2d() so M[i][i] matches it up to rounding
+// - By linearity the energy of any superposition sum_i a_i*V_i is a^T M a
+void calculate_energy_matrix_2d(
+    TypedPinnedArray<float> homogenous_out, TypedPinnedArray<float> inhomogenous_out,
+    TypedPinnedArray<float> v_fields,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<float> er_table, TypedPinnedArray<uint32_t> er_index_beta
+) {
+    const auto timer = Kernel_Timer("energy_matrix");
+    const int Nx = dx_arr.get_length();
+    const int Ny = dy_arr.get_length();
+    const int field_stride = (Nx+1)*(Ny+1);
+    const int total_fields = v_fields.get_length() / field_stride;
+    const int total_pairs = total_fields*(total_fields+1)/2;
+    const float* v = v_fields.get_data();
+    const float* dx = dx_arr.get_data();
+    const float* er = er_table.get_data();
+    constexpr int W = f32_vec::WIDTH;
+
+    const int total_chunks = get_total_chunks(Ny, MIN_ROWS_PER_CHUNK);
+    auto chunk_homogenous = std::vector<double>(total_chunks*total_pairs, 0.0);
+    auto chunk_inhomogenous = std::vector<double>(total_chunks*total_pairs, 0.0);
+    parallel_for_total_chunks(Ny, total_chunks, [&](int chunk_index, int y_start, int y_end) {
+        auto samples_vec = std::vector<f32_vec>(4*total_fields, 0.0f);
+        auto samples = std::vector<float>(4*total_fields, 0.0f);
+        auto row_homogenous_vec = std::vector<f32_vec>(total_pairs, 0.0f);
+        auto row_inhomogenous_vec = std::vector<f32_vec>(total_pairs, 0.0f);
+        auto row_homogenous = std::vector<float>(total_pairs, 0.0f);
+        auto row_inhomogenous = std::vector<float>(total_pairs, 0.0f);
+        double* energy_homogenous = &chunk_homogenous[chunk_index*total_pairs];
+        double* energy_inhomogenous = &chunk_inhomogenous[chunk_index*total_pairs];
+        for (int y = y_start; y < y_end; y++) {
+            const float dy = dy_arr[y];
+            const uint32_t* index_beta = &er_index_beta[y*Nx];
+            // inhomogenous energy excludes the last row and column
+            const int Nx_inhomogenous = (y < Ny-1) ? (Nx-1) : 0;
+            const int Nx_vec = (Nx_inhomogenous > 0) ? Nx_inhomogenous : Nx;
+            for (int p = 0; p < total_pairs; p++) {
+                row_homogenous_vec[p] = 0.0f;
+                row_inhomogenous_vec[p] = 0.0f;
+            }
+
+            int x = 0;
+            for (; x+W <= Nx_vec; x += W) {
+                for (int f = 0; f < total_fields; f++) {
+                    const float* v0 = &v[f*field_stride + y*(Nx+1) + x];
+                    const float* v1 = &v[f*field_stride + (y+1)*(Nx+1) + x];
+                    get_cell_samples_from_v_field<f32_vec>(v0, v1, &dx[x], dy, &samples_vec[4*f]);
+                }
+                const f32_vec dx_cell = f32_vec_load(&dx[x]);
+                const f32_vec er_cell = (Nx_inhomogenous > 0) ? get_permittivity(er, &index_beta[x]) : f32_vec(0.0f);
+                int p = 0;
+                for (int i = 0; i < total_fields; i++) {
+                    for (int j = i; j < total_fields; j++, p++) {
+                        const f32_vec sum = get_cross_integral<f32_vec>(&samples_vec[4*i], &samples_vec[4*j], dx_cell, dy);
+                        row_homogenous_vec[p] = row_homogenous_vec[p] + sum;
+                        row_inhomogenous_vec[p] = row_inhomogenous_vec[p] + er_cell*sum;
+                    }
+                }
+            }
+            for (int p = 0; p < total_pairs; p++) {
+                row_homogenous[p] = f32_vec_reduce_add(row_homogenous_vec[p]);
+                row_inhomogenous[p] = f32_vec_reduce_add(row_inhomogenous_vec[p]);
+            }
+            for (; x < Nx; x++) {
+                for (int f = 0; f < total_fields; f++) {
+                    const float* v0 = &v[f*field_stride + y*(Nx+1) + x];
+                    const float* v1 = &v[f*field_stride + (y+1)*(Nx+1) + x];
+                    get_cell_samples_from_v_field<float>(v0, v1, &dx[x], dy, &samples[4*f]);
+                }
+                const float er_cell = (x < Nx_inhomogenous) ? get_permittivity(er, index_beta[x]) : 0.0f;
+                int p = 0;
+                for (int i = 0; i < total_fields; i++) {
+                    for (int j = i; j < total_fields; j++, p++) {
+                        const float sum = get_cross_integral<float>(&samples[4*i], &samples[4*j], dx[x], dy);
+                        row_homogenous[p] += sum;
+                        row_inhomogenous[p] += er_cell*sum;
+                    }
+                }
+            }
+            for (int p = 0; p < total_pairs; p++) {
+                energy_homogenous[p] += double(row_homogenous[p]);
+                energy_inhomogenous[p] += double(row_inhomogenous[p]);
+            }
+        }
+    });
+
+    // sum chunks in order and mirror the upper triangle
+    int p = 0;
+    for (int i = 0; i < total_fields; i++) {
+        for (int j = i; j < total_fields; j++, p++) {
+            double homogenous = 0.0;
+            double inhomogenous = 0.0;
+            for (int c = 0; c < total_chunks; c++) {
+                homogenous += chunk_homogenous[c*total_pairs + p];
+                inhomogenous += chunk_inhomogenous[c*total_pairs + p];
+            }
+            homogenous_out[i*total_fields + j] = float(homogenous);
+            homogenous_out[j*total_fields + i] = float(homogenous);
+            inhomogenous_out[i*total_fields + j] = float(inhomogenous);
+            inhomogenous_out[j*total_fields + i] = float(inhomogenous);
         }
     }
+}
+
+// Same pass as calculate_energy_matrix_2d() with each inhomogenous term split across the two table entries of the cell
+// - (1-beta)*sum goes to material 0 and beta*sum goes to material index
+// - Vector lanes usually share one material along a row so those are accumulated as vectors, otherwise each lane
+//   is scattered on its own
+int32_t calculate_partial_energy_matrix_2d(
+    TypedPinnedArray<float> homogenous_out, TypedPinnedArray<float> partial_out,
+    TypedPinnedArray<float> v_fields,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> er_index_beta
+) {
+    const auto timer = Kernel_Timer("partial_energy_matrix");
+    const int Nx = dx_arr.get_length();
+    const int Ny = dy_arr.get_length();
+    const int field_stride = (Nx+1)*(Ny+1);
+    const int total_fields = v_fields.get_length() / field_stride;
+    const int total_pairs = total_fields*(total_fields+1)/2;
+    const int matrix_size = total_fields*total_fields;
+    const int table_length = (matrix_size > 0) ? int(partial_out.get_length() / matrix_size) : 0;
+    const int total_partials = table_length*total_pairs;
+    const float* v = v_fields.get_data();
+    const float* dx = dx_arr.get_data();
+    constexpr int W = f32_vec::WIDTH;
+
+    const int total_chunks = get_total_chunks(Ny, MIN_ROWS_PER_CHUNK);
+    auto chunk_homogenous = std::vector<double>(total_chunks*total_pairs, 0.0);
+    auto chunk_partial = std::vector<double>(total_chunks*total_partials, 0.0);
+    auto chunk_is_invalid = std::vector<uint8_t>(total_chunks, 0);
+    parallel_for_total_chunks(Ny, total_chunks, [&](int chunk_index, int y_start, int y_end) {
+        auto samples_vec = std::vector<f32_vec>(4*total_fields, 0.0f);
+        auto samples = std::vector<float>(4*total_fields, 0.0f);
+        auto sum_vec = std::vector<f32_vec>(total_pairs, 0.0f);
+        auto lane_sums = std::vector<float>(W*total_pairs, 0.0f);
+        auto row_homogenous_vec = std::vector<f32_vec>(total_pairs, 0.0f);
+        auto row_partial_vec = std::vector<f32_vec>(total_partials, 0.0f);
+        auto row_homogenous = std::vector<float>(total_pairs, 0.0f);
+        auto row_partial = std::vector<float>(total_partials, 0.0f);
+        double* energy_homogenous = &chunk_homogenous[chunk_index*total_pairs];
+        double* energy_partial = &chunk_partial[chunk_index*total_partials];
+        bool is_invalid = false;
+
+        const auto scatter_lane = [&](uint32_t index_beta, int lane, const float* lane_sums, int lane_stride) {
+            const int index = int(index_beta >> 16);
+            if (index >= table_length) {
+                is_invalid = true;
+                return;
+            }
+            const float beta = float(index_beta & 0xFFFF) * BETA_SCALE;
+            float* partial_base = &row_partial[0];
+            float* partial_index = &row_partial[index*total_pairs];
+            for (int p = 0; p < total_pairs; p++) {
+                const float sum = lane_sums[p*lane_stride + lane];
+                partial_base[p] += (1.0f-beta)*sum;
+                partial_index[p] += beta*sum;
+            }
+        };
 
-    for (int y = 0; y < Ny; y++) {
-        const float dy = dy_arr[y];
-        for (int x = 0; x < Nx+1; x++) {
-            const int ie = x + y*(Nx+1);
-            const int iv = x + y*(Nx+1);
-            const int iv_dy = x + (y+1)*(Nx+1);
-            // Ey = -dV/dy
-            ey_field[ie] = -(v_field[iv_dy]-v_field[iv])/dy;
+        for (int y = y_start; y < y_end; y++) {
+            const float dy = dy_arr[y];
+            const uint32_t* index_beta = &er_index_beta[y*Nx];
+            // inhomogenous energy excludes the last row and column
+            const int Nx_inhomogenous = (y < Ny-1) ? (Nx-1) : 0;
+            const int Nx_vec = (Nx_inhomogenous > 0) ? Nx_inhomogenous : Nx;
+            for (int p = 0; p < total_pairs; p++) row_homogenous_vec[p] = 0.0f;
+            for (int p = 0; p < total_partials; p++) row_partial_vec[p] = 0.0f;
+            for (int p = 0; p < total_partials; p++) row_partial[p] = 0.0f;
+
+            int x = 0;
+            for (; x+W <= Nx_vec; x += W) {
+                for (int f = 0; f < total_fields; f++) {
+                    const float* v0 = &v[f*field_stride + y*(Nx+1) + x];
+                    const float* v1 = &v[f*field_stride + (y+1)*(Nx+1) + x];
+                    get_cell_samples_from_v_field<f32_vec>(v0, v1, &dx[x], dy, &samples_vec[4*f]);
+                }
+                const f32_vec dx_cell = f32_vec_load(&dx[x]);
+                int p = 0;
+                for (int i = 0; i < total_fields; i++) {
+                    for (int j = i; j < total_fields; j++, p++) {
+                        sum_vec[p] = get_cross_integral<f32_vec>(&samples_vec[4*i], &samples_vec[4*j], dx_cell, dy);
+                        row_homogenous_vec[p] = row_homogenous_vec[p] + sum_vec[p];
+                    }
+                }
+                if (Nx_inhomogenous == 0) continue;
+
+                const int index = int(index_beta[x] >> 16);
+                bool is_uniform = index < table_length;
+                for (int i = 1; i < W; i++) is_uniform = is_uniform && int(index_beta[x+i] >> 16) == index;
+                if (is_uniform) {
+                    const f32_vec beta = f32_vec_load_u16_lower(&index_beta[x]) * BETA_SCALE;
+                    const f32_vec beta_base = f32_vec(1.0f)-beta;
+                    f32_vec* partial_base = &row_partial_vec[0];
+                    f32_vec* partial_index = &row_partial_vec[index*total_pairs];
+                    for (int p = 0; p < total_pairs; p++) {
+                        partial_base[p] = partial_base[p] + beta_base*sum_vec[p];
+                        partial_index[p] = partial_index[p] + beta*sum_vec[p];
+                    }
+                } else {
+                    for (int p = 0; p < total_pairs; p++) f32_vec_store(&lane_sums[p*W], sum_vec[p]);
+                    for (int i = 0; i < W; i++) scatter_lane(index_beta[x+i], i, lane_sums.data(), W);
+                }
+            }
+            for (int p = 0; p < total_pairs; p++) row_homogenous[p] = f32_vec_reduce_add(row_homogenous_vec[p]);
+            for (int p = 0; p < total_partials; p++) row_partial[p] += f32_vec_reduce_add(row_partial_vec[p]);
+            for (; x < Nx; x++) {
+                for (int f = 0; f < total_fields; f++) {
+                    const float* v0 = &v[f*field_stride + y*(Nx+1) + x];
+                    const float* v1 = &v[f*field_stride + (y+1)*(Nx+1) + x];
+                    get_cell_samples_from_v_field<float>(v0, v1, &dx[x], dy, &samples[4*f]);
+                }
+                float* sums = lane_sums.data();
+                int p = 0;
+                for (int i = 0; i < total_fields; i++) {
+                    for (int j = i; j < total_fields; j++, p++) {
+                        sums[p] = get_cross_integral<float>(&samples[4*i], &samples[4*j], dx[x], dy);
+                        row_homogenous[p] += sums[p];
+                    }
+                }
+                if (x < Nx_inhomogenous) scatter_lane(index_beta[x], 0, sums, 1);
+            }
+            for (int p = 0; p < total_pairs; p++) energy_homogenous[p] += double(row_homogenous[p]);
+            for (int p = 0; p < total_partials; p++) energy_partial[p] += double(row_partial[p]);
         }
+        chunk_is_invalid[chunk_index] = is_invalid ? 1 : 0;
+    });
+
+    // sum chunks in order and mirror the upper triangle
+    int p = 0;
+    for (int i = 0; i < total_fields; i++) {
+        for (int j = i; j < total_fields; j++, p++) {
+            double homogenous = 0.0;
+            for (int c = 0; c < total_chunks; c++) homogenous += chunk_homogenous[c*total_pairs + p];
+            homogenous_out[i*total_fields + j] = float(homogenous);
+            homogenous_out[j*total_fields + i] = float(homogenous);
+            for (int m = 0; m < table_length; m++) {
+                double partial = 0.0;
+                for (int c = 0; c < total_chunks; c++) partial += chunk_partial[c*total_partials + m*total_pairs + p];
+                partial_out[m*matrix_size + i*total_fields + j] = float(partial);
+                partial_out[m*matrix_size + j*total_fields + i] = float(partial);
+            }
+        }
+    }
+    for (const uint8_t is_invalid: chunk_is_invalid) {
+        if (is_invalid) return ENERGY_INVALID_INDEX;
     }
-}
\ No newline at end of file
+    return 0;
+}
+
+// Difference between the 2 point Gauss Legendre integral and the 1 point midpoint integral of a cell
+// - Expanding the samples around the midpoints m = (e0+e1)/2 gives e0_sample,e1_sample = m +/- (e0-e1)*(A1-A0)/2
+// - The cross terms cancel which leaves (A1-A0)^2/4 * [(ex0-ex1)^2 + (ey0-ey1)^2] * dx*dy
+// - Computed from the differences directly so it is never negative from cancellation
+// - ex0-ex1 is dEx/dy and ey0-ey1 is dEy/dx across the cell which measure how much the field bends
+static constexpr float ERROR_SCALE = (A1-A0)*(A1-A0)*0.25f;
+
+template <typename T>
+static inline T get_cell_error_from_v_field(const float* v0, const float* v1, const float* dx, float dy) {
+    const T v00 = load_lanes<T>(v0);
+    const T v01 = load_lanes<T>(v0+1);
+    const T v10 = load_lanes<T>(v1);
+    const T v11 = load_lanes<T>(v1+1);
+    const T dx_cell = load_lanes<T>(dx);
+    const T dy_cell = dy;
+    const T ex0 = (v00-v01)/dx_cell;
+    const T ex1 = (v10-v11)/dx_cell;
+    const T ey0 = (v00-v10)/dy_cell;
+    const T ey1 = (v01-v11)/dy_cell;
+    return (fsquare(ex0-ex1) + fsquare(ey0-ey1))*(dx_cell*dy_cell)*ERROR_SCALE;
+}
+
+void calculate_energy_error_2d(
+    TypedPinnedArray<float> error_out,
+    TypedPinnedArray<float> v_field,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<float> er_table, TypedPinnedArray<uint32_t> er_index_beta
+) {
+    const auto timer = Kernel_Timer("energy_error");
+    const int Nx = dx_arr.get_length();
+    const int Ny = dy_arr.get_length();
+    float* error = error_out.get_data();
+    const float* v = v_field.get_data();
+    const float* dx = dx_arr.get_data();
+    const float* er = er_table.get_data();
+    constexpr int W = f32_vec::WIDTH;
+
+    parallel_for_chunks(Ny, MIN_ROWS_PER_CHUNK, [&](int, int y_start, int y_end) {
+        for (int y = y_start; y < y_end; y++) {
+            const float dy = dy_arr[y];
+            const float* v0 = &v[y*(Nx+1)];
+            const float* v1 = &v[(y+1)*(Nx+1)];
+            const uint32_t* index_beta = &er_index_beta[y*Nx];
+            float* error_row = &error[y*Nx];
+            int x = 0;
+            for (; x+W <= Nx; x += W) {
+                const f32_vec cell_error = get_cell_error_from_v_field<f32_vec>(&v0[x], &v1[x], &dx[x], dy);
+                f32_vec_store(&error_row[x], get_permittivity(er, &index_beta[x])*cell_error);
+            }
+            for (; x < Nx; x++) {
+                const float cell_error = get_cell_error_from_v_field<float>(&v0[x], &v1[x], &dx[x], dy);
+                error_row[x] = get_permittivity(er, index_beta[x])*cell_error;
+            }
+        }
+    });
+}
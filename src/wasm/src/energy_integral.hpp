@@ -18,4 +18,47 @@ void calculate_e_field(
     TypedPinnedArray<float> ex_field, TypedPinnedArray<float> ey_field,
     TypedPinnedArray<float> v_field, 
     TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr
-);
\ No newline at end of file
+);
+
+struct Energy_2D {
+    float homogenous = 0.0f;
+    float inhomogenous = 0.0f;
+};
+
+Energy_2D calculate_energy_2d(
+    TypedPinnedArray<float> v_field,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<float> er_table, TypedPinnedArray<uint32_t> er_index_beta
+);
+
+// Cross energies between k voltage fields with shape [k,Ny+1,Nx+1] written to [k,k] matrices
+void calculate_energy_matrix_2d(
+    TypedPinnedArray<float> homogenous_out, TypedPinnedArray<float> inhomogenous_out,
+    TypedPinnedArray<float> v_fields,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<float> er_table, TypedPinnedArray<uint32_t> er_index_beta
+);
+
+// Cross energies between k voltage fields with the inhomogenous part split by dielectric index
+// - partial_out has shape [table_length,k,k] and homogenous_out has shape [k,k]
+// - Cell permittivity is linear in er_table so for any er_table of that length the inhomogenous
+//   cross energies are sum_m er_table[m]*partial_out[m] without another pass over the grid
+// - Uses the same samples and cells as calculate_energy_matrix_2d() so results match up to rounding
+// - Returns ENERGY_INVALID_INDEX if er_index_beta has an index outside of the table
+constexpr int32_t ENERGY_INVALID_INDEX = -1;
+int32_t calculate_partial_energy_matrix_2d(
+    TypedPinnedArray<float> homogenous_out, TypedPinnedArray<float> partial_out,
+    TypedPinnedArray<float> v_fields,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> er_index_beta
+);
+
+// Per cell error indicator of the energy integral for a voltage field written to error_out[Ny,Nx]
+// - Energy of the field variation inside each cell which the midpoint rule misses and is large where the mesh is too coarse
+// - Weighted by permittivity so it is in the same units as the inhomogenous energy
+void calculate_energy_error_2d(
+    TypedPinnedArray<float> error_out,
+    TypedPinnedArray<float> v_field,
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<float> er_table, TypedPinnedArray<uint32_t> er_index_beta
+);
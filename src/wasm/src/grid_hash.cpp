@@ -0,0 +1,111 @@
+#include "./grid_hash.hpp"
+#include "./thread_pool.hpp"
+#include "./kernel_timings.hpp"
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// SRC: https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+static constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t SEED_LOWER = 0x6772696448617368ull;
+static constexpr uint64_t SEED_UPPER = 0x3243F6A8885A308Dull;
+// NOTE: block size is part of the hash so changing it invalidates persisted cache keys
+static constexpr int BLOCK_WORDS = 1 << 14;
+
+static inline uint64_t rotate_left(uint64_t x, int r) {
+    return (x << r) | (x >> (64-r));
+}
+
+static inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= PRIME_2;
+    h ^= h >> 29;
+    h *= PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
+
+struct Hash_128 {
+    uint64_t lower = 0;
+    uint64_t upper = 0;
+};
+
+// two lanes with different seeds give 128 bits from the 64bit xxhash round
+class Hash_State
+{
+private:
+    uint64_t m_lower = SEED_LOWER;
+    uint64_t m_upper = SEED_UPPER;
+public:
+    inline void update(uint64_t k) {
+        m_lower = rotate_left(m_lower + k*PRIME_2, 31)*PRIME_1;
+        m_upper = rotate_left(m_upper + (k^PRIME_3)*PRIME_2, 27)*PRIME_1;
+    }
+    inline Hash_128 digest() const {
+        return { avalanche(m_lower), avalanche(m_upper ^ PRIME_3) };
+    }
+};
+
+template <bool IS_FLOAT>
+static inline uint32_t get_canonical_word(uint32_t word) {
+    if (!IS_FLOAT) return word;
+    if ((word & 0x7FFFFFFFu) == 0) return 0; // -0.0
+    if ((word & 0x7F800000u) == 0x7F800000u && (word & 0x007FFFFFu) != 0) return 0x7FC00000u; // NaN
+    return word;
+}
+
+template <bool IS_FLOAT>
+static Hash_128 hash_block(const uint32_t* data, int start, int end) {
+    Hash_State state;
+    int i = start;
+    for (; i+2 <= end; i += 2) {
+        const uint64_t word_0 = get_canonical_word<IS_FLOAT>(data[i]);
+        const uint64_t word_1 = get_canonical_word<IS_FLOAT>(data[i+1]);
+        state.update(word_0 | (word_1 << 32));
+    }
+    if (i < end) state.update(get_canonical_word<IS_FLOAT>(data[i]));
+    return state.digest();
+}
+
+template <bool IS_FLOAT>
+static void update_array(Hash_State& state, const uint32_t* data, int length) {
+    state.update(uint64_t(length));
+    const int total_blocks = (length + BLOCK_WORDS-1) / BLOCK_WORDS;
+    auto digests = std::vector<Hash_128>(size_t(total_blocks));
+    parallel_for_chunks(total_blocks, 1, [&](int, int block_start, int block_end) {
+        for (int i = block_start; i < block_end; i++) {
+            const int start = i*BLOCK_WORDS;
+            const int end = std::min(start+BLOCK_WORDS, length);
+            digests[size_t(i)] = hash_block<IS_FLOAT>(data, start, end);
+        }
+    });
+    for (const auto& digest: digests) {
+        state.update(digest.lower);
+        state.update(digest.upper);
+    }
+}
+
+std::string hash_grid_inputs(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta,
+    TypedPinnedArray<float> ek_table, TypedPinnedArray<uint32_t> ek_index_beta
+) {
+    const auto timer = Kernel_Timer("hash_grid_inputs");
+    const auto as_words = [](TypedPinnedArray<float> arr) {
+        return reinterpret_cast<const uint32_t*>(arr.get_data());
+    };
+    Hash_State state;
+    update_array<true>(state, as_words(dx_arr), dx_arr.get_length());
+    update_array<true>(state, as_words(dy_arr), dy_arr.get_length());
+    update_array<false>(state, v_index_beta.get_data(), v_index_beta.get_length());
+    update_array<true>(state, as_words(ek_table), ek_table.get_length());
+    update_array<false>(state, ek_index_beta.get_data(), ek_index_beta.get_length());
+    const auto digest = state.digest();
+    char hex[33];
+    snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)digest.upper, (unsigned long long)digest.lower);
+    return std::string(hex);
+}
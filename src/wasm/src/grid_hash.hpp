@@ -0,0 +1,18 @@
+#pragma once
+
+#include "./PinnedArray.hpp"
+#include <stdint.h>
+#include <string>
+
+// Canonical 128bit hash of the grid inputs of a solve which is used as a persistent result cache key
+// - Arrays are split into fixed size blocks which are hashed in parallel and then combined in order,
+//   so the hash only depends on the data and not on the thread count or session
+// - Lengths are hashed with the data so reshaped grids with the same values do not collide
+// - -0.0 is hashed as +0.0 and every NaN is hashed as the same quiet NaN
+// - Returned as 32 lower case hex characters since embind has no 64bit integers without BigInt
+// NOTE: This is not a cryptographic hash and only guards against accidental collisions
+std::string hash_grid_inputs(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta,
+    TypedPinnedArray<float> ek_table, TypedPinnedArray<uint32_t> ek_index_beta
+);
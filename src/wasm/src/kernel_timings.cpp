@@ -0,0 +1,35 @@
+#include "./kernel_timings.hpp"
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+
+// NOTE: kernels can be called from worker threads in native builds such as batch_solver
+static std::mutex g_timings_mutex;
+static std::vector<Kernel_Timing> g_timings;
+
+void record_kernel_timing(const char* name, double elapsed_ms) {
+    auto lock = std::unique_lock<std::mutex>(g_timings_mutex);
+    auto it = std::find_if(g_timings.begin(), g_timings.end(), [&](const Kernel_Timing& timing) {
+        return strcmp(timing.name.c_str(), name) == 0;
+    });
+    if (it == g_timings.end()) {
+        Kernel_Timing timing;
+        timing.name = name;
+        g_timings.push_back(std::move(timing));
+        it = g_timings.end()-1;
+    }
+    it->total_calls += 1.0;
+    it->total_ms += elapsed_ms;
+    it->last_ms = elapsed_ms;
+    it->max_ms = std::max(it->max_ms, elapsed_ms);
+}
+
+std::vector<Kernel_Timing> get_kernel_timings() {
+    auto lock = std::unique_lock<std::mutex>(g_timings_mutex);
+    return g_timings;
+}
+
+void reset_kernel_timings() {
+    auto lock = std::unique_lock<std::mutex>(g_timings_mutex);
+    g_timings.clear();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Wall clock timings of native kernels which are otherwise opaque spans in the profiler
+// - Each kernel records into a named entry in the order it was first called
+// - Callers read the timings after a run and reset them before the next one
+// NOTE: counts are doubles since embind has no 64bit integers without BigInt
+struct Kernel_Timing {
+    std::string name;
+    double total_calls = 0.0;
+    double total_ms = 0.0;
+    double last_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+void record_kernel_timing(const char* name, double elapsed_ms);
+std::vector<Kernel_Timing> get_kernel_timings();
+void reset_kernel_timings();
+
+// Records the lifetime of the scope under name which must be a string literal
+class Kernel_Timer
+{
+private:
+    const char* m_name;
+    std::chrono::steady_clock::time_point m_start;
+public:
+    explicit Kernel_Timer(const char* name): m_name(name), m_start(std::chrono::steady_clock::now()) {}
+    ~Kernel_Timer() { record_kernel_timing(m_name, get_elapsed_ms()); }
+    Kernel_Timer(const Kernel_Timer&) = delete;
+    Kernel_Timer& operator=(const Kernel_Timer&) = delete;
+    double get_elapsed_ms() const {
+        const auto elapsed = std::chrono::steady_clock::now() - m_start;
+        return std::chrono::duration<double, std::milli>(elapsed).count();
+    }
+};
@@ -0,0 +1,139 @@
+#include "./laplace_matrix.hpp"
+#include "./kernel_timings.hpp"
+
+// Creating the following constraint for cell at [y,x]
+// div(E)[y,x] = (Ex[y,x]-Ex[y,x-1])/(dx[x]+dx[x-1]) +
+//               (Ey[y,x]-Ey[y-1,x])/(dy[y]+dy[y-1])
+// div(E)[y,x] = 0
+//
+// Ex[y,x] = -(V[y,x+1]-V[y,x])/dx[x]
+// Ey[y,x] = -(V[y+1,x]-V[y,x])/dy[y]
+//
+// substituting into div(E)[y,x] = 0
+// div(E)[y,x] = - (V[y,x+1]/dx[x+0])/(dx[x]+dx[x-1]) # Ex[y,x]
+//               + (V[y,x+0]/dx[x+0])/(dx[x]+dx[x-1]) # Ex[y,x]
+//               + (V[y,x+0]/dx[x-1])/(dx[x]+dx[x-1]) # Ex[y,x-1]
+//               - (V[y,x-1]/dx[x-1])/(dx[x]+dx[x-1]) # Ex[y,x-1]
+//               - (V[y+1,x]/dy[y+0])/(dy[y]+dy[y-1]) # Ey[y,x]
+//               + (V[y+0,x]/dy[y+0])/(dy[y]+dy[y-1]) # Ey[y,x]
+//               + (V[y+0,x]/dy[y-1])/(dy[y]+dy[y-1]) # Ey[y-1,x]
+//               - (V[y-1,x]/dy[y-1])/(dy[y]+dy[y-1]) # Ey[y-1,x]
+// div(E)[y,x] = 0
+//
+// This gives us a row for our constraint matrix A and target value b
+// these are the possible columns that are set in a row inside A
+// di = -(Nx+1), -1, 0, +1, +(Nx+1)
+//
+// Cells with a forced voltage (beta > 0.5) or cells on the corners of the grid
+// have no div(E) constraint and are given an identity row instead
+static inline bool is_fixed_voltage(uint32_t index_beta) {
+    const float beta = float(index_beta & 0xFFFF) / float(0xFFFF);
+    return beta > 0.5f;
+}
+
+CSR_Matrix create_laplace_csr_matrix(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+) {
+    const auto timer = Kernel_Timer("laplace_matrix");
+    const int Nx = dx_arr.get_length();
+    const int Ny = dy_arr.get_length();
+    const int total_voltages = (Nx+1)*(Ny+1);
+
+    CSR_Matrix A;
+    A.total_rows = total_voltages;
+    A.total_cols = total_voltages;
+
+    // first pass: count exact number of non-zero entries per row so buffers are allocated once
+    A.row_index_ptr.resize(total_voltages+1);
+    int32_t total_non_zero = 0;
+    for (int y = 0; y < Ny+1; y++) {
+        const bool is_y_inner = (y > 0 && y < Ny);
+        for (int x = 0; x < Nx+1; x++) {
+            const int iv = x + y*(Nx+1);
+            A.row_index_ptr[iv] = total_non_zero;
+            const bool is_x_inner = (x > 0 && x < Nx);
+            if (is_fixed_voltage(v_index_beta[iv]) || !(is_x_inner || is_y_inner)) {
+                total_non_zero += 1;
+                continue;
+            }
+            total_non_zero += 1 + (is_x_inner ? 2 : 0) + (is_y_inner ? 2 : 0);
+        }
+    }
+    A.row_index_ptr[total_voltages] = total_non_zero;
+    A.non_zero_data.resize(total_non_zero);
+    A.col_indices.resize(total_non_zero);
+
+    // second pass: fill in place with columns in ascending order
+    float* data = A.non_zero_data.data();
+    int32_t* cols = A.col_indices.data();
+    for (int y = 0; y < Ny+1; y++) {
+        const bool is_y_inner = (y > 0 && y < Ny);
+        for (int x = 0; x < Nx+1; x++) {
+            const int iv = x + y*(Nx+1);
+            int32_t i = A.row_index_ptr[iv];
+            const bool is_x_inner = (x > 0 && x < Nx);
+            if (is_fixed_voltage(v_index_beta[iv]) || !(is_x_inner || is_y_inner)) {
+                data[i] = 1.0f;
+                cols[i] = iv;
+                continue;
+            }
+
+            float v_dx0 = 0.0f, v_dx1 = 0.0f;
+            float v_dy0 = 0.0f, v_dy1 = 0.0f;
+            float v_center = 0.0f;
+            // div(Ex) = 0
+            if (is_x_inner) {
+                const float dx_0 = dx_arr[x-1];
+                const float dx_1 = dx_arr[x];
+                const float norm = dx_0+dx_1;
+                v_dx0 = -(1.0f/dx_0)/norm;
+                v_center += (1.0f/dx_0 + 1.0f/dx_1)/norm;
+                v_dx1 = -(1.0f/dx_1)/norm;
+            }
+            // div(Ey) = 0
+            if (is_y_inner) {
+                const float dy_0 = dy_arr[y-1];
+                const float dy_1 = dy_arr[y];
+                const float norm = dy_0+dy_1;
+                v_dy0 = -(1.0f/dy_0)/norm;
+                v_center += (1.0f/dy_0 + 1.0f/dy_1)/norm;
+                v_dy1 = -(1.0f/dy_1)/norm;
+            }
+
+            if (is_y_inner) { data[i] = v_dy0; cols[i] = iv-(Nx+1); i++; }
+            if (is_x_inner) { data[i] = v_dx0; cols[i] = iv-1; i++; }
+            data[i] = v_center; cols[i] = iv; i++;
+            if (is_x_inner) { data[i] = v_dx1; cols[i] = iv+1; i++; }
+            if (is_y_inner) { data[i] = v_dy1; cols[i] = iv+(Nx+1); i++; }
+        }
+    }
+    return A;
+}
+
+int32_t create_laplace_rhs(
+    TypedPinnedArray<float> B_out,
+    TypedPinnedArray<uint32_t> v_index_beta,
+    TypedPinnedArray<float> v_tables, int total_rhs
+) {
+    const auto timer = Kernel_Timer("laplace_rhs");
+    const int total_voltages = v_index_beta.get_length();
+    if (total_rhs <= 0 || B_out.get_length() != total_voltages*total_rhs) return LAPLACE_INVALID_SHAPE;
+    if (v_tables.get_length() % total_rhs != 0) return LAPLACE_INVALID_SHAPE;
+    const int table_length = v_tables.get_length() / total_rhs;
+    // invalid indices are zeroed and reported after the fill so the loop stays branch free
+    bool is_invalid = false;
+    for (int k = 0; k < total_rhs; k++) {
+        const float* v_table = v_tables.get_data() + k*table_length;
+        float* B = B_out.get_data() + k*total_voltages;
+        for (int i = 0; i < total_voltages; i++) {
+            const uint32_t index_beta = v_index_beta[i];
+            const int index = int(index_beta >> 16);
+            const bool is_fixed = is_fixed_voltage(index_beta);
+            const bool is_valid = index < table_length;
+            is_invalid = is_invalid || (is_fixed && !is_valid);
+            B[i] = (is_fixed && is_valid) ? v_table[index] : 0.0f;
+        }
+    }
+    return is_invalid ? LAPLACE_INVALID_INDEX : 0;
+}
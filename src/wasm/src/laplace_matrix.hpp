@@ -0,0 +1,31 @@
+#pragma once
+
+#include "./PinnedArray.hpp"
+#include <stdint.h>
+#include <vector>
+
+struct CSR_Matrix {
+    std::vector<float> non_zero_data;
+    std::vector<int32_t> col_indices;
+    std::vector<int32_t> row_index_ptr;
+    int total_rows = 0;
+    int total_cols = 0;
+};
+
+CSR_Matrix create_laplace_csr_matrix(
+    TypedPinnedArray<float> dx_arr, TypedPinnedArray<float> dy_arr,
+    TypedPinnedArray<uint32_t> v_index_beta
+);
+
+// returned by create_laplace_rhs() if total_rhs <= 0 or B_out and v_tables do not have k columns
+constexpr int32_t LAPLACE_INVALID_SHAPE = -1;
+// returned by create_laplace_rhs() if a forced voltage has an index outside of the v_table
+constexpr int32_t LAPLACE_INVALID_INDEX = -2;
+
+// Fill k columns of B (column-major) with the forcing voltages of each v_table
+// v_tables has shape [k, table_length] and B has shape [k, (Ny+1)*(Nx+1)]
+int32_t create_laplace_rhs(
+    TypedPinnedArray<float> B_out,
+    TypedPinnedArray<uint32_t> v_index_beta,
+    TypedPinnedArray<float> v_tables, int total_rhs
+);
@@ -1,9 +1,22 @@
 #include <emscripten/bind.h>
 #include "./PinnedArray.hpp"
+#include "./pinned_pool.hpp"
 #include "./LU_Solver.hpp"
+#include "./Cholesky_Solver.hpp"
+#include "./Mirror_Solver.hpp"
+#include "./Iterative_Solver.hpp"
+#include "./Multigrid_Solver.hpp"
+#include "./laplace_matrix.hpp"
 #include "./ZipFile.hpp"
+#include "./ZipStream.hpp"
 #include "./energy_integral.hpp"
+#include "./thread_pool.hpp"
 #include "./convert_f32_to_f16.hpp"
+#include "./conductor_matrix.hpp"
+#include "./FDTD_3D_Engine.hpp"
+#include "./rasterise_regions.hpp"
+#include "./grid_hash.hpp"
+#include "./kernel_timings.hpp"
 #include <memory>
 
 // SRC: https://emscripten.org/docs/porting/connecting_cpp_and_javascript/embind.html#classes
@@ -25,12 +38,136 @@ namespace emscripten {
                 "create(A_non_zero_data, A_col_indices, A_row_index_pointers, total_rows, total_columns)", 
                 &LU_Solver::create
             )
+            .class_function(
+                "create_from_grid(dx, dy, v_index_beta)",
+                &LU_Solver::create_from_grid
+            )
+            .function("refactor(A_non_zero_data, is_same_row_permutation)", &LU_Solver::refactor)
+            .function("refactor_from_grid(dx, dy, v_index_beta, is_same_row_permutation)", &LU_Solver::refactor_from_grid)
             .function("solve(b)", &LU_Solver::solve)
+            .function("solve_many(B, total_rhs)", &LU_Solver::solve_many)
+            .function("get_stats()", &LU_Solver::get_stats)
             .property("total_rows", &LU_Solver::get_total_rows, return_value_policy::reference())
             .property("total_cols", &LU_Solver::get_total_cols, return_value_policy::reference());
         value_object<LU_Solver::Create_Result>("LU_Solver_Create_Result")
             .field("solver", &LU_Solver::Create_Result::solver)
             .field("lu_factor_info", &LU_Solver::Create_Result::lu_factor_info);
+        value_object<LU_Solver::Stats>("LU_Solver_Stats")
+            .field("total_rows", &LU_Solver::Stats::total_rows)
+            .field("A_non_zeros", &LU_Solver::Stats::A_non_zeros)
+            .field("L_non_zeros", &LU_Solver::Stats::L_non_zeros)
+            .field("U_non_zeros", &LU_Solver::Stats::U_non_zeros)
+            .field("total_supernodes", &LU_Solver::Stats::total_supernodes)
+            .field("factor_flops", &LU_Solver::Stats::factor_flops)
+            .field("solve_flops", &LU_Solver::Stats::solve_flops)
+            .field("ordering_ms", &LU_Solver::Stats::ordering_ms)
+            .field("factor_ms", &LU_Solver::Stats::factor_ms)
+            .field("solve_ms", &LU_Solver::Stats::solve_ms)
+            .field("total_factorisations", &LU_Solver::Stats::total_factorisations)
+            .field("total_solves", &LU_Solver::Stats::total_solves)
+            .field("tiny_pivots", &LU_Solver::Stats::tiny_pivots)
+            .field("memory_expansions", &LU_Solver::Stats::memory_expansions)
+            .field("lu_bytes", &LU_Solver::Stats::lu_bytes)
+            .field("total_bytes", &LU_Solver::Stats::total_bytes);
+        class_<Cholesky_Solver>("Cholesky_Solver")
+            .smart_ptr<std::shared_ptr<Cholesky_Solver>>("Cholesky_Solver")
+            .class_function(
+                "create_from_grid(dx, dy, v_index_beta)",
+                &Cholesky_Solver::create_from_grid
+            )
+            .function("refactor_from_grid(dx, dy, v_index_beta)", &Cholesky_Solver::refactor_from_grid)
+            .function("solve(b)", &Cholesky_Solver::solve)
+            .function("solve_many(B, total_rhs)", &Cholesky_Solver::solve_many)
+            .function("get_stats()", &Cholesky_Solver::get_stats)
+            .property("total_rows", &Cholesky_Solver::get_total_rows, return_value_policy::reference())
+            .property("total_cols", &Cholesky_Solver::get_total_cols, return_value_policy::reference());
+        value_object<Cholesky_Solver::Create_Result>("Cholesky_Solver_Create_Result")
+            .field("solver", &Cholesky_Solver::Create_Result::solver)
+            .field("factor_info", &Cholesky_Solver::Create_Result::factor_info);
+        value_object<Cholesky_Solver::Stats>("Cholesky_Solver_Stats")
+            .field("total_rows", &Cholesky_Solver::Stats::total_rows)
+            .field("reduced_rows", &Cholesky_Solver::Stats::reduced_rows)
+            .field("A_non_zeros", &Cholesky_Solver::Stats::A_non_zeros)
+            .field("L_non_zeros", &Cholesky_Solver::Stats::L_non_zeros)
+            .field("factor_flops", &Cholesky_Solver::Stats::factor_flops)
+            .field("ordering_ms", &Cholesky_Solver::Stats::ordering_ms)
+            .field("factor_ms", &Cholesky_Solver::Stats::factor_ms)
+            .field("solve_ms", &Cholesky_Solver::Stats::solve_ms)
+            .field("total_factorisations", &Cholesky_Solver::Stats::total_factorisations)
+            .field("total_solves", &Cholesky_Solver::Stats::total_solves)
+            .field("factor_bytes", &Cholesky_Solver::Stats::factor_bytes);
+        class_<Mirror_Solver>("Mirror_Solver")
+            .smart_ptr<std::shared_ptr<Mirror_Solver>>("Mirror_Solver")
+            .class_function("find_axis(dx, v_index_beta)", &Mirror_Solver::find_axis)
+            .class_function(
+                "create_from_grid(dx, dy, v_index_beta)",
+                &Mirror_Solver::create_from_grid
+            )
+            .function("refactor_from_grid(dx, dy, v_index_beta)", &Mirror_Solver::refactor_from_grid)
+            .function("solve(b)", &Mirror_Solver::solve)
+            .function("solve_many(B, total_rhs)", &Mirror_Solver::solve_many)
+            .function("get_stats()", &Mirror_Solver::get_stats)
+            .property("axis", &Mirror_Solver::get_axis)
+            .property("has_odd_solver", &Mirror_Solver::get_has_odd_solver)
+            .property("total_rows", &Mirror_Solver::get_total_rows, return_value_policy::reference())
+            .property("total_cols", &Mirror_Solver::get_total_cols, return_value_policy::reference());
+        value_object<Mirror_Solver::Create_Result>("Mirror_Solver_Create_Result")
+            .field("solver", &Mirror_Solver::Create_Result::solver)
+            .field("create_info", &Mirror_Solver::Create_Result::create_info);
+        class_<Iterative_Solver>("Iterative_Solver")
+            .smart_ptr<std::shared_ptr<Iterative_Solver>>("Iterative_Solver")
+            .class_function(
+                "create(A_non_zero_data, A_col_indices, A_row_index_pointers, total_rows, total_columns)",
+                &Iterative_Solver::create
+            )
+            .class_function(
+                "create_from_grid(dx, dy, v_index_beta)",
+                &Iterative_Solver::create_from_grid
+            )
+            .function("solve(b)", &Iterative_Solver::solve)
+            .function("solve_many(B, total_rhs)", &Iterative_Solver::solve_many)
+            .function("set_initial_guess(X, total_rhs)", &Iterative_Solver::set_initial_guess)
+            .property("tolerance", &Iterative_Solver::get_tolerance, &Iterative_Solver::set_tolerance)
+            .property("max_iterations", &Iterative_Solver::get_max_iterations, &Iterative_Solver::set_max_iterations)
+            .property("last_iterations", &Iterative_Solver::get_last_iterations)
+            .property("last_relative_residual", &Iterative_Solver::get_last_relative_residual)
+            .property("total_rows", &Iterative_Solver::get_total_rows)
+            .property("total_cols", &Iterative_Solver::get_total_cols);
+        value_object<Iterative_Solver::Create_Result>("Iterative_Solver_Create_Result")
+            .field("solver", &Iterative_Solver::Create_Result::solver)
+            .field("ilu_factor_info", &Iterative_Solver::Create_Result::ilu_factor_info);
+        class_<Multigrid_Solver>("Multigrid_Solver")
+            .smart_ptr<std::shared_ptr<Multigrid_Solver>>("Multigrid_Solver")
+            .class_function(
+                "create_from_grid(dx, dy, v_index_beta)",
+                &Multigrid_Solver::create_from_grid
+            )
+            .function("solve(b)", &Multigrid_Solver::solve)
+            .function("solve_many(B, total_rhs)", &Multigrid_Solver::solve_many)
+            .function("set_initial_guess(X, total_rhs)", &Multigrid_Solver::set_initial_guess)
+            .property("tolerance", &Multigrid_Solver::get_tolerance, &Multigrid_Solver::set_tolerance)
+            .property("max_cycles", &Multigrid_Solver::get_max_cycles, &Multigrid_Solver::set_max_cycles)
+            .property("last_cycles", &Multigrid_Solver::get_last_cycles)
+            .property("last_relative_residual", &Multigrid_Solver::get_last_relative_residual)
+            .property("total_levels", &Multigrid_Solver::get_total_levels)
+            .property("total_rows", &Multigrid_Solver::get_total_rows)
+            .property("total_cols", &Multigrid_Solver::get_total_cols);
+        value_object<Multigrid_Solver::Create_Result>("Multigrid_Solver_Create_Result")
+            .field("solver", &Multigrid_Solver::Create_Result::solver)
+            .field("create_info", &Multigrid_Solver::Create_Result::create_info);
+        class_<FDTD_3D_Engine>("FDTD_3D_Engine")
+            .smart_ptr<std::shared_ptr<FDTD_3D_Engine>>("FDTD_3D_Engine")
+            .class_function("create(size_x, size_y, size_z)", &FDTD_3D_Engine::create)
+            .function(
+                "add_source(offset_x, offset_y, offset_z, size_x, size_y, size_z, signal)",
+                &FDTD_3D_Engine::add_source
+            )
+            .function("clear_sources()", &FDTD_3D_Engine::clear_sources)
+            .function("step(E, H, A0, A1, b0, timestep, total_steps)", &FDTD_3D_Engine::step)
+            .property("time_block", &FDTD_3D_Engine::get_time_block)
+            .property("max_time_block", &FDTD_3D_Engine::get_max_time_block, &FDTD_3D_Engine::set_max_time_block)
+            .property("cache_size_bytes", &FDTD_3D_Engine::get_cache_size_bytes, &FDTD_3D_Engine::set_cache_size_bytes)
+            .property("total_sources", &FDTD_3D_Engine::get_total_sources);
         class_<PinnedArray>("PinnedArray")
             .smart_ptr<std::shared_ptr<PinnedArray>>("PinnedArray")
             .class_function("owned_pin_from_malloc(length)", &PinnedArray::owned_pin_from_malloc)
@@ -45,6 +182,17 @@ namespace emscripten {
             )
             .function("write_file(name, data)", &ZipFile::write_file)
             .function("get_bytes()", &ZipFile::get_bytes);
+        class_<ZipStream>("ZipStream")
+            .smart_ptr<std::shared_ptr<ZipStream>>("ZipStream")
+            .class_function("create()", &ZipStream::create)
+            .function("add_entry(name, data, level)", &ZipStream::add_entry)
+            .function("add_npy_entry(name, data, descr, shape, level)", &ZipStream::add_npy_entry)
+            .function("finish()", &ZipStream::finish)
+            .function("read_chunk()", &ZipStream::read_chunk)
+            .property("is_done", &ZipStream::get_is_done)
+            .property("error", &ZipStream::get_error)
+            .property("total_bytes_written", &ZipStream::get_total_bytes_written)
+            .property("block_size", &ZipStream::get_block_size, &ZipStream::set_block_size);
         BIND_TYPED_PINNED_ARRAY("Int8", int8_t);
         BIND_TYPED_PINNED_ARRAY("Uint8", uint8_t);
         BIND_TYPED_PINNED_ARRAY("Int16", int16_t);
@@ -56,6 +204,66 @@ namespace emscripten {
         function("calculate_homogenous_energy_2d(ex_field, ey_field, dx, dy)", &calculate_homogenous_energy_2d);
         function("calculate_inhomogenous_energy_2d(ex_field, ey_field, dx, dy, er_table, er_index_beta)", &calculate_inhomogenous_energy_2d);
         function("calculate_e_field(ex_field_out, ey_field_out, v_field_in, dx_in, dy_in)", &calculate_e_field);
+        value_object<Energy_2D>("Energy_2D")
+            .field("homogenous", &Energy_2D::homogenous)
+            .field("inhomogenous", &Energy_2D::inhomogenous);
+        function("calculate_energy_2d(v_field, dx, dy, er_table, er_index_beta)", &calculate_energy_2d);
+        function(
+            "calculate_energy_matrix_2d(homogenous_out, inhomogenous_out, v_fields, dx, dy, er_table, er_index_beta)",
+            &calculate_energy_matrix_2d
+        );
+        function(
+            "calculate_partial_energy_matrix_2d(homogenous_out, partial_out, v_fields, dx, dy, er_index_beta)",
+            &calculate_partial_energy_matrix_2d
+        );
+        function(
+            "calculate_energy_error_2d(error_out, v_field, dx, dy, er_table, er_index_beta)",
+            &calculate_energy_error_2d
+        );
+        function(
+            "calculate_conductor_matrices(Ch_out, Cih_out, Lh_out, energy_homogenous, energy_inhomogenous)",
+            &calculate_conductor_matrices
+        );
+        function(
+            "calculate_modal_impedances(Z0_out, velocity_out, vectors_out, Lh, Cih)",
+            &calculate_modal_impedances
+        );
+        function(
+            "extract_conductor_matrices(Ch_out, Cih_out, Lh_out, v_fields_out, solver, conductor_indices, v_index_beta, dx, dy, er_table, er_index_beta)",
+            &extract_conductor_matrices
+        );
         function("convert_f32_to_f16(f32_in, f16_out)", &convert_f32_to_f16);
+        function("pack_index_beta_f16(f16_out, table, index_beta)", &pack_index_beta_f16);
+        function("pack_xy_components_f16(f16_out, x_data, y_data, Nx, Ny)", &pack_xy_components_f16);
+        value_object<Pinned_Pool_Stats>("Pinned_Pool_Stats")
+            .field("live_bytes", &Pinned_Pool_Stats::live_bytes)
+            .field("live_class_bytes", &Pinned_Pool_Stats::live_class_bytes)
+            .field("cached_bytes", &Pinned_Pool_Stats::cached_bytes)
+            .field("peak_bytes", &Pinned_Pool_Stats::peak_bytes)
+            .field("total_allocations", &Pinned_Pool_Stats::total_allocations)
+            .field("total_reuses", &Pinned_Pool_Stats::total_reuses)
+            .field("heap_size", &Pinned_Pool_Stats::heap_size)
+            .field("peak_heap_size", &Pinned_Pool_Stats::peak_heap_size)
+            .field("heap_free_bytes", &Pinned_Pool_Stats::heap_free_bytes)
+            .field("internal_fragmentation", &Pinned_Pool_Stats::internal_fragmentation)
+            .field("heap_fragmentation", &Pinned_Pool_Stats::heap_fragmentation);
+        function("get_pinned_pool_stats()", &get_pinned_pool_stats);
+        value_object<Kernel_Timing>("Kernel_Timing")
+            .field("name", &Kernel_Timing::name)
+            .field("total_calls", &Kernel_Timing::total_calls)
+            .field("total_ms", &Kernel_Timing::total_ms)
+            .field("last_ms", &Kernel_Timing::last_ms)
+            .field("max_ms", &Kernel_Timing::max_ms);
+        register_vector<Kernel_Timing>("Kernel_Timing_Vector");
+        function("get_kernel_timings()", &get_kernel_timings);
+        function("reset_kernel_timings()", &reset_kernel_timings);
+        function("trim_pinned_pool()", &trim_pinned_pool);
+        function("get_pinned_pool_max_cached_bytes()", &get_pinned_pool_max_cached_bytes);
+        function("set_pinned_pool_max_cached_bytes(max_cached_bytes)", &set_pinned_pool_max_cached_bytes);
+        function("get_total_threads()", &get_total_threads);
+        function("set_total_threads(total_threads)", &set_total_threads);
+        function("create_laplace_rhs(B_out, v_index_beta, v_tables, total_rhs)", &create_laplace_rhs);
+        function("rasterise_regions(ek_index_beta, v_index_beta, dx, dy, primitives)", &rasterise_regions);
+        function("hash_grid_inputs(dx, dy, v_index_beta, ek_table, ek_index_beta)", &hash_grid_inputs);
     }
 }
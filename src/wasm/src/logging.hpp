@@ -2,6 +2,10 @@
 
 #if(NDEBUG)
 #define MODULE_LOG(...)
+#elif(MODULE_LOG_TO_STDERR)
+// native executables keep stdout for their results
+#include <stdio.h>
+#define MODULE_LOG(...) fprintf(stderr, __VA_ARGS__)
 #else
 #include <stdio.h>
 #define MODULE_LOG(...) printf(__VA_ARGS__)
@@ -0,0 +1,197 @@
+#include "./pinned_pool.hpp"
+#include "./logging.hpp"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__EMSCRIPTEN__)
+#include <emscripten/heap.h>
+#include <malloc.h>
+#endif
+
+// smallest size class and the number of size classes between each power of two
+static constexpr size_t MIN_CLASS_SIZE = 64;
+static constexpr int CLASSES_PER_OCTAVE_LOG2 = 2;
+static constexpr double DEFAULT_MAX_CACHED_BYTES = 128.0*1024.0*1024.0;
+// NOTE: calloc never fails with ALLOW_MEMORY_GROWTH since the heap grows instead, so the cache is also
+//       bounded by the buffers in use. A grid rebuild allocates the new grid before freeing the old one,
+//       so a cache the size of the live set is enough to reuse every buffer of the next rebuild.
+static constexpr double MAX_CACHED_TO_LIVE_RATIO = 1.0;
+
+// round length up to the next size class
+// - lengths in (2^k, 2^(k+1)] are split into 4 steps of 2^(k-2)
+static size_t get_class_size(size_t length) {
+    if (length <= MIN_CLASS_SIZE) return MIN_CLASS_SIZE;
+    int octave = 0;
+    while ((size_t(1) << (octave+1)) < length) octave++;
+    const size_t base = size_t(1) << octave;
+    const size_t step = base >> CLASSES_PER_OCTAVE_LOG2;
+    return base + ((length-base+step-1)/step)*step;
+}
+
+class Pinned_Pool
+{
+private:
+    std::mutex m_mutex;
+    std::unordered_map<size_t, std::vector<void*>> m_free_lists;
+    double m_max_cached_bytes = DEFAULT_MAX_CACHED_BYTES;
+    size_t m_live_bytes = 0;
+    size_t m_live_class_bytes = 0;
+    size_t m_cached_bytes = 0;
+    size_t m_peak_bytes = 0;
+    uint64_t m_total_allocations = 0;
+    uint64_t m_total_reuses = 0;
+    size_t m_peak_heap_size = 0;
+private:
+    void update_peaks() {
+        m_peak_bytes = std::max(m_peak_bytes, m_live_class_bytes+m_cached_bytes);
+        #if defined(__EMSCRIPTEN__)
+        m_peak_heap_size = std::max(m_peak_heap_size, emscripten_get_heap_size());
+        #endif
+    }
+    // caller holds m_mutex
+    size_t get_cache_limit() const {
+        const double live_limit = double(m_live_class_bytes)*MAX_CACHED_TO_LIVE_RATIO;
+        return size_t(std::min(m_max_cached_bytes, live_limit));
+    }
+    // caller holds m_mutex
+    void release_cached(size_t target_cached_bytes) {
+        for (auto& [class_size, free_list]: m_free_lists) {
+            while (m_cached_bytes > target_cached_bytes && !free_list.empty()) {
+                free(free_list.back());
+                free_list.pop_back();
+                m_cached_bytes -= class_size;
+            }
+        }
+    }
+public:
+    void* allocate(size_t length) {
+        const size_t class_size = get_class_size(length);
+        void* data = nullptr;
+        {
+            auto lock = std::unique_lock<std::mutex>(m_mutex);
+            m_total_allocations++;
+            auto it = m_free_lists.find(class_size);
+            if (it != m_free_lists.end() && !it->second.empty()) {
+                data = it->second.back();
+                it->second.pop_back();
+                m_cached_bytes -= class_size;
+                m_total_reuses++;
+            }
+            if (data != nullptr) {
+                m_live_bytes += length;
+                m_live_class_bytes += class_size;
+            }
+        }
+        if (data != nullptr) {
+            memset(data, 0, length);
+            return data;
+        }
+
+        data = calloc(class_size, 1);
+        if (data == nullptr) {
+            // heap may be exhausted by cached buffers of other size classes
+            trim();
+            data = calloc(class_size, 1);
+            if (data == nullptr) return nullptr;
+        }
+        auto lock = std::unique_lock<std::mutex>(m_mutex);
+        m_live_bytes += length;
+        m_live_class_bytes += class_size;
+        update_peaks();
+        return data;
+    }
+
+    void release(void* data, size_t length) {
+        if (data == nullptr) return;
+        const size_t class_size = get_class_size(length);
+        auto lock = std::unique_lock<std::mutex>(m_mutex);
+        m_live_bytes -= length;
+        m_live_class_bytes -= class_size;
+        const size_t cache_limit = get_cache_limit();
+        if (m_cached_bytes+class_size > cache_limit) {
+            MODULE_LOG("Pinned pool is full, freeing buffer at addr=%p, len=%zu\n", data, length);
+            free(data);
+            // live set shrank so older cached buffers may be over the limit as well
+            release_cached(cache_limit);
+            return;
+        }
+        m_free_lists[class_size].push_back(data);
+        m_cached_bytes += class_size;
+    }
+
+    void trim() {
+        auto lock = std::unique_lock<std::mutex>(m_mutex);
+        release_cached(0);
+    }
+
+    double get_max_cached_bytes() {
+        auto lock = std::unique_lock<std::mutex>(m_mutex);
+        return m_max_cached_bytes;
+    }
+
+    void set_max_cached_bytes(double max_cached_bytes) {
+        auto lock = std::unique_lock<std::mutex>(m_mutex);
+        m_max_cached_bytes = std::max(max_cached_bytes, 0.0);
+        release_cached(get_cache_limit());
+    }
+
+    Pinned_Pool_Stats get_stats() {
+        auto lock = std::unique_lock<std::mutex>(m_mutex);
+        update_peaks();
+        Pinned_Pool_Stats stats;
+        stats.live_bytes = double(m_live_bytes);
+        stats.live_class_bytes = double(m_live_class_bytes);
+        stats.cached_bytes = double(m_cached_bytes);
+        stats.peak_bytes = double(m_peak_bytes);
+        stats.total_allocations = double(m_total_allocations);
+        stats.total_reuses = double(m_total_reuses);
+        #if defined(__EMSCRIPTEN__)
+        const struct mallinfo info = mallinfo();
+        stats.heap_size = double(emscripten_get_heap_size());
+        stats.peak_heap_size = double(m_peak_heap_size);
+        stats.heap_free_bytes = double(info.fordblks);
+        #endif
+        if (m_live_class_bytes > 0) {
+            stats.internal_fragmentation = 1.0 - double(m_live_bytes)/double(m_live_class_bytes);
+        }
+        if (stats.heap_size > 0.0) {
+            stats.heap_fragmentation = stats.heap_free_bytes/stats.heap_size;
+        }
+        return stats;
+    }
+};
+
+// NOTE: never destroyed since pinned arrays can be released by static destructors at exit
+static Pinned_Pool& get_pool() {
+    static Pinned_Pool* pool = new Pinned_Pool();
+    return *pool;
+}
+
+void* pinned_pool_allocate(size_t length) {
+    return get_pool().allocate(length);
+}
+
+void pinned_pool_release(void* data, size_t length) {
+    get_pool().release(data, length);
+}
+
+void trim_pinned_pool() {
+    get_pool().trim();
+}
+
+double get_pinned_pool_max_cached_bytes() {
+    return get_pool().get_max_cached_bytes();
+}
+
+void set_pinned_pool_max_cached_bytes(double max_cached_bytes) {
+    get_pool().set_max_cached_bytes(max_cached_bytes);
+}
+
+Pinned_Pool_Stats get_pinned_pool_stats() {
+    return get_pool().get_stats();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+// Size class pool behind PinnedArray::owned_pin_from_malloc() which reuses released buffers
+// - Every grid rebuild allocates and frees the same set of buffer shapes, which fragments the heap with
+//   ALLOW_MEMORY_GROWTH since the wasm heap can never shrink
+// - Lengths are rounded up to 4 size classes per power of two so internal waste is at most 25%
+// - Released buffers are kept on a free list per size class up to max_cached_bytes, then returned to malloc
+// - The cache is also capped to the bytes in use, so it drains as the live set is freed
+// - Buffers are zeroed on reuse so they behave the same as calloc
+void* pinned_pool_allocate(size_t length);
+void pinned_pool_release(void* data, size_t length);
+// return all cached buffers to malloc
+void trim_pinned_pool();
+double get_pinned_pool_max_cached_bytes();
+void set_pinned_pool_max_cached_bytes(double max_cached_bytes);
+
+// NOTE: byte counts are doubles since embind has no 64bit integers without BigInt
+struct Pinned_Pool_Stats {
+    double live_bytes = 0.0;            // requested length of buffers which are in use
+    double live_class_bytes = 0.0;      // size class length of buffers which are in use
+    double cached_bytes = 0.0;          // released buffers held for reuse
+    double peak_bytes = 0.0;            // high water of live_class_bytes+cached_bytes
+    double total_allocations = 0.0;
+    double total_reuses = 0.0;          // allocations served from a free list
+    double heap_size = 0.0;             // size of the wasm heap, 0 on native builds
+    double peak_heap_size = 0.0;        // high water of heap_size since the module was loaded
+    double heap_free_bytes = 0.0;       // bytes free inside malloc's arena, 0 on native builds
+    double internal_fragmentation = 0.0; // 1 - live_bytes/live_class_bytes
+    double heap_fragmentation = 0.0;    // heap_free_bytes/heap_size
+};
+
+Pinned_Pool_Stats get_pinned_pool_stats();
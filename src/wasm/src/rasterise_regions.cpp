@@ -0,0 +1,299 @@
+#include "./rasterise_regions.hpp"
+#include "./kernel_timings.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Port of the fill_*_sdf routines from views/stackup_2d/grid.ts
+// - Sample positions are computed in double exactly like the typescript version
+// - Sample points on region corners lie exactly on the slope so the comparisons are also kept in double,
+//   since rounding them to f32 would flip these ties and change the rasterised grid
+
+// x=0,y=0 is top left of the region in normalised coordinates
+enum class Slope {
+    BOTTOM_LEFT,    // y >= x
+    BOTTOM_RIGHT,   // y >= 1-x
+    TOP_LEFT,       // y <= 1-x
+    TOP_RIGHT,      // y <= x
+};
+
+struct Grid_Lines {
+    const double* segments;
+    std::vector<double> lines;
+    int total_segments;
+};
+
+static Grid_Lines create_grid_lines(TypedPinnedArray<double> segments) {
+    Grid_Lines grid;
+    grid.segments = segments.get_data();
+    grid.total_segments = segments.get_length();
+    grid.lines.resize(size_t(grid.total_segments+1));
+    double line = 0.0;
+    for (int i = 0; i < grid.total_segments; i++) {
+        grid.lines[size_t(i)] = line;
+        line += grid.segments[i];
+    }
+    grid.lines[size_t(grid.total_segments)] = line;
+    return grid;
+}
+
+static inline uint32_t pack_index_beta(uint32_t index, int total_samples) {
+    // same as Grid.pack_index_beta(index, total_samples/4)
+    return ((index & 0xFFFF) << 16) | uint32_t((0xFFFF*total_samples)/4);
+}
+
+// Sample positions of one axis of a region which are separable between x and y
+// - dielectric cells sample their corners from the center with offsets of half a cell
+// - voltage nodes sample half a cell either side of the node
+struct Axis_Samples {
+    std::vector<double> lo;
+    std::vector<double> hi;
+};
+
+static Axis_Samples get_axis_samples(
+    const Grid_Lines& grid, int g_start, int g_end, int total_nodes, bool is_voltage
+) {
+    Axis_Samples samples;
+    // normalised by the size of the region before extending voltage regions to include their boundary
+    const int g_segment_end = std::min(g_end, grid.total_segments);
+    double abs_size = 0.0;
+    for (int i = g_start; i < g_segment_end; i++) abs_size += grid.segments[i];
+    const int total_segments = g_segment_end-g_start;
+
+    if (is_voltage) g_end = std::min(total_nodes, g_end+1);
+    const int total = g_end-g_start;
+    if (total <= 0) return samples;
+    if (total_segments <= 0) {
+        // voltage region on the last grid line has no size so no samples are inside of it
+        // NOTE: the typescript version divided by zero here which also made every comparison fail
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        samples.lo.assign(size_t(total), nan);
+        samples.hi.assign(size_t(total), nan);
+        return samples;
+    }
+    const double origin = grid.lines[size_t(g_start)];
+    samples.lo.resize(size_t(total));
+    samples.hi.resize(size_t(total));
+    for (int i = 0; i < total; i++) {
+        const double norm_position = (grid.lines[size_t(g_start+i)]-origin)/abs_size;
+        // voltage nodes past the end of the region reuse the last segment
+        const int i_segment = std::min(i, total_segments-1);
+        const double norm_size = grid.segments[g_start+i_segment]/abs_size;
+        if (is_voltage) {
+            const double offset = norm_size/2;
+            samples.lo[size_t(i)] = norm_position-offset;
+            samples.hi[size_t(i)] = norm_position+offset;
+        } else {
+            const double offset = norm_size/2;
+            const double center = norm_position+offset;
+            samples.lo[size_t(i)] = center-offset;
+            samples.hi[size_t(i)] = center+offset;
+        }
+    }
+    return samples;
+}
+
+static void fill_constant(
+    uint32_t* data, int row_stride,
+    int gx_start, int gx_end, int gy_start, int gy_end,
+    uint32_t value
+) {
+    for (int y = gy_start; y < gy_end; y++) {
+        uint32_t* row = &data[y*row_stride];
+        std::fill(&row[gx_start], &row[gx_end], value);
+    }
+}
+
+// comparisons are branchless over precomputed sample positions so that they vectorise
+template <bool IS_GREATER>
+static inline int compare_sample(double lhs, double rhs) {
+    return IS_GREATER ? int(lhs >= rhs) : int(lhs <= rhs);
+}
+
+template <bool IS_GREATER>
+static void fill_slope_rows(
+    uint32_t* data, int row_stride, int gx_start, int gy_start,
+    const Axis_Samples& y_samples, const std::vector<double>& rhs_lo, const std::vector<double>& rhs_hi,
+    const uint32_t* packed_table
+) {
+    const int width = int(rhs_lo.size());
+    const int height = int(y_samples.lo.size());
+    for (int y = 0; y < height; y++) {
+        const double y_lo = y_samples.lo[size_t(y)];
+        const double y_hi = y_samples.hi[size_t(y)];
+        uint32_t* row = &data[(gy_start+y)*row_stride + gx_start];
+        for (int x = 0; x < width; x++) {
+            const double x_lo = rhs_lo[size_t(x)];
+            const double x_hi = rhs_hi[size_t(x)];
+            const int total_samples =
+                compare_sample<IS_GREATER>(y_lo, x_lo) + compare_sample<IS_GREATER>(y_lo, x_hi) +
+                compare_sample<IS_GREATER>(y_hi, x_lo) + compare_sample<IS_GREATER>(y_hi, x_hi);
+            row[x] = packed_table[total_samples];
+        }
+    }
+}
+
+static void fill_slope(
+    uint32_t* data, int row_stride,
+    int gx_start, int gy_start,
+    const Axis_Samples& x_samples, const Axis_Samples& y_samples,
+    uint32_t index, Slope slope
+) {
+    const int width = int(x_samples.lo.size());
+    const int height = int(y_samples.lo.size());
+    if (width == 0 || height == 0) return;
+
+    const bool is_flip_x = (slope == Slope::BOTTOM_RIGHT) || (slope == Slope::TOP_LEFT);
+    const bool is_greater = (slope == Slope::BOTTOM_LEFT) || (slope == Slope::BOTTOM_RIGHT);
+    // right hand side of the slope comparison for each x sample
+    std::vector<double> rhs_lo(static_cast<size_t>(width));
+    std::vector<double> rhs_hi(static_cast<size_t>(width));
+    for (int x = 0; x < width; x++) {
+        const double lo = x_samples.lo[size_t(x)];
+        const double hi = x_samples.hi[size_t(x)];
+        rhs_lo[size_t(x)] = is_flip_x ? 1.0-lo : lo;
+        rhs_hi[size_t(x)] = is_flip_x ? 1.0-hi : hi;
+    }
+
+    uint32_t packed_table[5];
+    for (int i = 0; i < 5; i++) packed_table[i] = pack_index_beta(index, i);
+
+    if (is_greater) {
+        fill_slope_rows<true>(data, row_stride, gx_start, gy_start, y_samples, rhs_lo, rhs_hi, packed_table);
+    } else {
+        fill_slope_rows<false>(data, row_stride, gx_start, gy_start, y_samples, rhs_lo, rhs_hi, packed_table);
+    }
+}
+
+struct Raster_Target {
+    uint32_t* data;
+    int Nx; // total columns
+    int Ny; // total rows
+    bool is_voltage;
+};
+
+static void fill_region_constant(
+    const Raster_Target& target,
+    int gx_start, int gx_end, int gy_start, int gy_end,
+    uint32_t index
+) {
+    // voltage regions include the boundary of the grid cell
+    if (target.is_voltage) {
+        gx_end = std::min(target.Nx, gx_end+1);
+        gy_end = std::min(target.Ny, gy_end+1);
+    }
+    fill_constant(target.data, target.Nx, gx_start, gx_end, gy_start, gy_end, pack_index_beta(index, 4));
+}
+
+static void fill_region_slope(
+    const Raster_Target& target, const Grid_Lines& x_grid, const Grid_Lines& y_grid,
+    int gx_start, int gx_end, int gy_start, int gy_end,
+    uint32_t index, Slope slope
+) {
+    const Axis_Samples x_samples = get_axis_samples(x_grid, gx_start, gx_end, target.Nx, target.is_voltage);
+    const Axis_Samples y_samples = get_axis_samples(y_grid, gy_start, gy_end, target.Ny, target.is_voltage);
+    fill_slope(target.data, target.Nx, gx_start, gy_start, x_samples, y_samples, index, slope);
+}
+
+static void fill_trapezoid(
+    const Raster_Target& target, const Grid_Lines& x_grid, const Grid_Lines& y_grid,
+    const int32_t* primitive, uint32_t index
+) {
+    const int gx_signal_left = primitive[3];
+    const int gx_taper_left = primitive[4];
+    const int gx_taper_right = primitive[5];
+    const int gx_signal_right = primitive[6];
+    const int gy_base = primitive[7];
+    const int gy_taper = primitive[8];
+    const int gy_start = std::min(gy_base, gy_taper);
+    int gy_end = std::max(gy_base, gy_taper);
+    const bool is_taper_down = gy_taper > gy_base;
+    const Slope left_slope = is_taper_down ? Slope::TOP_RIGHT : Slope::BOTTOM_RIGHT;
+    const Slope right_slope = is_taper_down ? Slope::TOP_LEFT : Slope::BOTTOM_LEFT;
+
+    if (target.is_voltage) {
+        // also set edge of region to voltage
+        gy_end = std::min(gy_end+1, target.Ny);
+        if (gx_signal_left < gx_taper_left) {
+            fill_region_slope(target, x_grid, y_grid, gx_signal_left, gx_taper_left, gy_start, gy_end, index, left_slope);
+        }
+        if (gx_taper_left <= gx_taper_right) {
+            fill_region_constant(target, gx_taper_left, gx_taper_right, gy_start, gy_end, index);
+        }
+        if (gx_taper_right < gx_signal_right) {
+            fill_region_slope(target, x_grid, y_grid, gx_taper_right, gx_signal_right, gy_start, gy_end, index, right_slope);
+        }
+    } else {
+        if (gy_start >= gy_end) return;
+        if (gx_signal_left < gx_taper_left) {
+            fill_region_slope(target, x_grid, y_grid, gx_signal_left, gx_taper_left, gy_start, gy_end, index, left_slope);
+        }
+        if (gx_taper_left < gx_taper_right) {
+            fill_region_constant(target, gx_taper_left, gx_taper_right, gy_start, gy_end, index);
+        }
+        if (gx_taper_right < gx_signal_right) {
+            fill_region_slope(target, x_grid, y_grid, gx_taper_right, gx_signal_right, gy_start, gy_end, index, right_slope);
+        }
+    }
+}
+
+static bool is_valid_primitive(const int32_t* primitive, int Nx, int Ny) {
+    const int32_t target = primitive[0];
+    const int32_t type = primitive[1];
+    if (target != REGION_TARGET_DIELECTRIC && target != REGION_TARGET_VOLTAGE) return false;
+    if (primitive[2] < 0 || primitive[2] > 0xFFFF) return false;
+    const auto is_x = [&](int32_t gx) { return gx >= 0 && gx <= Nx; };
+    const auto is_y = [&](int32_t gy) { return gy >= 0 && gy <= Ny; };
+    switch (type) {
+    case REGION_TYPE_PLANE:
+        return is_y(primitive[3]) && is_y(primitive[4]) && primitive[3] <= primitive[4];
+    case REGION_TYPE_TRAPEZOID:
+        return
+            is_x(primitive[3]) && is_x(primitive[4]) && is_x(primitive[5]) && is_x(primitive[6]) &&
+            is_y(primitive[7]) && is_y(primitive[8]);
+    default:
+        return false;
+    }
+}
+
+int32_t rasterise_regions(
+    TypedPinnedArray<uint32_t> ek_index_beta, TypedPinnedArray<uint32_t> v_index_beta,
+    TypedPinnedArray<double> dx, TypedPinnedArray<double> dy,
+    TypedPinnedArray<int32_t> primitives
+) {
+    const auto timer = Kernel_Timer("rasterise_regions");
+    const Grid_Lines x_grid = create_grid_lines(dx);
+    const Grid_Lines y_grid = create_grid_lines(dy);
+    const int Nx = x_grid.total_segments;
+    const int Ny = y_grid.total_segments;
+    const int total_primitives = primitives.get_length() / REGION_PRIMITIVE_STRIDE;
+    const int32_t* primitives_data = primitives.get_data();
+
+    for (int i = 0; i < total_primitives; i++) {
+        if (!is_valid_primitive(&primitives_data[i*REGION_PRIMITIVE_STRIDE], Nx, Ny)) {
+            return RASTERISE_INVALID_PRIMITIVE;
+        }
+    }
+
+    const Raster_Target dielectric_target = { ek_index_beta.get_data(), Nx, Ny, false };
+    const Raster_Target voltage_target = { v_index_beta.get_data(), Nx+1, Ny+1, true };
+
+    for (int i = 0; i < total_primitives; i++) {
+        const int32_t* primitive = &primitives_data[i*REGION_PRIMITIVE_STRIDE];
+        const Raster_Target& target = (primitive[0] == REGION_TARGET_VOLTAGE) ? voltage_target : dielectric_target;
+        const uint32_t index = uint32_t(primitive[2]);
+        switch (primitive[1]) {
+        case REGION_TYPE_PLANE: {
+            // planes span the whole width
+            fill_region_constant(target, 0, Nx, primitive[3], primitive[4], index);
+            break;
+        }
+        case REGION_TYPE_TRAPEZOID: {
+            fill_trapezoid(target, x_grid, y_grid, primitive, index);
+            break;
+        }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "./PinnedArray.hpp"
+#include <stdint.h>
+
+// Region primitives are rows of REGION_PRIMITIVE_STRIDE int32 in grid index space
+// - plane:     [target, REGION_TYPE_PLANE, index, gy_start, gy_end, 0, 0, 0, 0]
+// - trapezoid: [target, REGION_TYPE_TRAPEZOID, index, gx_signal_left, gx_taper_left, gx_taper_right, gx_signal_right, gy_base, gy_taper]
+// - target selects ek_index_beta[Ny,Nx] for dielectrics or v_index_beta[Ny+1,Nx+1] for voltages
+// - Primitives are drawn in order so later primitives overwrite earlier ones
+constexpr int32_t REGION_TARGET_DIELECTRIC = 0;
+constexpr int32_t REGION_TARGET_VOLTAGE = 1;
+constexpr int32_t REGION_TYPE_PLANE = 0;
+constexpr int32_t REGION_TYPE_TRAPEZOID = 1;
+constexpr int REGION_PRIMITIVE_STRIDE = 9;
+constexpr int32_t RASTERISE_INVALID_PRIMITIVE = -1;
+
+// dx/dy are the grid segments which are summed into grid lines the same way as RegionToGridMap
+// returns RASTERISE_INVALID_PRIMITIVE without drawing anything if a primitive is out of bounds
+int32_t rasterise_regions(
+    TypedPinnedArray<uint32_t> ek_index_beta, TypedPinnedArray<uint32_t> v_index_beta,
+    TypedPinnedArray<double> dx, TypedPinnedArray<double> dy,
+    TypedPinnedArray<int32_t> primitives
+);
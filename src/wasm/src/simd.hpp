@@ -0,0 +1,288 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// IEEE.754 f32 to f16 with round to nearest even, denormals, infinity and NaN
+// - f32: sign 1, exponent 8, mantissa 23, f16: sign 1, exponent 5, mantissa 10
+// - Denormals are rounded by the float adder by aligning them against a magic constant
+// - Normals round by adding half an ulp (minus one if the kept mantissa is even) before truncating
+//   which carries into the exponent and overflows to infinity correctly
+// SRC: https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne)
+namespace f16_consts {
+    constexpr uint32_t SIGN_MASK = 0x80000000u;
+    constexpr uint32_t F32_INFINITY = 255u << 23;
+    // smallest f32 which overflows f16
+    constexpr uint32_t F16_OVERFLOW = (127u + 16u) << 23;
+    // smallest f32 which is a normal f16
+    constexpr uint32_t F16_MIN_NORMAL = 113u << 23;
+    constexpr uint32_t DENORMAL_MAGIC = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    // exponent rebias of (15-127) done in unsigned arithmetic since shifting a negative value is not a constant expression
+    constexpr uint32_t NORMAL_BIAS = (uint32_t(15 - 127) << 23) + 0xFFFu;
+    constexpr uint32_t F16_INFINITY = 0x7C00u;
+    constexpr uint32_t F16_QUIET_NAN = 0x7E00u;
+}
+
+static inline uint16_t f32_to_f16(float x) {
+    using namespace f16_consts;
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    const uint32_t sign = bits & SIGN_MASK;
+    bits ^= sign;
+    uint32_t y;
+    if (bits >= F16_OVERFLOW) {
+        y = (bits > F32_INFINITY) ? F16_QUIET_NAN : F16_INFINITY;
+    } else if (bits < F16_MIN_NORMAL) {
+        float magic;
+        memcpy(&magic, &DENORMAL_MAGIC, sizeof(magic));
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        v += magic;
+        memcpy(&y, &v, sizeof(y));
+        y -= DENORMAL_MAGIC;
+    } else {
+        const uint32_t mantissa_odd = (bits >> 13) & 1;
+        y = (bits + NORMAL_BIAS + mantissa_odd) >> 13;
+    }
+    return uint16_t(y | (sign >> 16));
+}
+
+#if !defined(__wasm_simd128__) && defined(__SSE2__)
+#include <emmintrin.h>
+// f16 bits in the lower 16bits of each 32bit lane
+static inline __m128i f32x4_to_f16_bits_sse2(__m128 x) {
+    using namespace f16_consts;
+    const __m128i bits_signed = _mm_castps_si128(x);
+    const __m128i sign = _mm_and_si128(bits_signed, _mm_set1_epi32(int32_t(SIGN_MASK)));
+    const __m128i bits = _mm_xor_si128(bits_signed, sign);
+    // sign is cleared so signed compares are valid
+    const __m128i is_overflow = _mm_cmpgt_epi32(bits, _mm_set1_epi32(int32_t(F16_OVERFLOW-1)));
+    const __m128i is_nan = _mm_cmpgt_epi32(bits, _mm_set1_epi32(int32_t(F32_INFINITY)));
+    const __m128i is_denormal = _mm_cmplt_epi32(bits, _mm_set1_epi32(int32_t(F16_MIN_NORMAL)));
+    const __m128i overflow = _mm_or_si128(
+        _mm_set1_epi32(int32_t(F16_INFINITY)),
+        _mm_and_si128(is_nan, _mm_set1_epi32(int32_t(F16_QUIET_NAN ^ F16_INFINITY)))
+    );
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(int32_t(DENORMAL_MAGIC)));
+    const __m128i denormal = _mm_sub_epi32(
+        _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), magic)),
+        _mm_castps_si128(magic)
+    );
+    const __m128i mantissa_odd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+    const __m128i normal = _mm_srli_epi32(
+        _mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32(int32_t(NORMAL_BIAS))), mantissa_odd),
+        13
+    );
+    __m128i y = _mm_or_si128(_mm_and_si128(is_denormal, denormal), _mm_andnot_si128(is_denormal, normal));
+    y = _mm_or_si128(_mm_and_si128(is_overflow, overflow), _mm_andnot_si128(is_overflow, y));
+    return _mm_or_si128(y, _mm_srli_epi32(sign, 16));
+}
+
+static inline void f16_bits_store_sse2(uint16_t* y, __m128i x) {
+    // sign extend the lower 16bits so that the signed saturating pack is exact
+    const __m128i x_extended = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(y), _mm_packs_epi32(x_extended, x_extended));
+}
+
+static inline void f16_bits_store_x2_sse2(uint16_t* y, __m128i a, __m128i b) {
+    // little endian pairs of (a,b) are a single 32bit lane
+    const __m128i ab = _mm_or_si128(a, _mm_slli_epi32(b, 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y), ab);
+}
+#endif
+
+// Fixed width float vector used by the field kernels, selected at compile time
+// - wasm simd128 for the browser build (compiled with -msimd128)
+// - AVX or SSE2 for native builds
+// - Scalar fallback with a width of 1 if no vector extension is available
+// - All loads and stores are unaligned since rows of (Nx+1) wide fields have no fixed alignment
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SIMD_NAME "wasm_simd128"
+struct f32_vec {
+    static constexpr int WIDTH = 4;
+    v128_t v;
+    f32_vec() = default;
+    f32_vec(v128_t x): v(x) {}
+    f32_vec(float x): v(wasm_f32x4_splat(x)) {}
+};
+static inline f32_vec f32_vec_load(const float* x) { return wasm_v128_load(x); }
+static inline void f32_vec_store(float* y, f32_vec x) { wasm_v128_store(y, x.v); }
+static inline f32_vec operator+(f32_vec a, f32_vec b) { return wasm_f32x4_add(a.v, b.v); }
+static inline f32_vec operator-(f32_vec a, f32_vec b) { return wasm_f32x4_sub(a.v, b.v); }
+static inline f32_vec operator*(f32_vec a, f32_vec b) { return wasm_f32x4_mul(a.v, b.v); }
+static inline f32_vec operator/(f32_vec a, f32_vec b) { return wasm_f32x4_div(a.v, b.v); }
+// lower 16bits of packed index_beta as a float
+static inline f32_vec f32_vec_load_u16_lower(const uint32_t* x) {
+    const v128_t mask = wasm_i32x4_splat(0xFFFF);
+    return wasm_f32x4_convert_i32x4(wasm_v128_and(wasm_v128_load(x), mask));
+}
+// all bits set lanes of mask select a otherwise b
+static inline f32_vec f32_vec_load_mask(const uint32_t* x) { return wasm_v128_load(x); }
+static inline f32_vec f32_vec_select(f32_vec mask, f32_vec a, f32_vec b) { return wasm_v128_bitselect(a.v, b.v, mask.v); }
+static inline float f32_vec_reduce_add(f32_vec x) {
+    return (wasm_f32x4_extract_lane(x.v, 0) + wasm_f32x4_extract_lane(x.v, 1)) +
+           (wasm_f32x4_extract_lane(x.v, 2) + wasm_f32x4_extract_lane(x.v, 3));
+}
+// same as f32_to_f16() with the f16 bits in the lower 16bits of each 32bit lane
+static inline v128_t f32x4_to_f16_bits(v128_t x) {
+    using namespace f16_consts;
+    const v128_t sign = wasm_v128_and(x, wasm_i32x4_splat(int32_t(SIGN_MASK)));
+    const v128_t bits = wasm_v128_xor(x, sign);
+    const v128_t is_overflow = wasm_u32x4_ge(bits, wasm_i32x4_splat(int32_t(F16_OVERFLOW)));
+    const v128_t is_nan = wasm_u32x4_gt(bits, wasm_i32x4_splat(int32_t(F32_INFINITY)));
+    const v128_t is_denormal = wasm_u32x4_lt(bits, wasm_i32x4_splat(int32_t(F16_MIN_NORMAL)));
+    const v128_t overflow = wasm_v128_bitselect(
+        wasm_i32x4_splat(int32_t(F16_QUIET_NAN)), wasm_i32x4_splat(int32_t(F16_INFINITY)), is_nan
+    );
+    const v128_t magic = wasm_i32x4_splat(int32_t(DENORMAL_MAGIC));
+    const v128_t denormal = wasm_i32x4_sub(wasm_f32x4_add(bits, magic), magic);
+    const v128_t mantissa_odd = wasm_v128_and(wasm_u32x4_shr(bits, 13), wasm_i32x4_splat(1));
+    const v128_t normal = wasm_u32x4_shr(
+        wasm_i32x4_add(wasm_i32x4_add(bits, wasm_i32x4_splat(int32_t(NORMAL_BIAS))), mantissa_odd),
+        13
+    );
+    v128_t y = wasm_v128_bitselect(denormal, normal, is_denormal);
+    y = wasm_v128_bitselect(overflow, y, is_overflow);
+    return wasm_v128_or(y, wasm_u32x4_shr(sign, 16));
+}
+// round to nearest even f16 of each lane
+static inline void f32_vec_store_f16(uint16_t* y, f32_vec x) {
+    const v128_t bits = f32x4_to_f16_bits(x.v);
+    wasm_v128_store64_lane(y, wasm_u16x8_narrow_i32x4(bits, bits), 0);
+}
+// interleaved f16 pairs of (a,b) for each lane
+static inline void f32_vec_store_f16x2(uint16_t* y, f32_vec a, f32_vec b) {
+    const v128_t ab = wasm_v128_or(f32x4_to_f16_bits(a.v), wasm_i32x4_shl(f32x4_to_f16_bits(b.v), 16));
+    wasm_v128_store(y, ab);
+}
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_NAME "avx"
+struct f32_vec {
+    static constexpr int WIDTH = 8;
+    __m256 v;
+    f32_vec() = default;
+    f32_vec(__m256 x): v(x) {}
+    f32_vec(float x): v(_mm256_set1_ps(x)) {}
+};
+static inline f32_vec f32_vec_load(const float* x) { return _mm256_loadu_ps(x); }
+static inline void f32_vec_store(float* y, f32_vec x) { _mm256_storeu_ps(y, x.v); }
+static inline f32_vec operator+(f32_vec a, f32_vec b) { return _mm256_add_ps(a.v, b.v); }
+static inline f32_vec operator-(f32_vec a, f32_vec b) { return _mm256_sub_ps(a.v, b.v); }
+static inline f32_vec operator*(f32_vec a, f32_vec b) { return _mm256_mul_ps(a.v, b.v); }
+static inline f32_vec operator/(f32_vec a, f32_vec b) { return _mm256_div_ps(a.v, b.v); }
+// lower 16bits of packed index_beta as a float
+// - AVX1 has no 256bit integer and so the mask is applied as a bitwise float operation
+static inline f32_vec f32_vec_load_u16_lower(const uint32_t* x) {
+    const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0xFFFF));
+    const __m256 bits = _mm256_and_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(x)), mask);
+    return _mm256_cvtepi32_ps(_mm256_castps_si256(bits));
+}
+// all bits set lanes of mask select a otherwise b
+static inline f32_vec f32_vec_load_mask(const uint32_t* x) { return _mm256_loadu_ps(reinterpret_cast<const float*>(x)); }
+static inline f32_vec f32_vec_select(f32_vec mask, f32_vec a, f32_vec b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+static inline float f32_vec_reduce_add(f32_vec x) {
+    const __m128 lo = _mm256_castps256_ps128(x.v);
+    const __m128 hi = _mm256_extractf128_ps(x.v, 1);
+    __m128 sum = _mm_add_ps(lo, hi);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    return _mm_cvtss_f32(sum);
+}
+// round to nearest even f16 of each lane
+#if defined(__F16C__)
+static inline void f32_vec_store_f16(uint16_t* y, f32_vec x) {
+    const __m128i h = _mm256_cvtps_ph(x.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y), h);
+}
+// interleaved f16 pairs of (a,b) for each lane
+static inline void f32_vec_store_f16x2(uint16_t* y, f32_vec a, f32_vec b) {
+    const __m128i ha = _mm256_cvtps_ph(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m128i hb = _mm256_cvtps_ph(b.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y), _mm_unpacklo_epi16(ha, hb));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y+8), _mm_unpackhi_epi16(ha, hb));
+}
+#else
+static inline void f32_vec_store_f16(uint16_t* y, f32_vec x) {
+    f16_bits_store_sse2(y, f32x4_to_f16_bits_sse2(_mm256_castps256_ps128(x.v)));
+    f16_bits_store_sse2(y+4, f32x4_to_f16_bits_sse2(_mm256_extractf128_ps(x.v, 1)));
+}
+static inline void f32_vec_store_f16x2(uint16_t* y, f32_vec a, f32_vec b) {
+    f16_bits_store_x2_sse2(
+        y,
+        f32x4_to_f16_bits_sse2(_mm256_castps256_ps128(a.v)),
+        f32x4_to_f16_bits_sse2(_mm256_castps256_ps128(b.v))
+    );
+    f16_bits_store_x2_sse2(
+        y+8,
+        f32x4_to_f16_bits_sse2(_mm256_extractf128_ps(a.v, 1)),
+        f32x4_to_f16_bits_sse2(_mm256_extractf128_ps(b.v, 1))
+    );
+}
+#endif
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_NAME "sse2"
+struct f32_vec {
+    static constexpr int WIDTH = 4;
+    __m128 v;
+    f32_vec() = default;
+    f32_vec(__m128 x): v(x) {}
+    f32_vec(float x): v(_mm_set1_ps(x)) {}
+};
+static inline f32_vec f32_vec_load(const float* x) { return _mm_loadu_ps(x); }
+static inline void f32_vec_store(float* y, f32_vec x) { _mm_storeu_ps(y, x.v); }
+static inline f32_vec operator+(f32_vec a, f32_vec b) { return _mm_add_ps(a.v, b.v); }
+static inline f32_vec operator-(f32_vec a, f32_vec b) { return _mm_sub_ps(a.v, b.v); }
+static inline f32_vec operator*(f32_vec a, f32_vec b) { return _mm_mul_ps(a.v, b.v); }
+static inline f32_vec operator/(f32_vec a, f32_vec b) { return _mm_div_ps(a.v, b.v); }
+// lower 16bits of packed index_beta as a float
+static inline f32_vec f32_vec_load_u16_lower(const uint32_t* x) {
+    const __m128i mask = _mm_set1_epi32(0xFFFF);
+    const __m128i bits = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x)), mask);
+    return _mm_cvtepi32_ps(bits);
+}
+// all bits set lanes of mask select a otherwise b
+static inline f32_vec f32_vec_load_mask(const uint32_t* x) { return _mm_loadu_ps(reinterpret_cast<const float*>(x)); }
+static inline f32_vec f32_vec_select(f32_vec mask, f32_vec a, f32_vec b) {
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+static inline float f32_vec_reduce_add(f32_vec x) {
+    __m128 sum = _mm_add_ps(x.v, _mm_movehl_ps(x.v, x.v));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    return _mm_cvtss_f32(sum);
+}
+// round to nearest even f16 of each lane
+static inline void f32_vec_store_f16(uint16_t* y, f32_vec x) {
+    f16_bits_store_sse2(y, f32x4_to_f16_bits_sse2(x.v));
+}
+// interleaved f16 pairs of (a,b) for each lane
+static inline void f32_vec_store_f16x2(uint16_t* y, f32_vec a, f32_vec b) {
+    f16_bits_store_x2_sse2(y, f32x4_to_f16_bits_sse2(a.v), f32x4_to_f16_bits_sse2(b.v));
+}
+#else
+#define SIMD_NAME "scalar"
+struct f32_vec {
+    static constexpr int WIDTH = 1;
+    float v;
+    f32_vec() = default;
+    f32_vec(float x): v(x) {}
+};
+static inline f32_vec f32_vec_load(const float* x) { return *x; }
+static inline void f32_vec_store(float* y, f32_vec x) { *y = x.v; }
+static inline f32_vec operator+(f32_vec a, f32_vec b) { return a.v + b.v; }
+static inline f32_vec operator-(f32_vec a, f32_vec b) { return a.v - b.v; }
+static inline f32_vec operator*(f32_vec a, f32_vec b) { return a.v * b.v; }
+static inline f32_vec operator/(f32_vec a, f32_vec b) { return a.v / b.v; }
+static inline f32_vec f32_vec_load_u16_lower(const uint32_t* x) { return float(*x & 0xFFFF); }
+// scalar masks are stored as 0 or 1 instead of the bit pattern
+static inline f32_vec f32_vec_load_mask(const uint32_t* x) { return (*x != 0) ? 1.0f : 0.0f; }
+static inline f32_vec f32_vec_select(f32_vec mask, f32_vec a, f32_vec b) { return (mask.v != 0.0f) ? a : b; }
+static inline float f32_vec_reduce_add(f32_vec x) { return x.v; }
+static inline void f32_vec_store_f16(uint16_t* y, f32_vec x) { *y = f32_to_f16(x.v); }
+static inline void f32_vec_store_f16x2(uint16_t* y, f32_vec a, f32_vec b) {
+    y[0] = f32_to_f16(a.v);
+    y[1] = f32_to_f16(b.v);
+}
+#endif
\ No newline at end of file
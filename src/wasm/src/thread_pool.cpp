@@ -0,0 +1,162 @@
+#include "./thread_pool.hpp"
+#include "./logging.hpp"
+
+#if ENABLE_THREADS
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// NOTE: In the browser each std::thread takes a worker from the emscripten pthread pool
+//       The pool is sized to navigator.hardwareConcurrency (PTHREAD_POOL_SIZE) so that creating
+//       workers never has to yield to the event loop, which would deadlock a blocked main thread
+static thread_local bool t_is_running_job = false;
+
+class Thread_Pool
+{
+private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_job_start;
+    std::condition_variable m_job_end;
+    const std::function<void(int)>* m_job = nullptr;
+    int m_total_jobs = 0;
+    int m_next_job = 0;
+    int m_total_finished = 0;
+    uint64_t m_generation = 0;
+    bool m_is_stopping = false;
+    std::mutex m_run_mutex;
+private:
+    // run jobs from the current generation until none are left
+    void run_jobs(std::unique_lock<std::mutex>& lock) {
+        while (m_next_job < m_total_jobs) {
+            const int job_index = m_next_job++;
+            const auto* job = m_job;
+            lock.unlock();
+            t_is_running_job = true;
+            (*job)(job_index);
+            t_is_running_job = false;
+            lock.lock();
+            m_total_finished++;
+            if (m_total_finished == m_total_jobs) m_job_end.notify_all();
+        }
+    }
+    void worker_loop() {
+        uint64_t last_generation = 0;
+        auto lock = std::unique_lock<std::mutex>(m_mutex);
+        while (true) {
+            m_job_start.wait(lock, [&]() { return m_is_stopping || m_generation != last_generation; });
+            if (m_is_stopping) return;
+            last_generation = m_generation;
+            run_jobs(lock);
+        }
+    }
+public:
+    explicit Thread_Pool(int total_workers) {
+        for (int i = 0; i < total_workers; i++) {
+            m_workers.emplace_back([this]() { worker_loop(); });
+        }
+    }
+    ~Thread_Pool() {
+        {
+            auto lock = std::unique_lock<std::mutex>(m_mutex);
+            m_is_stopping = true;
+        }
+        m_job_start.notify_all();
+        for (auto& worker: m_workers) worker.join();
+    }
+    // returns false if the pool is already running jobs for another caller
+    bool try_run(int total_jobs, const std::function<void(int)>& job) {
+        if (t_is_running_job) return false;
+        auto run_lock = std::unique_lock<std::mutex>(m_run_mutex, std::try_to_lock);
+        if (!run_lock.owns_lock()) return false;
+        auto lock = std::unique_lock<std::mutex>(m_mutex);
+        m_job = &job;
+        m_total_jobs = total_jobs;
+        m_next_job = 0;
+        m_total_finished = 0;
+        m_generation++;
+        m_job_start.notify_all();
+        run_jobs(lock);
+        m_job_end.wait(lock, [&]() { return m_total_finished == m_total_jobs; });
+        m_job = nullptr;
+        m_total_jobs = 0;
+        return true;
+    }
+};
+
+static int get_default_total_threads() {
+    const int total = int(std::thread::hardware_concurrency());
+    return (total > 0) ? total : 1;
+}
+
+static int g_total_threads = get_default_total_threads();
+static std::shared_ptr<Thread_Pool> g_thread_pool = nullptr;
+static std::mutex g_thread_pool_mutex;
+
+static std::shared_ptr<Thread_Pool> get_thread_pool() {
+    auto lock = std::unique_lock<std::mutex>(g_thread_pool_mutex);
+    if (g_thread_pool == nullptr) {
+        g_thread_pool = std::make_shared<Thread_Pool>(g_total_threads-1);
+    }
+    return g_thread_pool;
+}
+
+int get_total_threads() {
+    return g_total_threads;
+}
+
+void set_total_threads(int total_threads) {
+    if (total_threads < 1) total_threads = 1;
+    auto lock = std::unique_lock<std::mutex>(g_thread_pool_mutex);
+    if (total_threads == g_total_threads) return;
+    // workers are joined once the last caller using the old pool releases it
+    g_thread_pool = nullptr;
+    g_total_threads = total_threads;
+    MODULE_LOG("Setting thread pool to %d threads\n", total_threads);
+}
+#else
+int get_total_threads() {
+    return 1;
+}
+
+void set_total_threads(int) {}
+#endif
+
+int get_total_chunks(int total, int min_chunk_size) {
+    if (total <= 0) return 0;
+    if (min_chunk_size < 1) min_chunk_size = 1;
+    const int max_chunks = (total + min_chunk_size - 1) / min_chunk_size;
+    const int total_threads = get_total_threads();
+    return (total_threads < max_chunks) ? total_threads : max_chunks;
+}
+
+void parallel_for_chunks(
+    int total, int min_chunk_size,
+    const std::function<void(int chunk_index, int start, int end)>& fn
+) {
+    const int total_chunks = get_total_chunks(total, min_chunk_size);
+    parallel_for_total_chunks(total, total_chunks, fn);
+}
+
+void parallel_for_total_chunks(
+    int total, int total_chunks,
+    const std::function<void(int chunk_index, int start, int end)>& fn
+) {
+    if (total <= 0 || total_chunks <= 0) return;
+    if (total_chunks > total) total_chunks = total;
+    const auto run_chunk = [&](int chunk_index) {
+        const int start = int((int64_t(total)*chunk_index) / total_chunks);
+        const int end = int((int64_t(total)*(chunk_index+1)) / total_chunks);
+        fn(chunk_index, start, end);
+    };
+#if ENABLE_THREADS
+    if (total_chunks > 1) {
+        const auto thread_pool = get_thread_pool();
+        const std::function<void(int)> job = run_chunk;
+        if (thread_pool->try_run(total_chunks, job)) return;
+    }
+#endif
+    for (int i = 0; i < total_chunks; i++) run_chunk(i);
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <functional>
+
+// Split [0,total) into contiguous chunks which are run in parallel on a persistent pool of worker threads
+// - Threads are only used when compiled with ENABLE_THREADS, otherwise chunks run serially on the calling thread
+// - The calling thread also runs chunks so total_threads includes it
+// - Nested or concurrent calls fall back to running serially on the calling thread
+// - Chunk boundaries only depend on total, min_chunk_size and total_threads so reductions over per chunk
+//   partial sums are deterministic for a given thread count
+int get_total_threads();
+void set_total_threads(int total_threads);
+int get_total_chunks(int total, int min_chunk_size);
+void parallel_for_chunks(
+    int total, int min_chunk_size,
+    const std::function<void(int chunk_index, int start, int end)>& fn
+);
+// Same as parallel_for_chunks with total_chunks from get_total_chunks() so per chunk accumulators can be sized
+// up front without a concurrent set_total_threads() changing the number of chunks in between
+void parallel_for_total_chunks(
+    int total, int total_chunks,
+    const std::function<void(int chunk_index, int start, int end)>& fn
+);
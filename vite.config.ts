@@ -3,6 +3,35 @@ import vue from '@vitejs/plugin-vue'
 import vueDevTools from 'vite-plugin-vue-devtools'
 import tailwindcss from '@tailwindcss/vite';
 import svgLoader from 'vite-svg-loader';
+import { createHash } from 'node:crypto';
+import { existsSync, readFileSync } from 'node:fs';
+
+const cross_origin_isolation_headers = {
+  "Cross-Origin-Opener-Policy": "same-origin",
+  "Cross-Origin-Embedder-Policy": "require-corp",
+};
+
+// cached measurements are only valid for the solver and mesher that produced them
+const solver_revision_files = [
+  "src/wasm/build/wasm_module.wasm",
+  "src/wasm/build/wasm_module_threads.wasm",
+  "src/views/stackup_2d/electrostatic_2d.ts",
+  "src/views/stackup_2d/grid.ts",
+  "src/views/stackup_2d/layout.ts",
+  "src/views/stackup_2d/measurement.ts",
+  "src/utility/mesher.ts",
+  "src/utility/regions.ts",
+];
+
+function get_solver_revision(): string {
+  const hash = createHash("sha256");
+  for (const file of solver_revision_files) {
+    if (!existsSync(file)) continue;
+    hash.update(file);
+    hash.update(readFileSync(file));
+  }
+  return hash.digest("hex").slice(0, 16);
+}
 
 // https://vite.dev/config/
 export default defineConfig(({ mode }) => {
@@ -15,5 +44,11 @@ export default defineConfig(({ mode }) => {
       svgLoader(),
     ],
     base: env.VITE_BASE_URL,
+    define: {
+      __SOLVER_REVISION__: JSON.stringify(get_solver_revision()),
+    },
+    // cross origin isolation is required for SharedArrayBuffer which the threaded wasm build needs
+    server: { headers: cross_origin_isolation_headers },
+    preview: { headers: cross_origin_isolation_headers },
   }
 })